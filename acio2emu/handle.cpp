@@ -51,8 +51,8 @@ namespace acio2emu {
     }
 
     void IOBHandle::forward_packet_(const Packet &packet) {
-        // clear the output queue
-        output_ = {};
+        // clear the output buffer
+        output_.clear();
 
         auto node = packet.node / 2;
         if (node >= number_of_nodes_) {
@@ -60,15 +60,15 @@ namespace acio2emu {
             return;
         }
 
-        // forward the packet to the node
-        std::vector<uint8_t> payload;
-        if (!nodes_[node]->handle_packet(packet, payload)) {
+        // forward the packet to the node, reusing the response buffer
+        response_.clear();
+        if (!nodes_[node]->handle_packet(packet, response_)) {
             // error in handler
             return;
         }
 
         // encode the response
-        encode_packet(output_, node, packet.tag, payload);
+        encode_packet(output_, node, packet.tag, response_);
     }
 
     /*
@@ -91,24 +91,20 @@ namespace acio2emu {
 
     int IOBHandle::read(LPVOID lpBuffer, DWORD nNumberOfBytesToRead) {
         auto buffer = reinterpret_cast<uint8_t *>(lpBuffer);
-        DWORD i = 0;
 
-        while (!output_.empty() && i < nNumberOfBytesToRead) {
-            buffer[i++] = output_.front();
-            output_.pop();
-        }
-
-        return i;
+        return output_.read(std::span(buffer, nNumberOfBytesToRead));
     }
 
     int IOBHandle::write(LPCVOID lpBuffer, DWORD nNumberOfBytesToWrite) {
-        auto buffer = reinterpret_cast<const uint8_t *>(lpBuffer);
+        auto data = std::span(reinterpret_cast<const uint8_t *>(lpBuffer), nNumberOfBytesToWrite);
 
-        for (DWORD i = 0; i < nNumberOfBytesToWrite; i++) {
-            if (decoder_.update(buffer[i])) {
+        while (!data.empty()) {
+            size_t consumed;
+            if (decoder_.update(data, consumed)) {
                 // forward the packet to a node
                 forward_packet_(decoder_.packet());
             }
+            data = data.subspan(consumed);
         }
 
         return nNumberOfBytesToWrite;
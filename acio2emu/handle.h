@@ -2,7 +2,7 @@
 
 #include <string>
 #include <array>
-#include <queue>
+#include <vector>
 #include <memory> // std::unique_ptr
 #include <cstdint>
 
@@ -21,7 +21,8 @@ namespace acio2emu {
         int number_of_nodes_ = 1;
 
         PacketDecoder decoder_;
-        std::queue<uint8_t> output_;
+        PacketBuffer output_;
+        std::vector<uint8_t> response_;
 
         void forward_packet_(const Packet &packet);
 
@@ -1,40 +1,67 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
 #include <cstddef>
 
 namespace acio2emu::detail {
-    inline uint8_t crc4_lgp_c(uint8_t crc, const uint8_t *data, size_t len) {
-        static constexpr uint8_t tbl[] = { 
-            0x00, 0x0D, 0x03, 0x0E, 
-            0x06, 0x0B, 0x05, 0x08,
-            0x0C, 0x01, 0x0F, 0x02,
-            0x0A, 0x07, 0x09, 0x04,
-        };
-
-        crc &= 15;
-        for (size_t i = 0; i < len; i++) {
-            auto b = data[i];
-            crc = (((crc >> 4) ^ (tbl[(b ^ crc) & 0x0F])) >> 4) ^ tbl[(((crc >> 4) ^ (tbl[(b ^ crc) & 0x0F])) ^ (b >> 4)) & 0x0F];
-        }
+    /*
+     * Both CRCs fit into a byte, are linear and only depend on (crc ^ b) per step. The nibble tables below
+     * expand into byte-wide tables at compile time, tables_[k] additionally advancing over k zero bytes,
+     * so four bytes are folded per step with only one lookup depending on the previous result.
+     */
+    using CrcTables = std::array<std::array<uint8_t, 256>, 4>;
 
-        return crc;
+    constexpr uint8_t crc_lgp_step_(const uint8_t (&tbl)[16], uint8_t crc, uint8_t b) {
+        return (((crc >> 4) ^ (tbl[(b ^ crc) & 0x0F])) >> 4) ^ tbl[(((crc >> 4) ^ (tbl[(b ^ crc) & 0x0F])) ^ (b >> 4)) & 0x0F];
     }
 
-    inline uint8_t crc7_lgp_48(uint8_t crc, const uint8_t *data, size_t len) {
-        static constexpr uint8_t tbl[] = { 
-            0x00, 0x09, 0x12, 0x1B, 
-            0x24, 0x2D, 0x36, 0x3F, 
-            0x48, 0x41, 0x5A, 0x53, 
-            0x6C, 0x65, 0x7E, 0x77 
-        };
-
-        crc &= 127;
-        for (size_t i = 0; i < len; i++) {
-            auto b = data[i];
-            crc = (((crc >> 4) ^ (tbl[(b ^ crc) & 0x0F])) >> 4) ^ tbl[(((crc >> 4) ^ (tbl[(b ^ crc) & 0x0F])) ^ (b >> 4)) & 0x0F];
+    constexpr CrcTables crc_lgp_tables_(const uint8_t (&tbl)[16]) {
+        CrcTables tables = {};
+        for (size_t i = 0; i < 256; i++) {
+            tables[0][i] = crc_lgp_step_(tbl, 0, static_cast<uint8_t>(i));
+        }
+        for (size_t k = 1; k < tables.size(); k++) {
+            for (size_t i = 0; i < 256; i++) {
+                tables[k][i] = tables[0][tables[k - 1][i]];
+            }
+        }
+        return tables;
+    }
+
+    inline uint8_t crc_lgp_(const CrcTables &tables, uint8_t crc, const uint8_t *data, size_t len) {
+        size_t i = 0;
+        for (; i + 4 <= len; i += 4) {
+            crc = tables[3][crc ^ data[i]] ^ tables[2][data[i + 1]] ^ tables[1][data[i + 2]] ^ tables[0][data[i + 3]];
+        }
+        for (; i < len; i++) {
+            crc = tables[0][crc ^ data[i]];
         }
 
         return crc;
     }
-}
\ No newline at end of file
+
+    inline constexpr uint8_t crc4_lgp_c_nibbles[] = {
+        0x00, 0x0D, 0x03, 0x0E, 
+        0x06, 0x0B, 0x05, 0x08,
+        0x0C, 0x01, 0x0F, 0x02,
+        0x0A, 0x07, 0x09, 0x04,
+    };
+
+    inline constexpr uint8_t crc7_lgp_48_nibbles[] = {
+        0x00, 0x09, 0x12, 0x1B, 
+        0x24, 0x2D, 0x36, 0x3F, 
+        0x48, 0x41, 0x5A, 0x53, 
+        0x6C, 0x65, 0x7E, 0x77 
+    };
+
+    inline uint8_t crc4_lgp_c(uint8_t crc, const uint8_t *data, size_t len) {
+        static constexpr auto tables = crc_lgp_tables_(crc4_lgp_c_nibbles);
+        return crc_lgp_(tables, crc & 15, data, len);
+    }
+
+    inline uint8_t crc7_lgp_48(uint8_t crc, const uint8_t *data, size_t len) {
+        static constexpr auto tables = crc_lgp_tables_(crc7_lgp_48_nibbles);
+        return crc_lgp_(tables, crc & 127, data, len);
+    }
+}
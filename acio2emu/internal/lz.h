@@ -1,12 +1,15 @@
 #pragma once
 
-#include <queue>
+#include <span>
 #include <cstdint>
 
+#include "acio2emu/internal/ring.h"
+
 namespace acio2emu::detail {
     class InflateTransformer {
     private:
-        std::queue<uint8_t> output_;
+        // a single put emits at most 7 bytes, callers drain the output after every put
+        RingBuffer<16> output_;
 
         uint8_t flags_ = 0, flag_shift_ = 0;
 
@@ -126,15 +129,12 @@ namespace acio2emu::detail {
         }
         
         int get() {
-            if (output_.empty()) {
-                // output queue is empty
-                return -1;
-            }
-
-            auto b = output_.front();
-            output_.pop();
+            // returns -1 when the output is empty
+            return output_.pop();
+        }
 
-            return b;
+        size_t read(std::span<uint8_t> out) {
+            return output_.read(out);
         }
     };
 }
\ No newline at end of file
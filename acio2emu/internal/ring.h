@@ -0,0 +1,101 @@
+#pragma once
+
+#include <array>
+#include <span>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <cstring> // std::memcpy
+
+namespace acio2emu::detail {
+    /*
+     * Fixed-capacity byte FIFO on contiguous storage, the capacity must be a power of two.
+     */
+    template<size_t N>
+    class RingBuffer {
+        static_assert(N > 0 && (N & (N - 1)) == 0, "capacity must be a power of two");
+
+    private:
+        std::array<uint8_t, N> buffer_ = {};
+        size_t head_ = 0, size_ = 0;
+
+    public:
+        static constexpr size_t capacity() {
+            return N;
+        }
+
+        size_t size() const {
+            return size_;
+        }
+
+        bool empty() const {
+            return size_ == 0;
+        }
+
+        void clear() {
+            head_ = 0;
+            size_ = 0;
+        }
+
+        bool push(uint8_t value) {
+            if (size_ == N) {
+                // buffer is full
+                return false;
+            }
+
+            buffer_[(head_ + size_++) & (N - 1)] = value;
+            return true;
+        }
+
+        int pop() {
+            if (size_ == 0) {
+                // buffer is empty
+                return -1;
+            }
+
+            auto value = buffer_[head_];
+            head_ = (head_ + 1) & (N - 1);
+            size_--;
+
+            return value;
+        }
+
+        /*
+         * Appends as much of the data as fits, returns the amount of bytes written.
+         */
+        size_t write(std::span<const uint8_t> data) {
+            auto count = std::min(data.size(), N - size_);
+            if (count == 0) {
+                return 0;
+            }
+            auto tail = (head_ + size_) & (N - 1);
+
+            // copy in up to two slices, wrapping at the end of the storage
+            auto first = std::min(count, N - tail);
+            std::memcpy(&buffer_[tail], data.data(), first);
+            std::memcpy(&buffer_[0], data.data() + first, (count - first));
+
+            size_ += count;
+            return count;
+        }
+
+        /*
+         * Removes up to out.size() bytes into out, returns the amount of bytes read.
+         */
+        size_t read(std::span<uint8_t> out) {
+            auto count = std::min(out.size(), size_);
+            if (count == 0) {
+                return 0;
+            }
+
+            // copy in up to two slices, wrapping at the end of the storage
+            auto first = std::min(count, N - head_);
+            std::memcpy(out.data(), &buffer_[head_], first);
+            std::memcpy(out.data() + first, &buffer_[0], (count - first));
+
+            head_ = (head_ + count) & (N - 1);
+            size_ -= count;
+            return count;
+        }
+    };
+}
@@ -1,5 +1,7 @@
 #include "packet.h"
 
+#include <algorithm>
+
 #include "util/logging.h"
 
 #include "acio2emu/internal/crc.h"
@@ -8,41 +10,60 @@ namespace acio2emu {
     static constexpr uint8_t SOF = 0xAA;
     static constexpr uint8_t ESC = 0xFF;
 
-    static void encode_payload_(std::queue<uint8_t> &out, const std::vector<uint8_t> &payload) {
+    static size_t encode_payload_(uint8_t *out, std::span<const uint8_t> payload) {
+        auto start = out;
         for (auto b : payload) {
             if (b == SOF || b == ESC) {
-                out.push(ESC);
+                *out++ = ESC;
                 b = ~b;
             }
-            out.push(b); 
+            *out++ = b;
         }
         // compute and write the payload's CRC
-        out.push(detail::crc7_lgp_48(0x7F, payload.data(), payload.size()) ^ 0x7F);
+        *out++ = detail::crc7_lgp_48(0x7F, payload.data(), payload.size()) ^ 0x7F;
+
+        return out - start;
     }
 
-    bool encode_packet(std::queue<uint8_t> &out, uint8_t node, uint8_t tag, const std::vector<uint8_t> &payload) {
+    size_t encode_packet(std::span<uint8_t> out, uint8_t node, uint8_t tag, std::span<const uint8_t> payload) {
         auto size = payload.size();
-        if (size > 127) {
-            log_warning("acio2emu", "cannot encode packet: payload too large: {} > 127", payload.size());
-            return false;
+        if (size > MAX_PAYLOAD_SIZE) {
+            log_warning("acio2emu", "cannot encode packet: payload too large: {} > {}", size, MAX_PAYLOAD_SIZE);
+            return 0;
+        }
+
+        // the worst case has every payload byte escaped
+        auto worst_case = 5 + size * 2 + 1;
+        if (out.size() < worst_case) {
+            log_warning("acio2emu", "cannot encode packet: buffer too small: {} < {}", out.size(), worst_case);
+            return 0;
         }
 
         // build the header
-        uint8_t header[5] = {
-            SOF,
-            static_cast<uint8_t>(node * 3),
-            tag,
-            static_cast<uint8_t>(size),
-            0,
-        };
-        // compute the header's CRC
-        header[4] = detail::crc4_lgp_c(0x0F, &header[1], sizeof(header) - 1) ^ 0x0F;
-        // push the header to the output queue
-        for (size_t i = 0; i < sizeof(header); i++) {
-            out.push(header[i]);
+        out[0] = SOF;
+        out[1] = static_cast<uint8_t>(node * 3);
+        out[2] = tag;
+        out[3] = static_cast<uint8_t>(size);
+        out[4] = 0;
+        // compute the header's CRC, including the zeroed CRC byte
+        out[4] = detail::crc4_lgp_c(0x0F, &out[1], 4) ^ 0x0F;
+
+        return 5 + encode_payload_(&out[5], payload);
+    }
+
+    bool encode_packet(PacketBuffer &out, uint8_t node, uint8_t tag, std::span<const uint8_t> payload) {
+        uint8_t buffer[MAX_PACKET_SIZE];
+        auto size = encode_packet(buffer, node, tag, payload);
+        if (size == 0) {
+            return false;
+        }
+
+        if (out.capacity() - out.size() < size) {
+            log_warning("acio2emu", "cannot encode packet: output buffer full");
+            return false;
         }
 
-        encode_payload_(out, payload);
+        out.write(std::span(buffer, size));
         return true;
     }
 
@@ -139,7 +160,10 @@ namespace acio2emu {
 
     void PacketDecoder::reset_(readStep s) {
         set_step_(s);
-        packet_ = {};
+        packet_.node = 0;
+        packet_.tag = 0;
+        // keep the payload's allocation for the next packet
+        packet_.payload.clear();
         payload_size_ = 0;
         payload_size_count_ = 0;
     }
@@ -212,10 +236,10 @@ namespace acio2emu {
             }
 
             if (encoding_ == payloadEncoding::lz) {
+                uint8_t inflated[16];
                 inflate_.put(b);
-                for (int i = inflate_.get(); i >= 0; i = inflate_.get()) {
-                    packet_.payload.push_back(i);
-                }
+                auto count = inflate_.read(inflated);
+                packet_.payload.insert(packet_.payload.end(), inflated, &inflated[count]);
             }
             else if (encoding_ == payloadEncoding::replace && b == substitute_) {
                 packet_.payload.push_back(SOF);
@@ -253,6 +277,51 @@ namespace acio2emu {
         return false;
     }
 
+    size_t PacketDecoder::update_payload_run_(std::span<const uint8_t> data) {
+        // only plain payload bytes are copied in bulk, everything else goes through update()
+        if (step_ != readStep::readPayload || obfuscated_ ||
+            (encoding_ != payloadEncoding::raw && encoding_ != payloadEncoding::byteStuffing)) {
+            return 0;
+        }
+
+        // leave the last byte of the packet to update() so it can complete the packet
+        auto remaining = payload_size_ - std::min<size_t>(payload_size_, packet_.payload.size());
+        auto limit = std::min<size_t>(data.size(), remaining > 0 ? remaining - 1 : 0);
+
+        size_t count = 0;
+        if (encoding_ == payloadEncoding::byteStuffing) {
+            while (count < limit && data[count] != SOF && data[count] != ESC) {
+                count++;
+            }
+        }
+        else {
+            while (count < limit && data[count] != SOF) {
+                count++;
+            }
+        }
+
+        packet_.payload.insert(packet_.payload.end(), data.begin(), data.begin() + count);
+        return count;
+    }
+
+    bool PacketDecoder::update(std::span<const uint8_t> data, size_t &consumed) {
+        consumed = 0;
+        while (consumed < data.size()) {
+            // copy runs of payload bytes at once
+            auto run = update_payload_run_(data.subspan(consumed));
+            if (run > 0) {
+                consumed += run;
+                continue;
+            }
+
+            if (update(data[consumed++])) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
     const Packet &PacketDecoder::packet() {
         return packet_;
     }
@@ -1,13 +1,21 @@
 #pragma once
 
 #include <vector>
-#include <queue>
+#include <span>
 #include <random> // std::linear_congruential_engine
 #include <cstdint>
 
 #include "acio2emu/internal/lz.h"
+#include "acio2emu/internal/ring.h"
 
 namespace acio2emu {
+    // header, payload with every byte escaped and the payload's CRC
+    static constexpr size_t MAX_PAYLOAD_SIZE = 127;
+    static constexpr size_t MAX_PACKET_SIZE = 5 + MAX_PAYLOAD_SIZE * 2 + 1;
+
+    // large enough to hold an encoded packet
+    using PacketBuffer = detail::RingBuffer<512>;
+
     struct Packet {
         uint8_t node;
         uint8_t tag;
@@ -55,11 +63,24 @@ namespace acio2emu {
 
         int update_payload_size_(uint8_t b);
         uint8_t deobfuscate_(uint8_t b);
+        size_t update_payload_run_(std::span<const uint8_t> data);
 
     public:
         bool update(uint8_t b);
+
+        /*
+         * Consumes bytes until a packet is complete, consumed is set to the amount of bytes used.
+         * Returns true if the last consumed byte completed a packet.
+         */
+        bool update(std::span<const uint8_t> data, size_t &consumed);
+
         const Packet &packet();
     };
 
-    bool encode_packet(std::queue<uint8_t> &out, uint8_t node, uint8_t tag, const std::vector<uint8_t> &payload);
+    /*
+     * Encodes a packet into out, returns the amount of bytes written or 0 on error.
+     */
+    size_t encode_packet(std::span<uint8_t> out, uint8_t node, uint8_t tag, std::span<const uint8_t> payload);
+
+    bool encode_packet(PacketBuffer &out, uint8_t node, uint8_t tag, std::span<const uint8_t> payload);
 }
\ No newline at end of file
@@ -1,4 +1,8 @@
 #include "acioemu.h"
+
+#include <algorithm>
+#include <cstring>
+
 #include "util/logging.h"
 #include "util/utils.h"
 
@@ -7,7 +11,6 @@ using namespace acioemu;
 ACIOEmu::ACIOEmu() {
     this->devices = new std::vector<ACIODeviceEmu *>();
     this->response_buffer = new circular_buffer<uint8_t>(4096);
-    this->read_buffer = new circular_buffer<uint8_t>(1024);
 }
 
 ACIOEmu::~ACIOEmu() {
@@ -20,46 +23,79 @@ ACIOEmu::~ACIOEmu() {
 
     // delete buffers
     delete this->response_buffer;
-    delete this->read_buffer;
 }
 
 void ACIOEmu::add_device(ACIODeviceEmu *device) {
     this->devices->push_back(device);
 }
 
+void ACIOEmu::frame_put(uint8_t byte) {
+
+    // clean garbage, a frame starts with exactly one SOF
+    if (this->frame_size == 0 ? byte != ACIO_SOF : (this->frame_size == 1 && byte == ACIO_SOF)) {
+        return;
+    }
+
+    // drop frames which can't be valid anymore
+    if (this->frame_size == sizeof(this->frame)) {
+        this->frame_size = 0;
+        return;
+    }
+
+    this->frame[this->frame_size++] = byte;
+}
+
+size_t ACIOEmu::frame_target() {
+
+    // the header needs to be complete before the size is known
+    if (this->frame_size < 6) {
+        return 6;
+    }
+
+    // check if broadcast
+    if (this->frame[1] == ACIO_BROADCAST) {
+
+        // SOF + checksum + broadcast header + data_size
+        return 2u + 2u + this->frame[2];
+    }
+
+    // SOF + checksum + command header + data_size
+    return 2u + MSG_HEADER_SIZE + this->frame[5];
+}
+
+void ACIOEmu::frame_check() {
+
+    // parse message if complete
+    if (this->frame_size >= 6 && this->frame_size >= this->frame_target()) {
+        this->msg_parse();
+        this->frame_size = 0;
+    }
+}
+
 void ACIOEmu::write(uint8_t byte) {
 
-    // insert into buffer
+    // insert into frame
     if (!invert) {
         if (byte == ACIO_ESCAPE) {
             invert = true;
         } else {
-            this->read_buffer->put(byte);
+            this->frame_put(byte);
         }
     } else {
         byte = ~byte;
         invert = false;
-        this->read_buffer->put(byte);
-    }
-
-    // clean garbage
-    while (!this->read_buffer->empty() && this->read_buffer->peek() != 0xAA) {
-        this->read_buffer->get();
-    }
-    while (this->read_buffer->size() > 1 && this->read_buffer->peek(1) == 0xAA) {
-        this->read_buffer->get();
+        this->frame_put(byte);
     }
 
     // handshake counter
-    static unsigned int handshake_counter = 0;
     if (byte == 0xAA) {
-        handshake_counter++;
+        this->handshake_counter++;
     } else {
-        handshake_counter = 0;
+        this->handshake_counter = 0;
     }
 
     // check for handshake
-    if (handshake_counter > 1) {
+    if (this->handshake_counter > 1) {
 
         /*
          * small hack - BIO2 seems to expect more bytes here - sending two bytes each time fixes it
@@ -67,36 +103,46 @@ void ACIOEmu::write(uint8_t byte) {
          */
         this->response_buffer->put(ACIO_SOF);
         this->response_buffer->put(ACIO_SOF);
-        handshake_counter--;
+        this->handshake_counter--;
         return;
     }
 
     // parse
-    if (!this->read_buffer->empty() && this->read_buffer->size() >= 6) {
-        bool is_complete = false;
-
-        // check if broadcast
-        if (this->read_buffer->peek(1) == ACIO_BROADCAST) {
-
-            // check msg data size
-            auto data_size = this->read_buffer->peek(2);
-
-            // check if msg is complete (SOF + checksum + broadcast header + data_size)
-            is_complete = this->read_buffer->size() >= 2u + 2u + data_size;
-        } else {
+    this->frame_check();
+}
 
-            // check msg data size
-            auto data_size = this->read_buffer->peek(5);
+void ACIOEmu::write(const uint8_t *data, size_t size) {
+    size_t pos = 0;
+    while (pos < size) {
 
-            // check if msg is complete (SOF + checksum + command header + data_size)
-            is_complete = this->read_buffer->size() >= 2u + MSG_HEADER_SIZE + data_size;
+        /*
+         * Bytes which are neither SOF nor escape reset the handshake and are either garbage or plain
+         * message data, so runs of them are copied at once up to the point where the frame needs checking.
+         */
+        if (!invert) {
+            size_t limit = size - pos;
+            if (this->frame_size > 0) {
+                auto target = std::max(this->frame_target(), this->frame_size + 1);
+                limit = std::min({limit, target - this->frame_size, sizeof(this->frame) - this->frame_size});
+            }
+            size_t run = 0;
+            while (run < limit && data[pos + run] != ACIO_SOF && data[pos + run] != ACIO_ESCAPE) {
+                run++;
+            }
+            if (run > 0) {
+                if (this->frame_size > 0) {
+                    memcpy(&this->frame[this->frame_size], &data[pos], run);
+                    this->frame_size += run;
+                }
+                this->handshake_counter = 0;
+                this->frame_check();
+                pos += run;
+                continue;
+            }
         }
 
-        // parse message if complete
-        if (is_complete) {
-            this->msg_parse();
-            this->read_buffer->reset();
-        }
+        // everything else goes through the byte-wise path
+        this->write(data[pos++]);
     }
 }
 
@@ -108,31 +154,35 @@ std::optional<uint8_t> ACIOEmu::read() {
     return this->response_buffer->get();
 }
 
+size_t ACIOEmu::read(uint8_t *buffer, size_t size) {
+    return this->response_buffer->get_all(buffer, size);
+}
+
 void ACIOEmu::msg_parse() {
 
 #ifdef ACIOEMU_LOG
-    log_info("acioemu", "MSG RECV: {}", bin2hex(*this->read_buffer));
+    log_info("acioemu", "MSG RECV: {}", bin2hex(this->frame, this->frame_size));
 #endif
 
     // calculate checksum
     uint8_t chk = 0;
-    size_t max = this->read_buffer->size() - 1;
+    size_t max = this->frame_size - 1;
     for (size_t i = 1; i < max; i++) {
-        chk += this->read_buffer->peek(i);
+        chk += this->frame[i];
     }
 
     // check checksum
-    uint8_t chk_receive = this->read_buffer->peek(this->read_buffer->size() - 1);
+    uint8_t chk_receive = this->frame[this->frame_size - 1];
     if (chk != chk_receive) {
 #ifdef ACIOEMU_LOG
         log_info("acioemu", "detected wrong checksum: {}/{}", chk, chk_receive);
 #endif
         return;
     }
+    this->messages++;
 
-    // get message data
-    auto msg_data = this->read_buffer->peek_all();
-    auto msg_in = (MessageData *) &msg_data[1];
+    // get message data, parsed in place
+    auto msg_in = (MessageData *) &this->frame[1];
 
     // correct cmd code endianness if this is not a broadcast
     if (msg_in->addr != ACIO_BROADCAST) {
@@ -200,6 +250,6 @@ void ACIOEmu::msg_parse() {
     log_info("acioemu", "UNHANDLED MSG FOR ADDR: {}, CMD: 0x{:x}), DATA: {}",
             msg_in->addr,
             msg_in->cmd.code,
-            bin2hex(*this->read_buffer));
+            bin2hex(this->frame, this->frame_size));
 #endif
 }
@@ -14,9 +14,17 @@ namespace acioemu {
     private:
         std::vector<ACIODeviceEmu *> *devices;
         circular_buffer<uint8_t> *response_buffer;
-        circular_buffer<uint8_t> *read_buffer;
+
+        // unescaped message being received, always starting with a single SOF
+        uint8_t frame[1024];
+        size_t frame_size = 0;
         bool invert = false;
+        unsigned int handshake_counter = 0;
+        size_t messages = 0;
 
+        void frame_put(uint8_t byte);
+        size_t frame_target();
+        void frame_check();
         void msg_parse();
 
     public:
@@ -27,6 +35,13 @@ namespace acioemu {
         void add_device(ACIODeviceEmu *device);
 
         void write(uint8_t byte);
+        void write(const uint8_t *data, size_t size);
         std::optional<uint8_t> read();
+        size_t read(uint8_t *buffer, size_t size);
+
+        // amount of messages with a valid checksum received so far
+        size_t message_count() const {
+            return this->messages;
+        }
     };
 }
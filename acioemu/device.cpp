@@ -1,10 +1,46 @@
 #include "device.h"
 
+#include <atomic>
+#include <bit>
+
 #include "util/logging.h"
 #include "util/utils.h"
 
 using namespace acioemu;
 
+// message slab, a set bit marks a slot as in use
+static MessageData MESSAGE_SLAB[32];
+static std::atomic<uint32_t> MESSAGE_SLAB_USED = 0;
+
+void *MessageData::operator new(size_t size) {
+
+    // claim a free slot
+    auto used = MESSAGE_SLAB_USED.load(std::memory_order_relaxed);
+    while (used != UINT32_MAX) {
+        auto index = std::countr_one(used);
+        if (MESSAGE_SLAB_USED.compare_exchange_weak(used, used | (1u << index), std::memory_order_acquire)) {
+            return &MESSAGE_SLAB[index];
+        }
+    }
+
+    // slab exhausted
+    return ::operator new(size);
+}
+
+void MessageData::operator delete(void *ptr) {
+    auto address = reinterpret_cast<uintptr_t>(ptr);
+    auto slab = reinterpret_cast<uintptr_t>(&MESSAGE_SLAB[0]);
+
+    // release the slot if it came from the slab
+    if (address >= slab && address < slab + sizeof(MESSAGE_SLAB)) {
+        auto index = (address - slab) / sizeof(MessageData);
+        MESSAGE_SLAB_USED.fetch_and(~(1u << index), std::memory_order_release);
+        return;
+    }
+
+    ::operator delete(ptr);
+}
+
 void ACIODeviceEmu::set_header(MessageData* data, uint8_t addr, uint16_t code, uint8_t pid,
         uint8_t data_size)
 {
@@ -45,18 +81,17 @@ MessageData *ACIODeviceEmu::create_msg(uint8_t addr, uint16_t code, uint8_t pid,
         data_size = 0xFF;
     }
 
-    // allocate data
-    auto data_raw = new uint8_t[MSG_HEADER_SIZE + data_size];
+    // allocate message
+    auto msg = new MessageData;
 
     // set header
-    auto msg = (MessageData *) &data_raw[0];
     set_header(msg, addr, code, pid, (uint8_t) data_size);
 
     // set data
     if (data) {
-        memcpy(data_raw + MSG_HEADER_SIZE, data, data_size);
+        memcpy(msg->cmd.raw, data, data_size);
     } else {
-        memset(data_raw + MSG_HEADER_SIZE, 0, data_size);
+        memset(msg->cmd.raw, 0, data_size);
     }
 
     // return prepared message
@@ -81,10 +116,13 @@ bool ACIODeviceEmu::is_applicable(uint8_t node_offset, uint8_t node) {
 
 void ACIODeviceEmu::write_msg(const uint8_t *data, size_t size, circular_buffer<uint8_t> *response_buffer) {
 
+    // escaped output is staged and written in bulk
+    uint8_t buffer[512];
+    size_t buffer_pos = 0;
+
     // header
-    for (int i = 0; i < 2; i++) {
-        response_buffer->put(ACIO_SOF);
-    }
+    buffer[buffer_pos++] = ACIO_SOF;
+    buffer[buffer_pos++] = ACIO_SOF;
 
     // msg data and checksum
     uint8_t b, chk = 0;
@@ -100,12 +138,19 @@ void ACIODeviceEmu::write_msg(const uint8_t *data, size_t size, circular_buffer<
 
         // check for escape
         if (b == ACIO_SOF || b == ACIO_ESCAPE) {
-            response_buffer->put(ACIO_ESCAPE);
-            response_buffer->put(~b);
+            buffer[buffer_pos++] = ACIO_ESCAPE;
+            buffer[buffer_pos++] = ~b;
         } else {
-            response_buffer->put(b);
+            buffer[buffer_pos++] = b;
+        }
+
+        // flush when full
+        if (buffer_pos > sizeof(buffer) - 2) {
+            response_buffer->put_all(buffer, (int) buffer_pos);
+            buffer_pos = 0;
         }
     }
+    response_buffer->put_all(buffer, (int) buffer_pos);
 
 #ifdef ACIOEMU_LOG
     log_info("acioemu", "ACIO MSG OUT: AA{}{:02X}", bin2hex(data, size), chk);
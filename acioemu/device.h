@@ -58,6 +58,13 @@ namespace acioemu {
                 uint8_t raw[0xFF];
             } broadcast;
         };
+
+        /*
+         * Messages are served from a preallocated slab and only fall back to the heap when it's exhausted,
+         * so responses created for every poll don't hit the allocator.
+         */
+        static void *operator new(size_t size);
+        static void operator delete(void *ptr);
     };
 #pragma pack(pop)
 
@@ -1,7 +1,12 @@
 #include "handle.h"
 
+#include <ctime>
+
+#include <fmt/format.h>
+
 #include "misc/eamuse.h"
 #include "rawinput/rawinput.h"
+#include "util/fileutils.h"
 #include "util/utils.h"
 
 acioemu::ACIOHandle::ACIOHandle(LPCWSTR lpCOMPort) {
@@ -18,6 +23,12 @@ bool acioemu::ACIOHandle::open(LPCWSTR lpFileName) {
     // ACIO device
     acio_emu.add_device(new acioemu::ICCADevice(false, true, 2));
 
+    // session recording
+    if (!acioemu::RECORD_PATH.empty() && fileutils::dir_create_recursive(acioemu::RECORD_PATH)) {
+        auto name = fmt::format("acio_{}_{}.bin", ws2s(com_port), std::time(nullptr));
+        recorder = std::make_unique<acioemu::SessionRecorder>(std::filesystem::path(acioemu::RECORD_PATH) / name);
+    }
+
     return true;
 }
 
@@ -25,15 +36,9 @@ int acioemu::ACIOHandle::read(LPVOID lpBuffer, DWORD nNumberOfBytesToRead) {
     auto buffer = reinterpret_cast<uint8_t *>(lpBuffer);
 
     // read from emu
-    DWORD bytes_read = 0;
-    while (bytes_read < nNumberOfBytesToRead) {
-        auto cur_byte = acio_emu.read();
-
-        if (cur_byte.has_value()) {
-            buffer[bytes_read++] = cur_byte.value();
-        } else {
-            break;
-        }
+    auto bytes_read = acio_emu.read(buffer, nNumberOfBytesToRead);
+    if (recorder) {
+        recorder->record(acioemu::RecordDirection::Read, buffer, bytes_read);
     }
 
     // return amount of bytes read
@@ -44,9 +49,10 @@ int acioemu::ACIOHandle::write(LPCVOID lpBuffer, DWORD nNumberOfBytesToWrite) {
     auto buffer = reinterpret_cast<const uint8_t *>(lpBuffer);
 
     // write to emu
-    for (DWORD i = 0; i < nNumberOfBytesToWrite; i++) {
-        acio_emu.write(buffer[i]);
+    if (recorder) {
+        recorder->record(acioemu::RecordDirection::Write, buffer, nNumberOfBytesToWrite);
     }
+    acio_emu.write(buffer, nNumberOfBytesToWrite);
 
     // return all data written
     return (int) nNumberOfBytesToWrite;
@@ -64,6 +70,7 @@ int acioemu::ACIOHandle::device_io(
 
 bool acioemu::ACIOHandle::close() {
     log_info("acioemu", "Closed {} (ACIO)", ws2s(com_port));
+    recorder.reset();
 
     return true;
 }
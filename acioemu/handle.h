@@ -1,6 +1,9 @@
 #pragma once
 
+#include <memory>
+
 #include "acioemu/acioemu.h"
+#include "acioemu/recorder.h"
 #include "hooks/devicehook.h"
 
 namespace acioemu {
@@ -10,6 +13,7 @@ namespace acioemu {
         LPCWSTR com_port;
 
         acioemu::ACIOEmu acio_emu;
+        std::unique_ptr<SessionRecorder> recorder;
 
     public:
         ACIOHandle(LPCWSTR lpCOMPort);
@@ -15,7 +15,7 @@ namespace acioemu {
     private:
         bool type_new;
         bool flip_order;
-        std::thread *keypad_thread;
+        std::thread *keypad_thread = nullptr;
         std::mutex keypad_mutex;
         uint8_t **cards;
         time_t *cards_time;
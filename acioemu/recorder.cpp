@@ -0,0 +1,117 @@
+#include "recorder.h"
+
+#include <cstring>
+
+#include "util/logging.h"
+
+namespace acioemu {
+
+    // settings
+    std::string RECORD_PATH;
+
+    // a single read or write never comes close to this
+    static const uint32_t RECORD_SIZE_MAX = 1024 * 1024;
+
+#pragma pack(push, 1)
+    struct RecordHeader {
+        uint8_t direction;
+        uint64_t timestamp;
+        uint32_t size;
+    };
+#pragma pack(pop)
+
+    SessionRecorder::SessionRecorder(const std::filesystem::path &path) {
+        this->start = std::chrono::steady_clock::now();
+
+        // open file
+        this->file.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!this->file) {
+            log_warning("acioemu", "unable to open session recording: {}", path.string());
+            return;
+        }
+
+        // write file header
+        this->file.write(RECORDING_MAGIC, sizeof(RECORDING_MAGIC));
+        this->file.write(reinterpret_cast<const char *>(&RECORDING_VERSION), sizeof(RECORDING_VERSION));
+        log_info("acioemu", "recording session to {}", path.string());
+    }
+
+    SessionRecorder::~SessionRecorder() {
+        if (this->file.is_open()) {
+            this->file.close();
+        }
+    }
+
+    bool SessionRecorder::is_open() const {
+        return this->file.is_open() && this->file.good();
+    }
+
+    void SessionRecorder::record(RecordDirection direction, const uint8_t *data, size_t size) {
+        if (size == 0) {
+            return;
+        }
+
+        // build header
+        auto elapsed = std::chrono::steady_clock::now() - this->start;
+        RecordHeader header {
+            .direction = static_cast<uint8_t>(direction),
+            .timestamp = static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()),
+            .size = static_cast<uint32_t>(size),
+        };
+
+        // write record
+        std::lock_guard<std::mutex> lock(this->file_mutex);
+        if (!this->file.good()) {
+            return;
+        }
+        this->file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        this->file.write(reinterpret_cast<const char *>(data), size);
+    }
+
+    std::optional<std::vector<SessionRecord>> load_recording(const std::filesystem::path &path) {
+
+        // open file
+        std::ifstream file(path, std::ios::in | std::ios::binary);
+        if (!file) {
+            log_warning("acioemu", "unable to open session recording: {}", path.string());
+            return std::nullopt;
+        }
+
+        // check file header
+        char magic[sizeof(RECORDING_MAGIC)];
+        uint32_t version = 0;
+        file.read(magic, sizeof(magic));
+        file.read(reinterpret_cast<char *>(&version), sizeof(version));
+        if (!file || memcmp(magic, RECORDING_MAGIC, sizeof(magic)) != 0) {
+            log_warning("acioemu", "invalid session recording: {}", path.string());
+            return std::nullopt;
+        }
+        if (version != RECORDING_VERSION) {
+            log_warning("acioemu", "unsupported session recording version {}: {}", version, path.string());
+            return std::nullopt;
+        }
+
+        // read records
+        std::vector<SessionRecord> records;
+        RecordHeader header {};
+        while (file.read(reinterpret_cast<char *>(&header), sizeof(header))) {
+            if (header.direction > static_cast<uint8_t>(RecordDirection::Read) || header.size > RECORD_SIZE_MAX) {
+                log_warning("acioemu", "invalid record in session recording: {}", path.string());
+                return std::nullopt;
+            }
+
+            SessionRecord record {
+                .direction = static_cast<RecordDirection>(header.direction),
+                .timestamp = header.timestamp,
+                .data = std::vector<uint8_t>(header.size),
+            };
+            if (!file.read(reinterpret_cast<char *>(record.data.data()), header.size)) {
+                break;
+            }
+            records.emplace_back(std::move(record));
+        }
+
+        return records;
+    }
+}
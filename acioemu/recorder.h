@@ -0,0 +1,57 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace acioemu {
+
+    // folder ACIO sessions get recorded into, disabled if empty
+    extern std::string RECORD_PATH;
+
+    /*
+     * Recording Format
+     * Magic and version, followed by a record for every read or write of the game.
+     * A record consists of the direction, the microseconds since the session was opened, the size and the raw bytes.
+     * All values are little endian.
+     */
+    constexpr char RECORDING_MAGIC[8] = { 'A', 'C', 'I', 'O', 'R', 'E', 'C', '\0' };
+    constexpr uint32_t RECORDING_VERSION = 1;
+
+    enum class RecordDirection : uint8_t {
+        Write = 0, // game to device
+        Read = 1,  // device to game
+    };
+
+    struct SessionRecord {
+        RecordDirection direction;
+        uint64_t timestamp;
+        std::vector<uint8_t> data;
+    };
+
+    class SessionRecorder {
+    private:
+        std::ofstream file;
+        std::mutex file_mutex;
+        std::chrono::steady_clock::time_point start;
+
+    public:
+
+        explicit SessionRecorder(const std::filesystem::path &path);
+        ~SessionRecorder();
+
+        bool is_open() const;
+        void record(RecordDirection direction, const uint8_t *data, size_t size);
+    };
+
+    /*
+     * Loads all records of a recording, returns nothing if the file is invalid.
+     * A truncated last record, as left behind by a crash, is ignored.
+     */
+    std::optional<std::vector<SessionRecord>> load_recording(const std::filesystem::path &path);
+}
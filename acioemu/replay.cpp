@@ -0,0 +1,98 @@
+#include "replay.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include <fmt/format.h>
+
+#include "util/utils.h"
+
+namespace acioemu {
+
+    // mismatches shown in the report
+    static const size_t REPORT_MISMATCHES_MAX = 8;
+
+    ReplayResult replay_session(ACIOEmu &emu, const std::vector<SessionRecord> &records) {
+        ReplayResult result;
+        result.write_times.reserve(records.size());
+
+        std::vector<uint8_t> response;
+        auto messages_start = emu.message_count();
+        for (size_t index = 0; index < records.size(); index++) {
+            auto &record = records[index];
+
+            switch (record.direction) {
+                case RecordDirection::Write: {
+
+                    // time processing of the written data
+                    auto start = std::chrono::steady_clock::now();
+                    emu.write(record.data.data(), record.data.size());
+                    auto elapsed = std::chrono::steady_clock::now() - start;
+
+                    result.write_times.push_back(static_cast<uint64_t>(
+                            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+                    result.writes++;
+                    result.bytes_written += record.data.size();
+                    break;
+                }
+                case RecordDirection::Read: {
+
+                    // read as much as the game did and compare
+                    response.resize(record.data.size());
+                    response.resize(emu.read(response.data(), response.size()));
+                    if (response != record.data) {
+                        result.mismatches.push_back(ReplayMismatch {
+                            .record = index,
+                            .expected = record.data,
+                            .actual = response,
+                        });
+                    }
+
+                    result.reads++;
+                    result.bytes_read += record.data.size();
+                    break;
+                }
+            }
+        }
+        result.messages = emu.message_count() - messages_start;
+
+        return result;
+    }
+
+    std::string replay_report(const ReplayResult &result) {
+        std::string report = fmt::format("{} writes ({} bytes, {} messages), {} reads ({} bytes), {} mismatches\n",
+                result.writes, result.bytes_written, result.messages,
+                result.reads, result.bytes_read, result.mismatches.size());
+
+        // timing
+        if (!result.write_times.empty()) {
+            auto times = result.write_times;
+            std::sort(times.begin(), times.end());
+            uint64_t total = 0;
+            for (auto time : times) {
+                total += time;
+            }
+            auto percentile = [&times](size_t p) {
+                return times[std::min(times.size() - 1, times.size() * p / 100)];
+            };
+            report += fmt::format("write time: p50 {}ns, p99 {}ns, max {}ns",
+                    percentile(50), percentile(99), times.back());
+            if (result.messages > 0) {
+                report += fmt::format(", {}ns per message", total / result.messages);
+            }
+            report += "\n";
+        }
+
+        // mismatches
+        for (size_t i = 0; i < result.mismatches.size() && i < REPORT_MISMATCHES_MAX; i++) {
+            auto &mismatch = result.mismatches[i];
+            report += fmt::format("record {}: expected {}, got {}\n",
+                    mismatch.record, bin2hex(mismatch.expected), bin2hex(mismatch.actual));
+        }
+        if (result.mismatches.size() > REPORT_MISMATCHES_MAX) {
+            report += fmt::format("{} more mismatches\n", result.mismatches.size() - REPORT_MISMATCHES_MAX);
+        }
+
+        return report;
+    }
+}
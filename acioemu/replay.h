@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "acioemu.h"
+#include "recorder.h"
+
+namespace acioemu {
+
+    struct ReplayMismatch {
+        size_t record;
+        std::vector<uint8_t> expected;
+        std::vector<uint8_t> actual;
+    };
+
+    struct ReplayResult {
+        size_t writes = 0;
+        size_t reads = 0;
+        size_t messages = 0;
+        size_t bytes_written = 0;
+        size_t bytes_read = 0;
+        std::vector<ReplayMismatch> mismatches;
+
+        // processing time of every write in nanoseconds
+        std::vector<uint64_t> write_times;
+
+        bool passed() const {
+            return mismatches.empty();
+        }
+    };
+
+    /*
+     * Feeds the writes of a recording into the emulator and compares its responses with the recorded reads.
+     * The emulator needs the same devices as the recorded session, with deterministic input state.
+     */
+    ReplayResult replay_session(ACIOEmu &emu, const std::vector<SessionRecord> &records);
+
+    /*
+     * Human readable summary including timing percentiles and the first mismatches.
+     */
+    std::string replay_report(const ReplayResult &result);
+}
@@ -3,6 +3,8 @@
 
 #include "controller.h"
 
+#include <algorithm>
+#include <chrono>
 #include <utility>
 
 #include "cfg/configurator.h"
@@ -12,28 +14,25 @@
 #include "util/utils.h"
 
 #include "module.h"
-#include "modules/analogs.h"
-#include "modules/buttons.h"
-#include "modules/card.h"
-#include "modules/capture.h"
-#include "modules/coin.h"
-#include "modules/control.h"
-#include "modules/drs.h"
-#include "modules/iidx.h"
-#include "modules/info.h"
-#include "modules/keypads.h"
-#include "modules/lcd.h"
-#include "modules/lights.h"
-#include "modules/memory.h"
-#include "modules/touch.h"
+#include "msgpack.h"
 #include "request.h"
 #include "response.h"
 
 using namespace rapidjson;
 using namespace api;
 
+static inline size_t read_frame_size(const char *data) {
+    return (size_t) (uint8_t) data[0]
+         | (size_t) (uint8_t) data[1] << 8
+         | (size_t) (uint8_t) data[2] << 16
+         | (size_t) (uint8_t) data[3] << 24;
+}
+
 Controller::Controller(unsigned short port, std::string password, bool pretty)
-    : port(port), password(std::move(password)), pretty(pretty)
+    : port(port), password(std::move(password)), pretty(pretty),
+      registry(!this->password.empty()),
+      server(server_worker_count, server_receive_buffer_size, server_send_buffer_max_size),
+      blocking_pool(std::make_unique<ThreadPool>(blocking_worker_count))
 {
     if (!crypt::INITIALIZED && !this->password.empty()) {
         log_fatal("api", "API server with password cannot be used without crypt module");
@@ -44,70 +43,35 @@ Controller::Controller(unsigned short port, std::string password, bool pretty)
     int error;
     if ((error = WSAStartup(MAKEWORD(2, 2), &wsa_data)) != 0) {
         log_warning("api", "WSAStartup() returned {}", error);
-        this->server = INVALID_SOCKET;
-        if (!cfg::CONFIGURATOR_STANDALONE) {
-            log_fatal("api", "failed to start server");
-        }
-        return;
-    }
-
-    // create socket
-    this->server = socket(AF_INET, SOCK_STREAM, 0);
-    if (this->server == INVALID_SOCKET) {
-        log_warning("api", "could not create listener socket: {}", get_last_error_string());
-        if (!cfg::CONFIGURATOR_STANDALONE) {
-            log_fatal("api", "failed to start server");
-        }
-        return;
-    }
-
-    // configure socket
-    int opt_enable = 1;
-    if (setsockopt(this->server, SOL_SOCKET, SO_REUSEADDR,
-            reinterpret_cast<const char *>(&opt_enable), sizeof(int)) == -1)
-    {
-        log_warning("api", "could not set socket option SO_REUSEADDR: {}", get_last_error_string());
-    }
-    if (setsockopt(this->server, IPPROTO_TCP, TCP_NODELAY,
-            reinterpret_cast<const char *>(&opt_enable), sizeof(int)) == -1)
-    {
-        log_warning("api", "could not set socket option TCP_NODELAY: {}", get_last_error_string());
-    }
-
-    // create address
-    sockaddr_in server_address{};
-    server_address.sin_family = AF_INET;
-    server_address.sin_port = htons(this->port);
-    server_address.sin_addr.s_addr = INADDR_ANY;
-    memset(&server_address.sin_zero, 0, sizeof(server_address.sin_zero));
-
-    // bind socket to address
-    if (bind(this->server, (sockaddr *) &server_address, sizeof(sockaddr)) == -1) {
-        log_warning("api", "could not bind socket on port {}: {}", port, get_last_error_string());
-        this->server = INVALID_SOCKET;
         if (!cfg::CONFIGURATOR_STANDALONE) {
             log_fatal("api", "failed to start server");
         }
         return;
     }
 
-    // set socket to listen
-    if (listen(this->server, server_backlog) == -1) {
-        log_warning("api", "could not listen to socket on port {}: {}", port, get_last_error_string());
-        this->server = INVALID_SOCKET;
+    // connection callbacks
+    this->server.on_connect = [this] (util::SocketServer::Connection &connection) {
+        return this->connection_open(connection);
+    };
+    this->server.on_receive = [this] (util::SocketServer::Connection &connection, char *data, size_t size) {
+        this->connection_receive(connection, data, size);
+    };
+    this->server.on_disconnect = [this] (util::SocketServer::Connection &connection) {
+        this->connection_close(connection);
+    };
+    this->server.on_tick = [this] (util::SocketServer::Connection &connection) {
+        return this->connection_tick(connection);
+    };
+
+    // start listening, clients connect from other devices
+    if (!this->server.listen(this->port, server_backlog, true)) {
+        log_warning("api", "{}", this->server.get_error());
         if (!cfg::CONFIGURATOR_STANDALONE) {
             log_fatal("api", "failed to start server");
         }
         return;
     }
-
-    // start workers
     this->server_running = true;
-    for (int i = 0; i < server_worker_count; i++) {
-        this->server_workers.emplace_back(std::thread([this] {
-            this->server_worker();
-        }));
-    }
 
     // log success
     log_info("api", "API server is listening on port: {}", this->port);
@@ -115,6 +79,9 @@ Controller::Controller(unsigned short port, std::string password, bool pretty)
 
     // start websocket on next port
     this->websocket = new WebSocketController(this, port + 1);
+
+    // start capture stream on the port after
+    this->stream = new StreamController(this->password, port + 2);
 }
 
 Controller::~Controller() {
@@ -122,6 +89,9 @@ Controller::~Controller() {
     // stop websocket
     delete this->websocket;
 
+    // stop capture stream
+    delete this->stream;
+
     // stop serial controllers
     for (auto &s : this->serial) {
         delete s;
@@ -130,21 +100,17 @@ Controller::~Controller() {
     // mark server stop
     this->server_running = false;
 
-    // close socket
-    if (this->server != INVALID_SOCKET) {
-        closesocket(this->server);
+    // finish the blocking calls while the I/O threads can still take their results,
+    // calls issued from now on fail right away
+    std::unique_ptr<ThreadPool> blocking_pool;
+    {
+        std::lock_guard<std::mutex> lock(this->blocking_pool_m);
+        blocking_pool.swap(this->blocking_pool);
     }
+    blocking_pool.reset();
 
-    // lock handlers
-    std::lock_guard<std::mutex> handlers_guard(this->server_handlers_m);
-
-    // join threads
-    for (auto &worker : this->server_workers) {
-        worker.join();
-    }
-    for (auto &handler : this->server_handlers) {
-        handler.join();
-    }
+    // stop I/O threads, this closes all connections
+    this->server.stop();
 
     // cleanup WSA
     WSACleanup();
@@ -154,159 +120,412 @@ void Controller::listen_serial(std::string port, DWORD baud) {
     this->serial.push_back(new SerialController(this, port, baud));
 }
 
-void Controller::server_worker() {
+bool Controller::connection_open(util::SocketServer::Connection &connection) {
 
-    // connection loop
-    while (this->server_running) {
+    // check connection limit
+    if (this->server.get_connection_count() >= (size_t) server_connection_limit) {
+        log_warning("api", "connection limit hit");
+        return false;
+    }
 
-        // create client state
-        ClientState client_state {};
+    // create client state
+    auto client_state = new ClientState();
+    client_state->address = connection.address;
+    client_state->socket = connection.socket;
+    client_state->push_supported = true;
+    client_state->framing_supported = true;
+    connection.user = client_state;
 
-        // accept connection
-        int socket_in_size = sizeof(sockaddr_in);
-        client_state.socket = accept(this->server, (sockaddr *) &client_state.address, &socket_in_size);
-        if (client_state.socket == INVALID_SOCKET) {
-            continue;
-        }
+    // log connection
+    log_info("api", "client connected: {}", get_ip_address(client_state->address));
+    client_states_m.lock();
+    client_states.emplace_back(client_state);
+    client_states_m.unlock();
 
-        // lock handlers
-        std::lock_guard<std::mutex> handlers_guard(this->server_handlers_m);
+    // init state
+    init_state(client_state);
+    return true;
+}
 
-        // check connection limit
-        if (this->server_handlers.size() >= server_connection_limit) {
-            log_warning("api", "connection limit hit");
-            closesocket(client_state.socket);
-            continue;
-        }
+void Controller::connection_receive(util::SocketServer::Connection &connection, char *data, size_t size) {
+    auto client_state = reinterpret_cast<ClientState *>(connection.user);
 
-        // handle connection
-        this->server_handlers.emplace_back(std::thread([this, client_state] {
-            this->connection_handler(client_state);
-        }));
+    // cipher
+    if (client_state->cipher != nullptr) {
+        client_state->cipher->crypt((uint8_t *) data, size);
     }
+
+    this->receive_data(connection, client_state, data, size);
 }
 
-void Controller::connection_handler(api::ClientState client_state) {
+void Controller::receive_data(util::SocketServer::Connection &connection, ClientState *state,
+        const char *data, size_t size)
+{
+    // split into messages, the framing may change in between
+    std::vector<char> send_buffer;
+    while (size > 0 && !state->close && !state->pending) {
+        size_t consumed;
+        if (state->framing == Framing::MSGPACK) {
+            consumed = this->receive_frame(connection, state, data, size, send_buffer);
+        } else {
+            consumed = this->receive_message(connection, state, data, size, send_buffer);
+        }
+        data += consumed;
+        size -= consumed;
+    }
 
-    // get address string
-    char client_address_str_data[INET_ADDRSTRLEN];
-    inet_ntop(AF_INET, &client_state.address.sin_addr, client_address_str_data, INET_ADDRSTRLEN);
-    std::string client_address_str(client_address_str_data);
+    // hold back the following requests while a blocking call is running
+    if (state->pending && size > 0) {
+        if (state->held_input.size() + size > server_held_input_max_size) {
+            state->close = true;
+        } else {
+            state->held_input.insert(state->held_input.end(), data, data + size);
+        }
+    }
 
-    // log connection
-    log_info("api", "client connected: {}", client_address_str);
-    client_states_m.lock();
-    client_states.emplace_back(&client_state);
-    client_states_m.unlock();
+    // pipelined requests get all of their responses sent at once
+    if (!send_buffer.empty()) {
+        this->server.send(connection, send_buffer.data(), send_buffer.size());
+    }
 
-    // init state
-    init_state(&client_state);
+    // forward close request
+    if (state->close) {
+        connection.close = true;
+    }
+}
+
+size_t Controller::receive_message(util::SocketServer::Connection &connection, ClientState *state,
+        const char *data, size_t size, std::vector<char> &send_buffer)
+{
+    auto &message_buffer = state->message_buffer;
 
-    // listen loop
-    std::vector<char> message_buffer;
-    char receive_buffer[server_receive_buffer_size];
-    while (this->server_running && !client_state.close) {
+    // find escape byte
+    auto escape = (const char *) memchr(data, 0, size);
+    size_t length = escape != nullptr ? (size_t) (escape - data) : size;
+
+    // check buffer size
+    if (message_buffer.size() + length > server_message_buffer_max_size) {
+        message_buffer.clear();
+        state->close = true;
+        return size;
+    }
 
-        // receive data
-        int received_length = recv(client_state.socket, receive_buffer, server_receive_buffer_size, 0);
-        if (received_length < 0) {
+    // incomplete message stays buffered
+    if (escape == nullptr) {
+        message_buffer.insert(message_buffer.end(), data, data + length);
+        return size;
+    }
 
-            // if the received length is < 0, we've got an error
-            log_warning("api", "receive error: {}", WSAGetLastError());
-            break;
-        } else if (received_length == 0) {
+    // get response, avoiding the copy if the message arrived in one piece
+    auto offset = send_buffer.size();
+    if (message_buffer.empty()) {
+        this->process_request(state, data, length, &send_buffer, &connection);
+    } else {
+        message_buffer.insert(message_buffer.end(), data, data + length);
+        this->process_request(state, message_buffer.data(), message_buffer.size(), &send_buffer, &connection);
+        message_buffer.clear();
+    }
+    process_response(state, send_buffer, offset);
+    return length + 1;
+}
 
-            // if the received length is 0, the connection is closed
-            break;
+size_t Controller::receive_frame(util::SocketServer::Connection &connection, ClientState *state,
+        const char *data, size_t size, std::vector<char> &send_buffer)
+{
+    auto &message_buffer = state->message_buffer;
+    auto offset = send_buffer.size();
+
+    // process without copying if the frame arrived in one piece
+    if (message_buffer.empty() && size >= 4) {
+        auto frame_size = read_frame_size(data);
+        if (frame_size > server_message_buffer_max_size) {
+            state->close = true;
+            return size;
+        }
+        if (size - 4 >= frame_size) {
+            this->process_request(state, data + 4, frame_size, &send_buffer, &connection);
+            process_response(state, send_buffer, offset);
+            return 4 + frame_size;
         }
+    }
 
-        // cipher
-        if (client_state.cipher != nullptr) {
-            client_state.cipher->crypt(
-                    (uint8_t *) receive_buffer,
-                    (size_t) received_length
-            );
+    // complete the size prefix
+    size_t consumed = 0;
+    if (message_buffer.size() < 4) {
+        consumed = std::min(size, 4 - message_buffer.size());
+        message_buffer.insert(message_buffer.end(), data, data + consumed);
+        if (message_buffer.size() < 4) {
+            return consumed;
         }
+    }
 
-        // put into buffer
-        for (int i = 0; i < received_length; i++) {
+    // check buffer size
+    auto frame_size = read_frame_size(message_buffer.data());
+    if (frame_size > server_message_buffer_max_size) {
+        message_buffer.clear();
+        state->close = true;
+        return size;
+    }
 
-            // check for escape byte
-            if (receive_buffer[i] == 0) {
+    // append payload
+    size_t missing = 4 + frame_size - message_buffer.size();
+    size_t length = std::min(size - consumed, missing);
+    message_buffer.insert(message_buffer.end(), data + consumed, data + consumed + length);
+    consumed += length;
+
+    // process the complete frame
+    if (length == missing) {
+        this->process_request(state, message_buffer.data() + 4, frame_size, &send_buffer, &connection);
+        message_buffer.clear();
+        process_response(state, send_buffer, offset);
+    }
+    return consumed;
+}
 
-                // get response
+void Controller::process_response(ClientState *state, std::vector<char> &send_buffer, size_t offset) {
+
+    // cipher the new response, a password change only affects the following ones
+    if (state->cipher != nullptr && send_buffer.size() > offset) {
+        state->cipher->crypt(
+                (uint8_t *) send_buffer.data() + offset,
+                send_buffer.size() - offset
+        );
+    }
+
+    // check for password change
+    process_password_change(state);
+}
+
+void Controller::connection_close(util::SocketServer::Connection &connection) {
+    auto client_state = reinterpret_cast<ClientState *>(connection.user);
+
+    // log disconnect
+    log_info("api", "client disconnected: {}", get_ip_address(client_state->address));
+    client_states_m.lock();
+    client_states.erase(std::remove(client_states.begin(), client_states.end(), client_state));
+    client_states_m.unlock();
+    connection.user = nullptr;
+
+    // a call still running on the pool frees the state once it completed
+    if (auto pending = client_state->pending) {
+        std::lock_guard<std::mutex> lock(pending->mutex);
+        if (!pending->done) {
+            pending->abandoned = true;
+            return;
+        }
+    }
+
+    // free state
+    free_state(client_state);
+    delete client_state;
+}
+
+int Controller::connection_tick(util::SocketServer::Connection &connection) {
+    auto client_state = reinterpret_cast<ClientState *>(connection.user);
+
+    // a blocking call wakes the connection once it completed
+    if (client_state->pending && !this->complete_pending(connection, client_state)) {
+        return -1;
+    }
+    if (client_state->pending || connection.close) {
+        return -1;
+    }
+
+    // check for subscriptions
+    if (client_state->subscriptions.empty()) {
+        return -1;
+    }
+
+    // update due subscriptions
+    auto now = std::chrono::steady_clock::now();
+    auto next_update = std::chrono::steady_clock::time_point::max();
+    for (auto subscription : client_state->subscriptions) {
+        if (subscription->next_update <= now) {
+            subscription->next_update = now + std::chrono::milliseconds(subscription->interval_ms);
+
+            // blocking functions get polled on the worker pool
+            if (subscription->target->module->blocking) {
+                auto pending = std::make_shared<PendingCall>(subscription->id);
+                pending->subscription = subscription;
+                pending->response.push = true;
+                this->run_pending(connection, client_state, std::move(pending));
+                return -1;
+            }
+
+            // push changes
+            Response push(subscription->id);
+            push.push = true;
+            if (subscription->update(push)) {
                 std::vector<char> send_buffer;
-                this->process_request(&client_state, &message_buffer, &send_buffer);
+                this->write_response(client_state, push, &send_buffer);
+                this->connection_send(connection, send_buffer);
+            }
+        }
+        next_update = std::min(next_update, subscription->next_update);
+    }
 
-                // clear message buffer
-                message_buffer.clear();
+    // time until the next subscription is due
+    return (int) std::chrono::ceil<std::chrono::milliseconds>(next_update - now).count();
+}
 
-                // check send buffer for content
-                if (!send_buffer.empty()) {
+void Controller::connection_send(util::SocketServer::Connection &connection, std::vector<char> &message) {
+    auto client_state = reinterpret_cast<ClientState *>(connection.user);
 
-                    // cipher
-                    if (client_state.cipher != nullptr) {
-                        client_state.cipher->crypt(
-                                (uint8_t *) send_buffer.data(),
-                                (size_t) send_buffer.size()
-                        );
-                    }
+    // cipher
+    if (client_state->cipher != nullptr) {
+        client_state->cipher->crypt(
+                (uint8_t *) message.data(),
+                (size_t) message.size()
+        );
+    }
 
-                    // send data
-                    send(client_state.socket, send_buffer.data(), (int) send_buffer.size(), 0);
+    // send data
+    this->server.send(connection, message.data(), message.size());
+}
 
-                    // check for password change
-                    process_password_change(&client_state);
-                }
-            } else {
+bool Controller::is_blocking(Request &request) {
 
-                // append to message
-                message_buffer.push_back(receive_buffer[i]);
+    // single call
+    if (!request.is_batch()) {
+        auto entry = this->registry.find(request.module, request.function);
+        return entry != nullptr && entry->module->blocking;
+    }
 
-                // check buffer size
-                if (message_buffer.size() > server_message_buffer_max_size) {
-                    message_buffer.clear();
-                    client_state.close = true;
-                    break;
-                }
+    // a batch is blocking as a whole if any of its modules is
+    for (auto &call : request.batch.GetArray()) {
+        if (!call.IsObject()) {
+            continue;
+        }
+        auto it = call.FindMember("module");
+        if (it != call.MemberEnd() && it->value.IsString()) {
+            auto module = this->registry.find_module(
+                    std::string_view(it->value.GetString(), it->value.GetStringLength()));
+            if (module != nullptr && module->blocking) {
+                return true;
             }
         }
     }
+    return false;
+}
 
-    // log disconnect
-    log_info("api", "client disconnected: {}", client_address_str);
-    client_states_m.lock();
-    client_states.erase(std::remove(client_states.begin(), client_states.end(), &client_state));
-    client_states_m.unlock();
+void Controller::run_pending(util::SocketServer::Connection &connection, ClientState *state,
+        std::shared_ptr<PendingCall> pending)
+{
+    pending->wakeup = this->server.get_wakeup(connection);
+    state->pending = pending;
+
+    // the pool is gone once the server shuts down
+    std::lock_guard<std::mutex> pool_lock(this->blocking_pool_m);
+    if (!this->blocking_pool) {
+        if (pending->subscription == nullptr) {
+            Value shutdown_error("Server is shutting down.");
+            pending->response.add_error(shutdown_error);
+        }
+        pending->done = true;
+        this->server.wake(*pending->wakeup);
+        return;
+    }
+    this->blocking_pool->add([this, state, pending] {
 
-    // close connection
-    closesocket(client_state.socket);
+        // call function
+        if (pending->subscription != nullptr) {
+            pending->changed = pending->subscription->update(pending->response);
+        } else {
+            this->execute(*pending->request, pending->response);
+        }
 
-    // free state
-    free_state(&client_state);
+        // hand the result back to the I/O thread, or clean up after a closed connection
+        std::unique_lock<std::mutex> lock(pending->mutex);
+        pending->done = true;
+        if (pending->abandoned) {
+            lock.unlock();
+            free_state(state);
+            delete state;
+            return;
+        }
+        lock.unlock();
+        this->server.wake(*pending->wakeup);
+    });
+}
+
+bool Controller::complete_pending(util::SocketServer::Connection &connection, ClientState *state) {
+    auto pending = state->pending;
+
+    // check if the call is still running
+    {
+        std::lock_guard<std::mutex> lock(pending->mutex);
+        if (!pending->done) {
+            return false;
+        }
+    }
+    state->pending.reset();
+
+    // send the result
+    std::vector<char> send_buffer;
+    if (pending->subscription != nullptr) {
+        if (pending->changed) {
+            this->write_response(state, pending->response, &send_buffer);
+            this->connection_send(connection, send_buffer);
+        }
+    } else {
+        this->finish_request(state, pending->response, &send_buffer);
+        process_response(state, send_buffer, 0);
+        this->server.send(connection, send_buffer.data(), send_buffer.size());
+    }
+
+    // continue with the requests which arrived in the meantime
+    if (!state->held_input.empty()) {
+        std::vector<char> held_input;
+        held_input.swap(state->held_input);
+        this->receive_data(connection, state, held_input.data(), held_input.size());
+    }
+    return true;
 }
 
 bool Controller::process_request(ClientState *state, std::vector<char> *in, std::vector<char> *out) {
     return this->process_request(state, &(*in)[0], in->size(), out);
 }
 
-bool Controller::process_request(ClientState *state, const char *in, size_t in_size, std::vector<char> *out) {
-
+bool Controller::process_request(ClientState *state, const char *in, size_t in_size, std::vector<char> *out,
+        util::SocketServer::Connection *connection)
+{
     // parse document
     Document document;
-    document.Parse(in, in_size);
+    bool parse_error;
+    if (state->framing == Framing::MSGPACK) {
+        parse_error = !msgpack::parse((const uint8_t *) in, in_size, document);
+    } else {
+        document.Parse(in, in_size);
+        parse_error = document.HasParseError();
+    }
 
     // check for parse error
-    if (document.HasParseError()) {
+    if (parse_error) {
 
         // return empty response and close connection
-        out->push_back(0);
+        if (state->framing == Framing::MSGPACK) {
+            out->insert(out->end(), 4, 0);
+        } else {
+            out->push_back(0);
+        }
         state->close = true;
         return false;
     }
 
-    // build request and response
+    // build request
     Request request(document);
+    request.client = state;
+
+    // blocking calls of socket server connections respond once they completed on the pool
+    if (connection != nullptr && !request.parse_error && this->is_blocking(request)) {
+        auto pending = std::make_shared<PendingCall>(request.id);
+        pending->document.Swap(document);
+        pending->request = std::make_unique<Request>(std::move(request));
+        this->run_pending(*connection, state, std::move(pending));
+        return true;
+    }
+
+    // build response
     Response response(request.id);
     bool success = true;
 
@@ -317,43 +536,139 @@ bool Controller::process_request(ClientState *state, const char *in, size_t in_s
         success = false;
     } else {
 
-        // find module
-        bool module_found = false;
-        for (auto module : state->modules) {
-            if (module->name == request.module) {
-                module_found = true;
-
-                // check password force
-                if (module->password_force && this->password.empty() && request.function != "session_refresh") {
-                    Value err("Module requires the password to be set.");
-                    response.add_error(err);
-                    break;
-                }
-
-                // handle request
-                module->handle(request, response);
-                break;
+        // handle request
+        this->execute(request, response);
+    }
+
+    this->finish_request(state, response, out);
+    return success;
+}
+
+void Controller::execute(Request &request, Response &response) {
+    if (request.is_batch()) {
+        this->process_batch(request.client, request, response);
+    } else {
+        auto entry = this->resolve(request, response);
+        if (entry != nullptr) {
+            entry->module->handle(entry->function, request, response);
+        }
+    }
+}
+
+void Controller::finish_request(ClientState *state, Response &response, std::vector<char> *out) {
+
+    // check for password change
+    if (response.password_changed) {
+        state->password = response.password;
+        state->password_change = true;
+    }
+
+    // write response
+    this->write_response(state, response, out);
+
+    // following messages use the new framing
+    if (response.framing_changed) {
+        state->framing = response.framing;
+    }
+}
+
+void Controller::process_batch(ClientState *state, Request &request, Response &response) {
+
+    // check size
+    if (request.batch.Size() > server_batch_limit) {
+        Value batch_error("Batch size limit exceeded.");
+        response.add_error(batch_error);
+        return;
+    }
+
+    // build requests
+    std::vector<Request> calls;
+    calls.reserve(request.batch.Size());
+    for (auto &call : request.batch.GetArray()) {
+        calls.emplace_back(call);
+        calls.back().client = state;
+    }
+
+    // lock every involved module once, always in the same order to avoid deadlocks
+    std::vector<Module *> modules;
+    for (auto &call : calls) {
+        if (!call.parse_error && !call.is_batch()) {
+            auto entry = this->registry.find(call.module, call.function);
+            if (entry != nullptr && !entry->module->concurrent) {
+                modules.push_back(entry->module);
             }
         }
+    }
+    std::sort(modules.begin(), modules.end());
+    modules.erase(std::unique(modules.begin(), modules.end()), modules.end());
+    std::vector<std::unique_lock<std::mutex>> locks;
+    locks.reserve(modules.size());
+    for (auto module : modules) {
+        locks.emplace_back(module->mutex);
+    }
 
-        // check if module wasn't found
-        if (!module_found) {
+    // execute in order
+    for (auto &call : calls) {
+        Response result(call.id);
+        if (call.parse_error) {
+            Value call_error("Request parse error (invalid message format?).");
+            result.add_error(call_error);
+        } else if (call.is_batch()) {
+            Value call_error("Batches can't be nested.");
+            result.add_error(call_error);
+        } else {
+            auto entry = this->resolve(call, result);
+            if (entry != nullptr) {
+                entry->module->handle_locked(entry->function, call, result);
+            }
+        }
+        response.add_result(result);
+    }
+}
+
+const ModuleRegistry::Entry *Controller::resolve(Request &request, Response &response) {
+
+    // find function
+    auto entry = this->registry.find(request.module, request.function);
+    if (entry == nullptr) {
+        auto module = this->registry.find_module(request.module);
+        if (module == nullptr) {
             Value module_error("Unknown module.");
             response.add_error(module_error);
+        } else {
+            module->error_function_unknown(response);
         }
+        return nullptr;
+    }
 
-        // check for password change
-        if (response.password_changed) {
-            state->password = response.password;
-            state->password_change = true;
-        }
+    // check password force
+    if (!this->registry.is_authorized(entry)) {
+        Value err("Module requires the password to be set.");
+        response.add_error(err);
+        return nullptr;
     }
 
-    // write response
-    auto response_out = response.get_string(this->pretty);
-    out->insert(out->end(), response_out.begin(), response_out.end());
-    out->push_back(0);
-    return success;
+    return entry;
+}
+
+void Controller::write_response(ClientState *state, Response &response, std::vector<char> *out) {
+    if (state->framing == Framing::MSGPACK) {
+
+        // size prefix followed by the encoded document
+        auto offset = out->size();
+        out->insert(out->end(), 4, 0);
+        response.get_msgpack(*out);
+        auto frame_size = (uint32_t) (out->size() - offset - 4);
+        for (int i = 0; i < 4; i++) {
+            (*out)[offset + i] = (char) (frame_size >> (i * 8));
+        }
+    } else {
+
+        // null terminated JSON
+        auto response_out = response.get_string(this->pretty);
+        out->insert(out->end(), response_out.begin(), response_out.end());
+        out->push_back(0);
+    }
 }
 
 void Controller::process_password_change(api::ClientState *state) {
@@ -375,7 +690,7 @@ void Controller::process_password_change(api::ClientState *state) {
 void Controller::init_state(api::ClientState *state) {
 
     // check if already initialized
-    if (!state->modules.empty()) {
+    if (state->cipher != nullptr) {
         log_fatal("api", "client state double initialization");
     }
 
@@ -385,29 +700,13 @@ void Controller::init_state(api::ClientState *state) {
     if (!this->password.empty()) {
         state->cipher = new util::RC4((uint8_t *) this->password.c_str(), this->password.size());
     }
-
-    // create module instances
-    state->modules.push_back(new modules::Analogs());
-    state->modules.push_back(new modules::Buttons());
-    state->modules.push_back(new modules::Card());
-    state->modules.push_back(new modules::Capture());
-    state->modules.push_back(new modules::Coin());
-    state->modules.push_back(new modules::Control());
-    state->modules.push_back(new modules::DRS());
-    state->modules.push_back(new modules::IIDX());
-    state->modules.push_back(new modules::Info());
-    state->modules.push_back(new modules::Keypads());
-    state->modules.push_back(new modules::LCD());
-    state->modules.push_back(new modules::Lights());
-    state->modules.push_back(new modules::Memory());
-    state->modules.push_back(new modules::Touch());
 }
 
 void Controller::free_state(api::ClientState *state) {
 
-    // free modules
-    for (auto module : state->modules) {
-        delete module;
+    // free subscriptions
+    for (auto subscription : state->subscriptions) {
+        delete subscription;
     }
 
     // free cipher
@@ -415,12 +714,15 @@ void Controller::free_state(api::ClientState *state) {
 }
 
 void Controller::free_socket() {
-    if (this->server != INVALID_SOCKET) {
-        closesocket(this->server);
-        this->server = INVALID_SOCKET;
+    this->server.close_listener();
+
+    if (this->websocket) {
+        this->websocket->free_socket();
     }
 
-    this->websocket->free_socket();
+    if (this->stream) {
+        this->stream->free_socket();
+    }
 
     for (auto &s : this->serial) {
         s->free_port();
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
@@ -8,21 +9,53 @@
 #include <winsock2.h>
 
 #include "util/rc4.h"
+#include "util/socket_server.h"
+#include "util/threadpool.h"
 
 #include "module.h"
+#include "registry.h"
+#include "subscription.h"
 #include "websocket.h"
 #include "serial.h"
+#include "stream.h"
 
 namespace api {
 
+    /*
+     * A call of a blocking module running on the worker pool.
+     * The connection holds back its input and subscription updates until the call completed.
+     */
+    struct PendingCall {
+        rapidjson::Document document;
+        std::unique_ptr<Request> request;
+        Subscription *subscription = nullptr;
+        Response response;
+        bool changed = false;
+
+        // completion, the pool frees the client state if the connection closed in the meantime
+        std::mutex mutex;
+        bool done = false;
+        bool abandoned = false;
+        std::shared_ptr<util::SocketServer::Wakeup> wakeup;
+
+        explicit PendingCall(uint64_t id) : response(id) {
+        }
+    };
+
     struct ClientState {
         SOCKADDR_IN address;
         SOCKET socket;
         bool close = false;
-        std::vector<Module*> modules;
+        std::vector<char> message_buffer;
+        bool push_supported = false;
+        bool framing_supported = false;
+        Framing framing = Framing::JSON;
+        std::vector<Subscription *> subscriptions;
         std::string password;
         bool password_change = false;
         util::RC4 *cipher = nullptr;
+        std::shared_ptr<PendingCall> pending;
+        std::vector<char> held_input;
     };
 
     class Controller {
@@ -32,30 +65,55 @@ namespace api {
         const static int server_backlog = 16;
         const static int server_receive_buffer_size = 64 * 1024;
         const static int server_message_buffer_max_size = 64 * 1024;
+        const static int server_send_buffer_max_size = 16 * 1024 * 1024;
         const static int server_worker_count = 2;
         const static int server_connection_limit = 4096;
+        const static int server_batch_limit = 1024;
+        const static int server_held_input_max_size = 1024 * 1024;
+        const static int blocking_worker_count = 2;
 
         // settings
         unsigned short port;
         std::string password;
         bool pretty;
 
+        // modules shared by all clients
+        ModuleRegistry registry;
+
         // server
-        WebSocketController *websocket;
+        WebSocketController *websocket = nullptr;
+        StreamController *stream = nullptr;
         std::vector<SerialController *> serial;
-        std::vector<std::thread> server_workers;
-        std::vector<std::thread> server_handlers;
-        std::mutex server_handlers_m;
+        util::SocketServer server;
+        std::unique_ptr<ThreadPool> blocking_pool;
+        std::mutex blocking_pool_m;
         std::vector<api::ClientState *> client_states;
         std::mutex client_states_m;
-        SOCKET server;
-        void server_worker();
-        void connection_handler(ClientState client_state);
+        bool connection_open(util::SocketServer::Connection &connection);
+        void connection_receive(util::SocketServer::Connection &connection, char *data, size_t size);
+        void connection_close(util::SocketServer::Connection &connection);
+        int connection_tick(util::SocketServer::Connection &connection);
+        void receive_data(util::SocketServer::Connection &connection, ClientState *state,
+                const char *data, size_t size);
+        size_t receive_message(util::SocketServer::Connection &connection, ClientState *state,
+                const char *data, size_t size, std::vector<char> &send_buffer);
+        size_t receive_frame(util::SocketServer::Connection &connection, ClientState *state,
+                const char *data, size_t size, std::vector<char> &send_buffer);
+        static void process_response(ClientState *state, std::vector<char> &send_buffer, size_t offset);
+        void connection_send(util::SocketServer::Connection &connection, std::vector<char> &message);
+        bool is_blocking(Request &request);
+        void run_pending(util::SocketServer::Connection &connection, ClientState *state,
+                std::shared_ptr<PendingCall> pending);
+        bool complete_pending(util::SocketServer::Connection &connection, ClientState *state);
+        void execute(Request &request, Response &response);
+        void finish_request(ClientState *state, Response &response, std::vector<char> *out);
+        void process_batch(ClientState *state, Request &request, Response &response);
+        const ModuleRegistry::Entry *resolve(Request &request, Response &response);
 
     public:
 
         // state
-        bool server_running;
+        bool server_running = false;
 
         // constructor / destructor
         Controller(unsigned short port, std::string password, bool pretty);
@@ -64,8 +122,10 @@ namespace api {
         void listen_serial(std::string port, DWORD baud);
 
         bool process_request(ClientState *state, std::vector<char> *in, std::vector<char> *out);
-        bool process_request(ClientState *state, const char *in, size_t in_size, std::vector<char> *out);
+        bool process_request(ClientState *state, const char *in, size_t in_size, std::vector<char> *out,
+                util::SocketServer::Connection *connection = nullptr);
         static void process_password_change(ClientState *state);
+        void write_response(ClientState *state, Response &response, std::vector<char> *out);
 
         void init_state(ClientState *state);
         static void free_state(ClientState *state);
@@ -78,5 +138,9 @@ namespace api {
         inline const std::string &get_password() const {
             return this->password;
         }
+
+        inline const std::vector<Module *> &get_modules() const {
+            return this->registry.get_modules();
+        }
     };
 }
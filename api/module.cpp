@@ -16,19 +16,23 @@ namespace api {
         this->password_force = password_force;
     }
 
-    void Module::handle(Request &req, Response &res) {
+    void Module::handle(ModuleFunction function, Request &req, Response &res) {
+        if (this->concurrent) {
+            this->handle_locked(function, req, res);
+            return;
+        }
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->handle_locked(function, req, res);
+    }
+
+    void Module::handle_locked(ModuleFunction function, Request &req, Response &res) {
 
         // log module access
         if (LOGGING)
             log_info("api::" + this->name, "handling request");
 
-        // find function
-        auto pos = functions.find(req.function);
-        if (pos == functions.end())
-            return error_function_unknown(res);
-
         // call function
-        pos->second(req, res);
+        function(*this, req, res);
     }
 
     void Module::error(Response &res, std::string err) {
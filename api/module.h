@@ -1,10 +1,10 @@
 #pragma once
 
-#include <functional>
-#include <map>
+#include <mutex>
 #include <string>
 #include <sstream>
-#include <external/robin_hood.h>
+#include <utility>
+#include <vector>
 
 #include "response.h"
 #include "request.h"
@@ -14,18 +14,42 @@ namespace api {
     // logging setting
     extern bool LOGGING;
 
-    // callback
-    typedef std::function<void(Request &, Response &)> ModuleFunctionCallback;
+    class Module;
+
+    // plain function pointer the registry dispatches to
+    typedef void (*ModuleFunction)(Module &, Request &, Response &);
 
     class Module {
     protected:
 
-        // map of available functions
-        robin_hood::unordered_map<std::string, ModuleFunctionCallback> functions;
+        // list of available functions
+        std::vector<std::pair<std::string, ModuleFunction>> functions;
 
         // default constructor
         explicit Module(std::string name, bool password_force=false);
 
+        // adds a member function of the derived module
+        template<auto F>
+        void add_function(std::string function_name) {
+            this->functions.emplace_back(std::move(function_name), &invoke<F>);
+        }
+
+    private:
+
+        template<class T>
+        struct member_class;
+
+        template<class T>
+        struct member_class<void (T::*)(Request &, Response &)> {
+            using type = T;
+        };
+
+        template<auto F>
+        static void invoke(Module &module, Request &req, Response &res) {
+            using T = typename member_class<decltype(F)>::type;
+            (static_cast<T &>(module).*F)(req, res);
+        }
+
     public:
 
         // virtual deconstructor
@@ -35,8 +59,24 @@ namespace api {
         std::string name;
         bool password_force;
 
+        // may wait on other threads, the API server runs its calls on a worker pool
+        bool blocking = false;
+
+        // synchronizes itself, calls don't take the module mutex
+        bool concurrent = false;
+
+        // serializes calls since the instance is shared by all clients
+        std::mutex mutex;
+
+        inline const std::vector<std::pair<std::string, ModuleFunction>> &get_functions() const {
+            return this->functions;
+        }
+
         // the magic
-        void handle(Request &req, Response &res);
+        void handle(ModuleFunction function, Request &req, Response &res);
+
+        // same as handle, but the caller already holds the module mutex if needed
+        void handle_locked(ModuleFunction function, Request &req, Response &res);
 
         /*
          * Error definitions.
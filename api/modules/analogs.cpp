@@ -1,5 +1,4 @@
 #include "analogs.h"
-#include <functional>
 #include "external/rapidjson/document.h"
 #include "misc/eamuse.h"
 #include "cfg/analog.h"
@@ -7,17 +6,15 @@
 #include "games/io.h"
 #include "util/utils.h"
 
-using namespace std::placeholders;
 using namespace rapidjson;
 
 
 namespace api::modules {
 
     Analogs::Analogs() : Module("analogs") {
-        functions["read"] = std::bind(&Analogs::read, this, _1, _2);
-        functions["write"] = std::bind(&Analogs::write, this, _1, _2);
-        functions["write_reset"] = std::bind(&Analogs::write_reset, this, _1, _2);
-        analogs = games::get_analogs(eamuse_get_game());
+        add_function<&Analogs::read>("read");
+        add_function<&Analogs::write>("write");
+        add_function<&Analogs::write_reset>("write_reset");
     }
 
     /**
@@ -25,13 +22,14 @@ namespace api::modules {
      */
     void Analogs::read(api::Request &req, Response &res) {
 
-        // check analog cache
+        // get analogs of the current game
+        auto analogs = games::get_analogs(eamuse_get_game());
         if (!analogs) {
             return;
         }
 
         // add state for each analog
-        for (auto &analog : *this->analogs) {
+        for (auto &analog : *analogs) {
             Value state(kArrayType);
             Value analog_name(analog.getName().c_str(), res.doc()->GetAllocator());
             Value analog_state(GameAPI::Analogs::getState(RI_MGR, analog));
@@ -48,7 +46,8 @@ namespace api::modules {
      */
     void Analogs::write(Request &req, Response &res) {
 
-        // check analog cache
+        // get analogs of the current game
+        auto analogs = games::get_analogs(eamuse_get_game());
         if (!analogs)
             return;
 
@@ -91,7 +90,8 @@ namespace api::modules {
      */
     void Analogs::write_reset(Request &req, Response &res) {
 
-        // check analog cache
+        // get analogs of the current game
+        auto analogs = games::get_analogs(eamuse_get_game());
         if (!analogs)
             return;
 
@@ -101,7 +101,7 @@ namespace api::modules {
         // write_reset()
         if (params.Size() == 0) {
             if (analogs != nullptr) {
-                for (auto &analog : *this->analogs) {
+                for (auto &analog : *analogs) {
                     analog.override_enabled = false;
                 }
             }
@@ -138,13 +138,14 @@ namespace api::modules {
 
     bool Analogs::write_analog(std::string name, float state) {
 
-        // check analog cache
-        if (!this->analogs) {
+        // get analogs of the current game
+        auto analogs = games::get_analogs(eamuse_get_game());
+        if (!analogs) {
             return false;
         }
 
         // find analog
-        for (auto &analog : *this->analogs) {
+        for (auto &analog : *analogs) {
             if (analog.getName() == name) {
                 analog.override_state = CLAMP(state, 0.f, 1.f);
                 analog.override_enabled = true;
@@ -158,13 +159,14 @@ namespace api::modules {
 
     bool Analogs::write_analog_reset(std::string name) {
 
-        // check analog cache
+        // get analogs of the current game
+        auto analogs = games::get_analogs(eamuse_get_game());
         if (!analogs) {
             return false;
         }
 
         // find analog
-        for (auto &analog : *this->analogs) {
+        for (auto &analog : *analogs) {
             if (analog.getName() == name) {
                 analog.override_enabled = false;
                 return true;
@@ -13,9 +13,6 @@ namespace api::modules {
 
     private:
 
-        // state
-        std::vector<Analog> *analogs;
-
         // function definitions
         void read(Request &req, Response &res);
         void write(Request &req, Response &res);
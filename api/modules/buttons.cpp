@@ -1,5 +1,4 @@
 #include "buttons.h"
-#include <functional>
 #include "external/rapidjson/document.h"
 #include "misc/eamuse.h"
 #include "cfg/button.h"
@@ -7,17 +6,15 @@
 #include "games/io.h"
 #include "util/utils.h"
 
-using namespace std::placeholders;
 using namespace rapidjson;
 
 
 namespace api::modules {
 
     Buttons::Buttons() : Module("buttons") {
-        functions["read"] = std::bind(&Buttons::read, this, _1, _2);
-        functions["write"] = std::bind(&Buttons::write, this, _1, _2);
-        functions["write_reset"] = std::bind(&Buttons::write_reset, this, _1, _2);
-        buttons = games::get_buttons(eamuse_get_game());
+        add_function<&Buttons::read>("read");
+        add_function<&Buttons::write>("write");
+        add_function<&Buttons::write_reset>("write_reset");
     }
 
     /**
@@ -25,13 +22,14 @@ namespace api::modules {
      */
     void Buttons::read(api::Request &req, Response &res) {
 
-        // check button cache
-        if (!this->buttons) {
+        // get buttons of the current game
+        auto buttons = games::get_buttons(eamuse_get_game());
+        if (!buttons) {
             return;
         }
 
         // add state for each button
-        for (auto &button : *this->buttons) {
+        for (auto &button : *buttons) {
             Value state(kArrayType);
             Value button_name(button.getName().c_str(), res.doc()->GetAllocator());
             Value button_state(GameAPI::Buttons::getVelocity(RI_MGR, button));
@@ -48,7 +46,8 @@ namespace api::modules {
      */
     void Buttons::write(Request &req, Response &res) {
 
-        // check button cache
+        // get buttons of the current game
+        auto buttons = games::get_buttons(eamuse_get_game());
         if (!buttons) {
             return;
         }
@@ -93,8 +92,9 @@ namespace api::modules {
      */
     void Buttons::write_reset(Request &req, Response &res) {
 
-        // check button cache
-        if (!this->buttons) {
+        // get buttons of the current game
+        auto buttons = games::get_buttons(eamuse_get_game());
+        if (!buttons) {
             return;
         }
 
@@ -104,7 +104,7 @@ namespace api::modules {
         // write_reset()
         if (params.Size() == 0) {
             if (buttons != nullptr) {
-                for (auto &button : *this->buttons) {
+                for (auto &button : *buttons) {
                     button.override_enabled = false;
                 }
             }
@@ -141,13 +141,14 @@ namespace api::modules {
 
     bool Buttons::write_button(std::string name, float state) {
 
-        // check button cache
-        if (!this->buttons) {
+        // get buttons of the current game
+        auto buttons = games::get_buttons(eamuse_get_game());
+        if (!buttons) {
             return false;
         }
 
         // find button
-        for (auto &button : *this->buttons) {
+        for (auto &button : *buttons) {
             if (button.getName() == name) {
                 button.override_state = state > 0.f ?
                         GameAPI::Buttons::BUTTON_PRESSED : GameAPI::Buttons::BUTTON_NOT_PRESSED;
@@ -163,13 +164,14 @@ namespace api::modules {
 
     bool Buttons::write_button_reset(std::string name) {
 
-        // check button cache
-        if (!this->buttons) {
+        // get buttons of the current game
+        auto buttons = games::get_buttons(eamuse_get_game());
+        if (!buttons) {
             return false;
         }
 
         // find button
-        for (auto &button : *this->buttons) {
+        for (auto &button : *buttons) {
             if (button.getName() == name) {
                 button.override_enabled = false;
                 return true;
@@ -1,10 +1,8 @@
 #include "capture.h"
-#include <functional>
 #include "external/rapidjson/document.h"
 #include "hooks/graphics/graphics.h"
 #include "util/crypt.h"
 
-using namespace std::placeholders;
 using namespace rapidjson;
 
 namespace api::modules {
@@ -12,8 +10,13 @@ namespace api::modules {
     static thread_local std::vector<uint8_t> CAPTURE_BUFFER;
 
     Capture::Capture() : Module("capture") {
-        functions["get_screens"] = std::bind(&Capture::get_screens, this, _1, _2);
-        functions["get_jpg"] = std::bind(&Capture::get_jpg, this, _1, _2);
+        add_function<&Capture::get_screens>("get_screens");
+        add_function<&Capture::get_jpg>("get_jpg");
+        add_function<&Capture::get_stats>("get_stats");
+
+        // waits for frames, concurrent requests share a wait instead of queueing up on the module mutex
+        this->blocking = true;
+        this->concurrent = true;
     }
 
     /**
@@ -32,33 +35,40 @@ namespace api::modules {
     }
 
     /**
-     * get_jpg([screen=0, quality=70, downscale=0, divide=1])
+     * get_jpg([screen=0, quality=70, divide=1, x=0, y=0, width=0, height=0, target_width=0, target_height=0])
      * screen: uint specifying the window
      * quality: uint in range [0, 100]
-     * reduce: uint for dividing image size
+     * divide: uint for dividing image size
+     * x, y, width, height: uint region of the screen, zero size captures everything
+     * target_width, target_height: uint output size, overrides divide, a single one keeps the aspect ratio
      */
     void Capture::get_jpg(Request &req, Response &res) {
-        CAPTURE_BUFFER.reserve(1024 * 128);
 
         // settings
         int screen = 0;
-        int quality = 70;
-        int divide = 1;
+        CaptureOptions options;
+        options.quality = 70;
         if (req.params.Size() > 0 && req.params[0].IsUint())
             screen = req.params[0].GetUint();
         if (req.params.Size() > 1 && req.params[1].IsUint())
-            quality = req.params[1].GetUint();
+            options.quality = req.params[1].GetUint();
         if (req.params.Size() > 2 && req.params[2].IsUint())
-            divide = req.params[2].GetUint();
+            options.divide = req.params[2].GetUint();
+        int *region[] {
+            &options.x, &options.y, &options.width, &options.height,
+            &options.target_width, &options.target_height,
+        };
+        for (size_t i = 0; i < std::size(region); i++) {
+            if (req.params.Size() > 3 + i && req.params[3 + i].IsUint())
+                *region[i] = (int) std::min(req.params[3 + i].GetUint(), 0xFFFFu);
+        }
 
         // receive JPEG data
         uint64_t timestamp = 0;
         int width = 0;
         int height = 0;
-        graphics_capture_trigger(screen);
-        bool success = graphics_capture_receive_jpeg(screen, [] (uint8_t byte) {
-            CAPTURE_BUFFER.push_back(byte);
-        }, true, quality, true, divide, &timestamp, &width, &height);
+        bool success = graphics_capture_receive_jpeg(screen, CAPTURE_BUFFER,
+                options, &timestamp, &width, &height);
         if (!success) {
             return;
         }
@@ -68,9 +78,6 @@ namespace api::modules {
                 CAPTURE_BUFFER.data(),
                 CAPTURE_BUFFER.size());
 
-        // clear buffer
-        CAPTURE_BUFFER.clear();
-
         // add data to response
         Value data;
         data.SetString(encoded.c_str(), encoded.length(), res.doc()->GetAllocator());
@@ -79,4 +86,21 @@ namespace api::modules {
         res.add_data(height);
         res.add_data(data);
     }
+
+    /**
+     * get_stats()
+     */
+    void Capture::get_stats(Request &req, Response &res) {
+        auto stats = graphics_capture_stats();
+        auto add_entry = [&res] (const char *name, uint64_t value) {
+            Value entry(kArrayType);
+            entry.PushBack(StringRef(name), res.doc()->GetAllocator());
+            entry.PushBack(value, res.doc()->GetAllocator());
+            res.add_data(entry);
+        };
+        add_entry("cache_hits", stats.cache_hits);
+        add_entry("cache_misses", stats.cache_misses);
+        add_entry("stalls", stats.stalls);
+        add_entry("completed", stats.completed);
+    }
 }
@@ -14,5 +14,6 @@ namespace api::modules {
         // function definitions
         void get_screens(Request &req, Response &res);
         void get_jpg(Request &req, Response &res);
+        void get_stats(Request &req, Response &res);
     };
 }
@@ -1,19 +1,17 @@
 #include "coin.h"
-#include <functional>
 #include "external/rapidjson/document.h"
 #include "misc/eamuse.h"
 
-using namespace std::placeholders;
 using namespace rapidjson;
 
 
 namespace api::modules {
 
     Coin::Coin() : Module("coin") {
-        functions["get"] = std::bind(&Coin::get, this, _1, _2);
-        functions["set"] = std::bind(&Coin::set, this, _1, _2);
-        functions["insert"] = std::bind(&Coin::insert, this, _1, _2);
-        functions["blocker_get"] = std::bind(&Coin::blocker_get, this, _1, _2);
+        add_function<&Coin::get>("get");
+        add_function<&Coin::set>("set");
+        add_function<&Coin::insert>("insert");
+        add_function<&Coin::blocker_get>("blocker_get");
     }
 
     /**
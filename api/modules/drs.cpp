@@ -1,16 +1,14 @@
 #include "drs.h"
-#include <functional>
 #include "external/rapidjson/document.h"
 #include "games/drs/drs.h"
 
-using namespace std::placeholders;
 using namespace rapidjson;
 
 namespace api::modules {
 
     DRS::DRS() : Module("drs") {
-        functions["tapeled_get"] = std::bind(&DRS::tapeled_get, this, _1, _2);
-        functions["touch_set"] = std::bind(&DRS::touch_set, this, _1, _2);
+        add_function<&DRS::tapeled_get>("tapeled_get");
+        add_function<&DRS::touch_set>("touch_set");
     }
 
     /**
@@ -1,10 +1,8 @@
 #include "iidx.h"
-#include <functional>
 #include <vector>
 #include "games/iidx/iidx.h"
 #include "external/rapidjson/document.h"
 
-using namespace std::placeholders;
 using namespace rapidjson;
 
 
@@ -14,9 +12,9 @@ namespace api::modules {
     static const size_t TICKER_SIZE = 9;
 
     IIDX::IIDX() : Module("iidx") {
-        functions["ticker_get"] = std::bind(&IIDX::ticker_get, this, _1, _2);
-        functions["ticker_set"] = std::bind(&IIDX::ticker_set, this, _1, _2);
-        functions["ticker_reset"] = std::bind(&IIDX::ticker_reset, this, _1, _2);
+        add_function<&IIDX::ticker_get>("ticker_get");
+        add_function<&IIDX::ticker_set>("ticker_set");
+        add_function<&IIDX::ticker_reset>("ticker_reset");
     }
 
     /**
@@ -1,5 +1,4 @@
 #include "info.h"
-#include <functional>
 #include <iomanip>
 #include "external/rapidjson/document.h"
 #include "avs/game.h"
@@ -9,16 +8,15 @@
 #include "util/memutils.h"
 #include "build/defs.h"
 
-using namespace std::placeholders;
 using namespace rapidjson;
 
 
 namespace api::modules {
 
     Info::Info() : Module("info") {
-        functions["avs"] = std::bind(&Info::avs, this, _1, _2);
-        functions["launcher"] = std::bind(&Info::launcher, this, _1, _2);
-        functions["memory"] = std::bind(&Info::memory, this, _1, _2);
+        add_function<&Info::avs>("avs");
+        add_function<&Info::launcher>("launcher");
+        add_function<&Info::memory>("memory");
     }
 
     /**
@@ -34,9 +34,9 @@ namespace api::modules {
     };
 
     Keypads::Keypads() : Module("keypads") {
-        functions["write"] = std::bind(&Keypads::write, this, _1, _2);
-        functions["set"] = std::bind(&Keypads::set, this, _1, _2);
-        functions["get"] = std::bind(&Keypads::get, this, _1, _2);
+        add_function<&Keypads::write>("write");
+        add_function<&Keypads::set>("set");
+        add_function<&Keypads::get>("get");
     }
 
     /**
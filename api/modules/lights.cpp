@@ -1,5 +1,4 @@
 #include "lights.h"
-#include <functional>
 #include "external/rapidjson/document.h"
 #include "misc/eamuse.h"
 #include "cfg/light.h"
@@ -7,17 +6,15 @@
 #include "games/io.h"
 #include "util/utils.h"
 
-using namespace std::placeholders;
 using namespace rapidjson;
 
 
 namespace api::modules {
 
     Lights::Lights() : Module("lights") {
-        functions["read"] = std::bind(&Lights::read, this, _1, _2);
-        functions["write"] = std::bind(&Lights::write, this, _1, _2);
-        functions["write_reset"] = std::bind(&Lights::write_reset, this, _1, _2);
-        lights = games::get_lights(eamuse_get_game());
+        add_function<&Lights::read>("read");
+        add_function<&Lights::write>("write");
+        add_function<&Lights::write_reset>("write_reset");
     }
 
     /**
@@ -25,13 +22,14 @@ namespace api::modules {
      */
     void Lights::read(api::Request &req, Response &res) {
 
-        // check light cache
-        if (!this->lights) {
+        // get lights of the current game
+        auto lights = games::get_lights(eamuse_get_game());
+        if (!lights) {
             return;
         }
 
         // add state for each light
-        for (auto &light : *this->lights) {
+        for (auto &light : *lights) {
             Value state(kArrayType);
             Value light_name(light.getName().c_str(), res.doc()->GetAllocator());
             Value light_state(GameAPI::Lights::readLight(RI_MGR, light));
@@ -48,8 +46,9 @@ namespace api::modules {
      */
     void Lights::write(Request &req, Response &res) {
 
-        // check light cache
-        if (!this->lights) {
+        // get lights of the current game
+        auto lights = games::get_lights(eamuse_get_game());
+        if (!lights) {
             return;
         }
 
@@ -92,8 +91,9 @@ namespace api::modules {
      */
     void Lights::write_reset(Request &req, Response &res) {
 
-        // check light cache
-        if (!this->lights) {
+        // get lights of the current game
+        auto lights = games::get_lights(eamuse_get_game());
+        if (!lights) {
             return;
         }
 
@@ -103,7 +103,7 @@ namespace api::modules {
         // write_reset()
         if (params.Size() == 0) {
             if (lights != nullptr) {
-                for (auto &light : *this->lights) {
+                for (auto &light : *lights) {
                     light.override_enabled = false;
                 }
             }
@@ -140,13 +140,14 @@ namespace api::modules {
 
     bool Lights::write_light(std::string name, float state) {
 
-        // check light cache
-        if (!this->lights) {
+        // get lights of the current game
+        auto lights = games::get_lights(eamuse_get_game());
+        if (!lights) {
             return false;
         }
 
         // find light
-        for (auto &light : *this->lights) {
+        for (auto &light : *lights) {
             if (light.getName() == name) {
                 light.override_state = CLAMP(state, 0.f, 1.f);
                 light.override_enabled = true;
@@ -160,13 +161,14 @@ namespace api::modules {
 
     bool Lights::write_light_reset(std::string name) {
 
-        // check light cache
-        if (!this->lights) {
+        // get lights of the current game
+        auto lights = games::get_lights(eamuse_get_game());
+        if (!lights) {
             return false;
         }
 
         // find light
-        for (auto &light : *this->lights) {
+        for (auto &light : *lights) {
             if (light.getName() == name) {
                 light.override_enabled = false;
                 return true;
@@ -1,6 +1,5 @@
 #include "memory.h"
 
-#include <functional>
 #include <mutex>
 
 #include "external/rapidjson/document.h"
@@ -10,7 +9,6 @@
 #include "util/sigscan.h"
 #include "util/utils.h"
 
-using namespace std::placeholders;
 using namespace rapidjson;
 
 
@@ -20,9 +18,9 @@ namespace api::modules {
     static std::mutex MEMORY_LOCK;
 
     Memory::Memory() : Module("memory", true) {
-        functions["write"] = std::bind(&Memory::write, this, _1, _2);
-        functions["read"] = std::bind(&Memory::read, this, _1, _2);
-        functions["signature"] = std::bind(&Memory::signature, this, _1, _2);
+        add_function<&Memory::write>("write");
+        add_function<&Memory::read>("read");
+        add_function<&Memory::signature>("signature");
     }
 
     /**
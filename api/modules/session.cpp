@@ -0,0 +1,46 @@
+#include "session.h"
+
+#include "external/rapidjson/document.h"
+#include "api/controller.h"
+
+using namespace rapidjson;
+
+
+namespace api::modules {
+
+    Session::Session() : Module("session") {
+        add_function<&Session::framing>("framing");
+    }
+
+    /**
+     * framing(mode: str)
+     *
+     * "json": UTF-8 JSON terminated by 0x00 (default)
+     * "msgpack": MessagePack encoded messages, each prefixed by its size as 32-bit little endian
+     */
+    void Session::framing(Request &req, Response &res) {
+
+        // check transport
+        if (req.client == nullptr || !req.client->framing_supported) {
+            return error(res, "Framing can't be changed on this connection.");
+        }
+
+        // check params
+        if (req.params.Size() < 1) {
+            return error_params_insufficient(res);
+        }
+        if (!req.params[0].IsString()) {
+            return error_type(res, "mode", "str");
+        }
+
+        // change framing after the response
+        std::string mode = req.params[0].GetString();
+        if (mode == "json") {
+            res.framing_change(Framing::JSON);
+        } else if (mode == "msgpack") {
+            res.framing_change(Framing::MSGPACK);
+        } else {
+            return error_unknown(res, "mode", mode);
+        }
+    }
+}
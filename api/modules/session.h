@@ -0,0 +1,17 @@
+#pragma once
+
+#include "api/module.h"
+#include "api/request.h"
+
+namespace api::modules {
+
+    class Session : public Module {
+    public:
+        Session();
+
+    private:
+
+        // function definitions
+        void framing(Request &req, Response &res);
+    };
+}
@@ -0,0 +1,186 @@
+#include "subscribe.h"
+
+#include <string_view>
+#include <utility>
+
+#include "external/rapidjson/document.h"
+#include "api/controller.h"
+#include "api/registry.h"
+#include "api/subscription.h"
+
+using namespace rapidjson;
+
+namespace api::modules {
+
+    /*
+     * Functions which only read state, everything else could have side effects on every update.
+     */
+    static const std::pair<std::string_view, std::string_view> SUBSCRIBABLE[] = {
+        { "analogs", "read" },
+        { "buttons", "read" },
+        { "capture", "get_screens" },
+        { "capture", "get_jpg" },
+        { "capture", "get_stats" },
+        { "coin", "get" },
+        { "coin", "blocker_get" },
+        { "drs", "tapeled_get" },
+        { "iidx", "ticker_get" },
+        { "info", "avs" },
+        { "info", "launcher" },
+        { "info", "memory" },
+        { "keypads", "get" },
+        { "lcd", "info" },
+        { "lights", "read" },
+        { "memory", "read" },
+        { "touch", "read" },
+    };
+
+    static bool is_subscribable(const ModuleRegistry::Entry *entry) {
+        for (auto &[module_name, function_name] : SUBSCRIBABLE) {
+            if (entry->module_name == module_name && entry->function_name == function_name) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    Subscribe::Subscribe(ModuleRegistry *registry) : Module("subscribe"), registry(registry) {
+        add_function<&Subscribe::add>("add");
+        add_function<&Subscribe::remove>("remove");
+        add_function<&Subscribe::clear>("clear");
+    }
+
+    /**
+     * add(module: str, function: str, params: array, interval_ms: uint)
+     * add(module: str, function: str, params: array, interval_ms: uint, threshold: float)
+     * add(module: str, function: str, params: array, interval_ms: uint, threshold: float, fields: [str])
+     *
+     * The result of the function gets pushed using the ID of this request, first in full and
+     * afterwards only the [name, value, ...] entries which changed by at least the threshold.
+     */
+    void Subscribe::add(Request &req, Response &res) {
+
+        // check transport
+        auto state = req.client;
+        if (state == nullptr || !state->push_supported) {
+            return error(res, "Subscriptions are not supported on this connection.");
+        }
+
+        // check params
+        if (req.params.Size() < 4) {
+            return error_params_insufficient(res);
+        }
+        if (!req.params[0].IsString()) {
+            return error_type(res, "module", "str");
+        }
+        if (!req.params[1].IsString()) {
+            return error_type(res, "function", "str");
+        }
+        if (!req.params[2].IsArray()) {
+            return error_type(res, "params", "array");
+        }
+        if (!req.params[3].IsUint() || req.params[3].GetUint() == 0) {
+            return error_type(res, "interval_ms", "positive uint");
+        }
+        if (req.params.Size() > 4 && !req.params[4].IsNumber()) {
+            return error_type(res, "threshold", "float");
+        }
+        if (req.params.Size() > 5 && !req.params[5].IsArray()) {
+            return error_type(res, "fields", "array of str");
+        }
+
+        // get params
+        std::string module_name = req.params[0].GetString();
+        std::string function_name = req.params[1].GetString();
+        auto interval_ms = req.params[3].GetUint();
+        auto threshold = req.params.Size() > 4 ? req.params[4].GetDouble() : 0.0;
+        std::vector<std::string> fields;
+        if (req.params.Size() > 5) {
+            for (auto &field : req.params[5].GetArray()) {
+                if (!field.IsString()) {
+                    return error_type(res, "fields", "array of str");
+                }
+                fields.emplace_back(field.GetString());
+            }
+        }
+
+        // check target
+        auto target = registry->find(module_name, function_name);
+        if (target == nullptr) {
+            if (registry->find_module(module_name) == nullptr) {
+                return error_unknown(res, "module", module_name);
+            }
+            return error_unknown(res, "function", function_name);
+        }
+        if (!is_subscribable(target)) {
+            return error(res, "Function can't be subscribed to.");
+        }
+        if (!registry->is_authorized(target)) {
+            return error(res, "Module requires the password to be set.");
+        }
+
+        // check for existing subscription
+        for (auto subscription : state->subscriptions) {
+            if (subscription->id == req.id) {
+                return error(res, "Subscription ID is already in use.");
+            }
+        }
+        if (state->subscriptions.size() >= subscription_limit) {
+            return error(res, "Subscription limit reached.");
+        }
+
+        // add subscription, the first push happens right after this response
+        state->subscriptions.push_back(new Subscription(
+                req.id,
+                target,
+                req.params[2],
+                interval_ms,
+                threshold,
+                std::move(fields)));
+        Value id(req.id);
+        res.add_data(id);
+    }
+
+    /**
+     * remove(id: uint)
+     */
+    void Subscribe::remove(Request &req, Response &res) {
+        auto state = req.client;
+        if (state == nullptr) {
+            return;
+        }
+
+        // check params
+        if (req.params.Size() < 1) {
+            return error_params_insufficient(res);
+        }
+        if (!req.params[0].IsUint64()) {
+            return error_type(res, "id", "uint");
+        }
+
+        // find subscription
+        auto id = req.params[0].GetUint64();
+        for (auto it = state->subscriptions.begin(); it != state->subscriptions.end(); it++) {
+            if ((*it)->id == id) {
+                delete *it;
+                state->subscriptions.erase(it);
+                return;
+            }
+        }
+        error_unknown(res, "subscription", std::to_string(id));
+    }
+
+    /**
+     * clear()
+     */
+    void Subscribe::clear(Request &req, Response &res) {
+        auto state = req.client;
+        if (state == nullptr) {
+            return;
+        }
+        for (auto subscription : state->subscriptions) {
+            delete subscription;
+        }
+        state->subscriptions.clear();
+    }
+}
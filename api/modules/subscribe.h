@@ -0,0 +1,29 @@
+#pragma once
+
+#include "api/module.h"
+#include "api/request.h"
+
+namespace api {
+    class ModuleRegistry;
+}
+
+namespace api::modules {
+
+    class Subscribe : public Module {
+    public:
+        Subscribe(ModuleRegistry *registry);
+
+    private:
+
+        // configuration
+        const static size_t subscription_limit = 64;
+
+        // state
+        ModuleRegistry *registry;
+
+        // function definitions
+        void add(Request &req, Response &res);
+        void remove(Request &req, Response &res);
+        void clear(Request &req, Response &res);
+    };
+}
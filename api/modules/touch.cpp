@@ -1,7 +1,5 @@
 #include "touch.h"
 
-#include <functional>
-
 #include "external/rapidjson/document.h"
 #include "avs/game.h"
 #include "misc/eamuse.h"
@@ -9,16 +7,15 @@
 #include "touch/touch.h"
 #include "util/utils.h"
 
-using namespace std::placeholders;
 using namespace rapidjson;
 
 
 namespace api::modules {
 
     Touch::Touch() : Module("touch") {
-        functions["read"] = std::bind(&Touch::read, this, _1, _2);
-        functions["write"] = std::bind(&Touch::write, this, _1, _2);
-        functions["write_reset"] = std::bind(&Touch::write_reset, this, _1, _2);
+        add_function<&Touch::read>("read");
+        add_function<&Touch::write>("write");
+        add_function<&Touch::write_reset>("write_reset");
     }
 
     /**
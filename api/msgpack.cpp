@@ -0,0 +1,304 @@
+#include "msgpack.h"
+
+#include <cstring>
+
+using namespace rapidjson;
+
+namespace api::msgpack {
+
+    // nesting limit so malformed input can't exhaust the stack
+    static const int DEPTH_MAX = 64;
+
+    class Reader {
+    public:
+        Reader(const uint8_t *data, size_t size, Document::AllocatorType &allocator)
+            : data(data), end(data + size), allocator(allocator) {
+        }
+
+        bool read(Value &value, int depth) {
+            if (depth > DEPTH_MAX || data >= end) {
+                return false;
+            }
+
+            // fixed size types
+            auto type = *data++;
+            if (type <= 0x7F) {
+                value.SetUint(type);
+                return true;
+            } else if (type >= 0xE0) {
+                value.SetInt((int8_t) type);
+                return true;
+            } else if ((type & 0xF0) == 0x80) {
+                return read_map(value, type & 0x0F, depth);
+            } else if ((type & 0xF0) == 0x90) {
+                return read_array(value, type & 0x0F, depth);
+            } else if ((type & 0xE0) == 0xA0) {
+                return read_string(value, type & 0x1F);
+            }
+
+            // variable size types
+            uint64_t length;
+            switch (type) {
+                case 0xC0:
+                    value.SetNull();
+                    return true;
+                case 0xC2:
+                    value.SetBool(false);
+                    return true;
+                case 0xC3:
+                    value.SetBool(true);
+                    return true;
+                case 0xC4:
+                case 0xD9:
+                    return read_uint(length, 1) && read_string(value, length);
+                case 0xC5:
+                case 0xDA:
+                    return read_uint(length, 2) && read_string(value, length);
+                case 0xC6:
+                case 0xDB:
+                    return read_uint(length, 4) && read_string(value, length);
+                case 0xCA: {
+                    uint64_t bits;
+                    if (!read_uint(bits, 4)) {
+                        return false;
+                    }
+                    float f;
+                    uint32_t bits32 = (uint32_t) bits;
+                    memcpy(&f, &bits32, sizeof(f));
+                    value.SetDouble(f);
+                    return true;
+                }
+                case 0xCB: {
+                    uint64_t bits;
+                    if (!read_uint(bits, 8)) {
+                        return false;
+                    }
+                    double d;
+                    memcpy(&d, &bits, sizeof(d));
+                    value.SetDouble(d);
+                    return true;
+                }
+                case 0xCC:
+                case 0xCD:
+                case 0xCE:
+                case 0xCF: {
+                    uint64_t u;
+                    if (!read_uint(u, 1 << (type - 0xCC))) {
+                        return false;
+                    }
+                    value.SetUint64(u);
+                    return true;
+                }
+                case 0xD0:
+                case 0xD1:
+                case 0xD2:
+                case 0xD3: {
+                    uint64_t u;
+                    auto size = 1 << (type - 0xD0);
+                    if (!read_uint(u, size)) {
+                        return false;
+                    }
+
+                    // sign extend
+                    auto shift = 64 - size * 8;
+                    value.SetInt64((int64_t) (u << shift) >> shift);
+                    return true;
+                }
+                case 0xDC:
+                    return read_uint(length, 2) && read_array(value, length, depth);
+                case 0xDD:
+                    return read_uint(length, 4) && read_array(value, length, depth);
+                case 0xDE:
+                    return read_uint(length, 2) && read_map(value, length, depth);
+                case 0xDF:
+                    return read_uint(length, 4) && read_map(value, length, depth);
+                default:
+                    return false;
+            }
+        }
+
+        inline bool done() const {
+            return data == end;
+        }
+
+    private:
+        const uint8_t *data;
+        const uint8_t *end;
+        Document::AllocatorType &allocator;
+
+        bool read_uint(uint64_t &value, size_t size) {
+            if ((size_t) (end - data) < size) {
+                return false;
+            }
+            value = 0;
+            for (size_t i = 0; i < size; i++) {
+                value = (value << 8) | *data++;
+            }
+            return true;
+        }
+
+        bool read_string(Value &value, uint64_t length) {
+            if ((uint64_t) (end - data) < length) {
+                return false;
+            }
+            value.SetString((const char *) data, (SizeType) length, allocator);
+            data += length;
+            return true;
+        }
+
+        bool read_array(Value &value, uint64_t length, int depth) {
+
+            // every element takes at least a byte
+            if ((uint64_t) (end - data) < length) {
+                return false;
+            }
+            value.SetArray();
+            value.Reserve((SizeType) length, allocator);
+            for (uint64_t i = 0; i < length; i++) {
+                Value element;
+                if (!read(element, depth + 1)) {
+                    return false;
+                }
+                value.PushBack(element, allocator);
+            }
+            return true;
+        }
+
+        bool read_map(Value &value, uint64_t length, int depth) {
+            if ((uint64_t) (end - data) < length * 2) {
+                return false;
+            }
+            value.SetObject();
+            for (uint64_t i = 0; i < length; i++) {
+                Value key, element;
+                if (!read(key, depth + 1) || !key.IsString() || !read(element, depth + 1)) {
+                    return false;
+                }
+                value.AddMember(key, element, allocator);
+            }
+            return true;
+        }
+    };
+
+    class Writer {
+    public:
+        explicit Writer(std::vector<char> &out) : out(out) {
+        }
+
+        void write(const Value &value) {
+            switch (value.GetType()) {
+                case kNullType:
+                    put(0xC0);
+                    break;
+                case kFalseType:
+                    put(0xC2);
+                    break;
+                case kTrueType:
+                    put(0xC3);
+                    break;
+                case kNumberType:
+                    write_number(value);
+                    break;
+                case kStringType:
+                    write_header(value.GetStringLength(), 0xA0, 0x1F, 0xD9);
+                    out.insert(out.end(), value.GetString(), value.GetString() + value.GetStringLength());
+                    break;
+                case kArrayType:
+                    write_header(value.Size(), 0x90, 0x0F, 0);
+                    for (auto &element : value.GetArray()) {
+                        write(element);
+                    }
+                    break;
+                case kObjectType:
+                    write_header(value.MemberCount(), 0x80, 0x0F, 0);
+                    for (auto &member : value.GetObject()) {
+                        write(member.name);
+                        write(member.value);
+                    }
+                    break;
+            }
+        }
+
+    private:
+        std::vector<char> &out;
+
+        inline void put(uint8_t c) {
+            out.push_back((char) c);
+        }
+
+        void put_uint(uint8_t type, uint64_t value, size_t size) {
+            put(type);
+            for (size_t i = size; i-- > 0;) {
+                put((uint8_t) (value >> (i * 8)));
+            }
+        }
+
+        void write_header(size_t length, uint8_t fix_type, size_t fix_max, uint8_t type8) {
+
+            // arrays and maps have no 8 bit variant, their 16/32 bit types follow the fixed ones
+            if (length <= fix_max) {
+                put(fix_type | (uint8_t) length);
+            } else if (type8 && length <= 0xFF) {
+                put_uint(type8, length, 1);
+            } else if (length <= 0xFFFF) {
+                put_uint(fix_type == 0xA0 ? 0xDA : (fix_type == 0x90 ? 0xDC : 0xDE), length, 2);
+            } else {
+                put_uint(fix_type == 0xA0 ? 0xDB : (fix_type == 0x90 ? 0xDD : 0xDF), length, 4);
+            }
+        }
+
+        void write_number(const Value &value) {
+            if (value.IsUint64()) {
+                auto u = value.GetUint64();
+                if (u <= 0x7F) {
+                    put((uint8_t) u);
+                } else if (u <= 0xFF) {
+                    put_uint(0xCC, u, 1);
+                } else if (u <= 0xFFFF) {
+                    put_uint(0xCD, u, 2);
+                } else if (u <= 0xFFFFFFFF) {
+                    put_uint(0xCE, u, 4);
+                } else {
+                    put_uint(0xCF, u, 8);
+                }
+            } else if (value.IsInt64()) {
+                auto i = value.GetInt64();
+                if (i >= -32) {
+                    put((uint8_t) i);
+                } else if (i >= INT8_MIN) {
+                    put_uint(0xD0, (uint64_t) i, 1);
+                } else if (i >= INT16_MIN) {
+                    put_uint(0xD1, (uint64_t) i, 2);
+                } else if (i >= INT32_MIN) {
+                    put_uint(0xD2, (uint64_t) i, 4);
+                } else {
+                    put_uint(0xD3, (uint64_t) i, 8);
+                }
+            } else {
+
+                // states are mostly floats, so don't waste bytes when it's lossless
+                auto d = value.GetDouble();
+                auto f = (float) d;
+                if ((double) f == d) {
+                    uint32_t bits;
+                    memcpy(&bits, &f, sizeof(bits));
+                    put_uint(0xCA, bits, 4);
+                } else {
+                    uint64_t bits;
+                    memcpy(&bits, &d, sizeof(bits));
+                    put_uint(0xCB, bits, 8);
+                }
+            }
+        }
+    };
+
+    bool parse(const uint8_t *data, size_t size, Document &document) {
+        Reader reader(data, size, document.GetAllocator());
+        return reader.read(document, 0) && reader.done();
+    }
+
+    void write(const Value &value, std::vector<char> &out) {
+        Writer writer(out);
+        writer.write(value);
+    }
+}
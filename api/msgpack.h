@@ -0,0 +1,19 @@
+#pragma once
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "external/rapidjson/document.h"
+
+/*
+ * MessagePack encoding of API messages.
+ * Documents are converted directly from/to the rapidjson DOM, so no JSON text is ever generated.
+ * Only the types JSON can represent are supported, bin values are read as strings.
+ */
+namespace api::msgpack {
+
+    bool parse(const uint8_t *data, size_t size, rapidjson::Document &document);
+    void write(const rapidjson::Value &value, std::vector<char> &out);
+}
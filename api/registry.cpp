@@ -0,0 +1,195 @@
+#include "registry.h"
+
+#include <algorithm>
+
+#include "util/logging.h"
+
+#include "modules/analogs.h"
+#include "modules/buttons.h"
+#include "modules/card.h"
+#include "modules/capture.h"
+#include "modules/coin.h"
+#include "modules/control.h"
+#include "modules/drs.h"
+#include "modules/iidx.h"
+#include "modules/info.h"
+#include "modules/keypads.h"
+#include "modules/lcd.h"
+#include "modules/lights.h"
+#include "modules/memory.h"
+#include "modules/session.h"
+#include "modules/subscribe.h"
+#include "modules/touch.h"
+
+namespace api {
+
+    static inline uint32_t hash_name(std::string_view module_name, std::string_view function_name) {
+
+        // FNV-1a
+        uint32_t hash = 2166136261u;
+        for (auto c : module_name) {
+            hash = (hash ^ (uint8_t) c) * 16777619u;
+        }
+        hash = (hash ^ (uint8_t) '.') * 16777619u;
+        for (auto c : function_name) {
+            hash = (hash ^ (uint8_t) c) * 16777619u;
+        }
+        return hash;
+    }
+
+    static inline uint32_t hash_seed(uint32_t hash, uint32_t seed) {
+
+        // murmur3 finalizer
+        hash ^= seed * 0x9E3779B1u;
+        hash ^= hash >> 16;
+        hash *= 0x85EBCA6Bu;
+        hash ^= hash >> 13;
+        hash *= 0xC2B2AE35u;
+        hash ^= hash >> 16;
+        return hash;
+    }
+
+    static inline size_t next_pow2(size_t value) {
+        size_t result = 1;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    ModuleRegistry::ModuleRegistry(bool password_set) : password_set(password_set) {
+
+        // create module instances
+        this->modules.push_back(new modules::Analogs());
+        this->modules.push_back(new modules::Buttons());
+        this->modules.push_back(new modules::Card());
+        this->modules.push_back(new modules::Capture());
+        this->modules.push_back(new modules::Coin());
+        this->modules.push_back(new modules::Control());
+        this->modules.push_back(new modules::DRS());
+        this->modules.push_back(new modules::IIDX());
+        this->modules.push_back(new modules::Info());
+        this->modules.push_back(new modules::Keypads());
+        this->modules.push_back(new modules::LCD());
+        this->modules.push_back(new modules::Lights());
+        this->modules.push_back(new modules::Memory());
+        this->modules.push_back(new modules::Touch());
+        this->modules.push_back(new modules::Session());
+        this->modules.push_back(new modules::Subscribe(this));
+
+        // build dispatch table
+        this->build();
+    }
+
+    ModuleRegistry::~ModuleRegistry() {
+        for (auto module : this->modules) {
+            delete module;
+        }
+    }
+
+    void ModuleRegistry::build() {
+
+        // collect entries
+        std::vector<Entry> entries;
+        for (auto module : this->modules) {
+            for (auto &[function_name, function] : module->get_functions()) {
+                entries.push_back(Entry {
+                    .module = module,
+                    .function = function,
+                    .module_name = module->name,
+                    .function_name = function_name,
+                });
+            }
+        }
+
+        // keep the table at most half full
+        size_t bucket_count = next_pow2(std::max<size_t>(entries.size() / 2, 1));
+        size_t table_size = next_pow2(entries.size() * 2);
+        this->seeds.assign(bucket_count, 0);
+        this->table.assign(table_size, Entry {});
+
+        // distribute into buckets
+        std::vector<std::vector<std::pair<uint32_t, const Entry *>>> buckets(bucket_count);
+        for (auto &entry : entries) {
+            auto hash = hash_name(entry.module_name, entry.function_name);
+            buckets[hash & (bucket_count - 1)].emplace_back(hash, &entry);
+        }
+
+        // place the largest buckets first
+        std::vector<size_t> order(bucket_count);
+        for (size_t i = 0; i < bucket_count; i++) {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&buckets] (size_t a, size_t b) {
+            return buckets[a].size() > buckets[b].size();
+        });
+
+        // find a seed per bucket which puts all of its entries into free slots
+        std::vector<bool> used(table_size, false);
+        std::vector<size_t> slots;
+        for (auto bucket_index : order) {
+            auto &bucket = buckets[bucket_index];
+            if (bucket.empty()) {
+                break;
+            }
+
+            bool placed = false;
+            for (uint32_t seed = 1; seed < 1u << 20 && !placed; seed++) {
+                slots.clear();
+                placed = true;
+                for (auto &[hash, entry] : bucket) {
+                    auto slot = hash_seed(hash, seed) & (table_size - 1);
+                    if (used[slot] || std::find(slots.begin(), slots.end(), slot) != slots.end()) {
+                        placed = false;
+                        break;
+                    }
+                    slots.push_back(slot);
+                }
+                if (placed) {
+                    this->seeds[bucket_index] = seed;
+                    for (size_t i = 0; i < bucket.size(); i++) {
+                        used[slots[i]] = true;
+                        this->table[slots[i]] = *bucket[i].second;
+                    }
+                }
+            }
+            if (!placed) {
+                log_fatal("api", "unable to build module dispatch table");
+            }
+        }
+    }
+
+    const ModuleRegistry::Entry *ModuleRegistry::find(
+            std::string_view module_name, std::string_view function_name) const
+    {
+        auto hash = hash_name(module_name, function_name);
+        auto seed = this->seeds[hash & (this->seeds.size() - 1)];
+        auto &entry = this->table[hash_seed(hash, seed) & (this->table.size() - 1)];
+
+        // the slot might belong to another function
+        if (entry.module == nullptr
+        || entry.function_name != function_name
+        || entry.module_name != module_name) {
+            return nullptr;
+        }
+
+        return &entry;
+    }
+
+    bool ModuleRegistry::is_authorized(const Entry *entry) const {
+
+        // the session refresh is how clients get a password in the first place
+        return !entry->module->password_force
+            || this->password_set
+            || entry->function_name == "session_refresh";
+    }
+
+    Module *ModuleRegistry::find_module(std::string_view module_name) const {
+        for (auto module : this->modules) {
+            if (module->name == module_name) {
+                return module;
+            }
+        }
+        return nullptr;
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+
+#include <stdint.h>
+
+#include "module.h"
+
+namespace api {
+
+    /*
+     * Process wide set of module instances shared by all clients.
+     * Functions are dispatched through a perfect hash table which gets built once on creation.
+     */
+    class ModuleRegistry {
+    public:
+
+        struct Entry {
+            Module *module = nullptr;
+            ModuleFunction function = nullptr;
+            std::string_view module_name;
+            std::string_view function_name;
+        };
+
+        explicit ModuleRegistry(bool password_set);
+        ~ModuleRegistry();
+
+        const Entry *find(std::string_view module_name, std::string_view function_name) const;
+        Module *find_module(std::string_view module_name) const;
+
+        // modules forcing a password can only be used if the server has one
+        bool is_authorized(const Entry *entry) const;
+
+        inline const std::vector<Module *> &get_modules() const {
+            return this->modules;
+        }
+
+    private:
+        std::vector<Module *> modules;
+        bool password_set;
+
+        // hash and displace: the first hash selects the seed used for the second hash
+        std::vector<uint32_t> seeds;
+        std::vector<Entry> table;
+
+        void build();
+    };
+}
@@ -1,15 +1,22 @@
 #include "request.h"
-#include "../util/logging.h"
+#include "util/logging.h"
 #include "module.h"
 
 using namespace rapidjson;
 
 namespace api {
 
-    Request::Request(rapidjson::Document &document) {
+    Request::Request(rapidjson::Value &document) {
         Value::MemberIterator it;
         this->parse_error = false;
 
+        // check type
+        if (!document.IsObject()) {
+            log_warning("api", "Request is not an object");
+            this->parse_error = true;
+            return;
+        }
+
         // get ID
         it = document.FindMember("id");
         if (it == document.MemberEnd() || !(*it).value.IsUint64()) {
@@ -19,6 +26,23 @@ namespace api {
         }
         this->id = (*it).value.GetUint64();
 
+        // get batch
+        it = document.FindMember("batch");
+        if (it != document.MemberEnd()) {
+            if (!(*it).value.IsArray()) {
+                log_warning("api", "Request batch is invalid");
+                this->parse_error = true;
+                return;
+            }
+            this->batch = (*it).value;
+
+            // log request
+            if (LOGGING) {
+                log_info("api", "new batch request > id: {}, size: {}", this->id, this->batch.Size());
+            }
+            return;
+        }
+
         // get module
         it = document.FindMember("module");
         if (it == document.MemberEnd() || !(*it).value.IsString()) {
@@ -26,7 +50,7 @@ namespace api {
             this->parse_error = true;
             return;
         }
-        this->module = (*it).value.GetString();
+        this->module = std::string_view((*it).value.GetString(), (*it).value.GetStringLength());
 
         // get function
         it = document.FindMember("function");
@@ -35,7 +59,7 @@ namespace api {
             this->parse_error = true;
             return;
         }
-        this->function = (*it).value.GetString();
+        this->function = std::string_view((*it).value.GetString(), (*it).value.GetStringLength());
 
         // get params
         it = document.FindMember("params");
@@ -44,7 +68,7 @@ namespace api {
             this->parse_error = true;
             return;
         }
-        this->params = document["params"];
+        this->params = (*it).value;
 
         // log request
         if (LOGGING) {
@@ -1,6 +1,6 @@
 #pragma once
 
-#include <string>
+#include <string_view>
 
 #include <stdint.h>
 
@@ -8,14 +8,26 @@
 
 namespace api {
 
+    struct ClientState;
+
     class Request {
     public:
-        uint64_t id;
-        std::string module;
-        std::string function;
+        uint64_t id = 0;
+        std::string_view module;
+        std::string_view function;
         rapidjson::Value params;
         bool parse_error;
 
-        Request(rapidjson::Document &document);
+        // ordered list of requests if this is a batch envelope
+        rapidjson::Value batch;
+
+        // the client which sent the request, if any
+        ClientState *client = nullptr;
+
+        Request(rapidjson::Value &document);
+
+        inline bool is_batch() const {
+            return this->batch.IsArray();
+        }
     };
 }
@@ -19,11 +19,23 @@ Future<CaptureData> captureGetJPG(Connection con, {
   int screen = 0,
   int quality = 60,
   int divide = 1,
+  int x = 0,
+  int y = 0,
+  int width = 0,
+  int height = 0,
+  int targetWidth = 0,
+  int targetHeight = 0,
 }) {
   var req = Request("capture", "get_jpg");
   req.addParam(screen);
   req.addParam(quality);
   req.addParam(divide);
+  req.addParam(x);
+  req.addParam(y);
+  req.addParam(width);
+  req.addParam(height);
+  req.addParam(targetWidth);
+  req.addParam(targetHeight);
   return con.request(req).then((res) {
     var captureData = CaptureData();
     var data = res.getData();
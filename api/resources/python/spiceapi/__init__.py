@@ -11,4 +11,5 @@ from .info import *
 from .keypads import *
 from .lights import *
 from .memory import *
+from .subscribe import *
 from .touch import *
@@ -22,6 +22,8 @@ class Connection:
         self.password = password
         self.socket = None
         self.cipher = None
+        self.buffer = bytearray()
+        self.pushes = []
         self.reconnect()
 
     def reconnect(self, refresh_session=True):
@@ -32,6 +34,8 @@ class Connection:
 
         # close old socket
         self.close()
+        self.buffer = bytearray()
+        self.pushes = []
 
         # create new socket
         self.socket = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
@@ -92,9 +96,75 @@ class Connection:
             self.socket.setsockopt(socket.IPPROTO_TCP, socket.TCP_QUICKACK, 1)
         self.socket.send(data)
 
-        # get answer
-        answer_data = []
-        while not len(answer_data) or answer_data[-1] != 0:
+        # get answer, pushed messages are queued for receive_push
+        while True:
+            response = self._receive_message()
+            if response.is_push():
+                self.pushes.append(response)
+            else:
+                break
+        if len(response.get_errors()):
+            raise APIError(response.get_errors())
+
+        # check ID
+        req_id = request.get_id()
+        res_id = response.get_id()
+        if req_id != res_id:
+            raise RuntimeError(f"Unexpected response ID: {res_id} (expected {req_id})")
+
+        # return response object
+        return response
+
+    def request_batch(self, requests: list):
+        """Send multiple requests as one batch and receive all answers at once.
+
+        The server executes the requests in order.
+        :param requests: list of request objects
+        :return: list of response objects
+        """
+
+        # build envelope
+        envelope = Request("", "")
+        envelope.data = {
+            "id": envelope.get_id(),
+            "batch": [request.data for request in requests]
+        }
+
+        # split the combined response
+        responses = []
+        for data in self.request(envelope).get_data():
+            response = Response.from_dict(data)
+            if len(response.get_errors()):
+                raise APIError(response.get_errors())
+            responses.append(response)
+        return responses
+
+    def receive_push(self):
+        """Receive the next message pushed by a subscription.
+
+        Blocks until a message arrives or the socket times out.
+        :return: response object
+        """
+
+        # check queued messages
+        if len(self.pushes):
+            return self.pushes.pop(0)
+
+        # check if disconnected
+        if not self.socket:
+            raise RuntimeError("No active connection.")
+
+        # wait for the next push
+        while True:
+            response = self._receive_message()
+            if response.is_push():
+                return response
+
+    def _receive_message(self):
+        """Receive a single message terminated by a null byte."""
+
+        # receive until the buffer contains a full message
+        while 0 not in self.buffer:
 
             # receive data
             if os.name != 'nt':
@@ -109,31 +179,24 @@ class Connection:
 
                     # add decrypted data
                     for b in receive_data:
-                        answer_data.append(int(b ^ next(self.cipher)))
+                        self.buffer.append(b ^ next(self.cipher))
                 else:
 
                     # add plaintext
-                    for b in receive_data:
-                        answer_data.append(int(b))
+                    self.buffer.extend(receive_data)
             else:
                 raise RuntimeError("Connection was closed.")
 
+        # split off message
+        end = self.buffer.index(0)
+        answer_data = bytes(self.buffer[:end])
+        del self.buffer[:end + 1]
+
         # check for empty response
-        if len(answer_data) <= 1:
+        if len(answer_data) == 0:
 
             # empty response means the JSON couldn't be parsed
             raise MalformedRequestException()
 
         # build response
-        response = Response(bytes(answer_data[:-1]).decode("UTF-8"))
-        if len(response.get_errors()):
-            raise APIError(response.get_errors())
-
-        # check ID
-        req_id = request.get_id()
-        res_id = response.get_id()
-        if req_id != res_id:
-            raise RuntimeError(f"Unexpected response ID: {res_id} (expected {req_id})")
-
-        # return response object
-        return response
+        return Response(answer_data.decode("UTF-8"))
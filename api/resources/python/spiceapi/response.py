@@ -4,10 +4,20 @@ import json
 class Response:
 
     def __init__(self, response_json: str):
-        self._res = json.loads(response_json)
+        self._load(json.loads(response_json))
+
+    @staticmethod
+    def from_dict(response_dict: dict):
+        res = Response.__new__(Response)
+        res._load(response_dict)
+        return res
+
+    def _load(self, response_dict: dict):
+        self._res = response_dict
         self._id = self._res["id"]
         self._errors = self._res["errors"]
         self._data = self._res["data"]
+        self._push = self._res.get("push", False)
 
     def to_json(self):
         return json.dumps(
@@ -28,3 +38,6 @@ class Response:
 
     def get_data(self):
         return self._data
+
+    def is_push(self):
+        return self._push
@@ -0,0 +1,28 @@
+from .connection import Connection
+from .request import Request
+
+
+def subscribe_add(con: Connection, module: str, function: str, params=None,
+                  interval_ms=16, threshold=None, fields=None):
+    req = Request("subscribe", "add")
+    req.add_param(module)
+    req.add_param(function)
+    req.add_param(params if params else [])
+    req.add_param(interval_ms)
+    if threshold is not None or fields:
+        req.add_param(threshold if threshold is not None else 0)
+    if fields:
+        req.add_param(fields)
+    res = con.request(req)
+    return res.get_data()[0]
+
+
+def subscribe_remove(con: Connection, subscription_id: int):
+    req = Request("subscribe", "remove")
+    req.add_param(subscription_id)
+    con.request(req)
+
+
+def subscribe_clear(con: Connection):
+    req = Request("subscribe", "clear")
+    con.request(req)
@@ -4,6 +4,7 @@
 
 #include "util/logging.h"
 
+#include "msgpack.h"
 #include "response.h"
 
 using namespace api;
@@ -32,11 +33,38 @@ Response::Response(uint64_t id) {
     this->data = document["data"];
 }
 
-std::string Response::get_string(bool pretty) {
+void Response::finalize() {
 
     // apply errors and data
-    this->document["errors"] = this->errors;
-    this->document["data"] = this->data;
+    if (!this->errors.IsNull()) {
+        this->document["errors"] = this->errors;
+        this->document["data"] = this->data;
+    }
+
+    // mark pushed messages so clients can tell them apart from responses
+    if (this->push && !this->document.HasMember("push")) {
+        this->document.AddMember("push", true, this->document.GetAllocator());
+    }
+}
+
+void Response::add_result(Response &result) {
+    result.finalize();
+
+    // the complete response of a batched request becomes one data entry
+    rapidjson::Value copy(result.document, this->document.GetAllocator());
+    this->add_data(copy);
+
+    // session changes apply after the whole batch
+    if (result.password_changed) {
+        this->password_change(result.password);
+    }
+    if (result.framing_changed) {
+        this->framing_change(result.framing);
+    }
+}
+
+std::string Response::get_string(bool pretty) {
+    this->finalize();
 
     // generate string
     rapidjson::StringBuffer sb;
@@ -49,3 +77,10 @@ std::string Response::get_string(bool pretty) {
     }
     return std::string(sb.GetString());
 }
+
+void Response::get_msgpack(std::vector<char> &out) {
+    this->finalize();
+
+    // encode straight from the document
+    msgpack::write(this->document, out);
+}
@@ -1,18 +1,31 @@
 #pragma once
 
+#include <string>
+#include <vector>
+
 #include "external/rapidjson/document.h"
 
 namespace api {
 
+    enum class Framing {
+        JSON,
+        MSGPACK,
+    };
+
     class Response {
     private:
         rapidjson::Document document;
         rapidjson::Value errors;
         rapidjson::Value data;
 
+        void finalize();
+
     public:
         std::string password;
         bool password_changed = false;
+        Framing framing = Framing::JSON;
+        bool framing_changed = false;
+        bool push = false;
 
         Response(uint64_t id);
 
@@ -23,15 +36,31 @@ namespace api {
             this->data.PushBack(data, document.GetAllocator());
         }
 
+        void add_result(Response &result);
+
         std::string get_string(bool pretty=false);
+        void get_msgpack(std::vector<char> &out);
 
         inline rapidjson::Document* doc() {
             return &document;
         }
 
+        inline rapidjson::Value &get_errors() {
+            return errors;
+        }
+
+        inline rapidjson::Value &get_data() {
+            return data;
+        }
+
         inline void password_change(std::string password) {
             this->password = password;
             this->password_changed = true;
         }
+
+        inline void framing_change(Framing framing) {
+            this->framing = framing;
+            this->framing_changed = true;
+        }
     };
 }
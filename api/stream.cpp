@@ -0,0 +1,100 @@
+#include "stream.h"
+
+#include <vector>
+
+#include "hooks/graphics/graphics.h"
+#include "util/jpeg_encoder.h"
+#include "util/logging.h"
+
+namespace api {
+
+    // settings
+    bool STREAM_EXTERNAL = false;
+
+    StreamController::StreamController(std::string password, uint16_t port)
+        : server(capture_screen_count, std::move(password))
+    {
+
+        // start server
+        if (!this->server.listen(port, server_backlog, STREAM_EXTERNAL)) {
+            log_warning("api::stream", "{}", this->server.get_error());
+            return;
+        }
+        log_info("api::stream", "server listening on {}port: {}", STREAM_EXTERNAL ? "" : "local ", port);
+
+        // start encoder
+        this->running = true;
+        this->encoder = std::thread([this] {
+            this->encoder_thread();
+        });
+    }
+
+    StreamController::~StreamController() {
+
+        // stop encoder
+        this->running = false;
+        if (this->encoder.joinable()) {
+            this->encoder.join();
+        }
+
+        // stop server
+        this->server.stop();
+    }
+
+    void StreamController::free_socket() {
+        this->server.close_listener();
+    }
+
+    void StreamController::encoder_thread() {
+        uint64_t sequences[capture_screen_count] {};
+        uint64_t skips[capture_screen_count] {};
+        bool pending[capture_screen_count] {};
+        size_t frame_sizes[capture_screen_count] {};
+        util::JPEGEncoder encoder;
+        CaptureOptions options;
+        options.quality = capture_quality;
+
+        while (this->running) {
+            bool active = false;
+            for (int screen = 0; screen < capture_screen_count && this->running; screen++) {
+
+                // only capture watched screens
+                if (this->server.get_subscriber_count(screen) == 0) {
+                    continue;
+                }
+                active = true;
+
+                // wait for the requested capture
+                if (!pending[screen]) {
+                    skips[screen] = graphics_capture_trigger(screen);
+                    pending[screen] = true;
+                }
+                CaptureData capture;
+                if (!graphics_capture_wait(screen, sequences[screen], skips[screen], capture, capture_timeout_ms)) {
+                    pending[screen] = false;
+                    continue;
+                }
+                sequences[screen] = capture.sequence;
+
+                // request the next frame so it gets captured while this one is encoded
+                skips[screen] = graphics_capture_trigger(screen);
+
+                // encode
+                auto frame = std::make_shared<std::vector<uint8_t>>();
+                frame->reserve(frame_sizes[screen]);
+                if (!graphics_capture_encode_jpeg(capture, options, encoder, *frame)) {
+                    continue;
+                }
+
+                // fan out to all subscribers
+                frame_sizes[screen] = frame->size();
+                this->server.publish(screen, std::move(frame));
+            }
+
+            // idle until someone is watching
+            if (!active) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(capture_timeout_ms));
+            }
+        }
+    }
+}
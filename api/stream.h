@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include "util/mjpeg_server.h"
+
+namespace api {
+
+    // also serve clients on other devices, the password is sent in plain text
+    extern bool STREAM_EXTERNAL;
+
+    /*
+     * Streams captures of the game screens as MJPEG over HTTP.
+     * Every frame gets encoded once no matter how many clients are watching.
+     */
+    class StreamController {
+    public:
+
+        StreamController(std::string password, uint16_t port);
+        ~StreamController();
+
+        void free_socket();
+
+    private:
+
+        // configuration
+        const static int server_backlog = 16;
+        const static int capture_screen_count = 4;
+        const static int capture_timeout_ms = 100;
+        const static int capture_quality = 70;
+
+        util::MJPEGServer server;
+        std::atomic<bool> running = false;
+        std::thread encoder;
+
+        void encoder_thread();
+    };
+}
@@ -0,0 +1,136 @@
+#include "subscription.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "external/rapidjson/writer.h"
+
+#include "request.h"
+
+using namespace rapidjson;
+
+namespace api {
+
+    static std::string serialize(const Value &value) {
+        StringBuffer sb;
+        Writer<StringBuffer> writer(sb);
+        value.Accept(writer);
+        return std::string(sb.GetString(), sb.GetSize());
+    }
+
+    static inline bool is_keyed_entry(const Value &value) {
+        return value.IsArray() && !value.Empty() && value[0].IsString();
+    }
+
+    Subscription::Subscription(uint64_t id, const ModuleRegistry::Entry *target, const Value &params,
+            uint32_t interval_ms, double threshold, std::vector<std::string> fields)
+        : id(id), target(target),
+          interval_ms(interval_ms), threshold(threshold), fields(std::move(fields)),
+          next_update(std::chrono::steady_clock::now())
+    {
+        this->params.CopyFrom(params, this->params.GetAllocator());
+    }
+
+    bool Subscription::update(Response &push) {
+        auto &allocator = push.doc()->GetAllocator();
+
+        // build request
+        Document document;
+        document.SetObject();
+        document.AddMember("id", Value(this->id), document.GetAllocator());
+        document.AddMember("module", StringRef(this->target->module_name.data(),
+                (SizeType) this->target->module_name.size()), document.GetAllocator());
+        document.AddMember("function", StringRef(this->target->function_name.data(),
+                (SizeType) this->target->function_name.size()), document.GetAllocator());
+        document.AddMember("params", Value(this->params, document.GetAllocator()), document.GetAllocator());
+        Request request(document);
+
+        // call function
+        Response result(this->id);
+        this->target->module->handle(this->target->function, request, result);
+
+        // forward errors once
+        bool changed = false;
+        auto &errors = result.get_errors();
+        auto errors_str = serialize(errors);
+        if (errors_str != this->last_errors) {
+            this->last_errors = std::move(errors_str);
+            for (auto &error : errors.GetArray()) {
+                Value copy(error, allocator);
+                push.add_error(copy);
+                changed = true;
+            }
+        }
+
+        // check if the result is a list of named entries
+        auto &data = result.get_data();
+        bool keyed = std::all_of(data.Begin(), data.End(), is_keyed_entry);
+        if (keyed && !data.Empty()) {
+
+            // only push the entries which changed
+            for (auto &entry : data.GetArray()) {
+                if (!this->fields.empty() && std::find(this->fields.begin(), this->fields.end(),
+                        entry[0].GetString()) == this->fields.end()) {
+                    continue;
+                }
+                if (this->update_entry(entry)) {
+                    Value copy(entry, allocator);
+                    push.add_data(copy);
+                    changed = true;
+                }
+            }
+        } else {
+
+            // push everything on change
+            auto data_str = serialize(data);
+            if (data_str != this->last_data) {
+                this->last_data = std::move(data_str);
+                for (auto &value : data.GetArray()) {
+                    Value copy(value, allocator);
+                    push.add_data(copy);
+                }
+                changed = true;
+            }
+        }
+
+        return changed;
+    }
+
+    bool Subscription::update_entry(const Value &entry) {
+
+        // split into value and the remaining fields
+        bool numeric = entry.Size() > 1 && entry[1].IsNumber();
+        double value = numeric ? entry[1].GetDouble() : 0.0;
+        std::string other;
+        for (SizeType i = numeric ? 2 : 1; i < entry.Size(); i++) {
+            other += serialize(entry[i]);
+            other += ',';
+        }
+
+        // new entry
+        auto it = this->entries.find(entry[0].GetString());
+        if (it == this->entries.end()) {
+            this->entries.emplace(entry[0].GetString(), Entry {
+                .other = std::move(other),
+                .value = value,
+                .numeric = numeric,
+            });
+            return true;
+        }
+
+        // compare to the last pushed state
+        auto &last = it->second;
+        bool changed = other != last.other || numeric != last.numeric;
+        if (!changed && numeric) {
+            auto delta = std::fabs(value - last.value);
+            changed = this->threshold > 0 ? delta >= this->threshold : delta > 0;
+        }
+        if (changed) {
+            last.other = std::move(other);
+            last.value = value;
+            last.numeric = numeric;
+        }
+        return changed;
+    }
+}
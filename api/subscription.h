@@ -0,0 +1,60 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "external/rapidjson/document.h"
+#include "external/robin_hood.h"
+
+#include "registry.h"
+#include "response.h"
+
+namespace api {
+
+    /*
+     * A function which gets polled on behalf of the client.
+     * Only the parts of the result which changed since the last push get sent.
+     */
+    class Subscription {
+    public:
+
+        // the ID of the request which created the subscription
+        uint64_t id;
+
+        // target
+        const ModuleRegistry::Entry *target;
+        rapidjson::Document params;
+
+        // settings
+        uint32_t interval_ms;
+        double threshold;
+        std::vector<std::string> fields;
+
+        // scheduling
+        std::chrono::steady_clock::time_point next_update;
+
+        Subscription(uint64_t id, const ModuleRegistry::Entry *target, const rapidjson::Value &params,
+                uint32_t interval_ms, double threshold, std::vector<std::string> fields);
+
+        bool update(Response &push);
+
+    private:
+
+        // last pushed state of an entry in the form of [name, value, ...]
+        struct Entry {
+            std::string other;
+            double value;
+            bool numeric;
+        };
+        robin_hood::unordered_map<std::string, Entry> entries;
+
+        // last pushed state of results which aren't keyed by name
+        std::string last_data;
+        std::string last_errors;
+
+        bool update_entry(const rapidjson::Value &entry);
+    };
+}
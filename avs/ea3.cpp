@@ -576,6 +576,11 @@ namespace avs {
                     avs::core::NODE_TYPE_str, url_buffer, sizeof(url_buffer));
             EA3_BOOT_URL = std::string(url_buffer);
 
+            // smartea logic: check services in the background until they're needed
+            if (easrv_smart) {
+                smartea::probe_start(EA3_BOOT_URL);
+            }
+
             // ssl initialization
             if (string_begins_with(url_buffer, "https")) {
 
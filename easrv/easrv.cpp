@@ -1,46 +1,26 @@
 #include "easrv.h"
 
-#include <sstream>
-#include <vector>
-#include <thread>
-
-#include <winsock2.h>
+#include <memory>
+#include <string>
 
 #include "avs/game.h"
-#include "avs/automap.h"
 #include "util/logging.h"
+#include "util/socket_server.h"
 #include "util/utils.h"
 
-extern "C" {
-#include "external/http-parser/http_parser.h"
-}
-
+#include "easrv_http.h"
 #include "responses/bs_info2_common.h"
 #include "responses/bs_pcb2_boot.h"
 #include "responses/bs_pcb2_error.h"
 #include "responses/op2_common_get_music_info.h"
 #include "responses/pcbtracker_alive.h"
 
-static const size_t RECEIVED_BUFFER_LENGTH = 2048*1024;
-static const size_t URL_BUFFER_SIZE = 1024;
-static const size_t HEADER_BUFFER_SIZE = 1024;
+static const size_t RECEIVE_BUFFER_SIZE = 64 * 1024;
+static const size_t SEND_BUFFER_MAX_SIZE = 4 * 1024 * 1024;
 
-static SOCKET SERVER_SOCKET;
-static bool SERVER_RUNNING;
+static std::unique_ptr<util::SocketServer> SERVER;
 static bool SERVER_MAINTENANCE;
 
-// worker state
-static thread_local char URL_BUFFER[URL_BUFFER_SIZE] {};
-static thread_local size_t URL_BUFFER_LENGTH = 0;
-static thread_local char HEADER_BUFFER[URL_BUFFER_SIZE] {};
-static thread_local size_t HEADER_BUFFER_LENGTH = 0;
-static thread_local bool HEADER_CRYPT = false;
-static thread_local enum header_state_t {
-    HS_UNKNOWN,
-    HS_EAMUSE_INFO,
-    HS_COMPRESS,
-} HEADER_STATE = HS_UNKNOWN;
-
 static std::string HTTP_DEFAULT;
 static std::string EA_HEADER;
 static std::string EA_HEADER_PLAIN;
@@ -59,381 +39,133 @@ static std::string EA_I36_SYSTEM_GETMASTER;
 static std::string EA_KGG_SYSTEM_GETMASTER;
 static std::string EA_KGG_HDKOPERATION_GET;
 
-static inline void easrv_init_messages();
-
-static int on_url(http_parser *, const char *data, size_t length) {
-
-    // prevent buffer overflow
-    if (URL_BUFFER_LENGTH + length >= URL_BUFFER_SIZE) {
-        return 1;
-    }
-
-    // append to buffer
-    memcpy(&URL_BUFFER[URL_BUFFER_LENGTH], data, length);
-    URL_BUFFER_LENGTH += length;
-    URL_BUFFER[URL_BUFFER_LENGTH] = '\0';
-    return 0;
-}
-
-static int on_header_field(http_parser *, const char *data, size_t length) {
-
-    // prevent buffer overflow
-    if (HEADER_BUFFER_LENGTH + length >= HEADER_BUFFER_SIZE) {
-        return 1;
-    }
+static EASrvResponse RESPONSE_HTTP_DEFAULT;
+static EASrvResponse RESPONSE_EMPTY;
+static EASrvResponse RESPONSE_EMPTY_CRYPT;
+static EASrvResponse RESPONSE_SERVICES_GET_FULL;
+static EASrvResponse RESPONSE_PCBTRACKER_ALIVE;
+static EASrvResponse RESPONSE_MESSAGE_GET;
+static EASrvResponse RESPONSE_MESSAGE_GET_MAINTENANCE;
+static EASrvResponse RESPONSE_FACILITY_GET;
+static EASrvResponse RESPONSE_PCBEVENT_PUT;
+static EASrvResponse RESPONSE_PACKAGE_LIST;
+static EASrvResponse RESPONSE_TAX_GET_PHASE;
+static EASrvResponse RESPONSE_EVENTLOG_WRITE;
+static EASrvResponse RESPONSE_MACHINE_GET_CONTROL;
+static EASrvResponse RESPONSE_INFO2_COMMON;
+static EASrvResponse RESPONSE_PCB2_BOOT;
+static EASrvResponse RESPONSE_PCB2_ERROR;
+static EASrvResponse RESPONSE_KGG_SYSTEM_GETMASTER;
+static EASrvResponse RESPONSE_I36_SYSTEM_GETMASTER;
+static EASrvResponse RESPONSE_KGG_HDKOPERATION_GET;
+static EASrvResponse RESPONSE_OP2_COMMON_GET_MUSIC_INFO;
+
+static EASrvRoutes ROUTES;
 
-    // append to buffer
-    memcpy(&HEADER_BUFFER[HEADER_BUFFER_LENGTH], data, length);
-    HEADER_BUFFER_LENGTH += length;
-    HEADER_BUFFER[HEADER_BUFFER_LENGTH] = '\0';
-
-    // check value
-    auto field = std::string(data, length);
-    if (field == "X-Eamuse-Info") {
-        HEADER_STATE = HS_EAMUSE_INFO;
-    } else if (field == "X-Compress") {
-        HEADER_STATE = HS_COMPRESS;
-    } else {
-        HEADER_STATE = HS_UNKNOWN;
-    }
+static inline void easrv_init_messages();
 
-    // success
-    return 0;
+static inline void easrv_build_response(EASrvResponse &response, const std::string &data, bool crypt = true) {
+    auto decoded = easrv_decode(data);
+    easrv_build_response(response, crypt ? EA_HEADER : EA_HEADER_PLAIN, decoded.data(), decoded.size());
 }
 
-static int on_header_value(http_parser *, const char *data, size_t length) {
-
-    // decide what to do with the value based on current header state
-    switch (HEADER_STATE) {
-        case HS_EAMUSE_INFO:
-            HEADER_CRYPT = true;
-        case HS_UNKNOWN:
-        default:
-            break;
-    }
-
-    // success
-    return 0;
+static inline void easrv_build_response(EASrvResponse &response,
+        const unsigned char *data, size_t size, bool crypt = true) {
+    easrv_build_response(response, crypt ? EA_HEADER : EA_HEADER_PLAIN, (const char *) data, size);
 }
 
-static inline bool check_url(const char *module, const char *method) {
-    std::string url(URL_BUFFER, URL_BUFFER_LENGTH);
-    std::ostringstream check1;
-    check1 << "module=" << module << "&method=" << method;
-    if (url.find(check1.str()) != std::string::npos) {
-        return true;
-    }
-    std::ostringstream check2;
-    check2 << '/' << module << '/' << method;
-    return url.find(check2.str()) != std::string::npos;
+static const EASrvResponse *easrv_handle_message_get(const EASrvClient &) {
+    return SERVER_MAINTENANCE ? &RESPONSE_MESSAGE_GET_MAINTENANCE : &RESPONSE_MESSAGE_GET;
 }
 
-static inline void easrv_add_data(std::vector<char> &send, const std::string &data, bool crypt = true) {
-
-    // copy header
-    if (crypt) {
-        send.reserve(EA_HEADER.size());
-
-        for (size_t i = 0; i < EA_HEADER.size(); i++) {
-            send.push_back(EA_HEADER[i]);
-        }
+static const EASrvResponse *easrv_handle_system_getmaster(const EASrvClient &client) {
+    if (avs::game::is_model("KGG")) {
+        return &RESPONSE_KGG_SYSTEM_GETMASTER;
+    } else if (avs::game::is_model("I36")) {
+        return &RESPONSE_I36_SYSTEM_GETMASTER;
     } else {
-        send.reserve(EA_HEADER_PLAIN.size());
-
-        for (size_t i = 0; i < EA_HEADER_PLAIN.size(); i++) {
-            send.push_back(EA_HEADER_PLAIN[i]);
-        }
-    }
-
-    // calculate length from encoded data because of null characters
-    // if 1 follows after 1 its a 1
-    // if 2 follows after 1 its a 0
-    bool escape = false;
-    size_t size = 0;
-    for (char c : data) {
-        if (escape) {
-            escape = false;
-            size++;
-        } else if (c == 1) {
-            escape = true;
-        } else {
-            size++;
-        }
-    }
-
-    // add content length
-    auto content_length = fmt::format("Content-Length: {}\r\n\r\n", size);
-    send.reserve(content_length.size());
-    for (char c : content_length) {
-        send.push_back(c);
-    }
-
-    // add encoded data
-    escape = false;
-    for (char c : data) {
-        if (escape) {
-            if (c == 2) {
-                c = 0;
-            }
-            escape = false;
-            send.push_back(c);
-        } else if (c == 1) {
-            escape = true;
-        } else {
-            send.push_back(c);
-        }
+        log_warning("easrv", "system.getmaster not available for this game model");
+        return client.crypt ? &RESPONSE_EMPTY_CRYPT : &RESPONSE_EMPTY;
     }
 }
 
-static inline void easrv_add_data_raw(std::vector<char> &send, const unsigned char *data, size_t size, bool crypt = true) {
+static void easrv_init_responses() {
 
-    // copy header
-    if (crypt) {
-        send.reserve(EA_HEADER.size());
-
-        for (size_t i = 0; i < EA_HEADER.size(); i++) {
-            send.push_back(EA_HEADER[i]);
-        }
-    } else {
-        send.reserve(EA_HEADER_PLAIN.size());
-
-        for (size_t i = 0; i < EA_HEADER_PLAIN.size(); i++) {
-            send.push_back(EA_HEADER_PLAIN[i]);
-        }
-    }
-
-    // add content length
-    auto content_length = fmt::format("Content-Length: {}\r\n\r\n", size);
-    send.reserve(content_length.size());
-    for (char c : content_length) {
-        send.push_back(c);
-    }
-
-    send.reserve(size);
-
-    for (size_t i = 0; i < size; i++) {
-        send.push_back(data[i]);
-    }
-}
-
-static SOCKET easrv_worker_method() {
-
-    // get connection
-    sockaddr_in client_address;
-    int socket_in_size = sizeof(sockaddr_in);
-    SOCKET connected = accept(SERVER_SOCKET, (sockaddr *) &client_address, &socket_in_size);
-    if (connected == INVALID_SOCKET) {
-        return connected;
-    }
-
-    // receive data
-    std::vector<char> received(RECEIVED_BUFFER_LENGTH);
-    int received_length = recv(connected, &received[0], received.size(), 0);
-    if (received_length == -1) {
-        return connected;
-    }
-
-    // create parser
-    http_parser parser {};
-    http_parser_init(&parser, HTTP_REQUEST);
-
-    // reset state
-    URL_BUFFER_LENGTH = 0;
-    URL_BUFFER[0] = 0x00;
-    HEADER_BUFFER_LENGTH = 0;
-    HEADER_BUFFER[0] = 0x00;
-    HEADER_STATE = HS_UNKNOWN;
-
-    // parser settings
-    http_parser_settings parser_settings;
-    http_parser_settings_init(&parser_settings);
-    parser_settings.on_url = on_url;
-    parser_settings.on_header_field = on_header_field;
-    parser_settings.on_header_value = on_header_value;
-
-    // execute
-    size_t parsed_length = http_parser_execute(&parser, &parser_settings, &received[0], (size_t) received_length);
-    if (parsed_length != (size_t) received_length)
-        return connected;
-
-    // check if protocol is changed
-    if (parser.upgrade)
-        return connected;
-
-    // check for unsupported method
-    if (parser.method != HTTP_GET && parser.method != HTTP_POST)
-        return connected;
-
-    // send data
-    std::vector<char> send_data;
-    switch (parser.method) {
-        case HTTP_GET: {
-
-            // this is probably a browser, so display the HTTP default message
-            for (size_t i = 0; i < HTTP_DEFAULT.size(); i++) {
-                send_data.push_back(HTTP_DEFAULT[i]);
-            }
-            break;
-        }
-        case HTTP_POST: {
-
-            // services
-            if (check_url("services", "get")) {
-                easrv_add_data(send_data, EA_SERVICES_GET_FULL);
-            } else if (check_url("pcbtracker", "alive")) {
-                easrv_add_data_raw(
-                        send_data,
-                        PCBTRACKER_ALIVE_BIN,
-                        PCBTRACKER_ALIVE_BIN_LEN
-                );
-            } else if (check_url("message", "get")) {
-                if (SERVER_MAINTENANCE) {
-                    easrv_add_data(send_data, EA_MESSAGE_GET_MAINTENANCE);
-                } else {
-                    easrv_add_data(send_data, EA_MESSAGE_GET);
-                }
-            } else if (check_url("facility", "get")) {
-                easrv_add_data(send_data, EA_FACILITY_GET);
-            } else if (check_url("pcbevent", "put")) {
-                easrv_add_data(send_data, EA_PCBEVENT_PUT);
-            } else if (check_url("package", "list")) {
-                easrv_add_data(send_data, EA_PACKAGE_LIST, false);
-            } else if (check_url("tax", "get_phase")) {
-                easrv_add_data(send_data, EA_TAX_GET_PHASE);
-            } else if (check_url("eventlog", "write")) {
-                easrv_add_data(send_data, EA_EVENTLOG_WRITE);
-            } else if (check_url("machine", "get_control")) {
-                easrv_add_data(send_data, EA_MACHINE_GET_CONTROL);
-            } else if (check_url("info2", "common")) {
-                easrv_add_data_raw(
-                        send_data,
-                        BS_INFO2_COMMON_BIN,
-                        BS_INFO2_COMMON_BIN_LEN,
-                        false
-                );
-            } else if (check_url("pcb2", "boot")) {
-                easrv_add_data_raw(
-                        send_data,
-                        BS_PCB2_BOOT_BIN,
-                        BS_PCB2_BOOT_BIN_LEN,
-                        false
-                );
-            } else if (check_url("pcb2", "error")) {
-                easrv_add_data_raw(
-                        send_data,
-                        BS_PCB2_ERROR_BIN,
-                        BS_PCB2_ERROR_BIN_LEN,
-                        false
-                );
-            } else if (check_url("system", "getmaster")) {
-                if (avs::game::is_model("KGG")) {
-                    easrv_add_data(send_data, EA_KGG_SYSTEM_GETMASTER);
-                } else if (avs::game::is_model("I36")) {
-                    easrv_add_data(send_data, EA_I36_SYSTEM_GETMASTER);
-                } else {
-                    log_warning("easrv", "system.getmaster not available for this game model");
-                    easrv_add_data(send_data, HEADER_CRYPT ? EA_EMPTY_CRYPT : EA_EMPTY);
-                }
-            } else if (check_url("hdkoperation", "get")) {
-                easrv_add_data(send_data, EA_KGG_HDKOPERATION_GET);
-            } else if (check_url("op2_common", "get_music_info")) {
-                easrv_add_data_raw(
-                        send_data,
-                        OP2_COMMON_GET_MUSIC_INFO_BIN,
-                        OP2_COMMON_GET_MUSIC_INFO_BIN_LEN
-                );
-            } else if (string_begins_with(std::string(URL_BUFFER), "//")) {
-                log_warning("easrv", "unknown URL: {}", std::string(URL_BUFFER, URL_BUFFER_LENGTH));
-                easrv_add_data(send_data, HEADER_CRYPT ? EA_EMPTY_CRYPT : EA_EMPTY);
-            }
-            break;
-        }
-        default:
-            return connected;
-    }
-
-    // send data
-    const char *send_ptr = send_data.data();
-    auto send_size = send_data.size();
-    while (send_size > 0) {
-        int bytes_sent = send(connected, send_ptr, send_size, 0);
-        if (bytes_sent == SOCKET_ERROR) {
-            return connected;
-        } else if (bytes_sent > 0) {
-            send_size -= bytes_sent;
-            send_ptr += bytes_sent;
-        } else {
-            return connected;
-        }
-    }
-
-    // flush data
-    shutdown(connected, SD_SEND);
-
-    // exit
-    return connected;
-}
-
-static void easrv_worker() {
-
-    // exit when running flag is cleared
-    while (SERVER_RUNNING) {
-
-        // call worker method and close socket afterwards
-        SOCKET connected = easrv_worker_method();
-        if (connected != INVALID_SOCKET) {
-            closesocket(connected);
-        }
-    }
+    // decode and encode all responses once
+    easrv_build_response(RESPONSE_HTTP_DEFAULT,
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Type: text/html\r\n",
+            HTTP_DEFAULT.data(), HTTP_DEFAULT.size());
+    easrv_build_response(RESPONSE_EMPTY, EA_EMPTY);
+    easrv_build_response(RESPONSE_EMPTY_CRYPT, EA_EMPTY_CRYPT);
+    easrv_build_response(RESPONSE_SERVICES_GET_FULL, EA_SERVICES_GET_FULL);
+    easrv_build_response(RESPONSE_PCBTRACKER_ALIVE, PCBTRACKER_ALIVE_BIN, PCBTRACKER_ALIVE_BIN_LEN);
+    easrv_build_response(RESPONSE_MESSAGE_GET, EA_MESSAGE_GET);
+    easrv_build_response(RESPONSE_MESSAGE_GET_MAINTENANCE, EA_MESSAGE_GET_MAINTENANCE);
+    easrv_build_response(RESPONSE_FACILITY_GET, EA_FACILITY_GET);
+    easrv_build_response(RESPONSE_PCBEVENT_PUT, EA_PCBEVENT_PUT);
+    easrv_build_response(RESPONSE_PACKAGE_LIST, EA_PACKAGE_LIST, false);
+    easrv_build_response(RESPONSE_TAX_GET_PHASE, EA_TAX_GET_PHASE);
+    easrv_build_response(RESPONSE_EVENTLOG_WRITE, EA_EVENTLOG_WRITE);
+    easrv_build_response(RESPONSE_MACHINE_GET_CONTROL, EA_MACHINE_GET_CONTROL);
+    easrv_build_response(RESPONSE_INFO2_COMMON, BS_INFO2_COMMON_BIN, BS_INFO2_COMMON_BIN_LEN, false);
+    easrv_build_response(RESPONSE_PCB2_BOOT, BS_PCB2_BOOT_BIN, BS_PCB2_BOOT_BIN_LEN, false);
+    easrv_build_response(RESPONSE_PCB2_ERROR, BS_PCB2_ERROR_BIN, BS_PCB2_ERROR_BIN_LEN, false);
+    easrv_build_response(RESPONSE_KGG_SYSTEM_GETMASTER, EA_KGG_SYSTEM_GETMASTER);
+    easrv_build_response(RESPONSE_I36_SYSTEM_GETMASTER, EA_I36_SYSTEM_GETMASTER);
+    easrv_build_response(RESPONSE_KGG_HDKOPERATION_GET, EA_KGG_HDKOPERATION_GET);
+    easrv_build_response(RESPONSE_OP2_COMMON_GET_MUSIC_INFO,
+            OP2_COMMON_GET_MUSIC_INFO_BIN, OP2_COMMON_GET_MUSIC_INFO_BIN_LEN);
+
+    // build routes
+    ROUTES = EASrvRoutes {};
+    ROUTES.http_default = &RESPONSE_HTTP_DEFAULT;
+    ROUTES.empty = &RESPONSE_EMPTY;
+    ROUTES.empty_crypt = &RESPONSE_EMPTY_CRYPT;
+    easrv_add_route(ROUTES, "services", "get", &RESPONSE_SERVICES_GET_FULL);
+    easrv_add_route(ROUTES, "pcbtracker", "alive", &RESPONSE_PCBTRACKER_ALIVE);
+    easrv_add_route(ROUTES, "message", "get", nullptr, easrv_handle_message_get);
+    easrv_add_route(ROUTES, "facility", "get", &RESPONSE_FACILITY_GET);
+    easrv_add_route(ROUTES, "pcbevent", "put", &RESPONSE_PCBEVENT_PUT);
+    easrv_add_route(ROUTES, "package", "list", &RESPONSE_PACKAGE_LIST);
+    easrv_add_route(ROUTES, "tax", "get_phase", &RESPONSE_TAX_GET_PHASE);
+    easrv_add_route(ROUTES, "eventlog", "write", &RESPONSE_EVENTLOG_WRITE);
+    easrv_add_route(ROUTES, "machine", "get_control", &RESPONSE_MACHINE_GET_CONTROL);
+    easrv_add_route(ROUTES, "info2", "common", &RESPONSE_INFO2_COMMON);
+    easrv_add_route(ROUTES, "pcb2", "boot", &RESPONSE_PCB2_BOOT);
+    easrv_add_route(ROUTES, "pcb2", "error", &RESPONSE_PCB2_ERROR);
+    easrv_add_route(ROUTES, "system", "getmaster", nullptr, easrv_handle_system_getmaster);
+    easrv_add_route(ROUTES, "hdkoperation", "get", &RESPONSE_KGG_HDKOPERATION_GET);
+    easrv_add_route(ROUTES, "op2_common", "get_music_info", &RESPONSE_OP2_COMMON_GET_MUSIC_INFO);
 }
 
 void easrv_start(unsigned short port, bool maintenance, int backlog, int thread_count) {
 
+#ifdef _WIN32
+
     // WSA startup
     WSADATA wsa_data;
     int error;
     if ((error = WSAStartup(MAKEWORD(2, 2), &wsa_data)) != 0) {
         log_fatal("easrv", "WSAStartup returned {}", error);
     }
-
-    // create socket
-    SERVER_SOCKET = socket(AF_INET, SOCK_STREAM, 0);
-    if (SERVER_SOCKET == INVALID_SOCKET) {
-        log_fatal("easrv", "could not create socket");
-    }
-
-    // configure socket
-    if (setsockopt(SERVER_SOCKET, SOL_SOCKET, SO_REUSEADDR, (const char *) &error, sizeof(int)) == -1) {
-        log_fatal("easrv", "could not set socket options");
-    }
-
-    // create address
-    sockaddr_in server_address;
-    server_address.sin_family = AF_INET;
-    server_address.sin_port = htons(port);
-    server_address.sin_addr.s_addr = INADDR_ANY;
-    memset(&server_address.sin_zero, 0, sizeof(server_address.sin_zero));
-
-    // bind socket to address
-    if (bind(SERVER_SOCKET, (sockaddr *) &server_address, sizeof(sockaddr)) == -1) {
-        log_fatal("easrv", "Could not bind socket. The port might be blocked, try restarting your PC or stopping background programs");
-    }
-
-    // set socket to listen
-    if (listen(SERVER_SOCKET, backlog) == -1) {
-        log_fatal("easrv", "could not listen to socket");
-    }
+#endif
 
     // set server maintenance
     SERVER_MAINTENANCE = maintenance;
 
     // init messages
     easrv_init_messages();
+    easrv_init_responses();
+
+    // create server, the I/O threads share all connections
+    SERVER = std::make_unique<util::SocketServer>(thread_count, RECEIVE_BUFFER_SIZE, SEND_BUFFER_MAX_SIZE);
+    easrv_serve(*SERVER, ROUTES);
 
-    // create workers
-    SERVER_RUNNING = true;
-    for (int i = 0; i < thread_count; i++) {
-        new std::thread(easrv_worker);
+    // start listening, the game might connect through the network adapter address
+    if (!SERVER->listen(port, backlog, true)) {
+        log_warning("easrv", "{}", SERVER->get_error());
+        log_fatal("easrv", "Could not bind socket. The port might be blocked, try restarting your PC or stopping background programs");
     }
 
     // information
@@ -443,25 +175,20 @@ void easrv_start(unsigned short port, bool maintenance, int backlog, int thread_
 void easrv_shutdown() {
 
     // don't shutdown if not running
-    if (!SERVER_RUNNING) {
+    if (!SERVER || !SERVER->is_running()) {
         return;
     }
 
-    // set running to false
-    SERVER_RUNNING = false;
-    closesocket(SERVER_SOCKET);
+    // stop and join the I/O threads
+    SERVER->stop();
 
-    // give workers time to exit
-    Sleep(100);
+    // free pooled clients
+    easrv_free_clients();
 }
 
 static inline void easrv_init_messages() {
     HTTP_DEFAULT = std::string(
-            "HTTP/1.1 200 OK\r\n"
-            "Content-Type: text/html\r\n"
-            "Content-Length: 204\r\n"
-            "Connection: close\r\n"
-            "\r\n<HTML><HEAD><TITLE>SpiceTools EASRV</TITLE></HEAD>"
+            "<HTML><HEAD><TITLE>SpiceTools EASRV</TITLE></HEAD>"
             "<BODY><H1>SpiceTools EASRV</H1>\r\n<IMG src="
             "\"https://upload.wikimedia.org/wikipedia/commons/thumb/1/19/Felfel-e_t.JPG/800px-Felfel-e_t.JPG\""
             "></BODY></HTML>"
@@ -472,14 +199,12 @@ static inline void easrv_init_messages() {
             "Server: SpiceTools\r\n"
             "X-Eamuse-Info: 1-53d121c7-a8b3\r\n"
             "X-Compress: none\r\n"
-            "Connection: close\r\n"
     );
     EA_HEADER_PLAIN = std::string(
             "HTTP/1.1 200 OK\r\n"
             "Content-Type: application/octet-stream\r\n"
             "Server: SpiceTools\r\n"
             "X-Compress: none\r\n"
-            "Connection: close\r\n"
     );
     EA_EMPTY = std::string(
             "\xA0\x42\x80\x7F\x01\x02\x01\x02\x01\x02\x10\x01\x01\x08\xDE\xAE\x35\xD3\x3E\x2A\x01\x01\x04\xA6\x6E\x66"
@@ -0,0 +1,397 @@
+#include "easrv_http.h"
+
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include "util/logging.h"
+#include "util/utils.h"
+
+static const size_t CONNECTIONS_MAX = 256;
+static const int KEEP_ALIVE_TIMEOUT_MS = 30000;
+
+// clients are recycled so reconnecting games don't allocate
+static std::mutex CLIENT_POOL_M;
+static std::vector<EASrvClient *> CLIENT_POOL;
+
+static int on_message_begin(http_parser *parser) {
+    auto client = reinterpret_cast<EASrvClient *>(parser->data);
+
+    // reset request state
+    client->url_length = 0;
+    client->url[0] = 0x00;
+    client->header_length = 0;
+    client->header[0] = 0x00;
+    client->header_value = false;
+    client->header_state = HS_UNKNOWN;
+    client->crypt = false;
+    client->body_length = 0;
+    return 0;
+}
+
+static int on_url(http_parser *parser, const char *data, size_t length) {
+    auto client = reinterpret_cast<EASrvClient *>(parser->data);
+
+    // prevent buffer overflow
+    if (client->url_length + length >= EASRV_URL_BUFFER_SIZE) {
+        return 1;
+    }
+
+    // append to buffer
+    memcpy(&client->url[client->url_length], data, length);
+    client->url_length += length;
+    client->url[client->url_length] = '\0';
+    return 0;
+}
+
+static int on_header_field(http_parser *parser, const char *data, size_t length) {
+    auto client = reinterpret_cast<EASrvClient *>(parser->data);
+
+    // a new field starts after a value
+    if (client->header_value) {
+        client->header_value = false;
+        client->header_length = 0;
+    }
+
+    // prevent buffer overflow
+    if (client->header_length + length >= EASRV_HEADER_BUFFER_SIZE) {
+        return 1;
+    }
+
+    // append to buffer, the field might be split across reads
+    memcpy(&client->header[client->header_length], data, length);
+    client->header_length += length;
+    client->header[client->header_length] = '\0';
+    return 0;
+}
+
+static int on_header_value(http_parser *parser, const char *, size_t) {
+    auto client = reinterpret_cast<EASrvClient *>(parser->data);
+
+    // check field once it is complete
+    if (!client->header_value) {
+        client->header_value = true;
+        if (_stricmp(client->header, "X-Eamuse-Info") == 0) {
+            client->header_state = HS_EAMUSE_INFO;
+        } else if (_stricmp(client->header, "X-Compress") == 0) {
+            client->header_state = HS_COMPRESS;
+        } else {
+            client->header_state = HS_UNKNOWN;
+        }
+    }
+
+    // decide what to do with the value based on current header state
+    switch (client->header_state) {
+        case HS_EAMUSE_INFO:
+            client->crypt = true;
+        case HS_UNKNOWN:
+        default:
+            break;
+    }
+
+    // success
+    return 0;
+}
+
+static int on_body(http_parser *parser, const char *, size_t length) {
+    auto client = reinterpret_cast<EASrvClient *>(parser->data);
+
+    // the body isn't needed for the canned responses, only limit its size
+    client->body_length += length;
+    return client->body_length > EASRV_REQUEST_BODY_MAX_SIZE ? 1 : 0;
+}
+
+static int on_message_complete(http_parser *parser) {
+    auto client = reinterpret_cast<EASrvClient *>(parser->data);
+
+    // check if protocol is changed
+    if (parser->upgrade) {
+        return 1;
+    }
+
+    // check for unsupported method
+    if (parser->method != HTTP_GET && parser->method != HTTP_POST) {
+        return 1;
+    }
+
+    // answer request, requests without a response end the connection
+    client->keep_alive = http_should_keep_alive(parser) != 0;
+    auto response = easrv_select_response(*client);
+    if (response == nullptr) {
+        client->keep_alive = false;
+        return 1;
+    }
+    client->send(*client, client->keep_alive ? response->keep_alive : response->close);
+
+    // stop parsing if the connection is going to be closed
+    return client->keep_alive ? 0 : 1;
+}
+
+static const http_parser_settings &parser_settings() {
+    static const http_parser_settings SETTINGS = [] {
+        http_parser_settings settings;
+        http_parser_settings_init(&settings);
+        settings.on_message_begin = on_message_begin;
+        settings.on_url = on_url;
+        settings.on_header_field = on_header_field;
+        settings.on_header_value = on_header_value;
+        settings.on_body = on_body;
+        settings.on_message_complete = on_message_complete;
+        return settings;
+    }();
+    return SETTINGS;
+}
+
+std::string easrv_decode(const std::string &data) {
+
+    // the canned messages are escaped because of null characters
+    // if 1 follows after 1 its a 1
+    // if 2 follows after 1 its a 0
+    std::string decoded;
+    decoded.reserve(data.size());
+    bool escape = false;
+    for (char c : data) {
+        if (escape) {
+            if (c == 2) {
+                c = 0;
+            }
+            escape = false;
+            decoded.push_back(c);
+        } else if (c == 1) {
+            escape = true;
+        } else {
+            decoded.push_back(c);
+        }
+    }
+    return decoded;
+}
+
+void easrv_build_response(EASrvResponse &response, const std::string &header, const char *data, size_t size) {
+
+    // build both connection variants so requests only have to pick one
+    for (auto keep_alive : { true, false }) {
+        auto &message = keep_alive ? response.keep_alive : response.close;
+        message = header;
+        message += fmt::format("Connection: {}\r\nContent-Length: {}\r\n\r\n",
+                keep_alive ? "keep-alive" : "close", size);
+        message.append(data, size);
+    }
+}
+
+static inline uint32_t easrv_route_hash(std::string_view module, std::string_view method) {
+
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (auto c : module) {
+        hash = (hash ^ (uint8_t) c) * 16777619u;
+    }
+    hash = (hash ^ (uint8_t) '.') * 16777619u;
+    for (auto c : method) {
+        hash = (hash ^ (uint8_t) c) * 16777619u;
+    }
+    return hash;
+}
+
+void easrv_add_route(EASrvRoutes &routes, std::string_view module, std::string_view method,
+        const EASrvResponse *response, const EASrvResponse *(*handler)(const EASrvClient &)) {
+
+    // linear probing, the table is a lot larger than the route count
+    auto slot = easrv_route_hash(module, method) & (EASRV_ROUTE_TABLE_SIZE - 1);
+    while (routes.routes[slot].module.data() != nullptr) {
+        slot = (slot + 1) & (EASRV_ROUTE_TABLE_SIZE - 1);
+    }
+    routes.routes[slot] = EASrvRoute {
+        .module = module,
+        .method = method,
+        .response = response,
+        .handler = handler,
+    };
+}
+
+const EASrvRoute *easrv_find_route(const EASrvRoutes &routes, std::string_view module, std::string_view method) {
+    auto slot = easrv_route_hash(module, method) & (EASRV_ROUTE_TABLE_SIZE - 1);
+    while (routes.routes[slot].module.data() != nullptr) {
+        auto &route = routes.routes[slot];
+        if (route.module == module && route.method == method) {
+            return &route;
+        }
+        slot = (slot + 1) & (EASRV_ROUTE_TABLE_SIZE - 1);
+    }
+    return nullptr;
+}
+
+static inline std::string_view easrv_query_value(std::string_view query, std::string_view name) {
+
+    // find parameter at the start or after a separator
+    size_t pos = 0;
+    while ((pos = query.find(name, pos)) != std::string_view::npos) {
+        if ((pos == 0 || query[pos - 1] == '&' || query[pos - 1] == '?')
+        && pos + name.size() < query.size() && query[pos + name.size()] == '=') {
+            auto value = query.substr(pos + name.size() + 1);
+            return value.substr(0, value.find('&'));
+        }
+        pos += name.size();
+    }
+    return {};
+}
+
+void easrv_parse_url(std::string_view url, std::string_view &module, std::string_view &method) {
+
+    // query style: /?model=...&module=...&method=...
+    auto query_start = url.find('?');
+    if (query_start != std::string_view::npos) {
+        auto query = url.substr(query_start + 1);
+        module = easrv_query_value(query, "module");
+        method = easrv_query_value(query, "method");
+        if (!module.empty() && !method.empty()) {
+            return;
+        }
+    }
+
+    // path style: /.../module/method
+    auto path = url.substr(0, query_start);
+    while (!path.empty() && path.back() == '/') {
+        path.remove_suffix(1);
+    }
+    auto method_start = path.rfind('/');
+    if (method_start == std::string_view::npos || method_start == 0) {
+        module = method = {};
+        return;
+    }
+    method = path.substr(method_start + 1);
+    path = path.substr(0, method_start);
+    module = path.substr(path.rfind('/') + 1);
+}
+
+const EASrvResponse *easrv_select_response(const EASrvClient &client) {
+    auto &routes = *client.routes;
+    switch (client.parser.method) {
+        case HTTP_GET: {
+
+            // this is probably a browser, so display the HTTP default message
+            return routes.http_default;
+        }
+        case HTTP_POST: {
+
+            // look up route
+            std::string_view url(client.url, client.url_length);
+            std::string_view module, method;
+            easrv_parse_url(url, module, method);
+            auto route = easrv_find_route(routes, module, method);
+            if (route != nullptr) {
+                return route->handler ? route->handler(client) : route->response;
+            } else if (url.substr(0, 2) == "//") {
+                log_warning("easrv", "unknown URL: {}", url);
+                return client.crypt ? routes.empty_crypt : routes.empty;
+            }
+            return nullptr;
+        }
+        default:
+            return nullptr;
+    }
+}
+
+void easrv_client_init(EASrvClient &client, const EASrvRoutes &routes,
+        void (*send)(EASrvClient &client, const std::string &message), void *user) {
+    client.routes = &routes;
+    client.send = send;
+    client.user = user;
+    client.keep_alive = true;
+    client.last_activity = std::chrono::steady_clock::now();
+    http_parser_init(&client.parser, HTTP_REQUEST);
+    client.parser.data = &client;
+}
+
+bool easrv_client_receive(EASrvClient &client, const char *data, size_t size) {
+
+    // ignore anything after the last response
+    if (!client.keep_alive) {
+        return false;
+    }
+    client.last_activity = std::chrono::steady_clock::now();
+
+    // parse what we got so far, requests may be split across reads or pipelined
+    size_t parsed_length = http_parser_execute(&client.parser, &parser_settings(), data, size);
+    if (parsed_length != size || HTTP_PARSER_ERRNO(&client.parser) != HPE_OK) {
+        client.keep_alive = false;
+    }
+    return client.keep_alive;
+}
+
+static void easrv_connection_send(EASrvClient &client, const std::string &message) {
+
+    // send straight from the shared buffer, the server only copies what can't be sent right away
+    auto server = reinterpret_cast<util::SocketServer *>(client.user);
+    server->send(*client.connection, message.data(), message.size());
+}
+
+void easrv_serve(util::SocketServer &server, const EASrvRoutes &routes) {
+    server.on_connect = [&server, &routes] (util::SocketServer::Connection &connection) {
+
+        // bound concurrency
+        if (server.get_connection_count() >= CONNECTIONS_MAX) {
+            return false;
+        }
+
+        // get client from pool
+        EASrvClient *client = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(CLIENT_POOL_M);
+            if (!CLIENT_POOL.empty()) {
+                client = CLIENT_POOL.back();
+                CLIENT_POOL.pop_back();
+            }
+        }
+        if (client == nullptr) {
+            client = new EASrvClient();
+        }
+
+        // init client
+        easrv_client_init(*client, routes, easrv_connection_send, &server);
+        client->connection = &connection;
+        connection.tick_deadline = client->last_activity + std::chrono::milliseconds(KEEP_ALIVE_TIMEOUT_MS);
+        connection.user = client;
+        return true;
+    };
+    server.on_receive = [] (util::SocketServer::Connection &connection, char *data, size_t size) {
+        auto client = reinterpret_cast<EASrvClient *>(connection.user);
+
+        // close once the response is out
+        if (!easrv_client_receive(*client, data, size)) {
+            connection.close_on_flush = true;
+        }
+    };
+    server.on_disconnect = [] (util::SocketServer::Connection &connection) {
+        auto client = reinterpret_cast<EASrvClient *>(connection.user);
+        connection.user = nullptr;
+
+        // return client to pool
+        client->connection = nullptr;
+        std::lock_guard<std::mutex> lock(CLIENT_POOL_M);
+        if (CLIENT_POOL.size() < CONNECTIONS_MAX) {
+            CLIENT_POOL.push_back(client);
+        } else {
+            delete client;
+        }
+    };
+    server.on_tick = [] (util::SocketServer::Connection &connection) {
+        auto client = reinterpret_cast<EASrvClient *>(connection.user);
+
+        // close idle connections
+        auto idle = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - client->last_activity).count();
+        if (idle >= KEEP_ALIVE_TIMEOUT_MS) {
+            connection.close = true;
+            return -1;
+        }
+        return KEEP_ALIVE_TIMEOUT_MS - (int) idle;
+    };
+}
+
+void easrv_free_clients() {
+    std::lock_guard<std::mutex> lock(CLIENT_POOL_M);
+    for (auto client : CLIENT_POOL) {
+        delete client;
+    }
+    CLIENT_POOL.clear();
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+extern "C" {
+#include "external/http-parser/http_parser.h"
+}
+
+#include "util/socket_server.h"
+
+/*
+ * Request parsing and routing of the EA server, apart from the canned messages and the game specific handlers.
+ * Requests may be split across reads or pipelined, every complete request is answered before the next is parsed.
+ */
+
+static const size_t EASRV_URL_BUFFER_SIZE = 1024;
+static const size_t EASRV_HEADER_BUFFER_SIZE = 1024;
+static const size_t EASRV_REQUEST_BODY_MAX_SIZE = 2048 * 1024;
+static const size_t EASRV_ROUTE_TABLE_SIZE = 64;
+
+// complete HTTP responses, built once on start and shared by all connections
+struct EASrvResponse {
+    std::string keep_alive;
+    std::string close;
+};
+
+// client state
+enum header_state_t {
+    HS_UNKNOWN,
+    HS_EAMUSE_INFO,
+    HS_COMPRESS,
+};
+struct EASrvRoutes;
+struct EASrvClient {
+    util::SocketServer::Connection *connection = nullptr;
+    http_parser parser {};
+    char url[EASRV_URL_BUFFER_SIZE] {};
+    size_t url_length = 0;
+    char header[EASRV_HEADER_BUFFER_SIZE] {};
+    size_t header_length = 0;
+    bool header_value = false;
+    header_state_t header_state = HS_UNKNOWN;
+    bool crypt = false;
+    bool keep_alive = false;
+    size_t body_length = 0;
+    std::chrono::steady_clock::time_point last_activity;
+
+    // where responses come from and go to
+    const EASrvRoutes *routes = nullptr;
+    void (*send)(EASrvClient &client, const std::string &message) = nullptr;
+    void *user = nullptr;
+};
+
+// (module, method) dispatch table
+struct EASrvRoute {
+    std::string_view module;
+    std::string_view method;
+    const EASrvResponse *response = nullptr;
+
+    // for responses which depend on the game or request
+    const EASrvResponse *(*handler)(const EASrvClient &) = nullptr;
+};
+struct EASrvRoutes {
+    EASrvRoute routes[EASRV_ROUTE_TABLE_SIZE];
+
+    // answers to browsers, and to requests for unknown EA URLs
+    const EASrvResponse *http_default = nullptr;
+    const EASrvResponse *empty = nullptr;
+    const EASrvResponse *empty_crypt = nullptr;
+};
+
+/*
+ * Unescapes a canned message, null bytes are stored as 1 2 and ones as 1 1.
+ */
+std::string easrv_decode(const std::string &data);
+void easrv_build_response(EASrvResponse &response, const std::string &header, const char *data, size_t size);
+void easrv_add_route(EASrvRoutes &routes, std::string_view module, std::string_view method,
+        const EASrvResponse *response, const EASrvResponse *(*handler)(const EASrvClient &) = nullptr);
+const EASrvRoute *easrv_find_route(const EASrvRoutes &routes, std::string_view module, std::string_view method);
+void easrv_parse_url(std::string_view url, std::string_view &module, std::string_view &method);
+
+/*
+ * Picks the response for the request the client just completed, or nullptr to close the connection.
+ */
+const EASrvResponse *easrv_select_response(const EASrvClient &client);
+
+/*
+ * Starts a new connection, responses are passed to send.
+ */
+void easrv_client_init(EASrvClient &client, const EASrvRoutes &routes,
+        void (*send)(EASrvClient &client, const std::string &message), void *user);
+
+/*
+ * Parses received data and answers every request completed by it.
+ * Returns false if the connection has to be closed once the responses are out.
+ */
+bool easrv_client_receive(EASrvClient &client, const char *data, size_t size);
+
+/*
+ * Serves the routes on the server, with the clients pooled over all connections.
+ */
+void easrv_serve(util::SocketServer &server, const EASrvRoutes &routes);
+void easrv_free_clients();
@@ -1,85 +1,480 @@
 #include "smartea.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
 #include <winsock2.h>
 #include <ws2tcpip.h>
-#include "util/utils.h"
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#endif
+
+#include "util/fileutils.h"
 #include "util/logging.h"
+#include "util/utils.h"
+
+#ifdef _WIN32
+typedef SOCKET socket_t;
+typedef int socklen_t;
+#else
+typedef int socket_t;
+#define INVALID_SOCKET (-1)
+#define SOCKET_ERROR (-1)
+#define closesocket close
+#endif
+
+static inline bool socket_in_progress() {
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EINPROGRESS;
+#endif
+}
+
+static inline bool socket_set_nonblocking(socket_t socket) {
+#ifdef _WIN32
+    u_long mode = 1;
+    return ioctlsocket(socket, FIONBIO, &mode) == 0;
+#else
+    int flags = fcntl(socket, F_GETFL, 0);
+    return flags != -1 && fcntl(socket, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
 
 namespace smartea {
 
-    bool check_url(std::string url) {
+    // settings
+    int RESOLVE_TIMEOUT_MS = 2000;
+    int CONNECT_TIMEOUT_MS = 2000;
+    std::string CACHE_PATH;
 
-        // WSA startup
-        WSADATA wsa_data;
-        int error;
-        if ((error = WSAStartup(MAKEWORD(2, 2), &wsa_data)) != 0) {
-            log_fatal("smartea", "WSAStartup returned {}", error);
-        }
+    // delay between starting connection attempts, as recommended by RFC 8305
+    static const auto ATTEMPT_DELAY = std::chrono::milliseconds(250);
 
-        // create hints
-        addrinfo hints;
-        ZeroMemory(&hints, sizeof(hints));
-        hints.ai_family = AF_UNSPEC;
-        hints.ai_socktype = SOCK_STREAM;
-        hints.ai_protocol = IPPROTO_TCP;
+    // while resolving, connection attempts are checked in small steps to pick up new addresses
+    static const auto RESOLVE_POLL = std::chrono::milliseconds(10);
+
+    typedef std::chrono::steady_clock clock;
+
+    struct Address {
+        sockaddr_storage storage {};
+        socklen_t length = 0;
+    };
+
+    struct ResolveState {
+        std::mutex m;
+        std::condition_variable cv;
+        bool done = false;
+        std::vector<Address> addresses;
+    };
+
+    struct Attempt {
+        socket_t socket;
+        size_t address;
+        clock::time_point deadline;
+    };
+
+    // current probe
+    static std::mutex PROBE_M;
+    static std::string PROBE_URL;
+    static std::shared_future<bool> PROBE_RESULT;
+
+    // serializes cache file access of probes for different URLs
+    static std::mutex CACHE_M;
+
+    static bool parse_url(const std::string &url, std::string &host, std::string &port) {
 
         // get port
         std::vector<std::string> url_split;
         strsplit(url, url_split, ':');
-        int port = 80;
-        if (url_split.size() >= 2 && string_begins_with(url_split[0], "http"))
+        port = "80";
+        if (url_split.size() >= 2 && string_begins_with(url_split[0], "http")) {
             url_split.erase(std::begin(url_split));
-        while (url_split.size() >= 1 && url_split[0].length() > 0 && url_split[0][0] == '/')
+        }
+        while (!url_split.empty() && !url_split[0].empty() && url_split[0][0] == '/') {
             url_split[0] = url_split[0].substr(1);
-        if (url_split.size() >= 2)
-            port = strtol(url_split[1].c_str(), nullptr, 10);
+        }
+        if (url_split.empty()) {
+            return false;
+        }
+        if (url_split.size() >= 2) {
+            port = std::to_string(strtol(url_split[1].c_str(), nullptr, 10));
+        }
 
         // remove path from host
-        auto host_slash = url_split[0].find("/");
-        if (host_slash != std::string::npos) {
-            url_split[0] = url_split[0].substr(0, host_slash);
+        host = url_split[0].substr(0, url_split[0].find('/'));
+        return !host.empty();
+    }
+
+    static std::vector<Address> to_addresses(addrinfo *info) {
+        std::vector<Address> addresses;
+        for (auto ptr = info; ptr != nullptr; ptr = ptr->ai_next) {
+            if (ptr->ai_addrlen > sizeof(sockaddr_storage)) {
+                continue;
+            }
+            Address address;
+            memcpy(&address.storage, ptr->ai_addr, ptr->ai_addrlen);
+            address.length = (socklen_t) ptr->ai_addrlen;
+            addresses.emplace_back(address);
+        }
+        return addresses;
+    }
+
+    static std::string address_to_string(const Address &address) {
+        char host[NI_MAXHOST] {};
+        char port[NI_MAXSERV] {};
+        if (getnameinfo((const sockaddr *) &address.storage, address.length,
+                host, sizeof(host), port, sizeof(port), NI_NUMERICHOST | NI_NUMERICSERV) != 0) {
+            return std::string();
+        }
+        return std::string(host) + " " + port;
+    }
+
+    static std::optional<Address> address_from_string(const std::string &host, const std::string &port) {
+
+        // numeric addresses resolve without any lookup
+        addrinfo hints {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_protocol = IPPROTO_TCP;
+        hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+        addrinfo *result = nullptr;
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0) {
+            return std::nullopt;
+        }
+        auto addresses = to_addresses(result);
+        freeaddrinfo(result);
+        if (addresses.empty()) {
+            return std::nullopt;
+        }
+        return addresses[0];
+    }
+
+    static bool same_address(const Address &a, const Address &b) {
+        return a.length == b.length && memcmp(&a.storage, &b.storage, a.length) == 0;
+    }
+
+    /*
+     * Cache Format
+     * One line per server: host, port, address and port which connected last time.
+     */
+    static std::optional<Address> cache_load(const std::string &host, const std::string &port) {
+        std::lock_guard<std::mutex> lock(CACHE_M);
+        if (CACHE_PATH.empty() || !fileutils::file_exists(CACHE_PATH)) {
+            return std::nullopt;
+        }
+        std::istringstream cache(fileutils::text_read(CACHE_PATH));
+        std::string line;
+        while (std::getline(cache, line)) {
+            std::vector<std::string> fields;
+            strsplit(line, fields, ' ');
+            if (fields.size() == 4 && fields[0] == host && fields[1] == port) {
+                return address_from_string(fields[2], fields[3]);
+            }
+        }
+        return std::nullopt;
+    }
+
+    static void cache_store(const std::string &host, const std::string &port, const Address &address) {
+        std::lock_guard<std::mutex> lock(CACHE_M);
+        auto address_str = address_to_string(address);
+        if (CACHE_PATH.empty() || address_str.empty()) {
+            return;
+        }
+
+        // replace the line of this server
+        std::string result = host + " " + port + " " + address_str + "\n";
+        if (fileutils::file_exists(CACHE_PATH)) {
+            std::istringstream cache(fileutils::text_read(CACHE_PATH));
+            std::string line;
+            while (std::getline(cache, line)) {
+                if (!line.empty() && !string_begins_with(line, host + " " + port + " ")) {
+                    result += line + "\n";
+                }
+            }
+        }
+        if (!fileutils::text_write(CACHE_PATH, result)) {
+            log_warning("smartea", "unable to save cache to {}", CACHE_PATH);
+        }
+    }
+
+    static std::shared_ptr<ResolveState> resolve_start(const std::string &host, const std::string &port) {
+        auto state = std::make_shared<ResolveState>();
+
+        // getaddrinfo can't be cancelled, so the thread is left behind if it takes too long
+        std::thread([state, host, port] {
+            addrinfo hints {};
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+            hints.ai_protocol = IPPROTO_TCP;
+            addrinfo *result = nullptr;
+            int error = getaddrinfo(host.c_str(), port.c_str(), &hints, &result);
+            std::vector<Address> addresses;
+            if (error == 0) {
+                addresses = to_addresses(result);
+                freeaddrinfo(result);
+            } else {
+                log_info("smartea", "could not resolve {}:{}: {}", host, port, error);
+            }
+
+            // interleave address families, starting with the first one returned
+            std::vector<Address> ordered;
+            std::vector<Address> primary, secondary;
+            for (auto &address : addresses) {
+                if (address.storage.ss_family == addresses[0].storage.ss_family) {
+                    primary.push_back(address);
+                } else {
+                    secondary.push_back(address);
+                }
+            }
+            for (size_t i = 0; i < primary.size() || i < secondary.size(); i++) {
+                if (i < primary.size()) {
+                    ordered.push_back(primary[i]);
+                }
+                if (i < secondary.size()) {
+                    ordered.push_back(secondary[i]);
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(state->m);
+            state->addresses = std::move(ordered);
+            state->done = true;
+            state->cv.notify_all();
+        }).detach();
+
+        return state;
+    }
+
+    static bool attempt_start(const Address &address, size_t index, std::vector<Attempt> &attempts) {
+
+        // create socket
+        auto sock = socket(address.storage.ss_family, SOCK_STREAM, IPPROTO_TCP);
+        if (sock == INVALID_SOCKET) {
+            return false;
         }
+        if (!socket_set_nonblocking(sock)) {
+            closesocket(sock);
+            return false;
+        }
+
+        // start connecting
+        if (connect(sock, (const sockaddr *) &address.storage, address.length) == SOCKET_ERROR
+        && !socket_in_progress()) {
+            closesocket(sock);
+            return false;
+        }
+        attempts.push_back(Attempt {
+            .socket = sock,
+            .address = index,
+            .deadline = clock::now() + std::chrono::milliseconds(CONNECT_TIMEOUT_MS),
+        });
+        return true;
+    }
+
+    static std::optional<size_t> attempts_wait(std::vector<Attempt> &attempts, clock::duration timeout) {
+
+        // wait for any attempt to finish
+        fd_set write_set, error_set;
+        FD_ZERO(&write_set);
+        FD_ZERO(&error_set);
+        socket_t max_socket = 0;
+        for (auto &attempt : attempts) {
+            FD_SET(attempt.socket, &write_set);
+            FD_SET(attempt.socket, &error_set);
+            max_socket = std::max(max_socket, attempt.socket);
+        }
+        auto timeout_us = std::chrono::duration_cast<std::chrono::microseconds>(timeout).count();
+        timeval tv {
+            .tv_sec = (long) (timeout_us / 1000000),
+            .tv_usec = (long) (timeout_us % 1000000),
+        };
+        if (select((int) max_socket + 1, nullptr, &write_set, &error_set, &tv) < 0) {
+            return std::nullopt;
+        }
+
+        // check results
+        auto now = clock::now();
+        std::optional<size_t> connected;
+        for (size_t i = attempts.size(); i-- > 0;) {
+            auto &attempt = attempts[i];
+            bool finished = FD_ISSET(attempt.socket, &write_set) || FD_ISSET(attempt.socket, &error_set);
+            if (finished && !connected.has_value()) {
+                int error = 0;
+                socklen_t error_length = sizeof(error);
+                getsockopt(attempt.socket, SOL_SOCKET, SO_ERROR, (char *) &error, &error_length);
+                if (error == 0 && !FD_ISSET(attempt.socket, &error_set)) {
+                    connected = attempt.address;
+                }
+            }
+            if (finished || attempt.deadline <= now) {
+                closesocket(attempt.socket);
+                attempts.erase(attempts.begin() + i);
+            }
+        }
+        return connected;
+    }
+
+    static bool probe(const std::string &url) {
+        auto time_start = clock::now();
 
-        // get address info
-        addrinfo *result;
-        if ((error = getaddrinfo(url_split[0].c_str(), to_string(port).c_str(), &hints, &result)) != 0) {
-            log_info("smartea", "could not resolve {}:{}: {}", url_split[0], url_split[1], error);
-            WSACleanup();
+        // get host and port
+        std::string host, port;
+        if (!parse_url(url, host, port)) {
+            log_info("smartea", "could not parse URL {}", url);
             return false;
         }
 
-        // iterate list
-        bool success = false;
-        for (addrinfo *ptr = result; ptr != nullptr; ptr = ptr->ai_next) {
+        // resolve in the background, the cached address doesn't need to wait for it
+        auto resolve = resolve_start(host, port);
+        auto resolve_deadline = time_start + std::chrono::milliseconds(RESOLVE_TIMEOUT_MS);
+        std::vector<Address> addresses;
+        if (auto cached = cache_load(host, port)) {
+            addresses.push_back(*cached);
+        }
+        bool resolving = true;
+
+        // connect to whatever answers first
+        std::vector<Attempt> attempts;
+        std::optional<size_t> connected;
+        size_t next_address = 0;
+        auto next_attempt = time_start;
+        while (!connected.has_value()) {
+            auto now = clock::now();
+
+            // pick up resolved addresses
+            if (resolving) {
+                std::lock_guard<std::mutex> lock(resolve->m);
+                if (resolve->done) {
+                    for (auto &address : resolve->addresses) {
+                        if (std::none_of(addresses.begin(), addresses.end(), [&address] (const Address &a) {
+                            return same_address(a, address);
+                        })) {
+                            addresses.push_back(address);
+                        }
+                    }
+                    resolving = false;
+                } else if (now >= resolve_deadline) {
+                    log_info("smartea", "resolving {} timed out", host);
+                    resolving = false;
+                }
+            }
 
-            // create socket
-            SOCKET sock = socket(ptr->ai_family, ptr->ai_socktype, ptr->ai_protocol);
-            if (sock == INVALID_SOCKET) {
-                log_info("smartea", "could not create socket: {}", WSAGetLastError());
-                WSACleanup();
-                return false;
+            // start the next attempt if the delay passed or nothing else is going on
+            while (next_address < addresses.size() && (now >= next_attempt || attempts.empty())) {
+                auto index = next_address++;
+                if (attempt_start(addresses[index], index, attempts)) {
+                    next_attempt = now + ATTEMPT_DELAY;
+                    break;
+                }
             }
 
-            // connect to server
-            error = connect(sock, ptr->ai_addr, (int) ptr->ai_addrlen);
-            if (error == SOCKET_ERROR) {
-                closesocket(sock);
+            // give up once everything failed
+            if (attempts.empty() && next_address >= addresses.size() && !resolving) {
+                break;
+            }
+
+            // wait for the resolver if there's nothing to connect to yet
+            if (attempts.empty()) {
+                std::unique_lock<std::mutex> lock(resolve->m);
+                resolve->cv.wait_until(lock, resolve_deadline, [&resolve] {
+                    return resolve->done;
+                });
                 continue;
             }
 
-            // success
-            success = true;
-            closesocket(sock);
-            break;
+            // wait for attempts, the next attempt or the resolver
+            auto timeout = clock::duration(std::chrono::milliseconds(CONNECT_TIMEOUT_MS));
+            if (next_address < addresses.size()) {
+                timeout = std::min(timeout, next_attempt - now);
+            }
+            if (resolving) {
+                timeout = std::min<clock::duration>(timeout, RESOLVE_POLL);
+            }
+            for (auto &attempt : attempts) {
+                timeout = std::min(timeout, attempt.deadline - now);
+            }
+            connected = attempts_wait(attempts, std::max(timeout, clock::duration::zero()));
+        }
+
+        // close remaining attempts
+        for (auto &attempt : attempts) {
+            closesocket(attempt.socket);
         }
 
-        // WSA shutdown
-        WSACleanup();
+        // remember working address
+        auto time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(clock::now() - time_start).count();
+        if (connected.has_value()) {
+            cache_store(host, port, addresses[*connected]);
+            log_info("smartea", "server seems to be available :) ({}ms)", time_ms);
+            return true;
+        } else {
+            log_info("smartea", "server seems to be dead :( ({}ms)", time_ms);
+            return false;
+        }
+    }
+
+    void probe_start(const std::string &url) {
+        std::lock_guard<std::mutex> lock(PROBE_M);
+
+        // already running or done
+        if (PROBE_RESULT.valid() && PROBE_URL == url) {
+            return;
+        }
+
+#ifdef _WIN32
+
+        // WSA startup, kept for the lifetime of the process since resolver threads might outlive the probe
+        static bool wsa_started = false;
+        if (!wsa_started) {
+            WSADATA wsa_data;
+            int error;
+            if ((error = WSAStartup(MAKEWORD(2, 2), &wsa_data)) != 0) {
+                log_fatal("smartea", "WSAStartup returned {}", error);
+            }
+            wsa_started = true;
+        }
+#endif
+
+        // default cache location
+        if (CACHE_PATH.empty() && getenv("APPDATA") != nullptr) {
+            CACHE_PATH = std::string(getenv("APPDATA")) + "\\spicetools_smartea.txt";
+        }
+
+        // start probe
+        log_info("smartea", "checking {}", url);
+        std::promise<bool> result;
+        PROBE_URL = url;
+        PROBE_RESULT = result.get_future().share();
+        std::thread([url, result = std::move(result)] () mutable {
+            result.set_value(probe(url));
+        }).detach();
+    }
+
+    bool check_url(const std::string &url) {
+
+        // get probe, starting it if it wasn't already
+        probe_start(url);
+        std::shared_future<bool> result;
+        {
+            std::lock_guard<std::mutex> lock(PROBE_M);
+            result = PROBE_RESULT;
+        }
 
-        // success
-        if (success)
-            log_info("smartea", "server seems to be available :)");
-        else
-            log_info("smartea", "server seems to be dead :(");
-        return success;
+        // wait for it
+        return result.get();
     }
 }
@@ -4,5 +4,22 @@
 
 namespace smartea {
 
-    bool check_url(std::string url);
+    // deadlines in milliseconds
+    extern int RESOLVE_TIMEOUT_MS;
+    extern int CONNECT_TIMEOUT_MS;
+
+    // file remembering the last address which worked per server, disabled if empty
+    extern std::string CACHE_PATH;
+
+    /*
+     * Starts checking the server in the background.
+     * The cached address of the last successful check is tried right away while the host gets resolved,
+     * resolved addresses are tried in parallel with a small delay in between (happy eyeballs).
+     */
+    void probe_start(const std::string &url);
+
+    /*
+     * Returns if the server is reachable, waiting for the probe of the URL to finish.
+     */
+    bool check_url(const std::string &url);
 }
@@ -1,5 +1,6 @@
 #include "utils.h"
 #include "avs/core.h"
+#include "util/lz77.h"
 #include "util/utils.h"
 
 
@@ -106,7 +107,20 @@ namespace layeredfs {
 
         // check if cstream is unavailable
         if (avs::core::cstream_create == nullptr) {
-            return lz_compress_dummy(input, input_length, compressed_length);
+
+            /*
+             * Compression using util::lz77, which produces the same AVSLZ stream format
+             */
+
+            auto compressed = util::lz77::compress(input, input_length);
+            auto output = (uint8_t *) malloc(compressed.size());
+            if (!output) {
+                logf("Couldn't allocate");
+                return NULL;
+            }
+            memcpy(output, compressed.data(), compressed.size());
+            *compressed_length = compressed.size();
+            return output;
         } else {
 
             /*
@@ -147,39 +161,4 @@ namespace layeredfs {
             return compress_buffer;
         }
     }
-
-    uint8_t *lz_compress_dummy(uint8_t *input, size_t input_length, size_t *compressed_length) {
-        uint8_t *output = (uint8_t *) malloc(input_length + input_length / 8 + 9);
-        uint8_t *cur_byte = &output[0];
-
-        // copy data blocks
-        for (size_t n = 0; n < input_length / 8; n++) {
-
-            // fake flag
-            *cur_byte++ = 0xFF;
-
-            // uncompressed data
-            for (size_t i = 0; i < 8; i++) {
-                *cur_byte++ = input[n * 8 + i];
-            }
-        }
-
-        // remaining bytes
-        int extra_bytes = input_length % 8;
-        if (extra_bytes == 0) {
-            *cur_byte++ = 0x00;
-        } else {
-            *cur_byte++ = 0xFF >> (8 - extra_bytes);
-            for (size_t i = input_length - extra_bytes; i < input_length; i++) {
-                *cur_byte++ = input[i];
-            }
-            for (size_t i = 0; i < 4; i++) {
-                *cur_byte++ = 0x00;
-            }
-        }
-
-        // calculate size
-        *compressed_length = (size_t) (cur_byte - &output[0]);
-        return output;
-    }
 }
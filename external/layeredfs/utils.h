@@ -24,5 +24,4 @@ namespace layeredfs {
     time_t file_time(const char *path);
     LONG time(void);
     uint8_t *lz_compress(uint8_t *input, size_t input_length, size_t *compressed_length);
-    uint8_t *lz_compress_dummy(uint8_t *input, size_t input_length, size_t *compressed_length);
 }
@@ -9,8 +9,10 @@
 #include "launcher/launcher.h"
 #include "util/detour.h"
 #include "util/fileutils.h"
+#include "util/jpeg_encoder.h"
 #include "util/libutils.h"
 #include "util/logging.h"
+#include "util/png_encoder.h"
 #include "util/utils.h"
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
@@ -353,6 +355,8 @@ namespace games::shared {
 
         // iterate folders
         log_info("printer", "writing files...");
+        std::vector<uint8_t> jpeg;
+        std::vector<uint8_t> png;
         for (const auto &path : PRINTER_PATH) {
             for (const auto &format : PRINTER_FORMAT) {
 
@@ -361,18 +365,33 @@ namespace games::shared {
                 bool success = false;
 
                 // call write function depending on format
-                if (format == "png" && stbi_write_png(
-                        image_path.c_str(), image_width, image_height, 3, image_data, image_width * 3))
-                    success = true;
+                if (format == "png") {
+
+                    // encode once for all paths
+                    if (png.empty()) {
+                        util::PNGEncoder encoder;
+                        encoder.encode(png, image_data, image_width, image_height);
+                    }
+                    if (!png.empty() && fileutils::bin_write(image_path, png.data(), png.size()))
+                        success = true;
+                }
                 if (format == "bmp" && stbi_write_bmp(
                         image_path.c_str(), image_width, image_height, 3, image_data))
                     success = true;
                 if (format == "tga" && stbi_write_tga(
                         image_path.c_str(), image_width, image_height, 3, image_data))
                     success = true;
-                if (format == "jpg" && stbi_write_jpg(
-                        image_path.c_str(), image_width, image_height, 3, image_data, PRINTER_JPG_QUALITY))
-                    success = true;
+                if (format == "jpg") {
+
+                    // encode once for all paths, full chroma resolution for high qualities like before
+                    if (jpeg.empty()) {
+                        util::JPEGEncoder encoder;
+                        encoder.encode(jpeg, image_data, image_width, image_height,
+                                PRINTER_JPG_QUALITY, PRINTER_JPG_QUALITY <= 90);
+                    }
+                    if (!jpeg.empty() && fileutils::bin_write(image_path, jpeg.data(), jpeg.size()))
+                        success = true;
+                }
 
                 // logging
                 if (success) {
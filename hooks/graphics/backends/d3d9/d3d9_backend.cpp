@@ -2,24 +2,22 @@
 
 #include <cassert>
 #include <memory>
+#include <mutex>
 #include <thread>
 #include <vector>
 #include <external/robin_hood.h>
 
 #include <d3d9.h>
-#ifdef __GNUC__
-#include <d3dx9tex.h>
-#endif
 
 #include "avs/game.h"
 #include "games/iidx/iidx.h"
 #include "games/sdvx/sdvx.h"
 #include "games/io.h"
 #include "hooks/graphics/graphics.h"
+#include "hooks/graphics/readback_ring.h"
 #include "launcher/launcher.h"
 #include "launcher/options.h"
 #include "launcher/shutdown.h"
-#include "misc/clipboard.h"
 #include "misc/eamuse.h"
 #include "misc/wintouchemu.h"
 #include "overlay/overlay.h"
@@ -29,6 +27,7 @@
 #include "util/logging.h"
 #include "util/utils.h"
 #include "util/memutils.h"
+#include "util/pixelutils.h"
 #include "util/threadpool.h"
 
 #include "d3d9_device.h"
@@ -46,19 +45,6 @@
         return __ret; \
     } while (0)
 
-#ifdef __GNUC__
-typedef decltype(D3DXSaveSurfaceToFileA) *D3DXSaveSurfaceToFileA_t;
-#else
-#define D3DXIFF_PNG ((DWORD) 3)
-
-typedef HRESULT (WINAPI *D3DXSaveSurfaceToFileA_t)(
-        LPCSTR pDestFile,
-        DWORD DestFormat,
-        LPDIRECT3DSURFACE9 pSrcSurface,
-        CONST PALETTEENTRY *pSrcPalette,
-        CONST RECT *pSrcRect);
-#endif
-
 /*
  * 9 on 12
  */
@@ -82,8 +68,6 @@ typedef IDirect3D9* (WINAPI *Direct3DCreate9On12_t)(
 static void *D3D9_DIRECT3D_CREATE9_ADR = nullptr;
 static char D3D9_DIRECT3D_CREATE9_CONTENTS[16];
 
-static bool ATTEMPTED_D3DX9_LOAD_LIBRARY = false;
-
 // settings
 std::optional<UINT> D3D9_ADAPTER = std::nullopt;
 DWORD D3D9_BEHAVIOR_DISABLE = 0;
@@ -96,6 +80,16 @@ static Direct3DCreate9On12Ex_t Direct3DCreate9On12Ex_orig = nullptr;
 static bool ATTEMPTED_SUB_SWAP_CHAIN_ACQUIRE = false;
 static IDirect3DSwapChain9 *SUB_SWAP_CHAIN = nullptr;
 
+// capture readback
+struct CaptureRequest {
+    bool screenshot = false;
+    bool capture = false;
+    int screen = 0;
+};
+static const size_t CAPTURE_RING_DEPTH = 3;
+static robin_hood::unordered_map<IDirect3DDevice9 *, std::unique_ptr<ReadbackRing<CaptureRequest>>> CAPTURE_RINGS;
+static std::mutex CAPTURE_RING_M;
+
 static void graphics_d3d9_ldj_init_sub_screen(IDirect3DDevice9Ex *device, D3DPRESENT_PARAMETERS *present_params);
 
 static std::string behavior2s(DWORD behavior_flags) {
@@ -924,6 +918,152 @@ static void graphics_d3d9_ldj_on_present(IDirect3DDevice9 *wrapped_device) {
     }
 }
 
+class D3D9ReadbackSurface : public ReadbackSurface {
+public:
+    IDirect3DDevice9 *device;
+    IDirect3DSurface9 *target = nullptr;
+    IDirect3DSurface9 *system = nullptr;
+    IDirect3DQuery9 *query = nullptr;
+    bool copied = false;
+
+    explicit D3D9ReadbackSurface(IDirect3DDevice9 *device) : device(device) {
+    }
+
+    ~D3D9ReadbackSurface() override {
+        if (query) {
+            query->Release();
+        }
+        if (system) {
+            system->Release();
+        }
+        if (target) {
+            target->Release();
+        }
+    }
+
+    bool copy(void *source) override {
+
+        // resolve into the cached render target
+        HRESULT hr = device->StretchRect(
+                reinterpret_cast<IDirect3DSurface9 *>(source), nullptr,
+                target, nullptr, D3DTEXF_NONE);
+        if (FAILED(hr)) {
+            log_warning("graphics::d3d9",
+                    "failed to copy back buffer contents, hr={}",
+                    FMT_HRESULT(hr));
+            return false;
+        }
+
+        // queue the download right behind it
+        hr = device->GetRenderTargetData(target, system);
+        if (FAILED(hr)) {
+            log_warning("graphics::d3d9",
+                    "failed to read back render target, hr={}",
+                    FMT_HRESULT(hr));
+            return false;
+        }
+
+        // mark the end of both in the command stream
+        if (query) {
+            query->Issue(D3DISSUE_END);
+        }
+        copied = false;
+        return true;
+    }
+
+    bool poll() override {
+        if (copied) {
+            return true;
+        }
+
+        // check if the GPU passed the download, locking the system surface won't wait afterwards
+        if (query) {
+            HRESULT hr = query->GetData(nullptr, 0, D3DGETDATA_FLUSH);
+            if (hr == S_FALSE) {
+                return false;
+            }
+        }
+        copied = true;
+        return true;
+    }
+
+    static ReadbackSurface *create(IDirect3DDevice9 *device, const ReadbackFormat &format) {
+        auto surface = new D3D9ReadbackSurface(device);
+        HRESULT hr = device->CreateRenderTarget(
+                format.width, format.height, (D3DFORMAT) format.format,
+                D3DMULTISAMPLE_NONE, 0, FALSE, &surface->target, nullptr);
+        if (SUCCEEDED(hr)) {
+            hr = device->CreateOffscreenPlainSurface(
+                    format.width, format.height, (D3DFORMAT) format.format,
+                    D3DPOOL_SYSTEMMEM, &surface->system, nullptr);
+        }
+        if (FAILED(hr)) {
+            log_warning("graphics::d3d9",
+                    "failed to acquire readback surfaces, hr={}",
+                    FMT_HRESULT(hr));
+            delete surface;
+            return nullptr;
+        }
+
+        // without event queries the download simply waits for the GPU
+        if (FAILED(device->CreateQuery(D3DQUERYTYPE_EVENT, &surface->query))) {
+            surface->query = nullptr;
+        }
+
+        return surface;
+    }
+};
+
+static ReadbackRing<CaptureRequest> *graphics_d3d9_capture_ring(IDirect3DDevice9 *device) {
+    std::lock_guard<std::mutex> lock(CAPTURE_RING_M);
+
+    // surfaces belong to a single device, every presenting device gets its own ring
+    auto &ring = CAPTURE_RINGS[device];
+    if (!ring) {
+        ring = std::make_unique<ReadbackRing<CaptureRequest>>(CAPTURE_RING_DEPTH,
+                [device] (const ReadbackFormat &format) {
+            return D3D9ReadbackSurface::create(device, format);
+        });
+    }
+
+    return ring.get();
+}
+
+static void graphics_d3d9_capture_dropped(CaptureRequest &request) {
+
+    // copies which never finished can't be handed out anymore, let their waiters know
+    if (request.capture) {
+        graphics_capture_skip(request.screen);
+    }
+    if (request.screenshot) {
+        log_warning("graphics::d3d9", "screenshot was dropped with the capture surfaces");
+    }
+}
+
+static pixelutils::Format pixel_format(D3DFORMAT format) {
+    switch (format) {
+        case D3DFMT_R8G8B8:
+            return pixelutils::Format::R8G8B8;
+        case D3DFMT_X8R8G8B8:
+        case D3DFMT_A8R8G8B8:
+            return pixelutils::Format::X8R8G8B8;
+        case D3DFMT_X8B8G8R8:
+        case D3DFMT_A8B8G8R8:
+            return pixelutils::Format::X8B8G8R8;
+        case D3DFMT_R5G6B5:
+            return pixelutils::Format::R5G6B5;
+        case D3DFMT_X1R5G5B5:
+        case D3DFMT_A1R5G5B5:
+            return pixelutils::Format::X1R5G5B5;
+        case D3DFMT_A2R10G10B10:
+            return pixelutils::Format::A2R10G10B10;
+        case D3DFMT_A2B10G10R10:
+            return pixelutils::Format::A2B10G10R10;
+        default:
+            return pixelutils::Format::Unknown;
+    }
+}
+
 static void save_capture(
         int screen,
         D3DFORMAT format,
@@ -941,58 +1081,15 @@ static void save_capture(
         return;
     }
 
-    // copy pixel data
-    size_t pitch = finished_copy.Pitch;
-    auto data = reinterpret_cast<uint8_t *>(finished_copy.pBits);
-    auto pixels = new uint8_t[width * height * 3];
-    for (size_t row = 0; row < height; row++) {
-        size_t offset_pixels = 0;
-        size_t offset_row = row * width * 3;
-        switch (format) {
-            case D3DFMT_R8G8B8: {
-                for (size_t offset = 0; offset < pitch; offset += 3) {
-                    auto cell = data + row * pitch + offset;
-                    auto pixel = &pixels[offset_row + offset_pixels];
-                    pixel[0] = cell[0];
-                    pixel[1] = cell[1];
-                    pixel[2] = cell[2];
-                    offset_pixels += 3;
-                }
-                break;
-            }
-            case D3DFMT_X8R8G8B8:
-            case D3DFMT_A8R8G8B8: {
-                for (size_t offset = 0; offset < pitch; offset += 4) {
-                    auto cell = data + row * pitch + offset;
-                    auto pixel = &pixels[offset_row + offset_pixels];
-                    pixel[0] = cell[2];
-                    pixel[1] = cell[1];
-                    pixel[2] = cell[0];
-                    offset_pixels += 3;
-                }
-                break;
-            }
-            case D3DFMT_X8B8G8R8:
-            case D3DFMT_A8B8G8R8: {
-                for (size_t offset = 0; offset < pitch; offset += 4) {
-                    auto cell = data + row * pitch + offset;
-                    auto pixel = &pixels[offset_row + offset_pixels];
-                    pixel[0] = cell[0];
-                    pixel[1] = cell[1];
-                    pixel[2] = cell[2];
-                    offset_pixels += 3;
-                }
-                break;
-            }
-            default: {
-                for (size_t offset = 0; offset < width; offset++) {
-                    auto pixel = &pixels[offset_row + offset_pixels];
-                    pixel[0] = 0;
-                    pixel[1] = 0;
-                    pixel[2] = 0;
-                    offset_pixels += 3;
-                }
-            }
+    // copy pixel data, conversion happens for the requested region only once someone asks for it
+    auto capture_format = pixel_format(format);
+    auto row_size = width * pixelutils::format_size(capture_format);
+    uint8_t *pixels = nullptr;
+    if (row_size > 0) {
+        pixels = new uint8_t[row_size * height];
+        auto src = reinterpret_cast<const uint8_t *>(finished_copy.pBits);
+        for (size_t y = 0; y < height; y++) {
+            memcpy(pixels + y * row_size, src + y * finished_copy.Pitch, row_size);
         }
     }
 
@@ -1000,15 +1097,21 @@ static void save_capture(
     hr = surface->UnlockRect();
     if (FAILED(hr)) {
         log_warning("graphics::d3d9", "failed to unlock screenshot surface, hr={}", FMT_HRESULT(hr));
+        delete[] pixels;
+        graphics_capture_skip(screen);
+        return;
+    }
+    if (pixels == nullptr) {
+        log_warning("graphics::d3d9", "unsupported capture format: {}", (int) format);
         graphics_capture_skip(screen);
         return;
     }
 
     // enqueue
-    graphics_capture_enqueue(screen, pixels, width, height);
+    graphics_capture_enqueue(screen, pixels, width, height, row_size, capture_format);
 }
 
-static void save_screenshot(const std::string &file_path, UINT height, IDirect3DSurface9 *surface) {
+static void save_screenshot(D3DFORMAT format, UINT width, UINT height, IDirect3DSurface9 *surface) {
     HRESULT hr;
 
     D3DLOCKED_RECT finished_copy {};
@@ -1018,75 +1121,31 @@ static void save_screenshot(const std::string &file_path, UINT height, IDirect3D
         return;
     }
 
-    // set alpha channel to 255
-    {
-        auto pitch = finished_copy.Pitch;
-        auto data = reinterpret_cast<uint8_t *>(finished_copy.pBits);
-
-        for (size_t i = 0; i < height; i++) {
-            for (int j = 3; j < pitch; j += 4) {
-                data[i * pitch + j] = 255;
-            }
-        }
-    }
+    // convert pixel data
+    pixelutils::Image image {
+        .data = reinterpret_cast<const uint8_t *>(finished_copy.pBits),
+        .width = width,
+        .height = height,
+        .pitch = (size_t) finished_copy.Pitch,
+        .format = pixel_format(format),
+    };
+    auto pixels = new uint8_t[width * height * 3];
+    auto converted = pixelutils::convert_rgb(image, pixels);
 
     hr = surface->UnlockRect();
     if (FAILED(hr)) {
         log_warning("graphics::d3d9", "failed to unlock screenshot surface, hr={}", FMT_HRESULT(hr));
+        delete[] pixels;
         return;
     }
-
-    // lazy load function
-    static D3DXSaveSurfaceToFileA_t D3DXSaveSurfaceToFileA_ptr = nullptr;
-    if (D3DXSaveSurfaceToFileA_ptr == nullptr) {
-        D3DXSaveSurfaceToFileA_ptr = libutils::try_proc<D3DXSaveSurfaceToFileA_t>("D3DXSaveSurfaceToFileA");
-
-        // check if function was not found, likely because d3dx9 is not loaded
-        if (!ATTEMPTED_D3DX9_LOAD_LIBRARY && D3DXSaveSurfaceToFileA_ptr == nullptr) {
-            ATTEMPTED_D3DX9_LOAD_LIBRARY = true;
-
-            for (size_t i = 43; i >= 24; i--) {
-                auto lib_name = fmt::format("d3dx9_{}.dll", i);
-                auto d3dx9 = libutils::try_library(lib_name);
-
-                // Check if library was not found
-                if (d3dx9 == nullptr) {
-                    continue;
-                }
-
-                D3DXSaveSurfaceToFileA_ptr = libutils::try_proc<D3DXSaveSurfaceToFileA_t>(
-                        d3dx9, "D3DXSaveSurfaceToFileA");
-
-                // Check if function was not found
-                if (D3DXSaveSurfaceToFileA_ptr == nullptr) {
-                    FreeLibrary(d3dx9);
-                    d3dx9 = nullptr;
-
-                    continue;
-                }
-
-                log_info("graphics::d3d9", "found surface save function in '{}'", lib_name);
-                break;
-            }
-        }
+    if (!converted) {
+        log_warning("graphics::d3d9", "unsupported screenshot format: {}", (int) format);
+        delete[] pixels;
+        return;
     }
 
-    if (D3DXSaveSurfaceToFileA_ptr != nullptr) {
-
-        // save to file
-        log_info("graphics::d3d9", "saving screenshot to {}", file_path);
-        auto hr = D3DXSaveSurfaceToFileA_ptr(file_path.c_str(), D3DXIFF_PNG, surface, nullptr, nullptr);
-
-        if (FAILED(hr)) {
-            log_warning("graphics::d3d9", "Failed to save screenshot");
-            return;
-        }
-
-        // save to clipboard
-        clipboard::copy_image(file_path);
-    } else {
-        log_warning("graphics::d3d9", "Direct3D save helper function not available");
-    }
+    // the PNG gets encoded in the background
+    graphics_screenshot_enqueue(pixels, width, height);
 }
 
 void graphics_d3d9_on_present(
@@ -1131,6 +1190,48 @@ void graphics_d3d9_on_present(
         trigger_last = false;
     }
 
+    // hand out finished readbacks
+    auto ring = graphics_d3d9_capture_ring(device);
+    ring->poll([ring] (ReadbackSurface *surface, const ReadbackFormat &format, CaptureRequest &request) {
+
+        // function for storing the surface
+        auto system = static_cast<D3D9ReadbackSurface *>(surface)->system;
+        auto surface_process = [=]() {
+
+            // capture
+            if (request.capture) {
+                save_capture(request.screen, (D3DFORMAT) format.format, format.width, format.height, system);
+            }
+
+            // screenshot
+            if (request.screenshot) {
+                save_screenshot((D3DFORMAT) format.format, format.width, format.height, system);
+            }
+
+            // slot can be reused
+            ring->release(surface);
+        };
+
+        // list of games that crash when running the screenshot processor on another thread
+        static const robin_hood::unordered_set<std::string> THREAD_BAN {
+                "JMA",
+#ifndef SPICE64
+                "KFC",
+#endif
+                "KMA",
+                "KLP",
+                "LMA",
+        };
+
+        // run the save operation on another thread for supported games
+        if (THREAD_BAN.contains(avs::game::MODEL)) {
+            surface_process();
+        } else {
+            static auto pool = ThreadPool(2);
+            pool.add(surface_process);
+        }
+    });
+
     // process pending screenshot
     bool screenshot = false;
     bool capture = false;
@@ -1152,6 +1253,9 @@ void graphics_d3d9_on_present(
             log_warning("graphics::d3d9",
                     "failed to get back buffer, hr={}",
                     FMT_HRESULT(hr));
+            if (capture) {
+                graphics_capture_skip(capture_screen);
+            }
             return;
         }
 
@@ -1162,76 +1266,75 @@ void graphics_d3d9_on_present(
                     "failed to acquire back buffer descriptor, hr={}",
                     FMT_HRESULT(hr));
             buffer->Release();
+            if (capture) {
+                graphics_capture_skip(capture_screen);
+            }
             return;
         }
 
-        // TODO: cache render targets
-        IDirect3DSurface9 *temp_surface = nullptr;
-        hr = device->CreateRenderTarget(
-                desc.Width, desc.Height, desc.Format, desc.MultiSampleType,
-                desc.MultiSampleQuality, TRUE, &temp_surface, nullptr);
-        if (FAILED(hr) || temp_surface == nullptr) {
-            log_warning("graphics::d3d9",
-                    "failed to acquire temporary surface, hr={}",
-                    FMT_HRESULT(hr));
-            buffer->Release();
-            return;
-        }
-
-        hr = device->StretchRect(buffer, nullptr, temp_surface, nullptr, D3DTEXF_NONE);
-        if (FAILED(hr)) {
-            log_warning("graphics::d3d9",
-                    "failed to copy back buffer contents, hr={}",
-                    FMT_HRESULT(hr));
-            temp_surface->Release();
-            buffer->Release();
-            return;
+        // copy into the readback ring, the data gets processed once the GPU is done with it
+        CaptureRequest request {
+            .screenshot = screenshot,
+            .capture = capture,
+            .screen = capture_screen,
+        };
+        ReadbackFormat format {
+            .width = desc.Width,
+            .height = desc.Height,
+            .format = (uint32_t) desc.Format,
+        };
+        auto stalls = ring->get_stats().stalls;
+        if (!ring->submit(buffer, format, request)) {
+            if (ring->get_stats().stalls != stalls) {
+
+                // every slot is busy, try again on the next frame
+                if (screenshot) {
+                    graphics_screenshot_trigger();
+                } else {
+                    graphics_capture_trigger(capture_screen);
+                }
+            } else if (capture) {
+                graphics_capture_skip(capture_screen);
+            }
         }
 
         // release original back buffer reference
         buffer->Release();
+    }
+}
 
-        // function for storing the surface
-        auto surface_process = [=]() {
-
-            // capture
-            if (capture) {
-                save_capture(capture_screen, desc.Format, desc.Width, desc.Height, temp_surface);
-            }
-
-            // screenshot
-            if (screenshot) {
-
-                // check where we can save it
-                auto file_path = graphics_screenshot_genpath();
-                if (!file_path.empty()) {
+void graphics_d3d9_capture_reset(IDirect3DDevice9 *device) {
+    std::lock_guard<std::mutex> lock(CAPTURE_RING_M);
 
-                    // write to file
-                    save_screenshot(file_path, desc.Height, temp_surface);
-                }
-            }
+    // default pool surfaces have to be released before the device can be reset
+    auto it = CAPTURE_RINGS.find(device);
+    if (it != CAPTURE_RINGS.end()) {
+        it->second->clear(graphics_d3d9_capture_dropped);
+    }
+}
 
-            // release surface
-            temp_surface->Release();
-        };
+void graphics_d3d9_capture_release(IDirect3DDevice9 *device) {
+    std::lock_guard<std::mutex> lock(CAPTURE_RING_M);
 
-        // list of games that crash when running the screenshot processor on another thread
-        static const robin_hood::unordered_set<std::string> THREAD_BAN {
-                "JMA",
-#ifndef SPICE64
-                "KFC",
-#endif
-                "KMA",
-                "KLP",
-                "LMA",
-        };
+    // a new device might get the same address, so the ring has to go with the device
+    auto it = CAPTURE_RINGS.find(device);
+    if (it != CAPTURE_RINGS.end()) {
+        it->second->clear(graphics_d3d9_capture_dropped);
+        CAPTURE_RINGS.erase(it);
+    }
+}
 
-        // run the save operation on another thread for supported games
-        if (THREAD_BAN.contains(avs::game::MODEL)) {
-            surface_process();
-        } else {
-            static auto pool = ThreadPool(2);
-            pool.add(surface_process);
-        }
+ReadbackStats graphics_d3d9_capture_stats() {
+    std::lock_guard<std::mutex> lock(CAPTURE_RING_M);
+
+    // sum of all devices
+    ReadbackStats stats {};
+    for (auto &[device, ring] : CAPTURE_RINGS) {
+        auto ring_stats = ring->get_stats();
+        stats.cache_hits += ring_stats.cache_hits;
+        stats.cache_misses += ring_stats.cache_misses;
+        stats.stalls += ring_stats.stalls;
+        stats.completed += ring_stats.completed;
     }
+    return stats;
 }
@@ -2,6 +2,8 @@
 
 #include <d3d9.h>
 
+#include "hooks/graphics/readback_ring.h"
+
 // {EEE9CCF6-53D6-4326-9AE5-60921B3DB394}
 static const GUID IID_WrappedIDirect3D9 = {
     0xeee9ccf6, 0x53d6, 0x4326, { 0x9a, 0xe5, 0x60, 0x92, 0x1b, 0x3d, 0xb3, 0x94 }
@@ -13,6 +15,10 @@ void graphics_d3d9_on_present(
     IDirect3DDevice9 *device,
     IDirect3DDevice9 *wrapped_device);
 
+void graphics_d3d9_capture_reset(IDirect3DDevice9 *device);
+void graphics_d3d9_capture_release(IDirect3DDevice9 *device);
+ReadbackStats graphics_d3d9_capture_stats();
+
 IDirect3DSurface9 *graphics_d3d9_ldj_get_sub_screen();
 
 struct WrappedIDirect3D9 : IDirect3D9Ex {
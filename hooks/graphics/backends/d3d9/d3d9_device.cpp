@@ -136,6 +136,9 @@ ULONG STDMETHODCALLTYPE WrappedIDirect3DDevice9::Release() {
                 overlay::OVERLAY.reset();
             }
         }
+
+        // release capture surfaces
+        graphics_d3d9_capture_release(this->pReal);
     }
 
     // get reference count of underlying interface
@@ -342,6 +345,9 @@ HRESULT STDMETHODCALLTYPE WrappedIDirect3DDevice9::Reset(
         overlay::OVERLAY->reset_invalidate();
     }
 
+    // release capture surfaces
+    graphics_d3d9_capture_reset(pReal);
+
     HRESULT res = pReal->Reset(pPresentationParameters);
 
     // recreate overlay
@@ -1647,6 +1653,9 @@ HRESULT STDMETHODCALLTYPE WrappedIDirect3DDevice9::ResetEx(
         overlay::OVERLAY->reset_invalidate();
     }
 
+    // release capture surfaces
+    graphics_d3d9_capture_reset(pReal);
+
     HRESULT res = static_cast<IDirect3DDevice9Ex *>(pReal)->ResetEx(
             pPresentationParameters, pFullscreenDisplayMode);
 
@@ -0,0 +1,189 @@
+#include "capture.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+#include "util/time.h"
+
+// state
+static const size_t GRAPHICS_CAPTURE_SCREEN_NO = 4;
+static const int GRAPHICS_CAPTURE_TIMEOUT_MS = 5000;
+static std::atomic<bool> GRAPHICS_CAPTURE_PENDING[GRAPHICS_CAPTURE_SCREEN_NO] {};
+static CaptureData GRAPHICS_CAPTURE_BUFFER[GRAPHICS_CAPTURE_SCREEN_NO] {};
+static std::mutex GRAPHICS_CAPTURE_BUFFER_M[GRAPHICS_CAPTURE_SCREEN_NO] {};
+static std::condition_variable GRAPHICS_CAPTURE_CV[GRAPHICS_CAPTURE_SCREEN_NO] {};
+static uint64_t GRAPHICS_CAPTURE_SKIPS[GRAPHICS_CAPTURE_SCREEN_NO] {};
+
+uint64_t graphics_capture_trigger(int screen) {
+    if (screen < 0 || (size_t) screen >= GRAPHICS_CAPTURE_SCREEN_NO) {
+        return 0;
+    }
+
+    // read the skip counter before the backend can see the request
+    uint64_t skips;
+    {
+        std::lock_guard<std::mutex> lock(GRAPHICS_CAPTURE_BUFFER_M[screen]);
+        skips = GRAPHICS_CAPTURE_SKIPS[screen];
+    }
+
+    // requests made before the readback happens all get the same frame
+    GRAPHICS_CAPTURE_PENDING[screen] = true;
+    return skips;
+}
+
+bool graphics_capture_consume(int *screen) {
+
+    // take turns so a busy screen can't starve the others
+    static size_t next = 0;
+    for (size_t i = 0; i < GRAPHICS_CAPTURE_SCREEN_NO; i++) {
+        auto candidate = (next + i) % GRAPHICS_CAPTURE_SCREEN_NO;
+        if (GRAPHICS_CAPTURE_PENDING[candidate].load(std::memory_order_relaxed)
+                && GRAPHICS_CAPTURE_PENDING[candidate].exchange(false)) {
+            next = candidate + 1;
+            *screen = (int) candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+void graphics_capture_enqueue(int screen, uint8_t *data, size_t width, size_t height,
+        size_t pitch, pixelutils::Format format) {
+    GRAPHICS_CAPTURE_BUFFER_M[screen].lock();
+    auto &capture = GRAPHICS_CAPTURE_BUFFER[screen];
+    capture.data.reset(data);
+    capture.width = width;
+    capture.height = height;
+    capture.pitch = pitch;
+    capture.format = format;
+    capture.timestamp = get_performance_milliseconds();
+    capture.sequence++;
+    GRAPHICS_CAPTURE_BUFFER_M[screen].unlock();
+    GRAPHICS_CAPTURE_CV[screen].notify_all();
+}
+
+void graphics_capture_skip(int screen) {
+
+    // the requested readback failed, let the waiters give up right away
+    GRAPHICS_CAPTURE_BUFFER_M[screen].lock();
+    GRAPHICS_CAPTURE_SKIPS[screen]++;
+    GRAPHICS_CAPTURE_BUFFER_M[screen].unlock();
+    GRAPHICS_CAPTURE_CV[screen].notify_all();
+}
+
+bool graphics_capture_wait(int screen, uint64_t sequence, uint64_t skips, CaptureData &capture, int timeout_ms) {
+    if (screen < 0 || (size_t) screen >= GRAPHICS_CAPTURE_SCREEN_NO) {
+        return false;
+    }
+
+    // wait for a capture newer than the given one, or a readback skipped since the trigger
+    std::unique_lock<std::mutex> lock(GRAPHICS_CAPTURE_BUFFER_M[screen]);
+    auto &buffer = GRAPHICS_CAPTURE_BUFFER[screen];
+    auto &skipped = GRAPHICS_CAPTURE_SKIPS[screen];
+    auto captured = [&buffer, sequence] {
+        return buffer.sequence > sequence && buffer.data != nullptr;
+    };
+    GRAPHICS_CAPTURE_CV[screen].wait_for(lock, std::chrono::milliseconds(timeout_ms), [&captured, &skipped, skips] {
+        return captured() || skipped != skips;
+    });
+    if (!captured()) {
+        return false;
+    }
+
+    capture = buffer;
+    return true;
+}
+
+bool graphics_capture_next(int screen, CaptureData &capture, int timeout_ms) {
+    if (screen < 0 || (size_t) screen >= GRAPHICS_CAPTURE_SCREEN_NO) {
+        return false;
+    }
+
+    // remember the current frame before triggering, so a fast readback can't be missed
+    uint64_t sequence;
+    {
+        std::lock_guard<std::mutex> lock(GRAPHICS_CAPTURE_BUFFER_M[screen]);
+        sequence = GRAPHICS_CAPTURE_BUFFER[screen].sequence;
+    }
+    auto skips = graphics_capture_trigger(screen);
+    return graphics_capture_wait(screen, sequence, skips, capture, timeout_ms);
+}
+
+bool graphics_capture_encode_jpeg(const CaptureData &capture, const CaptureOptions &options,
+        util::JPEGEncoder &encoder, std::vector<uint8_t> &jpeg, int *width, int *height) {
+
+    // select the region
+    pixelutils::Image frame {
+        .data = capture.data.get(),
+        .width = capture.width,
+        .height = capture.height,
+        .pitch = capture.pitch,
+        .format = capture.format,
+    };
+    auto region = pixelutils::crop(frame,
+            std::max(options.x, 0), std::max(options.y, 0),
+            std::max(options.width, 0), std::max(options.height, 0));
+    if (region.data == nullptr || region.width == 0 || region.height == 0) {
+        return false;
+    }
+
+    // output size, never larger than the region
+    size_t target_width = std::clamp(options.target_width, 0, (int) region.width);
+    size_t target_height = std::clamp(options.target_height, 0, (int) region.height);
+    if (target_width == 0 && target_height == 0) {
+        auto divide = (size_t) std::max(options.divide, 1);
+        target_width = (region.width + divide - 1) / divide;
+        target_height = (region.height + divide - 1) / divide;
+    } else if (target_width == 0) {
+        target_width = std::max(region.width * target_height / region.height, (size_t) 1);
+    } else if (target_height == 0) {
+        target_height = std::max(region.height * target_width / region.width, (size_t) 1);
+    }
+
+    // convert and scale only the requested pixels in one pass
+    static thread_local std::vector<uint8_t> PIXELS;
+    PIXELS.resize(target_width * target_height * 3);
+    if (!pixelutils::convert_rgb(region, PIXELS.data(), target_width, target_height)) {
+        return false;
+    }
+
+    // compress
+    if (!encoder.encode(jpeg, PIXELS.data(), target_width, target_height, options.quality, options.subsample)) {
+        return false;
+    }
+
+    // status
+    if (width) {
+        *width = (int) target_width;
+    }
+    if (height) {
+        *height = (int) target_height;
+    }
+    return true;
+}
+
+bool graphics_capture_receive_jpeg(int screen, std::vector<uint8_t> &jpeg,
+        const CaptureOptions &options, uint64_t *timestamp,
+        int *width, int *height) {
+
+    // wait for a fresh frame, shared with everyone else asking for this screen right now
+    CaptureData capture;
+    if (!graphics_capture_next(screen, capture, GRAPHICS_CAPTURE_TIMEOUT_MS)) {
+        return false;
+    }
+
+    // compress
+    static thread_local util::JPEGEncoder ENCODER;
+    if (!graphics_capture_encode_jpeg(capture, options, ENCODER, jpeg, width, height)) {
+        return false;
+    }
+
+    // status
+    if (timestamp) {
+        *timestamp = capture.timestamp;
+    }
+    return true;
+}
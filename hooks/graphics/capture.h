@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "util/jpeg_encoder.h"
+#include "util/pixelutils.h"
+
+struct CaptureData {
+
+    // pixels in the format of the surface, converted on demand
+    std::shared_ptr<uint8_t[]> data;
+    unsigned short width, height;
+    size_t pitch;
+    pixelutils::Format format;
+    uint64_t timestamp;
+
+    // increases with every capture of the screen
+    uint64_t sequence = 0;
+};
+
+/*
+ * Part of a captured frame to encode and how.
+ * Requests with different options waiting for the same screen share a single readback.
+ */
+struct CaptureOptions {
+
+    // region in frame pixels, clamped to the frame, an empty region selects the whole frame
+    int x = 0, y = 0;
+    int width = 0, height = 0;
+
+    // output size, a single side keeps the aspect ratio, none divides the region size by divide
+    int target_width = 0, target_height = 0;
+    int divide = 1;
+
+    int quality = 80;
+    bool subsample = true;
+};
+
+/*
+ * Hand-off of screen captures between the requesting threads and the graphics backend.
+ * Triggering returns the skip counter from before the request, waiters pass it back in so a
+ * readback failing right after the trigger still wakes them up.
+ */
+uint64_t graphics_capture_trigger(int screen);
+bool graphics_capture_consume(int *screen);
+void graphics_capture_enqueue(int screen, uint8_t *data, size_t width, size_t height,
+        size_t pitch, pixelutils::Format format);
+void graphics_capture_skip(int screen);
+bool graphics_capture_wait(int screen, uint64_t sequence, uint64_t skips, CaptureData &capture, int timeout_ms);
+bool graphics_capture_next(int screen, CaptureData &capture, int timeout_ms);
+bool graphics_capture_encode_jpeg(const CaptureData &capture, const CaptureOptions &options,
+        util::JPEGEncoder &encoder, std::vector<uint8_t> &jpeg,
+        int *width = nullptr, int *height = nullptr);
+bool graphics_capture_receive_jpeg(int screen, std::vector<uint8_t> &jpeg,
+        const CaptureOptions &options = {},
+        uint64_t *timestamp = nullptr,
+        int *width = nullptr, int *height = nullptr);
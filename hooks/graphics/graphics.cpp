@@ -6,26 +6,25 @@
 #include <vector>
 #include <mutex>
 #include <condition_variable>
+#include <fstream>
 
 #include "avs/game.h"
 #include "cfg/icon.h"
 #include "cfg/screen_resize.h"
 #include "hooks/graphics/backends/d3d9/d3d9_backend.h"
 #include "launcher/shutdown.h"
+#include "misc/clipboard.h"
 #include "overlay/overlay.h"
 #include "touch/touch.h"
 #include "util/detour.h"
 #include "util/logging.h"
 #include "util/fileutils.h"
+#include "util/pixelutils.h"
+#include "util/png_encoder.h"
+#include "util/threadpool.h"
 #include "util/utils.h"
 #include "util/time.h"
 
-struct CaptureData {
-    std::shared_ptr<uint8_t[]> data;
-    unsigned short width, height;
-    uint64_t timestamp;
-};
-
 // icon
 static HICON WINDOW_ICON = LoadIcon(GetModuleHandle(nullptr), MAKEINTRESOURCE(MAINICON));
 
@@ -35,12 +34,6 @@ static std::vector<WNDPROC> WNDPROC_CUSTOM {};
 static bool GRAPHICS_SCREENSHOT_TRIGGER = false;
 static std::set<int> GRAPHICS_SCREENS { 0 };
 static std::mutex GRAPHICS_SCREENS_M {};
-static std::vector<int> GRAPHICS_CAPTURE_SCREENS;
-static const size_t GRAPHICS_CAPTURE_SCREEN_NO = 4;
-static std::mutex GRAPHICS_CAPTURE_SCREENS_M {};
-static CaptureData GRAPHICS_CAPTURE_BUFFER[GRAPHICS_CAPTURE_SCREEN_NO] {};
-static std::mutex GRAPHICS_CAPTURE_BUFFER_M[GRAPHICS_CAPTURE_SCREEN_NO] {};
-static std::condition_variable GRAPHICS_CAPTURE_CV[GRAPHICS_CAPTURE_SCREEN_NO] {};
 
 // flag settings
 bool GRAPHICS_CAPTURE_CURSOR = false;
@@ -599,6 +592,7 @@ void graphics_init() {
 
     // init backends
     graphics_d3d9_init();
+    log_info("graphics", "capture pixel conversion uses {}", pixelutils::get_instruction_set());
 
     // general hooks
     ChangeDisplaySettingsA_orig = detour::iat_try("ChangeDisplaySettingsA", ChangeDisplaySettingsA_hook);
@@ -726,110 +720,8 @@ bool graphics_screenshot_consume() {
     return flag;
 }
 
-void graphics_capture_trigger(int screen) {
-    std::lock_guard<std::mutex> lock(GRAPHICS_CAPTURE_SCREENS_M);
-
-    GRAPHICS_CAPTURE_SCREENS.push_back(screen);
-}
-
-bool graphics_capture_consume(int *screen) {
-    auto flag = !GRAPHICS_CAPTURE_SCREENS.empty();
-    if (flag) {
-        std::lock_guard<std::mutex> lock(GRAPHICS_CAPTURE_SCREENS_M);
-
-        *screen = GRAPHICS_CAPTURE_SCREENS.back();
-        GRAPHICS_CAPTURE_SCREENS.pop_back();
-    }
-    return flag;
-}
-
-void graphics_capture_enqueue(int screen, uint8_t *data, size_t width, size_t height) {
-    GRAPHICS_CAPTURE_BUFFER_M[screen].lock();
-    auto &capture = GRAPHICS_CAPTURE_BUFFER[screen];
-    capture.data.reset(data);
-    capture.width = width;
-    capture.height = height;
-    capture.timestamp = get_performance_milliseconds();
-    GRAPHICS_CAPTURE_BUFFER_M[screen].unlock();
-    GRAPHICS_CAPTURE_CV[screen].notify_one();
-}
-
-void graphics_capture_skip(int screen) {
-    GRAPHICS_CAPTURE_CV[screen].notify_one();
-}
-
-bool graphics_capture_receive_jpeg(int screen, TooJpeg::WRITE_ONE_BYTE receiver,
-        bool rgb, int quality, bool downsample, int divide, uint64_t *timestamp,
-        int *width, int *height) {
-
-    // wait for capture event
-    std::unique_lock<std::mutex> lock(GRAPHICS_CAPTURE_BUFFER_M[screen]);
-    GRAPHICS_CAPTURE_CV[screen].wait(lock, [screen] {
-        return GRAPHICS_CAPTURE_BUFFER[screen].data != nullptr;
-    });
-    auto &capture = GRAPHICS_CAPTURE_BUFFER[screen];
-    auto capture_data = capture.data;
-    auto capture_width = capture.width;
-    auto capture_height = capture.height;
-    auto capture_timestamp = capture.timestamp;
-    lock.unlock();
-
-    // validate data
-    if (!capture_data || !capture_width || !capture_height) {
-        return false;
-    }
-
-    // divide image size
-    if (divide > 1) {
-
-        // get new resolution (round up)
-        int width_new = (capture_width + divide - 1) / divide;
-        int height_new = (capture_height + divide - 1) / divide;
-
-        // allocate new data
-        auto data_old = capture_data.get();
-        auto data_new = new uint8_t[width_new * height_new * 3];
-
-        // copy pixel data
-        int data_y = 0;
-        for (int y = 0; y < capture_height; y += divide) {
-            int data_y_offset_old = y * capture_width;
-            int data_y_offset = data_y * width_new;
-            int data_x = 0;
-            for (int x = 0; x < capture_width; x += divide) {
-                auto pixel_new = &data_new[(data_x + data_y_offset) * 3];
-                auto pixel_old = &data_old[(data_y_offset_old + x) * 3];
-                memcpy(pixel_new, pixel_old, 3);
-                data_x++;
-            }
-            data_y++;
-        }
-
-        // update capture data
-        capture_data.reset(data_new);
-        capture_width = width_new;
-        capture_height = height_new;
-    }
-
-    // compress
-    auto success = TooJpeg::writeJpeg(
-            receiver, capture_data.get(),
-            capture_width, capture_height,
-            rgb, quality, downsample);
-
-    // status
-    if (timestamp) {
-        *timestamp = capture_timestamp;
-    }
-    if (width) {
-        *width = capture_width;
-    }
-    if (height) {
-        *height = capture_height;
-    }
-
-    // clean up
-    return success;
+ReadbackStats graphics_capture_stats() {
+    return graphics_d3d9_capture_stats();
 }
 
 std::string graphics_screenshot_genpath() {
@@ -868,3 +760,35 @@ std::string graphics_screenshot_genpath() {
         id++;
     }
 }
+
+void graphics_screenshot_enqueue(uint8_t *data, size_t width, size_t height) {
+    std::shared_ptr<uint8_t[]> pixels(data);
+
+    // encode one after another, so the file names are picked in order
+    static ThreadPool pool(1);
+    pool.add([pixels, width, height] {
+
+        // check where we can save it
+        auto file_path = graphics_screenshot_genpath();
+        if (file_path.empty()) {
+            return;
+        }
+
+        // stream into the file
+        log_info("graphics", "saving screenshot to {}", file_path);
+        std::ofstream out(file_path, std::ios::out | std::ios::binary);
+        static util::PNGEncoder ENCODER;
+        auto success = out && ENCODER.encode([&out] (const uint8_t *data, size_t size) {
+            out.write(reinterpret_cast<const char *>(data), size);
+            return out.good();
+        }, pixels.get(), width, height);
+        out.close();
+        if (!success || !out) {
+            log_warning("graphics", "failed to save screenshot to {}", file_path);
+            return;
+        }
+
+        // save to clipboard
+        clipboard::copy_image(file_path);
+    });
+}
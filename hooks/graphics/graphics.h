@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory>
 #include <string>
 #include <vector>
 #include <optional>
@@ -7,7 +8,8 @@
 #include <windows.h>
 #include <d3d9.h>
 
-#include "external/toojpeg/toojpeg.h"
+#include "hooks/graphics/capture.h"
+#include "hooks/graphics/readback_ring.h"
 
 // flag settings
 extern bool GRAPHICS_CAPTURE_CURSOR;
@@ -38,12 +40,6 @@ void graphics_screens_unregister(int screen);
 void graphics_screens_get(std::vector<int> &screens);
 void graphics_screenshot_trigger();
 bool graphics_screenshot_consume();
-void graphics_capture_trigger(int screen);
-bool graphics_capture_consume(int *screen);
-void graphics_capture_enqueue(int screen, uint8_t *data, size_t width, size_t height);
-void graphics_capture_skip(int screen);
-bool graphics_capture_receive_jpeg(int screen, TooJpeg::WRITE_ONE_BYTE receiver,
-        bool rgb = true, int quality = 80, bool downsample = true, int divide = 0,
-        uint64_t *timestamp = nullptr,
-        int *width = nullptr, int *height = nullptr);
+ReadbackStats graphics_capture_stats();
 std::string graphics_screenshot_genpath();
+void graphics_screenshot_enqueue(uint8_t *data, size_t width, size_t height);
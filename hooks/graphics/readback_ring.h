@@ -0,0 +1,213 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+struct ReadbackFormat {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t format = 0;
+
+    inline bool operator==(const ReadbackFormat &other) const {
+        return width == other.width && height == other.height && format == other.format;
+    }
+};
+
+struct ReadbackStats {
+
+    // submits which could reuse the surfaces of a slot
+    uint64_t cache_hits = 0;
+    uint64_t cache_misses = 0;
+
+    // submits deferred because every slot was busy
+    uint64_t stalls = 0;
+
+    // copies handed to the handler
+    uint64_t completed = 0;
+};
+
+/*
+ * GPU side of a slot, implemented by the graphics backend.
+ */
+class ReadbackSurface {
+public:
+    virtual ~ReadbackSurface() = default;
+
+    // queues the copy of the source without waiting for it
+    virtual bool copy(void *source) = 0;
+
+    // returns true once the copy is finished and the data can be read without stalling
+    virtual bool poll() = 0;
+};
+
+/*
+ * Ring of cached readback surfaces.
+ *
+ * A frame gets copied into a free slot and is only handed out once the copy finished,
+ * so the render thread never waits on the GPU. Slots keep their surfaces for the next
+ * copy of the same format. Requests carry a user defined payload of type T.
+ */
+template<typename T>
+class ReadbackRing {
+public:
+    typedef std::function<ReadbackSurface *(const ReadbackFormat &)> Factory;
+    typedef std::function<void(ReadbackSurface *, const ReadbackFormat &, T &)> Handler;
+    typedef std::function<void(T &)> DropHandler;
+
+    ReadbackRing(size_t depth, Factory factory) : slots(depth), factory(std::move(factory)) {
+    }
+
+    ~ReadbackRing() {
+        this->clear();
+    }
+
+    ReadbackRing(const ReadbackRing &) = delete;
+    ReadbackRing &operator=(const ReadbackRing &) = delete;
+
+    /*
+     * Starts copying the source into a free slot.
+     * Returns false if no slot is available, the request should be retried on the next frame then.
+     */
+    bool submit(void *source, const ReadbackFormat &format, T request) {
+        std::lock_guard<std::mutex> lock(this->slots_m);
+
+        // prefer a free slot which already has surfaces of the right format
+        Slot *target = nullptr;
+        for (auto &slot : this->slots) {
+            if (slot.state == State::Free) {
+                if (slot.surface != nullptr && slot.format == format) {
+                    target = &slot;
+                    break;
+                } else if (target == nullptr || target->surface != nullptr) {
+                    target = &slot;
+                }
+            }
+        }
+        if (target == nullptr) {
+            this->stats.stalls++;
+            return false;
+        }
+
+        // (re)create surfaces
+        if (target->surface != nullptr && target->format == format) {
+            this->stats.cache_hits++;
+        } else {
+            this->stats.cache_misses++;
+            delete target->surface;
+            target->surface = this->factory(format);
+            target->format = format;
+            if (target->surface == nullptr) {
+                return false;
+            }
+        }
+
+        // start copy
+        if (!target->surface->copy(source)) {
+            return false;
+        }
+        target->state = State::Copying;
+        target->sequence = this->sequence++;
+        target->request = std::move(request);
+        return true;
+    }
+
+    /*
+     * Hands finished copies to the handler in the order they were submitted.
+     * The handler may process the surface asynchronously, but has to call release() afterwards.
+     */
+    void poll(const Handler &handler) {
+        while (true) {
+
+            // find the oldest copy
+            Slot *oldest = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(this->slots_m);
+                for (auto &slot : this->slots) {
+                    if (slot.state == State::Copying && (oldest == nullptr || slot.sequence < oldest->sequence)) {
+                        oldest = &slot;
+                    }
+                }
+                if (oldest == nullptr || !oldest->surface->poll()) {
+                    return;
+                }
+                oldest->state = State::Processing;
+                this->stats.completed++;
+            }
+
+            handler(oldest->surface, oldest->format, oldest->request);
+        }
+    }
+
+    /*
+     * Marks the slot of the surface as free again, may be called from any thread.
+     */
+    void release(ReadbackSurface *surface) {
+        std::lock_guard<std::mutex> lock(this->slots_m);
+        for (auto &slot : this->slots) {
+            if (slot.surface == surface && slot.state == State::Processing) {
+                slot.state = State::Free;
+                slot.request = T();
+                this->slots_cv.notify_all();
+                return;
+            }
+        }
+    }
+
+    /*
+     * Frees all surfaces, e.g. before a device reset.
+     * Pending copies are dropped and passed to the drop handler, so their requests can be failed.
+     * Surfaces still being processed are waited for.
+     */
+    void clear(const DropHandler &dropped = nullptr) {
+        std::unique_lock<std::mutex> lock(this->slots_m);
+        this->slots_cv.wait(lock, [this] {
+            for (auto &slot : this->slots) {
+                if (slot.state == State::Processing) {
+                    return false;
+                }
+            }
+            return true;
+        });
+        for (auto &slot : this->slots) {
+            if (slot.state == State::Copying && dropped) {
+                dropped(slot.request);
+            }
+            delete slot.surface;
+            slot.surface = nullptr;
+            slot.state = State::Free;
+            slot.request = T();
+        }
+    }
+
+    ReadbackStats get_stats() {
+        std::lock_guard<std::mutex> lock(this->slots_m);
+        return this->stats;
+    }
+
+private:
+    enum class State {
+        Free,
+        Copying,
+        Processing,
+    };
+
+    struct Slot {
+        ReadbackSurface *surface = nullptr;
+        ReadbackFormat format;
+        State state = State::Free;
+        uint64_t sequence = 0;
+        T request {};
+    };
+
+    std::vector<Slot> slots;
+    std::mutex slots_m;
+    std::condition_variable slots_cv;
+    Factory factory;
+    uint64_t sequence = 0;
+    ReadbackStats stats;
+};
@@ -8,6 +8,7 @@
 
 #include "acio/acio.h"
 #include "acio/icca/icca.h"
+#include "acioemu/recorder.h"
 #include "api/controller.h"
 #include "avs/automap.h"
 #include "avs/core.h"
@@ -17,6 +18,7 @@
 #include "cfg/spicecfg.h"
 #include "cfg/config.h"
 #include "easrv/easrv.h"
+#include "easrv/smartea.h"
 #include "external/cardio/cardio_runner.h"
 #include "external/scard/scard.h"
 #include "external/layeredfs/hook.h"
@@ -278,6 +280,10 @@ int main_implementation(int argc, char *argv[]) {
     if (options[launcher::Options::SmartEAmusement].value_bool()) {
         easrv_smart = true;
     }
+    if (options[launcher::Options::SmartEAmusementTimeout].is_active()) {
+        smartea::RESOLVE_TIMEOUT_MS = options[launcher::Options::SmartEAmusementTimeout].value_int();
+        smartea::CONNECT_TIMEOUT_MS = options[launcher::Options::SmartEAmusementTimeout].value_int();
+    }
     if (options[launcher::Options::EAmusementMaintenance].is_active()) {
         easrv_maint = options[launcher::Options::EAmusementMaintenance].value_int() > 0;
     }
@@ -538,6 +544,11 @@ int main_implementation(int argc, char *argv[]) {
     }
     if (options[launcher::Options::ServiceURL].is_active()) {
         avs::ea3::URL_CUSTOM = options[launcher::Options::ServiceURL].value_text();
+
+        // check the server while the game is loading
+        if (easrv_smart && easrv_port == 0u) {
+            smartea::probe_start(avs::ea3::URL_CUSTOM);
+        }
     }
     if (options[launcher::Options::PathToModules].is_active()) {
         std::error_code err;
@@ -623,6 +634,9 @@ int main_implementation(int argc, char *argv[]) {
     if (options[launcher::Options::APIDebugMode].value_bool()) {
         api_debug = true;
     }
+    if (options[launcher::Options::APIStreamExternal].value_bool()) {
+        api::STREAM_EXTERNAL = true;
+    }
     if (options[launcher::Options::DisableDebugHooks].value_bool()) {
         debughook::DEBUGHOOK_LOGGING = false;
     }
@@ -696,6 +710,9 @@ int main_implementation(int argc, char *argv[]) {
         avs::automap::RESTRICT_NETWORK = true;
         avs::automap::DUMP = true;
     }
+    if (options[launcher::Options::ACIORecordPath].is_active()) {
+        acioemu::RECORD_PATH = options[launcher::Options::ACIORecordPath].value_text();
+    }
     if (options[launcher::Options::GameExecutable].is_active()) {
         avs::game::DLL_NAME = options[launcher::Options::GameExecutable].value_text();
     }
@@ -1,12 +1,17 @@
 #include "logger.h"
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <condition_variable>
+#include <memory>
 #include <mutex>
 #include <thread>
 #include <vector>
 
 #include <windows.h>
+#include <intrin.h>
 
 #include "avs/ea3.h"
 #include "launcher/launcher.h"
@@ -22,28 +27,124 @@ namespace logger {
     bool BLOCKING = false;
     bool COLOR = true;
 
+    // records
+    struct Record {
+        uint32_t size;
+        uint16_t style;
+        uint16_t terminate;
+        int64_t time; // TSC ticks
+        RecordFormat_t format;
+    };
+    static constexpr size_t RECORD_RING_SIZE = 64 * 1024;
+    static constexpr size_t RECORD_SIZE_MAX = RECORD_RING_SIZE / 4;
+    static constexpr size_t OUTPUT_BATCH = 256;
+
+    struct OutputLine {
+        std::string data;
+        Style style;
+        bool terminate;
+    };
+
+    struct Sink {
+        LogSink_t sink;
+        void *user;
+        size_t capacity;
+        SinkPolicy policy;
+        std::mutex mutex;
+        std::condition_variable data_cv;
+        std::condition_variable space_cv;
+        std::vector<std::pair<std::string, Style>> queue;
+        bool closing = false;
+        std::shared_ptr<std::atomic<uint64_t>> dropped = std::make_shared<std::atomic<uint64_t>>(0);
+        std::thread *thread = nullptr;
+    };
+
+    struct RecordRing {
+
+        // producer, writing is set from reserve to commit
+        alignas(64) std::atomic<size_t> head {0};
+        std::atomic<bool> writing {false};
+        size_t tail_cached = 0;
+        size_t reserved = 0;
+        size_t reserved_end = 0;
+
+        // consumer
+        alignas(64) std::atomic<size_t> tail {0};
+        std::atomic<bool> abandoned {false};
+
+        alignas(64) uint8_t data[RECORD_RING_SIZE];
+    };
+
     // state
-    static bool RUNNING = false;
+    static std::atomic<bool> RUNNING = false;
+    static std::atomic<bool> STOPPING = false;
+    static std::mutex STOP_MUTEX;
+    static std::condition_variable STOP_CV;
+    static std::atomic<bool> SLEEPING = false;
+    static int64_t CLOCK_START_TICKS = 0;
+    static std::chrono::steady_clock::time_point CLOCK_START;
     static WORD DEFAULT_ATTRIBUTES = 0;
     static std::mutex EVENT_MUTEX;
     static std::condition_variable EVENT_CV;
+    static bool EVENT_HOT = false;
     static std::thread *THREAD = nullptr;
     static std::mutex OUTPUT_MUTEX;
-    static bool OUTPUT_BUFFER_HOT = false;
-    static std::vector<std::pair<std::string, Style>> OUTPUT_BUFFER1;
-    static std::vector<std::pair<std::string, Style>> OUTPUT_BUFFER2;
-    static std::vector<std::pair<std::string, Style>> *OUTPUT_BUFFER = &OUTPUT_BUFFER1;
-    static std::vector<std::pair<std::string, Style>> *OUTPUT_BUFFER_SWAP = &OUTPUT_BUFFER2;
+    static std::vector<OutputLine> OUTPUT_BUFFER;
+    static std::mutex PROCESS_MUTEX;
+    static std::mutex FLUSH_MUTEX;
+    static std::condition_variable FLUSH_CV;
+    static uint64_t FLUSH_PASS_STARTED = 0;
+    static uint64_t FLUSH_PASS_DONE = 0;
+    static std::mutex RINGS_MUTEX;
+    static std::vector<RecordRing *> RINGS;
+    static std::atomic<uint64_t> RINGS_GENERATION = 0;
+    static std::vector<RecordRing *> RINGS_LOCAL;
+    static uint64_t RINGS_LOCAL_GENERATION = 0;
+    static std::recursive_mutex HOOKS_MUTEX;
     static std::vector<std::pair<LogHook_t, void*>> HOOKS;
+    static std::mutex SINKS_MUTEX;
+    static std::vector<std::shared_ptr<Sink>> SINKS;
+
+    // thread state
+    static thread_local RecordRing *RING = nullptr;
+    static thread_local bool RING_EXITED = false;
+    static thread_local bool CONSUMER = false;
+    static thread_local Sink *SINK_CURRENT = nullptr;
+
+    struct RecordRingOwner {
+        ~RecordRingOwner() {
+            if (RING) {
+                if (!ring_release(RING)) {
+                    RING->abandoned.store(true, std::memory_order_release);
+                }
+                RING = nullptr;
+            }
+            RING_EXITED = true;
+        }
 
-    static inline std::vector<std::pair<std::string, Style>> *output_buffer_swap() {
-        OUTPUT_MUTEX.lock();
-        auto buffer = OUTPUT_BUFFER;
-        std::swap(OUTPUT_BUFFER, OUTPUT_BUFFER_SWAP);
-        OUTPUT_MUTEX.unlock();
-
-        return buffer;
-    }
+        /*
+         * Frees the ring right away if no logging thread is around to clean it up, which is the case
+         * for threads exiting after stop. Holding the process mutex keeps a thread started meanwhile
+         * from reading it, its first pass sees the new generation.
+         */
+        static bool ring_release(RecordRing *ring) {
+            if (RUNNING.load(std::memory_order_relaxed)) {
+                return false;
+            }
+            std::lock_guard<std::mutex> process_guard(PROCESS_MUTEX);
+            if (RUNNING || STOPPING
+            || ring->head.load(std::memory_order_acquire) != ring->tail.load(std::memory_order_relaxed)) {
+                return false;
+            }
+            {
+                std::lock_guard<std::mutex> rings_guard(RINGS_MUTEX);
+                RINGS.erase(std::remove(RINGS.begin(), RINGS.end(), ring), RINGS.end());
+                RINGS_GENERATION.fetch_add(1, std::memory_order_release);
+            }
+            delete ring;
+            return true;
+        }
+    };
 
     static void save_default_console_attributes(HANDLE hTerminal) {
         CONSOLE_SCREEN_BUFFER_INFO info;
@@ -69,16 +170,118 @@ namespace logger {
         SetConsoleTextAttribute(hTerminal, info.wAttributes);
     }
 
-    static void output_buffer_flush() {
+    static void sink_enqueue(Sink *sink, const std::vector<OutputLine> &buffer) {
+        std::unique_lock<std::mutex> lock(sink->mutex);
+        if (sink->closing) {
+            return;
+        }
+
+        // the sink thread only waits on an empty queue
+        bool notify = sink->queue.empty();
+        for (auto &line : buffer) {
+            if (sink->queue.size() >= sink->capacity) {
+
+                // sink threads never wait for a queue, they might be the one it waits for
+                if (sink->policy == SinkPolicy::Block && SINK_CURRENT == nullptr) {
+                    sink->data_cv.notify_one();
+                    sink->space_cv.wait(lock, [sink] {
+                        return sink->queue.size() < sink->capacity || sink->closing;
+                    });
+                    if (sink->closing) {
+                        return;
+                    }
+                    notify = sink->queue.empty();
+                } else {
+                    sink->dropped->fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+            }
+            sink->queue.emplace_back(line.data, line.style);
+        }
+        lock.unlock();
+
+        if (notify) {
+            sink->data_cv.notify_one();
+        }
+    }
+
+    static void sinks_dispatch(const std::vector<OutputLine> &buffer) {
+
+        // copy the list so sinks can be removed while a queue blocks
+        std::vector<std::shared_ptr<Sink>> sinks;
+        {
+            std::lock_guard<std::mutex> sinks_guard(SINKS_MUTEX);
+            if (SINKS.empty()) {
+                return;
+            }
+            sinks = SINKS;
+        }
+
+        for (auto &sink : sinks) {
+            sink_enqueue(sink.get(), buffer);
+        }
+    }
+
+    static void sink_thread(std::shared_ptr<Sink> sink) {
+
+        // the reference keeps the sink alive if it detached itself
+        SINK_CURRENT = sink.get();
+
+        std::vector<std::pair<std::string, Style>> lines;
+        while (true) {
+
+            // take all queued lines at once
+            {
+                std::unique_lock<std::mutex> lock(sink->mutex);
+                sink->data_cv.wait(lock, [&sink] { return !sink->queue.empty() || sink->closing; });
+                if (sink->queue.empty()) {
+                    return;
+                }
+                std::swap(lines, sink->queue);
+            }
+            sink->space_cv.notify_all();
+
+            // deliver
+            for (auto &line : lines) {
+                sink->sink(sink->user, line.first, line.second);
+            }
+            lines.clear();
+        }
+    }
+
+    static void sink_close(const std::shared_ptr<Sink> &sink) {
+
+        // remaining lines are still delivered
+        {
+            std::lock_guard<std::mutex> lock(sink->mutex);
+            sink->closing = true;
+        }
+        sink->data_cv.notify_all();
+        sink->space_cv.notify_all();
 
-        // get buffer and swap
-        auto buffer = output_buffer_swap();
+        // a sink removing itself can't wait for its own thread
+        if (SINK_CURRENT == sink.get()) {
+            sink->thread->detach();
+        } else {
+            sink->thread->join();
+        }
+        delete sink->thread;
+        sink->thread = nullptr;
+    }
+
+    static void output_write(std::vector<OutputLine> &buffer) {
 
         // return early if no messages to process
-        if (buffer->empty()) {
+        if (buffer.empty()) {
             return;
         }
 
+        // sinks get the lines before the console so blocking sinks don't hold the output lock
+        sinks_dispatch(buffer);
+
+        // only one writer at a time so the console colors stay consistent
+        std::lock_guard<std::mutex> output_guard(OUTPUT_MUTEX);
+
         // get terminal handle
         HANDLE hTerminal = GetStdHandle(STD_OUTPUT_HANDLE);
 
@@ -96,13 +299,15 @@ namespace logger {
         // write to console and file
         DWORD result;
         Style last_style = DEFAULT;
-        for (auto &content : *buffer) {
+        std::string run;
+        for (size_t i = 0; i < buffer.size();) {
+            auto style = buffer[i].style;
 
             // set style if color mode enabled
-            if (logger::COLOR && last_style != content.second) {
-                last_style = content.second;
+            if (logger::COLOR && last_style != style) {
+                last_style = style;
 
-                switch (content.second) {
+                switch (style) {
                     case Style::DEFAULT:
                         set_console_color(hTerminal, FOREGROUND_WHITE);
                         break;
@@ -118,17 +323,26 @@ namespace logger {
                 }
             }
 
+            // lines of the same style are written at once
+            run.clear();
+            for (; i < buffer.size() && buffer[i].style == style; i++) {
+                run += buffer[i].data;
+                if (buffer[i].terminate) {
+                    run += "\r\n";
+                }
+            }
+
             // write to console
-            WriteFile(hTerminal, content.first.c_str(), content.first.size(), &result, nullptr);
+            WriteFile(hTerminal, run.c_str(), run.size(), &result, nullptr);
 
             // write to file
             if (LOG_FILE && LOG_FILE != INVALID_HANDLE_VALUE) {
-                WriteFile(LOG_FILE, content.first.c_str(), content.first.size(), &result, nullptr);
+                WriteFile(LOG_FILE, run.c_str(), run.size(), &result, nullptr);
             }
         }
 
         // clear buffer
-        buffer->clear();
+        buffer.clear();
 
         // reset style
         if (logger::COLOR) {
@@ -136,6 +350,292 @@ namespace logger {
         }
     }
 
+    static void output_add(std::vector<OutputLine> &buffer, std::string data, Style style, bool terminate) {
+
+        // filter stage
+        {
+            std::lock_guard<std::recursive_mutex> hooks_guard(HOOKS_MUTEX);
+            for (auto &hook : HOOKS) {
+                std::string out;
+
+                if (hook.first(hook.second, data, style, out)) {
+                    data = std::move(out);
+                    break;
+                }
+            }
+        }
+
+        // check if empty
+        if (data.empty()) {
+            return;
+        }
+
+        // add to output
+        buffer.push_back(OutputLine { std::move(data), style, terminate });
+    }
+
+    static void record_wake() {
+
+        // pairs with the fence in records_wait so either side sees the other
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (SLEEPING.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> event_guard(EVENT_MUTEX);
+            EVENT_HOT = true;
+            EVENT_CV.notify_one();
+        }
+    }
+
+    static RecordRing *record_ring_create() {
+
+        // marks the ring as abandoned on thread exit
+        static thread_local RecordRingOwner owner;
+        (void) owner;
+
+        RING = new RecordRing();
+        std::lock_guard<std::mutex> rings_guard(RINGS_MUTEX);
+        RINGS.push_back(RING);
+        RINGS_GENERATION.fetch_add(1, std::memory_order_release);
+
+        return RING;
+    }
+
+    uint8_t *record_reserve(size_t size) {
+
+        // format on the calling thread if the logging thread isn't available
+        if (!RUNNING.load(std::memory_order_relaxed) || BLOCKING || CONSUMER || RING_EXITED) {
+            return nullptr;
+        }
+
+        // oversized records are formatted right away
+        size_t total = (sizeof(Record) + size + 7) & ~static_cast<size_t>(7);
+        if (total > RECORD_SIZE_MAX) {
+            return nullptr;
+        }
+
+        // announce the record before checking the logging thread again, see stop
+        auto ring = RING ? RING : record_ring_create();
+        ring->writing.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!RUNNING.load(std::memory_order_relaxed)) {
+            ring->writing.store(false, std::memory_order_release);
+            return nullptr;
+        }
+
+        // records are contiguous, skip the end of the ring if it doesn't fit
+        size_t head = ring->head.load(std::memory_order_relaxed);
+        size_t offset = head & (RECORD_RING_SIZE - 1);
+        size_t padding = RECORD_RING_SIZE - offset < total ? RECORD_RING_SIZE - offset : 0;
+
+        // wait for free space
+        while (head + padding + total - ring->tail_cached > RECORD_RING_SIZE) {
+            ring->tail_cached = ring->tail.load(std::memory_order_acquire);
+            if (head + padding + total - ring->tail_cached <= RECORD_RING_SIZE) {
+                break;
+            }
+            if (!RUNNING.load(std::memory_order_relaxed)) {
+                ring->writing.store(false, std::memory_order_release);
+                return nullptr;
+            }
+
+            // the logging thread might be blocked on the queue of this sink
+            if (SINK_CURRENT) {
+                ring->writing.store(false, std::memory_order_release);
+                return nullptr;
+            }
+            record_wake();
+            std::this_thread::yield();
+        }
+
+        // padding smaller than a header is skipped implicitly
+        if (padding >= sizeof(Record)) {
+            auto record = reinterpret_cast<Record *>(&ring->data[offset]);
+            record->size = static_cast<uint32_t>(padding);
+            record->format = nullptr;
+        }
+
+        ring->reserved = head + padding;
+        ring->reserved_end = head + padding + total;
+        return &ring->data[ring->reserved & (RECORD_RING_SIZE - 1)] + sizeof(Record);
+    }
+
+    void record_commit(RecordFormat_t format, Style style, bool terminate) {
+        auto ring = RING;
+
+        // fill header
+        auto record = reinterpret_cast<Record *>(&ring->data[ring->reserved & (RECORD_RING_SIZE - 1)]);
+        record->size = static_cast<uint32_t>(ring->reserved_end - ring->reserved);
+        record->style = static_cast<uint16_t>(style);
+        record->terminate = terminate;
+        record->time = static_cast<int64_t>(__rdtsc());
+        record->format = format;
+
+        // publish
+        ring->head.store(ring->reserved_end, std::memory_order_release);
+        ring->writing.store(false, std::memory_order_release);
+        record_wake();
+    }
+
+    static void record_format_string(std::string &out, std::time_t, const uint8_t *args) {
+        std::string *data;
+        memcpy(&data, args, sizeof(data));
+        out = std::move(*data);
+        delete data;
+    }
+
+    static Record *record_peek(RecordRing *ring) {
+        size_t tail = ring->tail.load(std::memory_order_relaxed);
+        size_t head = ring->head.load(std::memory_order_acquire);
+
+        while (tail != head) {
+            size_t offset = tail & (RECORD_RING_SIZE - 1);
+
+            // skip implicit padding
+            if (RECORD_RING_SIZE - offset < sizeof(Record)) {
+                tail += RECORD_RING_SIZE - offset;
+                ring->tail.store(tail, std::memory_order_release);
+                continue;
+            }
+
+            // skip padding records
+            auto record = reinterpret_cast<Record *>(&ring->data[offset]);
+            if (record->format == nullptr) {
+                tail += record->size;
+                ring->tail.store(tail, std::memory_order_release);
+                continue;
+            }
+
+            return record;
+        }
+
+        return nullptr;
+    }
+
+    static void rings_refresh() {
+        auto generation = RINGS_GENERATION.load(std::memory_order_acquire);
+        if (generation != RINGS_LOCAL_GENERATION) {
+            std::lock_guard<std::mutex> rings_guard(RINGS_MUTEX);
+            RINGS_LOCAL = RINGS;
+            RINGS_LOCAL_GENERATION = RINGS_GENERATION.load(std::memory_order_relaxed);
+        }
+    }
+
+    static bool records_pending() {
+        if (RINGS_GENERATION.load(std::memory_order_relaxed) != RINGS_LOCAL_GENERATION) {
+            return true;
+        }
+        for (auto ring : RINGS_LOCAL) {
+            if (ring->head.load(std::memory_order_relaxed) != ring->tail.load(std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static void records_process() {
+        rings_refresh();
+
+        /*
+         * Records carry TSC ticks which are the cheapest clock to read.
+         * The rate is calibrated against the steady clock since start, records are only a few ms old so
+         * the error of the converted wall time stays far below the second resolution of the log.
+         */
+        auto ticks_now = static_cast<int64_t>(__rdtsc());
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - CLOCK_START).count();
+        double ticks_per_second = elapsed > 0.001 ? (ticks_now - CLOCK_START_TICKS) / elapsed : 0.0;
+        double wall_now = std::chrono::duration<double>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+
+        // merge all rings by timestamp
+        while (true) {
+            RecordRing *next_ring = nullptr;
+            Record *next = nullptr;
+            for (auto ring : RINGS_LOCAL) {
+                auto record = record_peek(ring);
+                if (record && (!next || record->time < next->time)) {
+                    next_ring = ring;
+                    next = record;
+                }
+            }
+            if (!next) {
+                break;
+            }
+
+            // format
+            double age = ticks_per_second > 0.0 ? (ticks_now - next->time) / ticks_per_second : 0.0;
+            auto ts = static_cast<std::time_t>(std::floor(wall_now - age));
+            std::string data;
+            next->format(data, ts, reinterpret_cast<uint8_t *>(next + 1));
+            auto style = static_cast<Style>(next->style);
+            bool terminate = next->terminate != 0;
+
+            // release before the hooks run so producers can continue
+            next_ring->tail.store(next_ring->tail.load(std::memory_order_relaxed) + next->size,
+                    std::memory_order_release);
+
+            output_add(OUTPUT_BUFFER, std::move(data), style, terminate);
+            if (OUTPUT_BUFFER.size() >= OUTPUT_BATCH) {
+                output_write(OUTPUT_BUFFER);
+            }
+        }
+        output_write(OUTPUT_BUFFER);
+
+        // clean up rings of exited threads
+        for (auto it = RINGS_LOCAL.begin(); it != RINGS_LOCAL.end();) {
+            auto ring = *it;
+            if (ring->abandoned.load(std::memory_order_acquire) && record_peek(ring) == nullptr) {
+                std::lock_guard<std::mutex> rings_guard(RINGS_MUTEX);
+                RINGS.erase(std::remove(RINGS.begin(), RINGS.end(), ring), RINGS.end());
+                auto generation = RINGS_GENERATION.fetch_add(1, std::memory_order_release);
+                if (generation == RINGS_LOCAL_GENERATION) {
+                    RINGS_LOCAL_GENERATION = generation + 1;
+                }
+                it = RINGS_LOCAL.erase(it);
+                delete ring;
+            } else {
+                it++;
+            }
+        }
+    }
+
+    static void records_pass() {
+
+        // flush waits for a pass which started after it was called
+        uint64_t pass;
+        {
+            std::lock_guard<std::mutex> flush_guard(FLUSH_MUTEX);
+            pass = ++FLUSH_PASS_STARTED;
+        }
+
+        // process
+        {
+            std::lock_guard<std::mutex> process_guard(PROCESS_MUTEX);
+            records_process();
+        }
+
+        // notify waiting flushes
+        {
+            std::lock_guard<std::mutex> flush_guard(FLUSH_MUTEX);
+            FLUSH_PASS_DONE = pass;
+        }
+        FLUSH_CV.notify_all();
+    }
+
+    static void records_wait() {
+
+        // announce sleep before the last check, see record_wake
+        SLEEPING.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        // wait for new records
+        if (!records_pending()) {
+            std::unique_lock<std::mutex> lock(EVENT_MUTEX);
+            EVENT_CV.wait_for(lock, std::chrono::milliseconds(100), [] { return EVENT_HOT; });
+            EVENT_HOT = false;
+        }
+
+        SLEEPING.store(false, std::memory_order_relaxed);
+    }
+
     void start() {
 
         // don't start if blocking
@@ -143,108 +643,194 @@ namespace logger {
             return;
         }
 
+        // clock calibration
+        CLOCK_START_TICKS = static_cast<int64_t>(__rdtsc());
+        CLOCK_START = std::chrono::steady_clock::now();
+
         // start logging thread
         RUNNING = true;
         THREAD = new std::thread([] {
-            std::unique_lock<std::mutex> lock(EVENT_MUTEX);
+            CONSUMER = true;
 
             // main loop
             while (RUNNING) {
-
-                // wait for hot buffer
-                EVENT_CV.wait(lock, [] { return OUTPUT_BUFFER_HOT; });
-                OUTPUT_BUFFER_HOT = false;
-
-                // flush buffer
-                output_buffer_flush();
+                records_pass();
+                records_wait();
             }
 
             // make sure all is written
-            output_buffer_flush();
-
-            // flush writes to disk
-            if (LOG_FILE && LOG_FILE != INVALID_HANDLE_VALUE) {
-                FlushFileBuffers(LOG_FILE);
-            }
-
-            // reset terminal
-            if (logger::COLOR) {
-                HANDLE hTerminal = GetStdHandle(STD_OUTPUT_HANDLE);
-                SetConsoleTextAttribute(hTerminal, DEFAULT_ATTRIBUTES);
-            }
+            records_pass();
         });
     }
 
     void stop() {
         log_info("logger", "stop");
 
+        // lines logged from now on wait for the queued ones, see push
+        STOPPING = true;
+
         // clean up thread if required
         RUNNING = false;
         if (THREAD) {
 
             // fake notify to exit wait loop
-            OUTPUT_BUFFER_HOT = true;
+            {
+                std::lock_guard<std::mutex> event_guard(EVENT_MUTEX);
+                EVENT_HOT = true;
+            }
             EVENT_CV.notify_all();
 
             // join and clean up
             THREAD->join();
             delete THREAD;
             THREAD = nullptr;
-        }
-    }
 
-    void push(std::string data, Style color, bool terminate) {
+            /*
+             * Producers which saw the logging thread running still commit their record.
+             * They announce it before checking RUNNING and stop checks for them after clearing it,
+             * so with the fences in between every record is either committed now or never reserved.
+             */
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            {
+                std::lock_guard<std::mutex> rings_guard(RINGS_MUTEX);
+                for (auto ring : RINGS) {
+                    while (ring->writing.load(std::memory_order_acquire)) {
+                        std::this_thread::yield();
+                    }
+                }
+            }
+
+            // records committed while the thread was exiting
+            {
+                std::lock_guard<std::mutex> process_guard(PROCESS_MUTEX);
+                records_process();
+            }
+            FLUSH_CV.notify_all();
+            {
+                std::lock_guard<std::mutex> stop_guard(STOP_MUTEX);
+                STOPPING = false;
+            }
+            STOP_CV.notify_all();
 
-        // log hooks
-        for (auto &hook : HOOKS) {
-            std::string out;
+            // deliver remaining lines to sinks
+            std::vector<std::shared_ptr<Sink>> sinks;
+            {
+                std::lock_guard<std::mutex> sinks_guard(SINKS_MUTEX);
+                std::swap(sinks, SINKS);
+            }
+            for (auto &sink : sinks) {
+                sink_close(sink);
+            }
 
-            if (hook.first(hook.second, data, color, out)) {
-                data = std::move(out);
-                break;
+            // flush writes to disk
+            if (LOG_FILE && LOG_FILE != INVALID_HANDLE_VALUE) {
+                FlushFileBuffers(LOG_FILE);
+            }
+
+            // reset terminal
+            if (logger::COLOR) {
+                HANDLE hTerminal = GetStdHandle(STD_OUTPUT_HANDLE);
+                SetConsoleTextAttribute(hTerminal, DEFAULT_ATTRIBUTES);
             }
         }
+        STOPPING = false;
+    }
 
-        // check if empty
-        if (data.empty()) {
+    void flush() {
+
+        // nothing queued without the logging thread, it can't wait for itself or for a blocked sink thread
+        if (!RUNNING || CONSUMER || SINK_CURRENT) {
             return;
         }
 
-        // add to output
-        OUTPUT_MUTEX.lock();
-        OUTPUT_BUFFER->emplace_back(std::move(data), color);
-        if (terminate) {
-            OUTPUT_BUFFER->emplace_back("\r\n", color);
+        // wait for the next full pass
+        std::unique_lock<std::mutex> lock(FLUSH_MUTEX);
+        uint64_t target = FLUSH_PASS_STARTED + 1;
+        {
+            std::lock_guard<std::mutex> event_guard(EVENT_MUTEX);
+            EVENT_HOT = true;
         }
-        OUTPUT_MUTEX.unlock();
-
-        // check if blocking or the logging thread is not running
-        if (BLOCKING || !RUNNING) {
+        EVENT_CV.notify_one();
+        FLUSH_CV.wait(lock, [target] { return FLUSH_PASS_DONE >= target || !RUNNING; });
+    }
 
-            // blocking guard
-            static std::mutex blocking_lock;
-            std::lock_guard<std::mutex> blocking_guard(blocking_lock);
+    void push(std::string data, Style color, bool terminate) {
 
-            // immediately process logs
-            output_buffer_flush();
+        // hand over to the logging thread
+        if (auto args = record_reserve(sizeof(std::string *))) {
+            auto heap = new std::string(std::move(data));
+            memcpy(args, &heap, sizeof(heap));
+            record_commit(record_format_string, color, terminate);
+            return;
+        }
 
-        } else {
+        // lines logged by hooks on the logging thread join the current batch
+        if (CONSUMER) {
+            output_add(OUTPUT_BUFFER, std::move(data), color, terminate);
+            return;
+        }
 
-            // mark buffer as hot
-            std::unique_lock<std::mutex> lock(EVENT_MUTEX);
-            OUTPUT_BUFFER_HOT = true;
-            EVENT_CV.notify_one();
+        // keep the order of lines still queued by this thread, sink threads never wait
+        if (STOPPING && !SINK_CURRENT) {
+            std::unique_lock<std::mutex> lock(STOP_MUTEX);
+            STOP_CV.wait(lock, [] { return !STOPPING; });
         }
+
+        // immediately process logs
+        std::vector<OutputLine> buffer;
+        output_add(buffer, std::move(data), color, terminate);
+        output_write(buffer);
     }
 
     void hook_add(LogHook_t hook, void *user) {
+        std::lock_guard<std::recursive_mutex> hooks_guard(HOOKS_MUTEX);
         HOOKS.emplace_back(hook, user);
     }
 
     void hook_remove(LogHook_t hook, void *user) {
+
+        // queued lines still need to pass the hook, e.g. the PCBID filter
+        flush();
+
+        std::lock_guard<std::recursive_mutex> hooks_guard(HOOKS_MUTEX);
         HOOKS.erase(std::remove(HOOKS.begin(), HOOKS.end(), std::pair(hook, user)), HOOKS.end());
     }
 
+    std::shared_ptr<const std::atomic<uint64_t>> sink_add(LogSink_t sink, void *user, size_t capacity,
+            SinkPolicy policy)
+    {
+        auto entry = std::make_shared<Sink>();
+        entry->sink = sink;
+        entry->user = user;
+        entry->capacity = std::max<size_t>(capacity, 1);
+        entry->policy = policy;
+        entry->thread = new std::thread(sink_thread, entry);
+        auto dropped = entry->dropped;
+
+        std::lock_guard<std::mutex> sinks_guard(SINKS_MUTEX);
+        SINKS.emplace_back(std::move(entry));
+        return dropped;
+    }
+
+    void sink_remove(LogSink_t sink, void *user) {
+
+        // find and unlink
+        std::shared_ptr<Sink> entry;
+        {
+            std::lock_guard<std::mutex> sinks_guard(SINKS_MUTEX);
+            auto it = std::find_if(SINKS.begin(), SINKS.end(), [sink, user] (const std::shared_ptr<Sink> &e) {
+                return e->sink == sink && e->user == user;
+            });
+            if (it == SINKS.end()) {
+                return;
+            }
+            entry = std::move(*it);
+            SINKS.erase(it);
+        }
+
+        sink_close(entry);
+    }
+
     PCBIDFilter::PCBIDFilter() {
         hook_add(logger::PCBIDFilter::filter, this);
     }
@@ -1,6 +1,14 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
 
 namespace logger {
 
@@ -17,13 +25,153 @@ namespace logger {
 
     void start();
     void stop();
+    void flush();
     void push(std::string data, Style color, bool terminate = false);
 
-    // log hooks
+    /*
+     * Deferred records
+     * Log calls copy their module and raw arguments into a lock-free ring owned by the calling thread.
+     * The logging thread merges the rings by timestamp and runs the format function of each record.
+     * Returns nullptr from record_reserve if the record has to be formatted by the caller instead.
+     */
+    typedef void (*RecordFormat_t)(std::string &out, std::time_t ts, const uint8_t *args);
+    uint8_t *record_reserve(size_t size);
+    void record_commit(RecordFormat_t format, Style style, bool terminate = false);
+
+    // arguments copied by value, specialize for trivially copyable types with a formatter
+    template<typename T>
+    struct record_raw : std::bool_constant<
+            std::is_arithmetic_v<T> || std::is_enum_v<T> || std::is_same_v<T, std::nullptr_t> ||
+            std::is_same_v<T, void *> || std::is_same_v<T, const void *>> {};
+
+    // arguments copied as string contents
+    template<typename T>
+    struct record_string : std::bool_constant<
+            std::is_same_v<T, char *> || std::is_same_v<T, const char *> ||
+            std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>> {};
+
+    template<typename T>
+    constexpr bool record_deferrable = record_raw<std::decay_t<T>>::value || record_string<std::decay_t<T>>::value;
+
+    template<typename T>
+    inline std::string_view record_arg_string(const T &value) {
+        if constexpr (std::is_pointer_v<std::decay_t<T>>) {
+            const char *str = value;
+            return str ? std::string_view(str) : std::string_view();
+        } else {
+            return std::string_view(value);
+        }
+    }
+
+    template<typename T>
+    inline size_t record_arg_size(const T &value) {
+        if constexpr (record_string<std::decay_t<T>>::value) {
+            return sizeof(uint32_t) + record_arg_string(value).size();
+        } else {
+            return sizeof(std::decay_t<T>);
+        }
+    }
+
+    template<typename T>
+    inline void record_arg_write(uint8_t *&data, const T &value) {
+        if constexpr (record_string<std::decay_t<T>>::value) {
+            auto str = record_arg_string(value);
+            auto len = static_cast<uint32_t>(str.size());
+            memcpy(data, &len, sizeof(len));
+            memcpy(data + sizeof(len), str.data(), str.size());
+            data += sizeof(len) + str.size();
+        } else {
+            std::decay_t<T> copy = value;
+            memcpy(data, &copy, sizeof(copy));
+            data += sizeof(copy);
+        }
+    }
+
+    template<typename T>
+    inline auto record_arg_read(const uint8_t *&data) {
+        if constexpr (record_string<std::decay_t<T>>::value) {
+            uint32_t len;
+            memcpy(&len, data, sizeof(len));
+            std::string_view str(reinterpret_cast<const char *>(data + sizeof(len)), len);
+            data += sizeof(len) + len;
+            return str;
+        } else {
+            std::decay_t<T> value;
+            memcpy(&value, data, sizeof(value));
+            data += sizeof(value);
+            return value;
+        }
+    }
+
+    template<typename F, typename... Args>
+    void record_format(std::string &out, std::time_t ts, const uint8_t *args) {
+
+        // braced initialization keeps the read order
+        auto module = record_arg_read<std::string_view>(args);
+        std::tuple<decltype(record_arg_read<Args>(args))...> values { record_arg_read<Args>(args)... };
+
+        std::apply([&out, ts, module] (const auto &... values) {
+            F{}(out, ts, module, values...);
+        }, values);
+    }
+
+    /*
+     * Log with a captureless format lambda.
+     * Calls with arguments that can't be copied (e.g. views into other objects) are formatted right away.
+     */
+    template<typename F, typename... Args>
+    inline void push_deferred(F format, Style style, std::string_view module, const Args &... args) {
+        if constexpr ((record_deferrable<Args> && ...)) {
+            size_t size = record_arg_size(module) + (record_arg_size(args) + ... + 0);
+
+            // queue record
+            if (auto data = record_reserve(size)) {
+                record_arg_write(data, module);
+                (record_arg_write(data, args), ...);
+                record_commit(&record_format<F, Args...>, style);
+                return;
+            }
+
+            // format from a local copy so the format function is only instantiated once
+            std::string copy(size, '\0');
+            auto data = reinterpret_cast<uint8_t *>(copy.data());
+            record_arg_write(data, module);
+            (record_arg_write(data, args), ...);
+            std::string out;
+            record_format<F, Args...>(out, std::time(nullptr), reinterpret_cast<const uint8_t *>(copy.data()));
+            push(std::move(out), style);
+        } else {
+            std::string out;
+            format(out, std::time(nullptr), module, args...);
+            push(std::move(out), style);
+        }
+    }
+
+    /*
+     * Log hooks
+     * Hooks are the filter stage and run in registration order on the logging thread before any sink.
+     * The first hook returning true replaces the line with out, an empty line is dropped.
+     */
     typedef bool (*LogHook_t)(void *user, const std::string &data, Style style, std::string &out);
     void hook_add(LogHook_t hook, void *user);
     void hook_remove(LogHook_t hook, void *user);
 
+    /*
+     * Log sinks
+     * Sinks receive the filtered lines on their own thread through a bounded queue.
+     * A full queue either drops the line and counts it, or blocks the logging thread until there is space.
+     * Lines logged from sink callbacks never wait and are dropped from full queues instead.
+     * sink_add returns the counter of dropped lines, which stays valid after the sink was removed.
+     */
+    enum class SinkPolicy {
+        Drop,
+        Block,
+    };
+    typedef void (*LogSink_t)(void *user, const std::string &data, Style style);
+    std::shared_ptr<const std::atomic<uint64_t>> sink_add(LogSink_t sink, void *user, size_t capacity = 4096,
+            SinkPolicy policy = SinkPolicy::Drop);
+    void sink_remove(LogSink_t sink, void *user);
+
     class PCBIDFilter {
     public:
         PCBIDFilter();
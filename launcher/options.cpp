@@ -152,6 +152,13 @@ static const std::vector<OptionDefinition> OPTION_DEFINITIONS = {
         .type = OptionType::Bool,
         .category = "Network",
     },
+    {
+        .title = "Smart EA Timeout",
+        .name = "smarteatimeout",
+        .desc = "Milliseconds Smart EA waits for resolving and connecting to the server, defaults to 2000",
+        .type = OptionType::Integer,
+        .category = "Network",
+    },
     {
         .title = "EA Maintenance",
         .name = "eamaint",
@@ -708,6 +715,14 @@ static const std::vector<OptionDefinition> OPTION_DEFINITIONS = {
         .type = OptionType::Bool,
         .category = "SpiceCompanion and API",
     },
+    {
+        .title = "API Stream External",
+        .name = "apistreamexternal",
+        .desc = "Allows other devices to watch the MJPEG capture stream. "
+                "The API password is sent unencrypted in the stream URL",
+        .type = OptionType::Bool,
+        .category = "SpiceCompanion and API",
+    },
     {
         .title = "Enable All IO Modules",
         .name = "io",
@@ -949,6 +964,13 @@ static const std::vector<OptionDefinition> OPTION_DEFINITIONS = {
         .type = OptionType::Bool,
         .category = "Development",
     },
+    {
+        .title = "ACIO Session Recording",
+        .name = "aciorecord",
+        .desc = "Records the raw serial traffic of emulated ACIO devices into the given folder, for replaying it later",
+        .type = OptionType::Text,
+        .category = "Development",
+    },
     {
         .title = "Discord RPC AppID Override",
         .name = "discordappid",
@@ -30,6 +30,7 @@ namespace launcher {
             NoLegacy,
             RichPresence,
             SmartEAmusement,
+            SmartEAmusementTimeout,
             EAmusementMaintenance,
             AdapterNetwork,
             AdapterSubnet,
@@ -102,6 +103,7 @@ namespace launcher {
             APISerialBaud,
             APIPretty,
             APIDebugMode,
+            APIStreamExternal,
             EnableAllIOModules,
             EnableACIOModule,
             EnableICCAModule,
@@ -136,6 +138,7 @@ namespace launcher {
             LogLevel,
             EAAutomap,
             EANetdump,
+            ACIORecordPath,
             DiscordAppID,
             BlockingLogger,
             DebugCreateFile,
@@ -579,7 +579,7 @@ namespace overlay::windows {
                         ImGui::Text("Password set.");
                     }
                     if (ImGui::TreeNode("Modules")) {
-                        for (auto &module : client.modules) {
+                        for (auto module : API_CONTROLLER->get_modules()) {
                             if (ImGui::TreeNode(module->name.c_str())) {
                                 ImGui::Text("Password force: %i", module->password_force);
                                 ImGui::TreePop();
@@ -21,18 +21,18 @@ namespace overlay::windows {
         if (LOG_FILE_PATH.length() > 0) {
             auto contents = fileutils::text_read(LOG_FILE_PATH);
             if (contents.length() > 0) {
-                this->log_hook(this, contents, logger::Style::DEFAULT, contents);
+                this->log_sink(this, contents, logger::Style::DEFAULT);
             }
         }
 
-        // add log hook
-        logger::hook_add(&log_hook, this);
+        // add log sink, the UI must never stall logging
+        this->log_dropped = logger::sink_add(&log_sink, this, 16384, logger::SinkPolicy::Drop);
     }
 
     Log::~Log() {
 
-        // remove log hook
-        logger::hook_remove(&log_hook, this);
+        // remove log sink
+        logger::sink_remove(&log_sink, this);
     }
 
     void Log::clear() {
@@ -51,12 +51,21 @@ namespace overlay::windows {
 
         // autoscroll option
         ImGui::SameLine();
-        ImGui::Checkbox("Autoscroll", &this->autoscroll);
+        bool autoscroll = this->autoscroll;
+        if (ImGui::Checkbox("Autoscroll", &autoscroll)) {
+            this->autoscroll = autoscroll;
+        }
 
         // filter
         ImGui::SameLine();
         this->filter.Draw("Filter", -50.f);
 
+        // lines which didn't fit into the sink queue
+        auto dropped = this->log_dropped->load(std::memory_order_relaxed);
+        if (dropped > 0) {
+            ImGui::TextColored(ImVec4(1.f, 1.f, 0.f, 1.f), "%llu lines dropped", (unsigned long long) dropped);
+        }
+
         // log area
         ImGui::Separator();
         ImGui::BeginChild("scrolling", ImVec2(0, 0), false, ImGuiWindowFlags_HorizontalScrollbar);
@@ -65,8 +74,8 @@ namespace overlay::windows {
         this->log_data_m.lock();
         for (auto &data : log_data) {
 
-            // ignore empty lines and check filter
-            if (data.first != "\r\n" && this->filter.PassFilter(data.first.c_str())) {
+            // check filter
+            if (this->filter.PassFilter(data.first.c_str())) {
 
                 // decide on color
                 ImVec4 col(1.f, 1.f, 1.f, 1.f);
@@ -92,8 +101,7 @@ namespace overlay::windows {
         this->log_data_m.unlock();
 
         // automatic scrolling to bottom
-        if (scroll_to_bottom) {
-            scroll_to_bottom = false;
+        if (this->scroll_to_bottom.exchange(false)) {
             ImGui::SetScrollHereY(1.f);
         }
 
@@ -101,7 +109,7 @@ namespace overlay::windows {
         ImGui::EndChild();
     }
 
-    bool Log::log_hook(void *user, const std::string &data, logger::Style style, std::string &out) {
+    void Log::log_sink(void *user, const std::string &data, logger::Style style) {
 
         // get reference from user pointer
         auto This = reinterpret_cast<Log *>(user);
@@ -115,8 +123,5 @@ namespace overlay::windows {
         if (This->autoscroll) {
             This->scroll_to_bottom = true;
         }
-
-        // don't replace log data
-        return false;
     }
 }
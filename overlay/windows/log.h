@@ -1,5 +1,7 @@
 #pragma once
 
+#include <atomic>
+#include <memory>
 #include <mutex>
 #include "overlay/window.h"
 #include "launcher/logger.h"
@@ -12,8 +14,11 @@ namespace overlay::windows {
         std::vector<std::pair<std::string, logger::Style>> log_data;
         std::mutex log_data_m;
         ImGuiTextFilter filter;
-        bool scroll_to_bottom = true;
-        bool autoscroll = true;
+        std::shared_ptr<const std::atomic<uint64_t>> log_dropped;
+
+        // set from the sink thread
+        std::atomic<bool> scroll_to_bottom = true;
+        std::atomic<bool> autoscroll = true;
 
         void clear();
 
@@ -23,6 +28,6 @@ namespace overlay::windows {
         ~Log() override;
 
         void build_content() override;
-        static bool log_hook(void *user, const std::string &data, logger::Style style, std::string &out);
+        static void log_sink(void *user, const std::string &data, logger::Style style);
     };
 }
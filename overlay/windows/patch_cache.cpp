@@ -0,0 +1,267 @@
+#include "patch_cache.h"
+
+#include <cstring>
+#include <fstream>
+
+#include "external/rapidjson/document.h"
+#include "external/rapidjson/writer.h"
+#include "external/hash-library/sha256.h"
+
+using namespace rapidjson;
+
+namespace overlay::windows {
+
+    // amount of bytes hashed for the file identity
+    static const size_t IDENTITY_HASH_SIZE = 4096;
+
+    // offsets from the NT headers, the checksum is at the same place for PE32 and PE32+
+    static const size_t PE_TIME_STAMP_OFFSET = 8;
+    static const size_t PE_CHECKSUM_OFFSET = 24 + 64;
+
+    std::optional<PatchCacheFile> PatchCache::identify(const std::filesystem::path &path) {
+        std::error_code ec;
+        PatchCacheFile file;
+
+        // size and modification time
+        file.size = std::filesystem::file_size(path, ec);
+        if (ec) {
+            return std::nullopt;
+        }
+        auto time = std::filesystem::last_write_time(path, ec);
+        if (ec) {
+            return std::nullopt;
+        }
+        file.time = time.time_since_epoch().count();
+
+        // hash the headers
+        std::ifstream stream(path, std::ios::binary);
+        if (!stream) {
+            return std::nullopt;
+        }
+        char buffer[IDENTITY_HASH_SIZE];
+        stream.read(buffer, sizeof(buffer));
+        auto buffer_size = static_cast<size_t>(stream.gcount());
+        SHA256 hash;
+        hash.add(buffer, buffer_size);
+        file.hash = hash.getHash();
+
+        // PE time stamp and checksum
+        if (buffer_size >= 0x40 && buffer[0] == 'M' && buffer[1] == 'Z') {
+            uint32_t nt_offset;
+            memcpy(&nt_offset, &buffer[0x3C], sizeof(nt_offset));
+            if (static_cast<uint64_t>(nt_offset) + PE_CHECKSUM_OFFSET + sizeof(file.pe_checksum) <= buffer_size
+            && !memcmp(&buffer[nt_offset], "PE\0\0", 4)) {
+                memcpy(&file.pe_time_stamp, &buffer[nt_offset + PE_TIME_STAMP_OFFSET], sizeof(file.pe_time_stamp));
+                memcpy(&file.pe_checksum, &buffer[nt_offset + PE_CHECKSUM_OFFSET], sizeof(file.pe_checksum));
+            }
+        }
+
+        return file;
+    }
+
+    std::string PatchCache::signature_key(const std::string &signature, const std::string &replacement,
+            int64_t offset, int64_t usage)
+    {
+        SHA256 hash;
+        hash.add(signature.c_str(), signature.length() + 1);
+        hash.add(replacement.c_str(), replacement.length() + 1);
+        hash.add(&offset, sizeof(offset));
+        hash.add(&usage, sizeof(usage));
+        return hash.getHash();
+    }
+
+    bool PatchCache::load(const std::string &json) {
+        this->dlls.clear();
+        this->dirty = false;
+
+        // parse document
+        Document doc;
+        doc.Parse(json.c_str());
+        if (doc.HasParseError() || !doc.IsObject()) {
+            return false;
+        }
+
+        // check version
+        auto version_it = doc.FindMember("version");
+        if (version_it == doc.MemberEnd() || !version_it->value.IsInt()
+        || version_it->value.GetInt() != version) {
+            return false;
+        }
+
+        // read DLLs
+        auto dlls_it = doc.FindMember("dlls");
+        if (dlls_it == doc.MemberEnd() || !dlls_it->value.IsObject()) {
+            return false;
+        }
+        for (auto &dll_member : dlls_it->value.GetObject()) {
+            auto &dll_value = dll_member.value;
+            if (!dll_value.IsObject()) {
+                continue;
+            }
+
+            // file identity
+            auto size_it = dll_value.FindMember("size");
+            auto time_it = dll_value.FindMember("time");
+            auto pe_time_stamp_it = dll_value.FindMember("pe_time_stamp");
+            auto pe_checksum_it = dll_value.FindMember("pe_checksum");
+            auto hash_it = dll_value.FindMember("hash");
+            auto standalone_it = dll_value.FindMember("standalone");
+            auto signatures_it = dll_value.FindMember("signatures");
+            if (size_it == dll_value.MemberEnd() || !size_it->value.IsUint64()
+            || time_it == dll_value.MemberEnd() || !time_it->value.IsInt64()
+            || pe_time_stamp_it == dll_value.MemberEnd() || !pe_time_stamp_it->value.IsUint()
+            || pe_checksum_it == dll_value.MemberEnd() || !pe_checksum_it->value.IsUint()
+            || hash_it == dll_value.MemberEnd() || !hash_it->value.IsString()
+            || standalone_it == dll_value.MemberEnd() || !standalone_it->value.IsBool()
+            || signatures_it == dll_value.MemberEnd() || !signatures_it->value.IsObject()) {
+                continue;
+            }
+            Dll dll;
+            dll.file.size = size_it->value.GetUint64();
+            dll.file.time = time_it->value.GetInt64();
+            dll.file.pe_time_stamp = pe_time_stamp_it->value.GetUint();
+            dll.file.pe_checksum = pe_checksum_it->value.GetUint();
+            dll.file.hash = hash_it->value.GetString();
+            dll.standalone = standalone_it->value.GetBool();
+
+            // entries
+            for (auto &signature_member : signatures_it->value.GetObject()) {
+                auto &value = signature_member.value;
+                if (!value.IsObject()) {
+                    continue;
+                }
+                auto found_it = value.FindMember("found");
+                auto location_it = value.FindMember("location");
+                auto data_offset_it = value.FindMember("data_offset");
+                auto count_it = value.FindMember("count");
+                if (found_it == value.MemberEnd() || !found_it->value.IsBool()
+                || location_it == value.MemberEnd() || !location_it->value.IsUint64()
+                || data_offset_it == value.MemberEnd() || !data_offset_it->value.IsUint64()
+                || count_it == value.MemberEnd() || !count_it->value.IsUint64()) {
+                    continue;
+                }
+                Entry entry;
+                entry.data.found = found_it->value.GetBool();
+                entry.data.location = location_it->value.GetUint64();
+                entry.data.data_offset = data_offset_it->value.GetUint64();
+                entry.data.count = count_it->value.GetUint64();
+                dll.entries.emplace(signature_member.name.GetString(), entry);
+            }
+
+            this->dlls.emplace(dll_member.name.GetString(), std::move(dll));
+        }
+
+        return true;
+    }
+
+    std::string PatchCache::save() {
+
+        // prune unused entries of DLLs which were looked at
+        for (auto &[dll_name, dll] : this->dlls) {
+            if (dll.validated) {
+                std::erase_if(dll.entries, [] (auto &entry) {
+                    return !entry.second.used;
+                });
+            }
+        }
+        this->dirty = false;
+
+        Document doc;
+        doc.SetObject();
+        auto &allocator = doc.GetAllocator();
+        doc.AddMember("version", version, allocator);
+
+        // DLLs
+        Value dlls_value(kObjectType);
+        for (auto &[dll_name, dll] : this->dlls) {
+            Value dll_value(kObjectType);
+            dll_value.AddMember("size", dll.file.size, allocator);
+            dll_value.AddMember("time", dll.file.time, allocator);
+            dll_value.AddMember("pe_time_stamp", dll.file.pe_time_stamp, allocator);
+            dll_value.AddMember("pe_checksum", dll.file.pe_checksum, allocator);
+            dll_value.AddMember("hash", Value(dll.file.hash.c_str(), allocator), allocator);
+            dll_value.AddMember("standalone", dll.standalone, allocator);
+
+            // entries
+            Value signatures_value(kObjectType);
+            for (auto &[key, entry] : dll.entries) {
+                Value entry_value(kObjectType);
+                entry_value.AddMember("found", entry.data.found, allocator);
+                entry_value.AddMember("location", entry.data.location, allocator);
+                entry_value.AddMember("data_offset", entry.data.data_offset, allocator);
+                entry_value.AddMember("count", entry.data.count, allocator);
+                signatures_value.AddMember(Value(key.c_str(), allocator), entry_value, allocator);
+            }
+            dll_value.AddMember("signatures", signatures_value, allocator);
+
+            dlls_value.AddMember(Value(dll_name.c_str(), allocator), dll_value, allocator);
+        }
+        doc.AddMember("dlls", dlls_value, allocator);
+
+        // build JSON
+        StringBuffer buffer;
+        Writer<StringBuffer> writer(buffer);
+        doc.Accept(writer);
+        return buffer.GetString();
+    }
+
+    bool PatchCache::validate(const std::string &dll_name, const PatchCacheFile &file, bool standalone) {
+        auto &dll = this->dlls[dll_name];
+        if (dll.validated) {
+            return true;
+        }
+        dll.validated = true;
+
+        // keep entries of the same file
+        if (dll.file == file && dll.standalone == standalone) {
+            return true;
+        }
+
+        // start over
+        dll.entries.clear();
+        dll.file = file;
+        dll.standalone = standalone;
+        this->dirty = true;
+        return false;
+    }
+
+    bool PatchCache::is_dirty() const {
+        if (this->dirty) {
+            return true;
+        }
+
+        // unused entries get pruned
+        for (auto &[dll_name, dll] : this->dlls) {
+            if (dll.validated) {
+                for (auto &[key, entry] : dll.entries) {
+                    if (!entry.used) {
+                        return true;
+                    }
+                }
+            }
+        }
+        return false;
+    }
+
+    const PatchCacheEntry *PatchCache::find(const std::string &dll_name, const std::string &key) {
+        auto dll = this->dlls.find(dll_name);
+        if (dll == this->dlls.end() || !dll->second.validated) {
+            return nullptr;
+        }
+        auto entry = dll->second.entries.find(key);
+        if (entry == dll->second.entries.end()) {
+            return nullptr;
+        }
+        entry->second.used = true;
+        return &entry->second.data;
+    }
+
+    void PatchCache::store(const std::string &dll_name, const std::string &key, const PatchCacheEntry &entry) {
+        auto &dll = this->dlls[dll_name];
+        dll.entries[key] = Entry {
+            .data = entry,
+            .used = true,
+        };
+        this->dirty = true;
+    }
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+namespace overlay::windows {
+
+    /*
+     * Identity of a DLL on disk, compared to decide if cached results are still valid.
+     */
+    struct PatchCacheFile {
+        uint64_t size = 0;
+        int64_t time = 0;
+
+        // link time stamp and checksum from the PE headers, rebuilt binaries differ even if size and time match
+        uint32_t pe_time_stamp = 0;
+        uint32_t pe_checksum = 0;
+
+        // SHA256 of the first page
+        std::string hash;
+
+        bool operator==(const PatchCacheFile &other) const {
+            return size == other.size && time == other.time
+                && pe_time_stamp == other.pe_time_stamp && pe_checksum == other.pe_checksum
+                && hash == other.hash;
+        }
+    };
+
+    /*
+     * Resolved signature patch.
+     */
+    struct PatchCacheEntry {
+        bool found = false;
+
+        // RVA in the module, or offset into the file data when running standalone
+        uint64_t location = 0;
+
+        // offset into the file
+        uint64_t data_offset = 0;
+
+        // amount of matches of the signature
+        uint64_t count = 0;
+    };
+
+    /*
+     * On-disk cache of signature patch results, so unchanged game binaries don't get scanned on every launch.
+     *
+     * Results are stored per DLL and dropped as a whole when the file identity or the scan mode changes.
+     * Entries are keyed by the hash of the signature definition, so a changed patch file only misses the
+     * signatures which were actually edited, and entries not used anymore are pruned when saving.
+     * Whether a patch is applicable follows from the found flags of its signatures, the enabled state is
+     * kept in the patch config and the applied state is always read back from memory.
+     */
+    class PatchCache {
+    public:
+
+        const static int version = 2;
+
+        /*
+         * Reads the identity of the file, or nothing if it can't be accessed.
+         */
+        static std::optional<PatchCacheFile> identify(const std::filesystem::path &path);
+
+        /*
+         * Builds the entry key for a signature patch.
+         */
+        static std::string signature_key(const std::string &signature, const std::string &replacement,
+                int64_t offset, int64_t usage);
+
+        /*
+         * Replaces the contents with the serialized cache, returns false if it can't be used.
+         */
+        bool load(const std::string &json);
+
+        /*
+         * Serializes the cache, pruning entries of looked at DLLs which weren't used since loading.
+         */
+        std::string save();
+
+        /*
+         * Selects the DLL for lookups, dropping its entries if the file or mode doesn't match.
+         * Returns true if the previous entries were kept.
+         */
+        bool validate(const std::string &dll_name, const PatchCacheFile &file, bool standalone);
+
+        const PatchCacheEntry *find(const std::string &dll_name, const std::string &key);
+        void store(const std::string &dll_name, const std::string &key, const PatchCacheEntry &entry);
+
+        /*
+         * Checks if saving would change the stored contents.
+         */
+        bool is_dirty() const;
+
+    private:
+
+        struct Entry {
+            PatchCacheEntry data;
+            bool used = false;
+        };
+
+        struct Dll {
+            PatchCacheFile file;
+            bool standalone = false;
+            bool validated = false;
+            std::unordered_map<std::string, Entry> entries;
+        };
+
+        std::map<std::string, Dll> dlls;
+        bool dirty = false;
+    };
+}
@@ -1,5 +1,6 @@
 #include "patch_manager.h"
 
+#include <chrono>
 #include <psapi.h>
 #include "external/rapidjson/document.h"
 #include "external/rapidjson/writer.h"
@@ -10,6 +11,7 @@
 #include "games/io.h"
 #include "build/resource.h"
 #include "util/sigscan.h"
+#include "overlay/windows/patch_cache.h"
 #include "util/resutils.h"
 #include "util/fileutils.h"
 #include "util/libutils.h"
@@ -34,9 +36,11 @@ using namespace rapidjson;
 namespace overlay::windows {
 
     robin_hood::unordered_map<std::string, std::unique_ptr<std::vector<uint8_t>>> DLL_MAP;
+    PatchCache PATCH_CACHE;
 
     // configuration
     std::string PatchManager::config_path;
+    std::string PatchManager::cache_path;
     bool PatchManager::config_dirty = false;
     bool PatchManager::setting_auto_apply = false;
     std::vector<std::string> PatchManager::setting_auto_apply_list;
@@ -450,6 +454,10 @@ namespace overlay::windows {
             log_warning("patchmanager", "config parse error: {}", error);
         }
 
+        // signature patches get resolved after parsing, all of a DLL in a single scan
+        std::vector<SignaturePatch> signature_patches;
+        size_t patches_begin = patches.size();
+
         // iterate patches
         for (auto &patch : doc.GetArray()) {
 
@@ -766,10 +774,11 @@ namespace overlay::windows {
                             .replacement = data_replacement_it->value.GetString(),
                             .offset = offset,
                             .usage = usage,
+                            .patch_index = patches.size(),
                     };
 
-                    // convert to memory patch
-                    patch_data.patches_memory.emplace_back(signature_data.to_memory(&patch_data));
+                    // converted to a memory patch once resolved
+                    signature_patches.emplace_back(std::move(signature_data));
                     patch_data.type = PatchType::Memory;
                     break;
                 }
@@ -779,14 +788,20 @@ namespace overlay::windows {
                     break;
             }
 
-            // auto apply
+            // remember patch
+            patches.emplace_back(patch_data);
+        }
+
+        // find signatures
+        resolve_signatures(signature_patches);
+
+        // auto apply
+        for (size_t i = patches_begin; i < patches.size(); i++) {
+            auto &patch_data = patches[i];
             if (apply_patches && setting_auto_apply && patch_data.enabled) {
                 log_misc("patchmanager", "auto apply: {}", patch_data.name);
                 apply_patch(patch_data, true);
             }
-
-            // remember patch
-            patches.emplace_back(patch_data);
         }
     }
 
@@ -1073,71 +1088,80 @@ namespace overlay::windows {
         }
     }
 
-    MemoryPatch SignaturePatch::to_memory(PatchData *patch) {
+    static std::optional<SignaturePattern> parse_signature(std::string hex) {
 
-        // check if file exists
-        auto dll_path = MODULE_PATH / dll_name;
-        if (!fileutils::file_exists(dll_path)) {
+        // patch files also use "XX" for wildcards
+        std::replace(hex.begin(), hex.end(), 'X', '?');
+        return SignaturePattern::parse(hex);
+    }
 
-            // file does not exist so that's pretty fatal
+    static MemoryPatch signature_to_memory(PatchData &patch, const std::string &dll_name,
+            const SignaturePattern &signature, const SignaturePattern &replacement,
+            uint8_t *data_offset_ptr, uint64_t data_offset, uintptr_t data_offset_ptr_base)
+    {
+
+        // check pointers
+        if (data_offset_ptr == nullptr) {
             return {.fatal_error = true};
         }
 
-        // remove spaces
-        signature.erase(std::remove(signature.begin(), signature.end(), ' '), signature.end());
-        replacement.erase(std::remove(replacement.begin(), replacement.end(), ' '), replacement.end());
+        // get disabled/enabled data
+        size_t data_len = std::max(signature.size(), replacement.size());
+        auto data = data_offset_ptr + data_offset_ptr_base;
+        std::shared_ptr<uint8_t[]> data_disabled(new uint8_t[data_len]);
+        std::shared_ptr<uint8_t[]> data_enabled(new uint8_t[data_len]);
+        memutils::VProtectGuard data_guard(data, data_len);
+        memcpy(data_disabled.get(), data, data_len);
+        memcpy(data_enabled.get(), data, data_len);
+        signature.apply(data_disabled.get());
+        replacement.apply(data_enabled.get());
 
-        // build pattern
-        std::string pattern_str(signature);
-        strreplace(pattern_str, "??", "00");
-        strreplace(pattern_str, "XX", "00");
-        auto pattern_bin = std::make_unique<uint8_t[]>(signature.length() / 2);
-        if (!hex2bin(pattern_str.c_str(), pattern_bin.get())) {
-            return {.fatal_error = true};
-        }
+        // log edit
+        log_misc("patchmanager", "found {}: {:#08X}: {} -> {}",
+                 patch.name, data_offset,
+                 bin2hex(data_disabled.get(), data_len),
+                 bin2hex(data_enabled.get(), data_len));
 
-        // build signature mask
-        std::ostringstream signature_mask;
-        for (size_t i = 0; i < signature.length(); i += 2) {
-            if (signature[i] == '?' || signature[i] == 'X') {
-                if (signature[i + 1] == '?' || signature[i + 1] == 'X') {
-                    signature_mask << '?';
-                } else {
-                    return {.fatal_error = true};
-                }
-            } else {
-                signature_mask << 'X';
+        // build patch
+        return MemoryPatch {
+                .dll_name = dll_name,
+                .data_disabled = std::move(data_disabled),
+                .data_disabled_len = data_len,
+                .data_enabled = std::move(data_enabled),
+                .data_enabled_len = data_len,
+                .data_offset = data_offset,
+                .data_offset_ptr = data_offset_ptr,
+        };
+    }
+
+    static void resolve_signature_dll(std::vector<PatchData> &patches, const std::string &dll_name,
+            std::vector<SignaturePatch *> &signatures, size_t &cache_hits)
+    {
+
+        // check if file exists
+        auto dll_path = MODULE_PATH / dll_name;
+        if (!fileutils::file_exists(dll_path)) {
+
+            // file does not exist so that's pretty fatal
+            for (auto signature : signatures) {
+                patches[signature->patch_index].patches_memory.push_back({.fatal_error = true});
             }
-        }
-        std::string signature_mask_str = signature_mask.str();
-
-        // build replace data
-        std::string replace_data_str(replacement);
-        strreplace(replace_data_str, "??", "00");
-        strreplace(replace_data_str, "XX", "00");
-        auto replace_data_bin = std::make_unique<uint8_t[]>(replacement.length() / 2);
-        if (!hex2bin(replace_data_str.c_str(), replace_data_bin.get())) {
-            return {.fatal_error = true};
+            return;
         }
 
-        // build replace mask
-        std::ostringstream replace_mask;
-        for (size_t i = 0; i < replacement.length(); i += 2) {
-            if (replacement[i] == '?' || replacement[i] == 'X') {
-                if (replacement[i + 1] == '?' || replacement[i + 1] == 'X') {
-                    replace_mask << '?';
-                } else {
-                    return {.fatal_error = true};
-                }
-            } else {
-                replace_mask << 'X';
-            }
+        // build patterns
+        std::vector<std::optional<SignaturePattern>> signature_patterns;
+        std::vector<std::optional<SignaturePattern>> replacement_patterns;
+        for (auto signature : signatures) {
+            signature_patterns.emplace_back(parse_signature(signature->signature));
+            replacement_patterns.emplace_back(parse_signature(signature->replacement));
         }
-        std::string replace_mask_str = replace_mask.str();
 
-        // find offset
-        uint64_t data_offset = 0;
-        uint8_t *data_offset_ptr = nullptr;
+        // get data
+        HMODULE module = nullptr;
+        bool module_free = false;
+        const uint8_t *data = nullptr;
+        size_t data_size = 0;
         uintptr_t data_offset_ptr_base = 0;
         if (cfg::CONFIGURATOR_STANDALONE) {
 
@@ -1149,79 +1173,180 @@ namespace overlay::windows {
                                 fileutils::bin_read(dll_path));
                 it = DLL_MAP.find(dll_name);
             }
-
-            // find pattern
-            data_offset = find_pattern(*it->second, 0, pattern_bin.get(), signature_mask_str.c_str(), offset, usage);
-            data_offset_ptr = reinterpret_cast<uint8_t *>(data_offset);
-            data_offset_ptr_base = (uintptr_t) it->second->data();
+            data = it->second->data();
+            data_size = it->second->size();
+            data_offset_ptr_base = (uintptr_t) data;
 
         } else {
 
             // get module
-            auto module = libutils::try_module(dll_path);
-            bool module_free = false;
+            module = libutils::try_module(dll_path);
             if (!module) {
                 module = libutils::try_library(dll_path);
                 if (module) {
                     module_free = true;
                 } else {
-                    return {.fatal_error = true};
+                    for (auto signature : signatures) {
+                        patches[signature->patch_index].patches_memory.push_back({.fatal_error = true});
+                    }
+                    return;
+                }
+            }
+            MODULEINFO module_info {};
+            if (GetModuleInformation(GetCurrentProcess(), module, &module_info, sizeof(module_info))) {
+                data = reinterpret_cast<const uint8_t *>(module);
+                data_size = module_info.SizeOfImage;
+            }
+        }
+
+        // look up cached results, found signatures must still match
+        auto file = PatchCache::identify(dll_path);
+        if (file) {
+            PATCH_CACHE.validate(dll_name, *file, cfg::CONFIGURATOR_STANDALONE);
+        }
+        std::vector<std::string> keys;
+        std::vector<std::optional<PatchCacheEntry>> entries;
+        for (size_t i = 0; i < signatures.size(); i++) {
+            auto signature = signatures[i];
+            auto &key = keys.emplace_back(PatchCache::signature_key(
+                    signature->signature, signature->replacement, signature->offset, signature->usage));
+            auto &entry = entries.emplace_back();
+            if (!file || !signature_patterns[i] || !replacement_patterns[i]) {
+                continue;
+            }
+            auto cached = PATCH_CACHE.find(dll_name, key);
+            if (cached == nullptr) {
+                continue;
+            }
+            auto match = static_cast<int64_t>(cached->location) - signature->offset;
+            if (cached->found && (match < 0 || data == nullptr
+            || static_cast<uint64_t>(match) + signature_patterns[i]->size() > data_size
+            || !signature_patterns[i]->matches(data + match))) {
+                continue;
+            }
+            entry = *cached;
+            cache_hits++;
+        }
+
+        // find the remaining patterns in a single pass
+        SignatureBatch batch;
+        std::vector<size_t> batch_indices(signatures.size(), SIZE_MAX);
+        for (size_t i = 0; i < signatures.size(); i++) {
+            if (!entries[i] && signature_patterns[i] && replacement_patterns[i]) {
+                batch_indices[i] = batch.add(*signature_patterns[i], signatures[i]->usage);
+            }
+        }
+        if (batch.size() > 0) {
+            auto &results = module ? batch.scan(module) : batch.scan(data, data_size, 0);
+            for (size_t i = 0; i < signatures.size(); i++) {
+                if (batch_indices[i] == SIZE_MAX) {
+                    continue;
+                }
+
+                // get offset
+                auto &result = results[batch_indices[i]];
+                PatchCacheEntry entry {
+                    .found = result.address != 0,
+                    .count = result.count,
+                };
+                if (entry.found) {
+                    if (module) {
+                        entry.location = result.address + signatures[i]->offset - (intptr_t) module;
+                        entry.data_offset = libutils::rva2offset(dll_path, (intptr_t) entry.location);
+                    } else {
+                        entry.location = result.address + signatures[i]->offset;
+                        entry.data_offset = entry.location;
+                    }
+                }
+                entries[i] = entry;
+
+                // remember result
+                if (file) {
+                    PATCH_CACHE.store(dll_name, keys[i], entry);
                 }
             }
+        }
 
-            // find pattern
-            data_offset_ptr = reinterpret_cast<uint8_t *>(
-                    find_pattern(module, pattern_bin.get(), signature_mask_str.c_str(), offset, usage));
+        // build memory patches
+        for (size_t i = 0; i < signatures.size(); i++) {
+            auto signature = signatures[i];
+            auto &patch = patches[signature->patch_index];
+            if (!entries[i]) {
+                patch.patches_memory.push_back({.fatal_error = true});
+                continue;
+            }
 
-            // convert back to offset
-            data_offset = libutils::rva2offset(dll_path, (intptr_t) (data_offset_ptr - (uint8_t*) module));
+            // flag ambiguous signatures
+            auto &entry = *entries[i];
+            if (entry.count > 1 && signature->usage == 0) {
+                log_warning("patchmanager", "signature for {} is ambiguous with {} matches",
+                        patch.name, entry.count);
+            }
 
-            // clean
-            if (module_free) {
-                FreeLibrary(module);
+            // get pointer
+            uint8_t *data_offset_ptr = nullptr;
+            if (entry.found) {
+                if (module) {
+                    data_offset_ptr = reinterpret_cast<uint8_t *>(module) + entry.location;
+                } else {
+                    data_offset_ptr = reinterpret_cast<uint8_t *>(entry.location);
+                }
             }
+
+            patch.patches_memory.emplace_back(signature_to_memory(
+                    patch, dll_name, *signature_patterns[i], *replacement_patterns[i],
+                    data_offset_ptr, entry.data_offset, data_offset_ptr_base));
         }
 
-        // check pointers
-        if (data_offset_ptr == nullptr) {
-            return {.fatal_error = true};
+        // clean
+        if (module_free) {
+            FreeLibrary(module);
         }
+    }
 
-        // get disabled/enabled data
-        size_t data_len = std::max(signature_mask_str.length(), replace_mask_str.length());
-        std::shared_ptr<uint8_t[]> data_disabled(new uint8_t[data_len]);
-        std::shared_ptr<uint8_t[]> data_enabled(new uint8_t[data_len]);
-        memutils::VProtectGuard data_guard(data_offset_ptr + data_offset_ptr_base, data_len);
-        for (size_t i = 0; i < data_len; ++i) {
-            if (i >= signature_mask_str.length() || signature_mask_str[i] != 'X') {
-                data_disabled.get()[i] = (data_offset_ptr + data_offset_ptr_base)[i];
-            } else {
-                data_disabled.get()[i] = pattern_bin.get()[i];
+    void PatchManager::resolve_signatures(std::vector<SignaturePatch> &signature_patches) {
+        if (signature_patches.empty()) {
+            return;
+        }
+        auto time_start = std::chrono::steady_clock::now();
+
+        // load cache
+        if (cache_path.empty()) {
+            cache_path = std::string(getenv("APPDATA")) + "\\spicetools_patch_cache.json";
+            if (fileutils::file_exists(cache_path)
+            && !PATCH_CACHE.load(fileutils::text_read(cache_path))) {
+                log_warning("patchmanager", "ignoring invalid patch cache {}", cache_path);
             }
         }
-        for (size_t i = 0; i < data_len; ++i) {
-            if (i >= replace_mask_str.length() || replace_mask_str[i] != 'X') {
-                data_enabled.get()[i] = (data_offset_ptr + data_offset_ptr_base)[i];
-            } else {
-                data_enabled.get()[i] = replace_data_bin.get()[i];
+
+        // group by DLL
+        std::vector<std::pair<std::string, std::vector<SignaturePatch *>>> dlls;
+        for (auto &signature : signature_patches) {
+            auto it = std::find_if(dlls.begin(), dlls.end(), [&signature] (auto &entry) {
+                return entry.first == signature.dll_name;
+            });
+            if (it == dlls.end()) {
+                dlls.emplace_back(signature.dll_name, std::vector<SignaturePatch *>());
+                it = dlls.end() - 1;
             }
+            it->second.push_back(&signature);
         }
 
-        // log edit
-        log_misc("patchmanager", "found {}: {:#08X}: {} -> {}",
-                 patch->name, data_offset,
-                 bin2hex(data_disabled.get(), data_len),
-                 bin2hex(data_enabled.get(), data_len));
+        // resolve
+        size_t cache_hits = 0;
+        for (auto &[dll_name, signatures] : dlls) {
+            resolve_signature_dll(patches, dll_name, signatures, cache_hits);
+        }
 
-        // build patch
-        return MemoryPatch {
-                .dll_name = dll_name,
-                .data_disabled = std::move(data_disabled),
-                .data_disabled_len = data_len,
-                .data_enabled = std::move(data_enabled),
-                .data_enabled_len = data_len,
-                .data_offset = data_offset,
-                .data_offset_ptr = data_offset_ptr,
-        };
+        // save cache
+        if (PATCH_CACHE.is_dirty() && !fileutils::text_write(cache_path, PATCH_CACHE.save())) {
+            log_warning("patchmanager", "unable to save patch cache to {}", cache_path);
+        }
+
+        // show timing
+        auto time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - time_start).count();
+        log_info("patchmanager", "resolved {} signatures in {}ms, {} from cache",
+                signature_patches.size(), time_ms, cache_hits);
     }
 }
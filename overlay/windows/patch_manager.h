@@ -27,13 +27,11 @@ namespace overlay::windows {
         bool fatal_error = false;
     };
 
-    struct PatchData;
     struct SignaturePatch {
         std::string dll_name = "";
         std::string signature = "", replacement = "";
         int64_t offset = 0, usage = 0;
-
-        MemoryPatch to_memory(PatchData *patch);
+        size_t patch_index = 0;
     };
 
     struct PatchData {
@@ -63,6 +61,7 @@ namespace overlay::windows {
 
         // configuration
         static std::string config_path;
+        static std::string cache_path;
         static bool config_dirty;
         static bool setting_auto_apply;
         static std::vector<std::string> setting_auto_apply_list;
@@ -76,6 +75,7 @@ namespace overlay::windows {
         void config_save();
 
         void append_patches(std::string &patches_json, bool apply_patches = false);
+        static void resolve_signatures(std::vector<SignaturePatch> &signature_patches);
     };
 
     PatchStatus is_patch_active(PatchData &patch);
@@ -17,16 +17,12 @@ namespace script::api::capture {
     }
 
     std::string get_jpg(int screen, int quality, int divide) {
-        CAPTURE_BUFFER.reserve(1024 * 128);
 
         // receive JPEG data
-        uint64_t timestamp = 0;
-        int width = 0;
-        int height = 0;
-        graphics_capture_trigger(screen);
-        bool success = graphics_capture_receive_jpeg(screen, [] (uint8_t byte) {
-            CAPTURE_BUFFER.push_back(byte);
-        }, true, quality, true, divide, &timestamp, &width, &height);
+        CaptureOptions options;
+        options.quality = quality;
+        options.divide = divide;
+        bool success = graphics_capture_receive_jpeg(screen, CAPTURE_BUFFER, options);
         if (!success) {
             return std::string();
         }
@@ -36,9 +32,6 @@ namespace script::api::capture {
                 CAPTURE_BUFFER.data(),
                 CAPTURE_BUFFER.size());
 
-        // clear buffer
-        CAPTURE_BUFFER.clear();
-
         // return base64
         return encoded;
     }
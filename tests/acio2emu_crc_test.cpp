@@ -0,0 +1,91 @@
+#include <random>
+#include <vector>
+
+#include "acio2emu/packet.h"
+#include "acio2emu/internal/crc.h"
+
+#include "test.h"
+
+using namespace acio2emu;
+
+/*
+ * One nibble table step at a time, like the CRCs were computed before the byte tables.
+ */
+static uint8_t reference_crc(const uint8_t (&tbl)[16], uint8_t crc, const uint8_t *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        auto b = data[i];
+        crc = (((crc >> 4) ^ (tbl[(b ^ crc) & 0x0F])) >> 4) ^ tbl[(((crc >> 4) ^ (tbl[(b ^ crc) & 0x0F])) ^ (b >> 4)) & 0x0F];
+    }
+    return crc;
+}
+
+static void test_tables() {
+
+    // every state and byte for a single step
+    for (int crc = 0; crc < 128; crc++) {
+        for (int b = 0; b < 256; b++) {
+            auto value = static_cast<uint8_t>(b);
+            CHECK(detail::crc7_lgp_48(crc, &value, 1)
+                    == reference_crc(detail::crc7_lgp_48_nibbles, crc, &value, 1));
+            if (crc < 16) {
+                CHECK(detail::crc4_lgp_c(crc, &value, 1)
+                        == reference_crc(detail::crc4_lgp_c_nibbles, crc, &value, 1));
+            }
+        }
+    }
+
+    // all lengths around the four byte steps, the initial value is masked like before
+    std::mt19937_64 rng(7);
+    for (int iteration = 0; iteration < 10000; iteration++) {
+        std::vector<uint8_t> data(iteration < 64 ? iteration : rng() % 300);
+        for (auto &value : data) {
+            value = static_cast<uint8_t>(rng());
+        }
+        auto crc = static_cast<uint8_t>(rng());
+        CHECK(detail::crc7_lgp_48(crc, data.data(), data.size())
+                == reference_crc(detail::crc7_lgp_48_nibbles, crc & 127, data.data(), data.size()));
+        CHECK(detail::crc4_lgp_c(crc, data.data(), data.size())
+                == reference_crc(detail::crc4_lgp_c_nibbles, crc & 15, data.data(), data.size()));
+    }
+}
+
+static void test_packets() {
+    std::mt19937_64 rng(11);
+    for (int iteration = 0; iteration < 20000; iteration++) {
+
+        // payloads with plenty of bytes to escape
+        std::vector<uint8_t> payload(rng() % (MAX_PAYLOAD_SIZE + 1));
+        for (auto &value : payload) {
+            value = (rng() % 4 == 0) ? (rng() % 2 ? 0xAA : 0xFF) : static_cast<uint8_t>(rng());
+        }
+        auto node = static_cast<uint8_t>(rng() % 16);
+        auto tag = static_cast<uint8_t>(rng());
+        uint8_t packet[MAX_PACKET_SIZE];
+        auto size = encode_packet(packet, node, tag, payload);
+        if (!CHECK(size > 5)) {
+            continue;
+        }
+
+        // header CRC over the header with a zeroed CRC byte, payload CRC over the unescaped payload
+        uint8_t header[4] = { packet[1], packet[2], packet[3], 0 };
+        CHECK(packet[4] == (reference_crc(detail::crc4_lgp_c_nibbles, 0x0F, header, 4) ^ 0x0F));
+        CHECK(packet[size - 1] == (reference_crc(detail::crc7_lgp_48_nibbles, 0x7F,
+                payload.data(), payload.size()) ^ 0x7F));
+
+        // the ring buffer variant writes the same bytes
+        PacketBuffer ring;
+        std::vector<uint8_t> junk(rng() % 300);
+        ring.write(junk);
+        ring.read(junk);
+        CHECK(encode_packet(ring, node, tag, payload));
+        std::vector<uint8_t> encoded(ring.size());
+        ring.read(encoded);
+        CHECK(encoded == std::vector<uint8_t>(packet, packet + size));
+    }
+}
+
+int main() {
+    test_tables();
+    test_packets();
+    return test::result();
+}
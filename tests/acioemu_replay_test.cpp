@@ -0,0 +1,139 @@
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <vector>
+
+#include "acioemu/acioemu.h"
+#include "acioemu/recorder.h"
+#include "acioemu/replay.h"
+
+#include "test.h"
+
+using namespace acioemu;
+
+/*
+ * Answers every command with a status counting up from seed, so replays only match with the same state.
+ */
+class CounterDevice : public ACIODeviceEmu {
+public:
+
+    uint8_t counter;
+
+    explicit CounterDevice(uint8_t seed) : counter(seed) {
+        this->node_count = 1;
+    }
+
+    bool parse_msg(MessageData *msg_in, circular_buffer<uint8_t> *response_buffer) override {
+        auto msg = create_msg_status(msg_in, this->counter++);
+        write_msg(msg, response_buffer);
+        delete msg;
+        return true;
+    }
+};
+
+// builds an escaped message with checksum
+static std::vector<uint8_t> message(uint8_t addr, uint16_t code, uint8_t pid, const std::vector<uint8_t> &data) {
+    std::vector<uint8_t> raw { addr, static_cast<uint8_t>(code >> 8), static_cast<uint8_t>(code), pid,
+            static_cast<uint8_t>(data.size()) };
+    raw.insert(raw.end(), data.begin(), data.end());
+    uint8_t checksum = 0;
+    for (auto value : raw) {
+        checksum += value;
+    }
+    raw.push_back(checksum);
+
+    std::vector<uint8_t> escaped { ACIO_SOF };
+    for (auto value : raw) {
+        if (value == ACIO_SOF || value == ACIO_ESCAPE) {
+            escaped.push_back(ACIO_ESCAPE);
+            escaped.push_back(~value);
+        } else {
+            escaped.push_back(value);
+        }
+    }
+    return escaped;
+}
+
+/*
+ * Records a session of a game talking to two nodes, the messages split into random chunks.
+ */
+static void record_session(const std::filesystem::path &path, size_t message_count) {
+    ACIOEmu emu;
+    emu.add_device(new CounterDevice(0));
+    emu.add_device(new CounterDevice(100));
+    SessionRecorder recorder(path);
+    CHECK(recorder.is_open());
+
+    auto exchange = [&emu, &recorder] (const std::vector<uint8_t> &data) {
+        recorder.record(RecordDirection::Write, data.data(), data.size());
+        emu.write(data.data(), data.size());
+        uint8_t buffer[1024];
+        auto size = emu.read(buffer, sizeof(buffer));
+        recorder.record(RecordDirection::Read, buffer, size);
+    };
+
+    // handshake and node assignment
+    exchange(std::vector<uint8_t>(16, ACIO_SOF));
+    exchange(message(0, ACIO_CMD_ASSIGN_ADDRS, 0, { 0 }));
+
+    // polls with payloads needing escapes
+    std::mt19937 rng(17);
+    for (size_t i = 0; i < message_count; i++) {
+        std::vector<uint8_t> data(rng() % 16);
+        for (auto &value : data) {
+            value = (rng() % 4 == 0) ? ACIO_SOF : static_cast<uint8_t>(rng());
+        }
+        auto msg = message(static_cast<uint8_t>(1 + i % 2), 0x0134, static_cast<uint8_t>(i), data);
+        auto split = rng() % msg.size();
+        exchange(std::vector<uint8_t>(msg.begin(), msg.begin() + split));
+        exchange(std::vector<uint8_t>(msg.begin() + split, msg.end()));
+    }
+}
+
+static ReplayResult replay(const std::vector<SessionRecord> &records, uint8_t seed) {
+    ACIOEmu emu;
+    emu.add_device(new CounterDevice(seed));
+    emu.add_device(new CounterDevice(100));
+    return replay_session(emu, records);
+}
+
+int main() {
+    auto path = std::filesystem::temp_directory_path() / "spicetools_acioemu_replay_test.bin";
+    const size_t message_count = 2000;
+    record_session(path, message_count);
+
+    // same devices reproduce the recording
+    auto records = load_recording(path);
+    if (!CHECK(records)) {
+        return test::result();
+    }
+    auto result = replay(*records, 0);
+    printf("%s", replay_report(result).c_str());
+    CHECK(result.passed());
+    CHECK(result.messages == message_count + 1);
+    CHECK(result.writes + result.reads == records->size());
+    CHECK(result.write_times.size() == result.writes);
+
+    // a device in a different state is caught at its first response
+    auto mismatch = replay(*records, 1);
+    printf("%s", replay_report(mismatch).c_str());
+    if (CHECK(!mismatch.passed())) {
+        auto &first = mismatch.mismatches.front();
+        CHECK(first.expected.size() > 3 && first.expected[2] == (ACIO_RESPONSE_FLAG | 1));
+        CHECK(first.expected != first.actual);
+    }
+
+    // a truncated last record from a crash is dropped
+    auto size = std::filesystem::file_size(path);
+    std::filesystem::resize_file(path, size - 1);
+    auto truncated = load_recording(path);
+    CHECK(truncated && truncated->size() == records->size() - 1);
+
+    // other files are rejected
+    std::ofstream(path, std::ios::binary | std::ios::trunc) << "not a recording";
+    CHECK(!load_recording(path));
+    std::filesystem::remove(path);
+
+    return test::result();
+}
@@ -0,0 +1,448 @@
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "api/module.h"
+#include "api/request.h"
+#include "api/response.h"
+#include "util/socket_server.h"
+
+#include "bench.h"
+#include "test.h"
+
+using namespace rapidjson;
+
+/*
+ * Loopback test of batch envelopes and pipelined requests.
+ * The server handles the null terminated JSON messages like the API controller does, with the real
+ * request, response and module classes on the socket server, minus ciphers, framing and the pool.
+ */
+
+static const size_t LIGHT_COUNT = 40;
+
+// stands in for the lights module, write([name, state], ...) and read()
+class Lights : public api::Module {
+public:
+    float states[LIGHT_COUNT] {};
+
+    Lights() : Module("lights") {
+        add_function<&Lights::read>("read");
+        add_function<&Lights::write>("write");
+    }
+
+    void read(api::Request &, api::Response &res) {
+        for (size_t i = 0; i < LIGHT_COUNT; i++) {
+            Value state(states[i]);
+            res.add_data(state);
+        }
+    }
+
+    void write(api::Request &req, api::Response &res) {
+        for (Value &param : req.params.GetArray()) {
+            if (!param.IsArray() || param.Size() < 2 || !param[0].IsString() || !param[1].IsNumber()) {
+                error(res, "parameters must be [name, state]");
+                continue;
+            }
+            size_t index;
+            if (sscanf(param[0].GetString(), "light %zu", &index) != 1 || index >= LIGHT_COUNT) {
+                error_unknown(res, "light", param[0].GetString());
+                continue;
+            }
+            states[index] = param[1].GetFloat();
+        }
+    }
+};
+
+class ApiServer {
+public:
+    Lights lights;
+    util::SocketServer server { 1, 64 * 1024, 16 * 1024 * 1024 };
+
+    // send the responses of one read at once like the controller, or each on its own like before
+    std::atomic<bool> coalesce = true;
+
+    ApiServer() {
+        server.on_connect = [] (util::SocketServer::Connection &connection) {
+            connection.user = new std::string();
+            return true;
+        };
+        server.on_receive = [this] (util::SocketServer::Connection &connection, char *data, size_t size) {
+            this->receive(connection, data, size);
+        };
+        server.on_disconnect = [] (util::SocketServer::Connection &connection) {
+            delete reinterpret_cast<std::string *>(connection.user);
+        };
+    }
+
+private:
+
+    void receive(util::SocketServer::Connection &connection, const char *data, size_t size) {
+        auto &message = *reinterpret_cast<std::string *>(connection.user);
+        std::string out;
+        while (size > 0) {
+            auto end = (const char *) memchr(data, 0, size);
+            if (end == nullptr) {
+                message.append(data, size);
+                break;
+            }
+            message.append(data, end);
+            size -= end - data + 1;
+            data = end + 1;
+
+            this->process(message, out);
+            message.clear();
+            if (!coalesce) {
+                server.send(connection, out.data(), out.size());
+                out.clear();
+            }
+        }
+        if (!out.empty()) {
+            server.send(connection, out.data(), out.size());
+        }
+    }
+
+    void process(std::string_view message, std::string &out) {
+        Document document;
+        document.Parse(message.data(), message.size());
+        if (document.HasParseError()) {
+            out.push_back(0);
+            return;
+        }
+
+        api::Request request(document);
+        api::Response response(request.id);
+        if (request.parse_error) {
+            Value error("Request parse error (invalid message format?).");
+            response.add_error(error);
+        } else if (request.is_batch()) {
+            this->batch(request, response);
+        } else if (auto function = this->resolve(request, response)) {
+            lights.handle(function, request, response);
+        }
+        out += response.get_string();
+        out.push_back(0);
+    }
+
+    // same steps as Controller::process_batch with a single module
+    void batch(api::Request &request, api::Response &response) {
+        std::vector<api::Request> calls;
+        calls.reserve(request.batch.Size());
+        for (auto &call : request.batch.GetArray()) {
+            calls.emplace_back(call);
+        }
+
+        std::lock_guard<std::mutex> lock(lights.mutex);
+        for (auto &call : calls) {
+            api::Response result(call.id);
+            if (call.parse_error) {
+                Value error("Request parse error (invalid message format?).");
+                result.add_error(error);
+            } else if (call.is_batch()) {
+                Value error("Batches can't be nested.");
+                result.add_error(error);
+            } else if (auto function = this->resolve(call, result)) {
+                lights.handle_locked(function, call, result);
+            }
+            response.add_result(result);
+        }
+    }
+
+    api::ModuleFunction resolve(api::Request &request, api::Response &response) {
+        if (request.module != lights.name) {
+            Value error("Unknown module.");
+            response.add_error(error);
+            return nullptr;
+        }
+        for (auto &function : lights.get_functions()) {
+            if (function.first == request.function) {
+                return function.second;
+            }
+        }
+        lights.error_function_unknown(response);
+        return nullptr;
+    }
+};
+
+static int connect_loopback(uint16_t port) {
+    int socket = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(socket, (sockaddr *) &address, sizeof(address)) != 0) {
+        close(socket);
+        return -1;
+    }
+    int opt_enable = 1;
+    setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &opt_enable, sizeof(opt_enable));
+    return socket;
+}
+
+static bool send_all(int socket, const std::string &data) {
+    for (size_t pos = 0; pos < data.size();) {
+        auto sent = ::send(socket, data.data() + pos, data.size() - pos, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            return false;
+        }
+        pos += sent;
+    }
+    return true;
+}
+
+// reads until the given number of null terminated messages arrived
+static bool read_messages(int socket, size_t count, std::vector<std::string> &messages) {
+    std::string current;
+    char buffer[16384];
+    while (messages.size() < count) {
+        pollfd fd { socket, POLLIN, 0 };
+        if (poll(&fd, 1, 5000) <= 0) {
+            return false;
+        }
+        auto received = recv(socket, buffer, sizeof(buffer), 0);
+        if (received <= 0) {
+            return false;
+        }
+        for (ssize_t i = 0; i < received; i++) {
+            if (buffer[i] == 0) {
+                messages.push_back(std::move(current));
+                current.clear();
+            } else {
+                current.push_back(buffer[i]);
+            }
+        }
+    }
+    return current.empty();
+}
+
+static std::string write_call(uint64_t id, size_t light, float state) {
+    return "{\"id\":" + std::to_string(id) + ",\"module\":\"lights\",\"function\":\"write\","
+            "\"params\":[[\"light " + std::to_string(light) + "\"," + std::to_string(state) + "]]}";
+}
+
+static std::string read_call(uint64_t id) {
+    return "{\"id\":" + std::to_string(id) + ",\"module\":\"lights\",\"function\":\"read\",\"params\":[]}";
+}
+
+static std::string batch(uint64_t id, const std::vector<std::string> &calls) {
+    std::string out = "{\"id\":" + std::to_string(id) + ",\"batch\":[";
+    for (size_t i = 0; i < calls.size(); i++) {
+        out += (i > 0 ? "," : "") + calls[i];
+    }
+    return out + "]}";
+}
+
+static std::string message(const std::string &json) {
+    return std::string(json.c_str(), json.size() + 1);
+}
+
+// number of errors of a well formed response, SIZE_MAX otherwise
+static size_t error_count(const Value &response) {
+    if (!response.IsObject() || !response.HasMember("id") || !response.HasMember("errors")
+    || !response.HasMember("data") || !response["errors"].IsArray() || !response["data"].IsArray()) {
+        return SIZE_MAX;
+    }
+    return response["errors"].Size();
+}
+
+static bool response_ok(const Value &response, uint64_t id) {
+    return error_count(response) == 0 && response["id"].IsUint64() && response["id"].GetUint64() == id;
+}
+
+static bool states_match(const Value &data, float base) {
+    if (!data.IsArray() || data.Size() != LIGHT_COUNT) {
+        return false;
+    }
+    for (size_t i = 0; i < LIGHT_COUNT; i++) {
+        if (!data[i].IsNumber() || data[i].GetFloat() != base + i) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * A batch returns one response holding the complete response of every call, errors stay with their call.
+ */
+static void test_batch(uint16_t port) {
+    ApiServer api;
+    if (!CHECK(api.server.listen(port, 16))) {
+        return;
+    }
+    auto socket = connect_loopback(port);
+
+    // all lights, then read them back within the same batch
+    std::vector<std::string> calls;
+    for (size_t i = 0; i < LIGHT_COUNT; i++) {
+        calls.push_back(write_call(i + 1, i, 10.0f + i));
+    }
+    calls.push_back(read_call(LIGHT_COUNT + 1));
+    std::vector<std::string> messages;
+    CHECK(send_all(socket, message(batch(100, calls))));
+    if (CHECK(read_messages(socket, 1, messages))) {
+        Document response;
+        response.Parse(messages[0].c_str());
+        if (CHECK(response_ok(response, 100) && response["data"].Size() == LIGHT_COUNT + 1)) {
+            auto &results = response["data"];
+            bool results_ok = true;
+            for (size_t i = 0; i <= LIGHT_COUNT; i++) {
+                results_ok = results_ok && response_ok(results[i], i + 1);
+            }
+            CHECK(results_ok && states_match(results[LIGHT_COUNT]["data"], 10.0f));
+        }
+    }
+
+    // bad calls fail on their own
+    calls = {
+        write_call(1, 0, 1.0f),
+        "{\"id\":2,\"module\":\"lights\",\"function\":\"blink\",\"params\":[]}",
+        "{\"id\":3,\"module\":\"lights\"}",
+        batch(4, { read_call(5) }),
+        "{\"id\":6,\"module\":\"lights\",\"function\":\"write\",\"params\":[[\"light 99\",1]]}",
+        read_call(7),
+    };
+    messages.clear();
+    CHECK(send_all(socket, message(batch(101, calls))));
+    if (CHECK(read_messages(socket, 1, messages))) {
+        Document response;
+        response.Parse(messages[0].c_str());
+        if (CHECK(response_ok(response, 101) && response["data"].Size() == calls.size())) {
+            auto &results = response["data"];
+            CHECK(response_ok(results[0], 1));
+            CHECK(error_count(results[1]) == 1);
+            CHECK(error_count(results[2]) == 1);
+            CHECK(error_count(results[3]) == 1 && results[3]["errors"][0].IsString()
+                    && strcmp(results[3]["errors"][0].GetString(), "Batches can't be nested.") == 0);
+            CHECK(error_count(results[4]) == 1);
+            CHECK(response_ok(results[5], 7) && results[5]["data"][0].GetFloat() == 1.0f);
+        }
+    }
+
+    // the envelope itself must hold an array
+    messages.clear();
+    CHECK(send_all(socket, message("{\"id\":102,\"batch\":5}")));
+    if (CHECK(read_messages(socket, 1, messages))) {
+        Document response;
+        response.Parse(messages[0].c_str());
+        CHECK(error_count(response) == 1 && response["data"].Empty());
+    }
+    close(socket);
+}
+
+/*
+ * Requests sent back to back, cut at random points, are answered in order.
+ */
+static void test_pipelined(uint16_t port) {
+    ApiServer api;
+    if (!CHECK(api.server.listen(port, 16))) {
+        return;
+    }
+    auto socket = connect_loopback(port);
+    std::mt19937 rng(5);
+    for (bool coalesce : { true, false }) {
+        api.coalesce = coalesce;
+        std::string burst;
+        for (size_t i = 0; i < LIGHT_COUNT; i++) {
+            burst += message(write_call(i + 1, i, 20.0f + i));
+        }
+        burst += message(read_call(LIGHT_COUNT + 1));
+        for (size_t pos = 0; pos < burst.size();) {
+            auto length = std::min<size_t>(burst.size() - pos, 1 + rng() % 200);
+            CHECK(send_all(socket, burst.substr(pos, length)));
+            pos += length;
+        }
+
+        std::vector<std::string> messages;
+        if (!CHECK(read_messages(socket, LIGHT_COUNT + 1, messages))) {
+            break;
+        }
+        bool responses_ok = true;
+        for (size_t i = 0; i <= LIGHT_COUNT; i++) {
+            Document response;
+            response.Parse(messages[i].c_str());
+            responses_ok = responses_ok && response_ok(response, i + 1)
+                    && (i < LIGHT_COUNT || states_match(response["data"], 20.0f));
+        }
+        CHECK(responses_ok);
+    }
+    close(socket);
+}
+
+/*
+ * Time to set all lights on one connection: a round trip per call, pipelined with one send per response
+ * as before, pipelined with the responses of a read sent at once, and as a single batch.
+ */
+static void bench_lights(uint16_t port) {
+    ApiServer api;
+    if (!CHECK(api.server.listen(port, 16))) {
+        return;
+    }
+    auto socket = connect_loopback(port);
+    const size_t rounds = 2000;
+
+    std::string single[LIGHT_COUNT], pipelined, batched;
+    std::vector<std::string> calls;
+    for (size_t i = 0; i < LIGHT_COUNT; i++) {
+        auto call = write_call(i + 1, i, 0.5f);
+        single[i] = message(call);
+        pipelined += single[i];
+        calls.push_back(call);
+    }
+    batched = message(batch(1, calls));
+
+    auto run = [&] (const char *name, size_t responses, auto &&send) {
+        std::vector<double> latencies;
+        std::vector<std::string> messages;
+        for (size_t round = 0; round < rounds; round++) {
+            messages.clear();
+            auto start = bench::clock::now();
+            if (!send(messages) || !read_messages(socket, responses, messages)) {
+                CHECK(false);
+                return;
+            }
+            latencies.push_back(bench::seconds_since(start));
+        }
+        bench::report_latency(name, latencies);
+        std::sort(latencies.begin(), latencies.end());
+        printf("%-40s %.0f calls/s at the median\n", "", LIGHT_COUNT / latencies[latencies.size() / 2]);
+    };
+    run("40 writes, round trip each", 0, [&] (std::vector<std::string> &messages) {
+        for (size_t i = 0; i < LIGHT_COUNT; i++) {
+            if (!send_all(socket, single[i]) || !read_messages(socket, i + 1, messages)) {
+                return false;
+            }
+        }
+        return true;
+    });
+    api.coalesce = false;
+    run("40 writes pipelined, send per response", LIGHT_COUNT, [&] (std::vector<std::string> &) {
+        return send_all(socket, pipelined);
+    });
+    api.coalesce = true;
+    run("40 writes pipelined, one send per read", LIGHT_COUNT, [&] (std::vector<std::string> &) {
+        return send_all(socket, pipelined);
+    });
+    run("40 writes in one batch", 1, [&] (std::vector<std::string> &) {
+        return send_all(socket, batched);
+    });
+    close(socket);
+}
+
+int main(int argc, char **argv) {
+    uint16_t port = 20000 + getpid() % 20000;
+    test_batch(port);
+    test_pipelined(port + 1);
+    if (bench::enabled(argc, argv)) {
+        bench_lights(port + 2);
+    }
+    return test::result();
+}
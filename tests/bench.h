@@ -0,0 +1,77 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+/*
+ * Timing helpers for the host benchmarks.
+ * Benchmarks live in the test executables next to the reference implementations they compare
+ * against. They only run when the test gets passed --bench, so ctest skips them; numbers are only
+ * meaningful from a build configured with -DCMAKE_BUILD_TYPE=Release.
+ */
+namespace bench {
+
+    using clock = std::chrono::steady_clock;
+
+    inline bool enabled(int argc, char **argv) {
+        for (int i = 1; i < argc; i++) {
+            if (strcmp(argv[i], "--bench") == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // keeps the compiler from dropping results which aren't used otherwise
+    template<typename T>
+    inline void keep(T &value) {
+        asm volatile("" : : "g"(&value) : "memory");
+    }
+
+    inline double seconds_since(clock::time_point start) {
+        return std::chrono::duration<double>(clock::now() - start).count();
+    }
+
+    /*
+     * Runs the function until at least min_seconds passed and returns the seconds per call.
+     * The first call warms up caches and isn't counted.
+     */
+    template<typename F>
+    inline double measure(F &&function, double min_seconds = 0.5) {
+        function();
+        size_t calls = 0;
+        auto start = clock::now();
+        double elapsed;
+        do {
+            function();
+            calls++;
+            elapsed = seconds_since(start);
+        } while (elapsed < min_seconds);
+        return elapsed / calls;
+    }
+
+    // prints time per call and throughput for the given amount of bytes per call
+    inline void report(const char *name, double seconds, size_t bytes = 0) {
+        if (bytes > 0) {
+            printf("%-40s %12.3f us %10.1f MB/s\n", name, seconds * 1e6, bytes / seconds / 1e6);
+        } else {
+            printf("%-40s %12.3f us\n", name, seconds * 1e6);
+        }
+    }
+
+    // prints the median and tail of a set of latencies in seconds
+    inline void report_latency(const char *name, std::vector<double> latencies) {
+        if (latencies.empty()) {
+            return;
+        }
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&latencies] (double p) {
+            return latencies[std::min(latencies.size() - 1, (size_t) (p * latencies.size()))] * 1e6;
+        };
+        printf("%-40s p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n", name,
+                percentile(0.5), percentile(0.99), percentile(0.999), latencies.back() * 1e6);
+    }
+}
@@ -0,0 +1,309 @@
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csetjmp>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <jpeglib.h>
+
+#include "hooks/graphics/capture.h"
+
+#include "bench.h"
+#include "test.h"
+
+/*
+ * The capture hand-off between requests and the graphics backend, and the crop, scale and
+ * encode path every capture goes through. The output is decoded with libjpeg and compared to
+ * a box filter over the requested region of the frame.
+ */
+
+struct ErrorManager {
+    jpeg_error_mgr base;
+    jmp_buf jump;
+};
+
+static bool decode(const std::vector<uint8_t> &jpeg, size_t &width, size_t &height, std::vector<uint8_t> &rgb) {
+    jpeg_decompress_struct info {};
+    ErrorManager error {};
+    info.err = jpeg_std_error(&error.base);
+    error.base.error_exit = [] (j_common_ptr info) {
+        longjmp(reinterpret_cast<ErrorManager *>(info->err)->jump, 1);
+    };
+    error.base.output_message = [] (j_common_ptr) {};
+    if (setjmp(error.jump)) {
+        jpeg_destroy_decompress(&info);
+        return false;
+    }
+
+    jpeg_create_decompress(&info);
+    jpeg_mem_src(&info, jpeg.data(), (unsigned long) jpeg.size());
+    jpeg_read_header(&info, TRUE);
+    info.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&info);
+    width = info.output_width;
+    height = info.output_height;
+    rgb.resize(width * height * 3);
+    while (info.output_scanline < info.output_height) {
+        auto row = &rgb[info.output_scanline * width * 3];
+        jpeg_read_scanlines(&info, &row, 1);
+    }
+    jpeg_finish_decompress(&info);
+    jpeg_destroy_decompress(&info);
+    return true;
+}
+
+static double psnr(const std::vector<uint8_t> &a, const std::vector<uint8_t> &b) {
+    double error = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        double difference = (double) a[i] - b[i];
+        error += difference * difference;
+    }
+    if (error == 0) {
+        return 100;
+    }
+    return 10 * std::log10(255.0 * 255.0 * a.size() / error);
+}
+
+// X8R8G8B8 frame of small blocks in random colors, so a region off by a pixel stands out
+static CaptureData make_frame(size_t width, size_t height, unsigned seed) {
+    std::mt19937 rng(seed);
+    const size_t block = 6;
+    std::vector<uint32_t> colors((width / block + 1) * (height / block + 1));
+    for (auto &color : colors) {
+        color = rng() & 0xFFFFFF;
+    }
+    CaptureData capture {};
+    capture.width = (unsigned short) width;
+    capture.height = (unsigned short) height;
+    capture.pitch = width * 4 + 12;
+    capture.format = pixelutils::Format::X8R8G8B8;
+    capture.data.reset(new uint8_t[capture.pitch * height]);
+    for (size_t y = 0; y < height; y++) {
+        for (size_t x = 0; x < width; x++) {
+            auto color = colors[(y / block) * (width / block + 1) + x / block];
+            memcpy(&capture.data[y * capture.pitch + x * 4], &color, 4);
+        }
+    }
+    return capture;
+}
+
+// box filter over the region, one source pixel at least when a side isn't reduced
+static std::vector<uint8_t> reference(const CaptureData &capture, size_t x0, size_t y0,
+        size_t region_width, size_t region_height, size_t width, size_t height) {
+    std::vector<uint8_t> rgb(width * height * 3);
+    for (size_t y = 0; y < height; y++) {
+        size_t top = y * region_height / height;
+        size_t bottom = std::max((y + 1) * region_height / height, top + 1);
+        for (size_t x = 0; x < width; x++) {
+            size_t left = x * region_width / width;
+            size_t right = std::max((x + 1) * region_width / width, left + 1);
+            uint32_t sums[3] {};
+            for (size_t sy = top; sy < bottom; sy++) {
+                for (size_t sx = left; sx < right; sx++) {
+                    auto pixel = &capture.data[(y0 + sy) * capture.pitch + (x0 + sx) * 4];
+                    sums[0] += pixel[2];
+                    sums[1] += pixel[1];
+                    sums[2] += pixel[0];
+                }
+            }
+            auto count = (uint32_t) ((bottom - top) * (right - left));
+            for (size_t c = 0; c < 3; c++) {
+                rgb[(y * width + x) * 3 + c] = (uint8_t) ((sums[c] + count / 2) / count);
+            }
+        }
+    }
+    return rgb;
+}
+
+/*
+ * Region and target size combinations, checked against the expected size and content.
+ */
+static void test_encode() {
+    auto frame = make_frame(200, 120, 1);
+    struct Case {
+        CaptureOptions options;
+        size_t x, y, region_width, region_height;
+        size_t width, height;
+    };
+    auto options = [] (int x, int y, int width, int height, int target_width, int target_height, int divide) {
+        CaptureOptions options;
+        options.x = x, options.y = y, options.width = width, options.height = height;
+        options.target_width = target_width, options.target_height = target_height;
+        options.divide = divide;
+        options.quality = 95;
+        options.subsample = false;
+        return options;
+    };
+    Case cases[] {
+
+        // whole frame, divided with rounding up
+        { options(0, 0, 0, 0, 0, 0, 1), 0, 0, 200, 120, 200, 120 },
+        { options(0, 0, 0, 0, 0, 0, 2), 0, 0, 200, 120, 100, 60 },
+        { options(0, 0, 0, 0, 0, 0, 3), 0, 0, 200, 120, 67, 40 },
+        { options(0, 0, 0, 0, 0, 0, 0), 0, 0, 200, 120, 200, 120 },
+
+        // regions, clamped to the frame, an empty one selects all of it
+        { options(10, 20, 64, 48, 0, 0, 1), 10, 20, 64, 48, 64, 48 },
+        { options(10, 20, 64, 48, 0, 0, 2), 10, 20, 64, 48, 32, 24 },
+        { options(180, 100, 100, 100, 0, 0, 1), 180, 100, 20, 20, 20, 20 },
+        { options(-5, -5, 30, 20, 0, 0, 1), 0, 0, 30, 20, 30, 20 },
+        { options(150, 0, 0, 0, 0, 0, 1), 0, 0, 200, 120, 200, 120 },
+
+        // target sizes, a single side keeps the aspect ratio, never larger than the region
+        { options(10, 20, 64, 48, 32, 0, 1), 10, 20, 64, 48, 32, 24 },
+        { options(10, 20, 64, 48, 0, 12, 1), 10, 20, 64, 48, 16, 12 },
+        { options(10, 20, 64, 48, 20, 10, 1), 10, 20, 64, 48, 20, 10 },
+        { options(10, 20, 64, 48, 500, 500, 1), 10, 20, 64, 48, 64, 48 },
+        { options(10, 20, 64, 48, 32, 0, 4), 10, 20, 64, 48, 32, 24 },
+        { options(0, 7, 64, 1, 8, 0, 1), 0, 7, 64, 1, 8, 1 },
+        { options(0, 0, 1, 64, 0, 8, 1), 0, 0, 1, 64, 1, 8 },
+    };
+    util::JPEGEncoder encoder;
+    for (auto &test_case : cases) {
+        std::vector<uint8_t> jpeg;
+        int width = 0, height = 0;
+        auto &o = test_case.options;
+        if (!CHECK(graphics_capture_encode_jpeg(frame, o, encoder, jpeg, &width, &height))) {
+            continue;
+        }
+        size_t decoded_width, decoded_height;
+        std::vector<uint8_t> rgb;
+        CHECK(decode(jpeg, decoded_width, decoded_height, rgb));
+        if (!CHECK(width == (int) test_case.width && height == (int) test_case.height)
+                || !CHECK(decoded_width == test_case.width && decoded_height == test_case.height)) {
+            fprintf(stderr, "  region %d,%d %dx%d target %dx%d /%d: %dx%d\n", o.x, o.y, o.width, o.height,
+                    o.target_width, o.target_height, o.divide, width, height);
+            continue;
+        }
+        auto expected = reference(frame, test_case.x, test_case.y,
+                test_case.region_width, test_case.region_height, test_case.width, test_case.height);
+        auto quality = psnr(rgb, expected);
+        if (!CHECK(quality > 30)) {
+            fprintf(stderr, "  region %d,%d %dx%d target %dx%d /%d: %.1f dB\n", o.x, o.y, o.width, o.height,
+                    o.target_width, o.target_height, o.divide, quality);
+        }
+    }
+
+    // a region shifted by a single pixel doesn't pass for the right one
+    std::vector<uint8_t> jpeg, rgb;
+    size_t width, height;
+    graphics_capture_encode_jpeg(frame, options(11, 20, 64, 48, 0, 0, 1), encoder, jpeg);
+    decode(jpeg, width, height, rgb);
+    CHECK(psnr(rgb, reference(frame, 10, 20, 64, 48, 64, 48)) < 25);
+
+    // regions outside of the frame and frames without pixels
+    CHECK(!graphics_capture_encode_jpeg(frame, options(200, 0, 10, 10, 0, 0, 1), encoder, jpeg));
+    CHECK(!graphics_capture_encode_jpeg(frame, options(0, 120, 10, 10, 0, 0, 1), encoder, jpeg));
+    CHECK(!graphics_capture_encode_jpeg(CaptureData {}, CaptureOptions {}, encoder, jpeg));
+}
+
+/*
+ * A readback skipped between the trigger and the wait lets the waiter fail right away,
+ * a readback done in the same window hands over the frame.
+ */
+static void test_wait() {
+    using namespace std::chrono;
+    const int screen = 1;
+    CaptureData capture;
+
+    // skipped before the requester got to wait
+    auto skips = graphics_capture_trigger(screen);
+    int consumed = -1;
+    CHECK(graphics_capture_consume(&consumed) && consumed == screen);
+    CHECK(!graphics_capture_consume(&consumed));
+    graphics_capture_skip(screen);
+    auto start = steady_clock::now();
+    CHECK(!graphics_capture_wait(screen, 0, skips, capture, 5000));
+    CHECK(steady_clock::now() - start < milliseconds(1000));
+
+    // skips before the trigger don't count
+    graphics_capture_skip(screen);
+    skips = graphics_capture_trigger(screen);
+    graphics_capture_consume(&consumed);
+    start = steady_clock::now();
+    CHECK(!graphics_capture_wait(screen, 0, skips, capture, 100));
+    CHECK(steady_clock::now() - start >= milliseconds(100));
+
+    // captured before the wait
+    skips = graphics_capture_trigger(screen);
+    graphics_capture_consume(&consumed);
+    auto frame = make_frame(8, 8, 2);
+    auto pixels = new uint8_t[frame.pitch * 8];
+    graphics_capture_enqueue(screen, pixels, 8, 8, frame.pitch, frame.format);
+    CHECK(graphics_capture_wait(screen, 0, skips, capture, 5000));
+    CHECK(capture.sequence == 1 && capture.data.get() == pixels && capture.width == 8);
+
+    // the backend on another thread, serving requests until told to stop
+    std::atomic<bool> stop = false;
+    std::thread backend([&stop] {
+        int screen;
+        while (!stop) {
+            if (graphics_capture_consume(&screen)) {
+                static unsigned count = 0;
+                if (++count % 3 == 0) {
+                    graphics_capture_skip(screen);
+                } else {
+                    graphics_capture_enqueue(screen, new uint8_t[4], 1, 1, 4, pixelutils::Format::X8R8G8B8);
+                }
+            }
+            std::this_thread::sleep_for(microseconds(100));
+        }
+    });
+    size_t captured = 0, skipped = 0;
+    uint64_t sequence = capture.sequence;
+    for (int i = 0; i < 300; i++) {
+        start = steady_clock::now();
+        if (graphics_capture_next(screen, capture, 5000)) {
+            CHECK(capture.sequence > sequence);
+            sequence = capture.sequence;
+            captured++;
+        } else {
+            skipped++;
+        }
+        CHECK(steady_clock::now() - start < milliseconds(1000));
+    }
+    stop = true;
+    backend.join();
+    CHECK(captured == 200 && skipped == 100);
+
+    // screens out of range
+    CHECK(graphics_capture_trigger(-1) == 0);
+    CHECK(!graphics_capture_wait(4, 0, 0, capture, 0));
+    CHECK(!graphics_capture_next(4, capture, 0));
+}
+
+static void benchmark() {
+    auto frame = make_frame(1920, 1080, 3);
+    util::JPEGEncoder encoder;
+    std::vector<uint8_t> jpeg;
+    CaptureOptions full;
+    full.quality = 70;
+    bench::report("1920x1080 to jpeg", bench::measure([&] {
+        graphics_capture_encode_jpeg(frame, full, encoder, jpeg);
+        bench::keep(jpeg);
+    }), (size_t) frame.pitch * frame.height);
+    CaptureOptions half = full;
+    half.divide = 2;
+    bench::report("1920x1080 to 960x540 jpeg", bench::measure([&] {
+        graphics_capture_encode_jpeg(frame, half, encoder, jpeg);
+        bench::keep(jpeg);
+    }), (size_t) frame.pitch * frame.height);
+    CaptureOptions region = full;
+    region.x = 640, region.y = 360, region.width = 640, region.height = 360;
+    bench::report("640x360 region to jpeg", bench::measure([&] {
+        graphics_capture_encode_jpeg(frame, region, encoder, jpeg);
+        bench::keep(jpeg);
+    }), (size_t) 640 * 360 * 4);
+}
+
+int main(int argc, char **argv) {
+    test_encode();
+    test_wait();
+    if (bench::enabled(argc, argv)) {
+        benchmark();
+    }
+    return test::result();
+}
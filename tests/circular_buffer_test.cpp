@@ -0,0 +1,88 @@
+#include <random>
+#include <vector>
+
+#include "util/circular_buffer.h"
+
+#include "test.h"
+
+/*
+ * Bulk operations have to leave the buffer in the same state as the single item ones,
+ * so one buffer is driven with put_all/get_all and a twin with put/get.
+ */
+static void test_twin(size_t capacity, std::mt19937 &rng) {
+    circular_buffer<int> bulk(capacity);
+    circular_buffer<int> single(capacity);
+    int counter = 0;
+
+    for (int step = 0; step < 2000; step++) {
+        if (rng() % 2) {
+
+            // write up to twice the capacity to overflow
+            std::vector<int> items(rng() % (capacity * 2 + 1));
+            for (auto &item : items) {
+                item = counter++;
+            }
+            if (rng() % 2) {
+                bulk.put_all(items);
+            } else {
+                bulk.put_all(items.data(), static_cast<int>(items.size()));
+            }
+            for (auto item : items) {
+                single.put(item);
+            }
+        } else {
+
+            // read some
+            size_t count = rng() % (capacity + 2);
+            std::vector<int> items(count, -1);
+            auto read = bulk.get_all(items.data(), count);
+            CHECK(read == std::min(count, single.size()));
+            for (size_t i = 0; i < read; i++) {
+                CHECK(items[i] == single.get());
+            }
+            for (size_t i = read; i < count; i++) {
+                CHECK(items[i] == -1);
+            }
+        }
+
+        // same state
+        CHECK(bulk.size() == single.size());
+        CHECK(bulk.empty() == single.empty());
+        CHECK(bulk.full() == single.full());
+        CHECK(bulk.peek() == single.peek());
+        if (!single.empty()) {
+            auto pos = rng() % single.size();
+            CHECK(bulk.peek(pos) == single.peek(pos));
+        }
+    }
+    CHECK(bulk.get_all() == single.get_all());
+}
+
+static void test_edges() {
+    circular_buffer<int> buffer(4);
+
+    // non-positive sizes are ignored
+    int items[] = { 1, 2, 3, 4, 5, 6 };
+    buffer.put_all(items, 0);
+    buffer.put_all(items, -1);
+    CHECK(buffer.empty());
+
+    // overflow keeps the newest items, one slot always stays free
+    buffer.put_all(items, 6);
+    CHECK(buffer.full() && buffer.size() == 3);
+    CHECK(buffer.peek_all() == std::vector<int>({ 4, 5, 6 }));
+
+    // reading from an empty buffer doesn't touch the output
+    buffer.reset();
+    int output[2] = { -1, -1 };
+    CHECK(buffer.get_all(output, 2) == 0 && output[0] == -1);
+}
+
+int main() {
+    std::mt19937 rng(3);
+    for (size_t capacity : { 2, 3, 4, 7, 16, 33 }) {
+        test_twin(capacity, rng);
+    }
+    test_edges();
+    return test::result();
+}
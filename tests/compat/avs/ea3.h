@@ -0,0 +1,10 @@
+#pragma once
+
+#include <string>
+
+/*
+ * EA3 state used by the code under test, defined by the test itself.
+ */
+namespace avs::ea3 {
+    extern std::string EA3_BOOT_PCBID;
+}
@@ -0,0 +1,4 @@
+#pragma once
+
+// __rdtsc and friends
+#include <x86intrin.h>
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <windows.h>
+
+/*
+ * Launcher state used by the code under test, defined by the test itself.
+ */
+extern HANDLE LOG_FILE;
@@ -0,0 +1,21 @@
+#include "util/memutils.h"
+
+/*
+ * Test data lives in writable heap memory, so there is nothing to unprotect.
+ */
+namespace memutils {
+
+    VProtectGuard::VProtectGuard(void *addr, size_t size, DWORD mode, bool reset)
+        : addr(addr), reset(reset), size(size)
+    {
+        this->old_protect = mode;
+    }
+
+    VProtectGuard::~VProtectGuard() {
+        this->dispose();
+    }
+
+    void VProtectGuard::dispose() {
+        this->addr = nullptr;
+    }
+}
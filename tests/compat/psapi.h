@@ -0,0 +1,18 @@
+#pragma once
+
+#include "windows.h"
+
+struct MODULEINFO {
+    void *lpBaseOfDll;
+    DWORD SizeOfImage;
+    void *EntryPoint;
+};
+
+// there are no loaded modules to query, scans use the mapped headers instead
+inline HANDLE GetCurrentProcess() {
+    return nullptr;
+}
+
+inline bool GetModuleInformation(HANDLE, HMODULE, MODULEINFO *, DWORD) {
+    return false;
+}
@@ -0,0 +1,29 @@
+#include "util/time.h"
+
+#include <chrono>
+
+/*
+ * Steady clock instead of the performance counter, only differences between readings matter.
+ */
+using namespace std::chrono;
+
+static const steady_clock::time_point START = steady_clock::now();
+
+void init_performance_counter() {
+}
+
+double get_performance_seconds() {
+    return duration<double>(steady_clock::now() - START).count();
+}
+
+double get_performance_milliseconds() {
+    return get_performance_seconds() * 1000.0;
+}
+
+uint64_t get_system_seconds() {
+    return duration_cast<seconds>(system_clock::now().time_since_epoch()).count();
+}
+
+uint64_t get_system_milliseconds() {
+    return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+/*
+ * Helpers of util/fileutils.h needed by the code under test, on top of the standard library.
+ */
+namespace fileutils {
+
+    static inline bool file_exists(const std::filesystem::path &file_path) {
+        std::error_code error;
+        return std::filesystem::is_regular_file(file_path, error);
+    }
+
+    static inline bool text_write(const std::filesystem::path &file_path, std::string text) {
+        std::ofstream out(file_path, std::ios::out | std::ios::binary);
+        if (out) {
+            out << text;
+            out.close();
+            return true;
+        }
+        return false;
+    }
+
+    static inline std::string text_read(const std::filesystem::path &file_path) {
+        std::ifstream in(file_path, std::ios::in | std::ios::binary);
+        if (in) {
+            return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+        return std::string();
+    }
+}
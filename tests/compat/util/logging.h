@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdio>
+#include <exception>
+#include <string>
+
+#include "external/fmt/include/fmt/format.h"
+
+/*
+ * Replaces the logger for the host tests, lines are printed to stderr right away.
+ */
+#define LOG_HOST(level, module, format_str, ...) \
+    fputs(fmt::format("[" level "] {}: " format_str "\n", module, ## __VA_ARGS__).c_str(), stderr)
+#define log_misc(module, format_str, ...) LOG_HOST("M", module, format_str, ## __VA_ARGS__)
+#define log_info(module, format_str, ...) LOG_HOST("I", module, format_str, ## __VA_ARGS__)
+#define log_warning(module, format_str, ...) LOG_HOST("W", module, format_str, ## __VA_ARGS__)
+#define log_fatal(module, format_str, ...) { \
+    LOG_HOST("F", module, format_str, ## __VA_ARGS__); \
+    std::terminate(); \
+} ((void) 0 )
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <windows.h>
+
+#include "logging.h"
+#include "util/circular_buffer.h"
+
+/*
+ * Helpers of util/utils.h needed by the code under test, the original pulls in the whole launcher.
+ */
+
+static const char HEX_LOOKUP_UPPERCASE[] = "0123456789ABCDEF";
+
+static inline int _hex2bin_helper(char input) {
+    if (input >= '0' && input <= '9') {
+        return input - '0';
+    }
+    if (input >= 'A' && input <= 'F') {
+        return input - 'A' + 10;
+    }
+    if (input >= 'a' && input <= 'f') {
+        return input - 'a' + 10;
+    }
+    return -1;
+}
+
+static inline bool string_begins_with(const std::string &s, const std::string &prefix) {
+    return s.compare(0, prefix.size(), prefix) == 0;
+}
+
+template<class Container>
+static inline void strsplit(const std::string &str, Container &cont, char delim = ' ')
+{
+    std::istringstream ss(str);
+    std::string token;
+
+    while (std::getline(ss, token, delim)) {
+        cont.push_back(token);
+    }
+}
+
+static inline void strreplace(std::string &s, const std::string &search, const std::string &replace) {
+    size_t pos = 0;
+
+    while ((pos = s.find(search, pos)) != std::string::npos) {
+        s.replace(pos, search.length(), replace);
+        pos += replace.length();
+    }
+}
+
+template<typename T>
+static inline std::string bin2hex(T *data, size_t size) {
+    std::string str;
+    str.reserve(size * 2);
+    auto bytes = reinterpret_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; i++) {
+        str.push_back(HEX_LOOKUP_UPPERCASE[(bytes[i] & 0xF0) >> 4]);
+        str.push_back(HEX_LOOKUP_UPPERCASE[bytes[i] & 0x0F]);
+    }
+    return str;
+}
+
+template<typename T>
+static inline std::string bin2hex(const std::vector<T> &data) {
+    return bin2hex(data.data(), data.size());
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+/*
+ * Subset of the Windows headers used by the code under test, so it compiles on other hosts.
+ * Structures follow the 64-bit winnt.h layout.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+#include <strings.h>
+
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef int32_t LONG;
+typedef uint64_t ULONGLONG;
+typedef uint64_t DWORDLONG;
+typedef void *HANDLE;
+typedef void *HMODULE;
+typedef int BOOL;
+
+#define PAGE_EXECUTE_READWRITE 0x40
+
+#define _byteswap_ushort __builtin_bswap16
+#define _byteswap_ulong __builtin_bswap32
+
+#define _stricmp strcasecmp
+
+// console and file output, file handles are FILE pointers and the console is discarded
+#define INVALID_HANDLE_VALUE ((HANDLE) (intptr_t) -1)
+#define STD_OUTPUT_HANDLE ((DWORD) -11)
+#define FOREGROUND_BLUE 0x0001
+#define FOREGROUND_GREEN 0x0002
+#define FOREGROUND_RED 0x0004
+#define FOREGROUND_INTENSITY 0x0008
+
+struct CONSOLE_SCREEN_BUFFER_INFO {
+    WORD wAttributes;
+};
+
+inline HANDLE GetStdHandle(DWORD) {
+    return nullptr;
+}
+
+inline BOOL GetConsoleScreenBufferInfo(HANDLE, CONSOLE_SCREEN_BUFFER_INFO *) {
+    return false;
+}
+
+inline BOOL SetConsoleTextAttribute(HANDLE, WORD) {
+    return false;
+}
+
+inline BOOL WriteFile(HANDLE file, const void *data, DWORD size, DWORD *written, void *) {
+    *written = file ? (DWORD) fwrite(data, 1, size, (FILE *) file) : size;
+    return *written == size;
+}
+
+inline BOOL FlushFileBuffers(HANDLE file) {
+    return fflush((FILE *) file) == 0;
+}
+
+#define IMAGE_DOS_SIGNATURE 0x5A4D
+#define IMAGE_NT_SIGNATURE 0x00004550
+#define IMAGE_NUMBEROF_DIRECTORY_ENTRIES 16
+#define IMAGE_SIZEOF_SHORT_NAME 8
+#define IMAGE_SCN_MEM_EXECUTE 0x20000000
+
+struct IMAGE_DOS_HEADER {
+    WORD e_magic;
+    WORD e_cblp;
+    WORD e_cp;
+    WORD e_crlc;
+    WORD e_cparhdr;
+    WORD e_minalloc;
+    WORD e_maxalloc;
+    WORD e_ss;
+    WORD e_sp;
+    WORD e_csum;
+    WORD e_ip;
+    WORD e_cs;
+    WORD e_lfarlc;
+    WORD e_ovno;
+    WORD e_res[4];
+    WORD e_oemid;
+    WORD e_oeminfo;
+    WORD e_res2[10];
+    LONG e_lfanew;
+};
+
+struct IMAGE_FILE_HEADER {
+    WORD Machine;
+    WORD NumberOfSections;
+    DWORD TimeDateStamp;
+    DWORD PointerToSymbolTable;
+    DWORD NumberOfSymbols;
+    WORD SizeOfOptionalHeader;
+    WORD Characteristics;
+};
+
+struct IMAGE_DATA_DIRECTORY {
+    DWORD VirtualAddress;
+    DWORD Size;
+};
+
+struct IMAGE_OPTIONAL_HEADER {
+    WORD Magic;
+    BYTE MajorLinkerVersion;
+    BYTE MinorLinkerVersion;
+    DWORD SizeOfCode;
+    DWORD SizeOfInitializedData;
+    DWORD SizeOfUninitializedData;
+    DWORD AddressOfEntryPoint;
+    DWORD BaseOfCode;
+    ULONGLONG ImageBase;
+    DWORD SectionAlignment;
+    DWORD FileAlignment;
+    WORD MajorOperatingSystemVersion;
+    WORD MinorOperatingSystemVersion;
+    WORD MajorImageVersion;
+    WORD MinorImageVersion;
+    WORD MajorSubsystemVersion;
+    WORD MinorSubsystemVersion;
+    DWORD Win32VersionValue;
+    DWORD SizeOfImage;
+    DWORD SizeOfHeaders;
+    DWORD CheckSum;
+    WORD Subsystem;
+    WORD DllCharacteristics;
+    ULONGLONG SizeOfStackReserve;
+    ULONGLONG SizeOfStackCommit;
+    ULONGLONG SizeOfHeapReserve;
+    ULONGLONG SizeOfHeapCommit;
+    DWORD LoaderFlags;
+    DWORD NumberOfRvaAndSizes;
+    IMAGE_DATA_DIRECTORY DataDirectory[IMAGE_NUMBEROF_DIRECTORY_ENTRIES];
+};
+
+struct IMAGE_NT_HEADERS {
+    DWORD Signature;
+    IMAGE_FILE_HEADER FileHeader;
+    IMAGE_OPTIONAL_HEADER OptionalHeader;
+};
+
+struct IMAGE_SECTION_HEADER {
+    BYTE Name[IMAGE_SIZEOF_SHORT_NAME];
+    union {
+        DWORD PhysicalAddress;
+        DWORD VirtualSize;
+    } Misc;
+    DWORD VirtualAddress;
+    DWORD SizeOfRawData;
+    DWORD PointerToRawData;
+    DWORD PointerToRelocations;
+    DWORD PointerToLinenumbers;
+    WORD NumberOfRelocations;
+    WORD NumberOfLinenumbers;
+    DWORD Characteristics;
+};
+
+#define IMAGE_FIRST_SECTION(nt_headers) ((IMAGE_SECTION_HEADER *) ((uintptr_t) (nt_headers) \
+        + offsetof(IMAGE_NT_HEADERS, OptionalHeader) + (nt_headers)->FileHeader.SizeOfOptionalHeader))
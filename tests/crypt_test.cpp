@@ -0,0 +1,170 @@
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "util/cpufeatures.h"
+#include "util/crypt.h"
+#include "util/rc4.h"
+
+#include "bench.h"
+#include "test.h"
+
+namespace crypt::avx2 {
+    size_t base64_encode(const uint8_t *src, size_t length, char *dst);
+}
+
+/*
+ * The byte at a time implementations the block versions replaced.
+ */
+class ReferenceRC4 {
+public:
+    uint8_t s_box[256];
+    uint8_t a = 0, b = 0;
+
+    ReferenceRC4(const uint8_t *key, size_t key_size) {
+        for (size_t i = 0; i < 256; i++) {
+            s_box[i] = (uint8_t) i;
+        }
+        if (!key_size) {
+            return;
+        }
+        size_t j = 0;
+        for (size_t i = 0; i < 256; i++) {
+            j = (j + s_box[i] + key[i % key_size]) % 256;
+            std::swap(s_box[i], s_box[j]);
+        }
+    }
+
+    void crypt(uint8_t *data, size_t size) {
+        for (size_t pos = 0; pos < size; pos++) {
+            a = (a + 1) % 256;
+            b = (b + s_box[a]) % 256;
+            std::swap(s_box[a], s_box[b]);
+            data[pos] ^= s_box[(s_box[a] + s_box[b]) % 256];
+        }
+    }
+};
+
+static std::string reference_base64(const uint8_t *ptr, size_t length) {
+    static const char *table = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    static size_t mod[] = { 0, 2, 1 };
+    std::string result(4 * ((length + 2) / 3), '=');
+    if (ptr && length) {
+        for (size_t i = 0, j = 0, triplet = 0; i < length; triplet = 0) {
+            for (size_t k = 0; k < 3; ++k) {
+                triplet = (triplet << 8) | (i < length ? ptr[i++] : 0);
+            }
+            for (size_t k = 4; k--;) {
+                result[j++] = table[(triplet >> k * 6) & 0x3F];
+            }
+        }
+        for (size_t i = 0; i < mod[length % 3]; i++) {
+            result[result.length() - 1 - i] = '=';
+        }
+    }
+    return result;
+}
+
+static std::mt19937_64 RNG(5);
+
+static std::vector<uint8_t> random_bytes(size_t size) {
+    std::vector<uint8_t> data(size);
+    for (auto &value : data) {
+        value = static_cast<uint8_t>(RNG());
+    }
+    return data;
+}
+
+static void test_rc4() {
+    for (int iteration = 0; iteration < 2000; iteration++) {
+
+        // keys of any size, including none
+        auto key = random_bytes(RNG() % 300);
+        util::RC4 cipher(key.data(), key.size());
+        ReferenceRC4 reference(key.data(), key.size());
+
+        // the keystream has to continue across calls of any size
+        for (int call = 0; call < 8; call++) {
+            auto data = random_bytes(RNG() % (call % 2 ? 40 : 3000));
+            auto expected = data;
+            cipher.crypt(data.data(), data.size());
+            reference.crypt(expected.data(), expected.size());
+            CHECK(data == expected);
+        }
+    }
+
+    // encrypting twice with fresh state gives the plain text back
+    uint8_t key[] = { 's', 'p', 'i', 'c', 'e' };
+    auto plain = random_bytes(100000);
+    auto data = plain;
+    util::RC4(key, sizeof(key)).crypt(data.data(), data.size());
+    CHECK(data != plain);
+    util::RC4(key, sizeof(key)).crypt(data.data(), data.size());
+    CHECK(data == plain);
+}
+
+static void test_base64() {
+
+    // all short lengths and random ones around the vector block sizes
+    for (int iteration = 0; iteration < 20000; iteration++) {
+        size_t size = iteration < 200 ? iteration : RNG() % (iteration < 19900 ? 1000 : 1 << 20);
+        auto data = random_bytes(size);
+        CHECK(crypt::base64_encode(data.data(), data.size()) == reference_base64(data.data(), data.size()));
+    }
+    CHECK(crypt::base64_encode(nullptr, 0).empty());
+
+    // vector path on its own, it may only consume whole blocks and must not write past them
+    if (cpufeatures::has_avx2()) {
+        for (size_t size = 0; size < 300; size++) {
+            auto data = random_bytes(size);
+            std::string out(size / 3 * 4 + 64, '#');
+            auto consumed = crypt::avx2::base64_encode(data.data(), data.size(), out.data());
+            CHECK(consumed % 24 == 0 && consumed <= size);
+            CHECK(size < 32 || size - consumed < 28);
+            auto expected = reference_base64(data.data(), consumed);
+            CHECK(out.compare(0, expected.size(), expected) == 0);
+            CHECK(out.find_first_not_of('#', expected.size()) == std::string::npos);
+        }
+    } else {
+        printf("AVX2 not supported, only the scalar base64 path was tested\n");
+    }
+}
+
+static void benchmark() {
+    printf("AVX2: %s\n", cpufeatures::has_avx2() ? "yes" : "no");
+
+    // typical API message sizes and a 1080p capture JPEG
+    for (size_t size : { 64, 4096, 1 << 20 }) {
+        auto data = random_bytes(size);
+        uint8_t key[16] {};
+        ReferenceRC4 reference(key, sizeof(key));
+        util::RC4 cipher(key, sizeof(key));
+        printf("%zu bytes\n", size);
+        bench::report("  rc4 byte at a time", bench::measure([&] {
+            reference.crypt(data.data(), data.size());
+            bench::keep(data);
+        }), size);
+        bench::report("  rc4 blocks", bench::measure([&] {
+            cipher.crypt(data.data(), data.size());
+            bench::keep(data);
+        }), size);
+        bench::report("  base64 byte at a time", bench::measure([&] {
+            auto encoded = reference_base64(data.data(), data.size());
+            bench::keep(encoded);
+        }), size);
+        bench::report("  base64 dispatched", bench::measure([&] {
+            auto encoded = crypt::base64_encode(data.data(), data.size());
+            bench::keep(encoded);
+        }), size);
+    }
+}
+
+int main(int argc, char **argv) {
+    test_rc4();
+    test_base64();
+    if (bench::enabled(argc, argv)) {
+        benchmark();
+    }
+    return test::result();
+}
@@ -0,0 +1,719 @@
+#include <atomic>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "easrv/easrv_http.h"
+#include "easrv/responses/bs_info2_common.h"
+#include "easrv/responses/bs_pcb2_boot.h"
+#include "easrv/responses/bs_pcb2_error.h"
+#include "easrv/responses/op2_common_get_music_info.h"
+#include "easrv/responses/pcbtracker_alive.h"
+#include "external/fmt/include/fmt/format.h"
+
+#include "bench.h"
+#include "test.h"
+
+/*
+ * Drives the EA server request handling with split, pipelined and malformed requests,
+ * first straight through the parser and then over loopback with many keep-alive clients.
+ */
+
+static EASrvResponse RESPONSE_HTTP_DEFAULT;
+static EASrvResponse RESPONSE_EMPTY;
+static EASrvResponse RESPONSE_EMPTY_CRYPT;
+static EASrvResponse RESPONSE_SERVICES;
+static EASrvResponse RESPONSE_ALIVE;
+static EASrvResponse RESPONSE_MESSAGE;
+static EASrvResponse RESPONSE_MESSAGE_CRYPT;
+static EASrvRoutes ROUTES;
+
+static const EASrvResponse *handle_message(const EASrvClient &client) {
+    return client.crypt ? &RESPONSE_MESSAGE_CRYPT : &RESPONSE_MESSAGE;
+}
+
+static void init_routes() {
+    const std::string header = "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\n";
+    auto build = [&header] (EASrvResponse &response, const std::string &body) {
+        easrv_build_response(response, header, body.data(), body.size());
+    };
+    easrv_build_response(RESPONSE_HTTP_DEFAULT, "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\n", "<html/>", 7);
+    build(RESPONSE_EMPTY, "empty");
+    build(RESPONSE_EMPTY_CRYPT, "empty crypt");
+    build(RESPONSE_SERVICES, std::string(3000, 's'));
+    build(RESPONSE_ALIVE, "alive");
+    build(RESPONSE_MESSAGE, "message");
+    build(RESPONSE_MESSAGE_CRYPT, std::string("message\0crypt", 13));
+
+    ROUTES = EASrvRoutes {};
+    ROUTES.http_default = &RESPONSE_HTTP_DEFAULT;
+    ROUTES.empty = &RESPONSE_EMPTY;
+    ROUTES.empty_crypt = &RESPONSE_EMPTY_CRYPT;
+    easrv_add_route(ROUTES, "services", "get", &RESPONSE_SERVICES);
+    easrv_add_route(ROUTES, "pcbtracker", "alive", &RESPONSE_ALIVE);
+    easrv_add_route(ROUTES, "message", "get", nullptr, handle_message);
+}
+
+// collects the responses of a client which isn't connected to anything
+static void send_to_string(EASrvClient &client, const std::string &message) {
+    reinterpret_cast<std::string *>(client.user)->append(message);
+}
+
+struct TestClient {
+    EASrvClient client;
+    std::string output;
+
+    TestClient() {
+        easrv_client_init(client, ROUTES, send_to_string, &output);
+    }
+
+    bool receive(const std::string &data) {
+        return easrv_client_receive(client, data.data(), data.size());
+    }
+};
+
+static std::string post(const std::string &url, bool crypt = false, const std::string &body = "body",
+        const char *version = "HTTP/1.1", const char *connection = nullptr) {
+    std::string request = "POST " + url + " " + version + "\r\n";
+    request += "Host: 127.0.0.1\r\n";
+    if (crypt) {
+        request += "X-Eamuse-Info: 1-5f6a1d2c-1234\r\n";
+    }
+    request += "X-Compress: none\r\n";
+    if (connection) {
+        request += std::string("Connection: ") + connection + "\r\n";
+    }
+    request += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+    return request;
+}
+
+static const std::string GET = "GET / HTTP/1.1\r\nUser-Agent: test\r\n\r\n";
+
+static void test_parse_url() {
+    struct {
+        const char *url;
+        const char *module;
+        const char *method;
+    } cases[] {
+        { "/?model=KFC:J:A:A:2020&module=services&method=get", "services", "get" },
+        { "/?method=get&module=services", "services", "get" },
+        { "/?model=KFC&f=module&module=message&method=get&x=1", "message", "get" },
+        { "//services/get", "services", "get" },
+        { "/core/pcbtracker/alive/", "pcbtracker", "alive" },
+        { "/pcbtracker/alive?model=KFC", "pcbtracker", "alive" },
+        { "/?module=services", "", "" },
+        { "/?xmodule=services&xmethod=get", "", "" },
+        { "/alive", "", "" },
+        { "/", "", "" },
+        { "", "", "" },
+    };
+    for (auto &c : cases) {
+        std::string_view module = "x", method = "x";
+        easrv_parse_url(c.url, module, method);
+        if (!CHECK(module == c.module && method == c.method)) {
+            fprintf(stderr, "  url %s: %.*s.%.*s\n", c.url,
+                    (int) module.size(), module.data(), (int) method.size(), method.data());
+        }
+    }
+}
+
+/*
+ * Every route stays reachable when the table fills up and slots collide.
+ */
+static void test_routes() {
+    CHECK(easrv_find_route(ROUTES, "services", "get")->response == &RESPONSE_SERVICES);
+    CHECK(easrv_find_route(ROUTES, "message", "get")->handler == handle_message);
+    CHECK(easrv_find_route(ROUTES, "services", "put") == nullptr);
+    CHECK(easrv_find_route(ROUTES, "servicesget", "") == nullptr);
+    CHECK(easrv_find_route(ROUTES, "", "") == nullptr);
+
+    EASrvRoutes routes {};
+    const EASrvResponse *responses[] { &RESPONSE_EMPTY, &RESPONSE_EMPTY_CRYPT };
+    std::vector<std::string> names;
+    for (size_t i = 0; i < EASRV_ROUTE_TABLE_SIZE - 1; i++) {
+        names.push_back("module" + std::to_string(i));
+    }
+    for (size_t i = 0; i < names.size(); i++) {
+        easrv_add_route(routes, names[i], "method", responses[i % 2]);
+    }
+    for (size_t i = 0; i < names.size(); i++) {
+        auto route = easrv_find_route(routes, names[i], "method");
+        CHECK(route != nullptr && route->response == responses[i % 2]);
+    }
+    CHECK(easrv_find_route(routes, "module", "method") == nullptr);
+}
+
+/*
+ * Requests cut at any point give the same responses as whole ones.
+ */
+static void test_split() {
+    auto requests = post("/?model=KFC&module=services&method=get")
+            + post("//message/get", true)
+            + GET
+            + post("//message/get", false, std::string(5000, 'b'))
+            + post("/pcbtracker/alive", false, "");
+    auto expected = RESPONSE_SERVICES.keep_alive + RESPONSE_MESSAGE_CRYPT.keep_alive
+            + RESPONSE_HTTP_DEFAULT.keep_alive + RESPONSE_MESSAGE.keep_alive + RESPONSE_ALIVE.keep_alive;
+
+    TestClient whole;
+    CHECK(whole.receive(requests));
+    CHECK(whole.output == expected);
+
+    TestClient bytes;
+    for (auto c : requests) {
+        CHECK(bytes.receive(std::string(1, c)));
+    }
+    CHECK(bytes.output == expected);
+
+    // every position of a single cut
+    size_t failed = 0;
+    for (size_t cut = 1; cut < requests.size(); cut += 7) {
+        TestClient client;
+        client.receive(requests.substr(0, cut));
+        client.receive(requests.substr(cut));
+        failed += client.output != expected;
+    }
+    CHECK(failed == 0);
+}
+
+/*
+ * Pipelined requests are answered in order, a trailing partial one waits for the rest.
+ */
+static void test_pipelined() {
+    auto first = post("//services/get") + GET + post("//message/get");
+    auto last = post("//pcbtracker/alive");
+
+    TestClient client;
+    CHECK(client.receive(first + last.substr(0, 40)));
+    CHECK(client.output == RESPONSE_SERVICES.keep_alive + RESPONSE_HTTP_DEFAULT.keep_alive
+            + RESPONSE_MESSAGE.keep_alive);
+    client.output.clear();
+    CHECK(client.receive(last.substr(40)));
+    CHECK(client.output == RESPONSE_ALIVE.keep_alive);
+
+    // the crypt flag belongs to a single request, unknown EA calls get an empty answer
+    client.output.clear();
+    CHECK(client.receive(post("//message/get", true) + post("//message/get") + post("//x/y", true) + post("//x/y")));
+    CHECK(client.output == RESPONSE_MESSAGE_CRYPT.keep_alive + RESPONSE_MESSAGE.keep_alive
+            + RESPONSE_EMPTY_CRYPT.keep_alive + RESPONSE_EMPTY.keep_alive);
+}
+
+/*
+ * The last response of a connection is the close variant, anything after it is ignored.
+ */
+static void test_close() {
+    TestClient client;
+    CHECK(!client.receive(post("//services/get") + post("//message/get", false, "b", "HTTP/1.1", "close")
+            + post("//pcbtracker/alive")));
+    CHECK(client.output == RESPONSE_SERVICES.keep_alive + RESPONSE_MESSAGE.close);
+    CHECK(!client.receive(post("//pcbtracker/alive")));
+    CHECK(client.output == RESPONSE_SERVICES.keep_alive + RESPONSE_MESSAGE.close);
+
+    // HTTP/1.0 closes unless asked not to
+    TestClient old;
+    CHECK(old.receive(post("//services/get", false, "b", "HTTP/1.0", "keep-alive")));
+    CHECK(!old.receive(post("//services/get", false, "b", "HTTP/1.0")));
+    CHECK(old.output == RESPONSE_SERVICES.keep_alive + RESPONSE_SERVICES.close);
+}
+
+/*
+ * Requests without an answer end the connection without output.
+ */
+static void test_rejected() {
+    std::string rejected[] {
+
+        // unknown URL outside of the EA namespace
+        post("/unknown/call"),
+
+        // unsupported methods
+        "PUT //services/get HTTP/1.1\r\nContent-Length: 0\r\n\r\n",
+        "DELETE / HTTP/1.1\r\n\r\n",
+
+        // protocol change
+        "GET / HTTP/1.1\r\nConnection: Upgrade\r\nUpgrade: websocket\r\n\r\n",
+
+        // limits
+        post("//" + std::string(EASRV_URL_BUFFER_SIZE, 'u') + "/get"),
+        "POST //services/get HTTP/1.1\r\n" + std::string(EASRV_HEADER_BUFFER_SIZE, 'h') + ": 1\r\n\r\n",
+        post("//services/get", false, std::string(EASRV_REQUEST_BODY_MAX_SIZE + 1, 'b')),
+
+        // not HTTP
+        "\x16\x03\x01\x02\x00\x01\x00\x01\xfc\x03\x03",
+    };
+    for (auto &request : rejected) {
+        TestClient client;
+        CHECK(client.receive(post("//services/get")));
+        auto failed = !CHECK(!client.receive(request))
+                | !CHECK(client.output == RESPONSE_SERVICES.keep_alive);
+        if (failed) {
+            fprintf(stderr, "  request %.60s\n", request.c_str());
+        }
+    }
+
+    // the largest accepted request
+    TestClient client;
+    CHECK(client.receive(post("//services/get", false, std::string(EASRV_REQUEST_BODY_MAX_SIZE, 'b'))));
+    CHECK(client.output == RESPONSE_SERVICES.keep_alive);
+}
+
+static int connect_loopback(uint16_t port) {
+    int socket = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(socket, (sockaddr *) &address, sizeof(address)) != 0) {
+        close(socket);
+        return -1;
+    }
+    int opt_enable = 1;
+    setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &opt_enable, sizeof(opt_enable));
+    return socket;
+}
+
+// reads exactly size bytes
+static bool read_bytes(int socket, size_t size, std::string &data) {
+    data.clear();
+    char buffer[16 * 1024];
+    while (data.size() < size) {
+        pollfd fd { socket, POLLIN, 0 };
+        if (poll(&fd, 1, 5000) <= 0) {
+            return false;
+        }
+        auto received = recv(socket, buffer, std::min(sizeof(buffer), size - data.size()), 0);
+        if (received <= 0) {
+            return false;
+        }
+        data.append(buffer, received);
+    }
+    return true;
+}
+
+static bool wait_closed(int socket) {
+    pollfd fd { socket, POLLIN, 0 };
+    char byte;
+    return poll(&fd, 1, 5000) == 1 && recv(socket, &byte, 1, 0) == 0;
+}
+
+/*
+ * Load generator: keep-alive clients sending bursts of pipelined requests cut into random pieces.
+ * Every connection has to get exactly the responses for its requests, in order.
+ */
+static void test_load(uint16_t port, bool bench) {
+    const size_t client_threads = 4;
+    const size_t clients_per_thread = bench ? 64 : 16;
+    const size_t rounds = bench ? 50 : 10;
+    const size_t depth = 8;
+
+    util::SocketServer server(2, 64 * 1024, 4 * 1024 * 1024);
+    easrv_serve(server, ROUTES);
+    if (!CHECK(server.listen(port, 128))) {
+        fprintf(stderr, "%s\n", server.get_error().c_str());
+        return;
+    }
+
+    struct Call {
+        std::string request;
+        const EASrvResponse *response;
+    } calls[] {
+        { post("/?model=KFC:J:A:A:2020&module=services&method=get"), &RESPONSE_SERVICES },
+        { post("//pcbtracker/alive", true), &RESPONSE_ALIVE },
+        { post("//message/get", true, std::string(1500, 'm')), &RESPONSE_MESSAGE_CRYPT },
+        { post("//message/get"), &RESPONSE_MESSAGE },
+        { post("//pcbtracker/alive", false, std::string(200, 'a')), &RESPONSE_ALIVE },
+        { GET, &RESPONSE_HTTP_DEFAULT },
+    };
+
+    std::atomic<size_t> failures = 0;
+    std::vector<std::vector<double>> latencies(client_threads);
+    std::vector<std::thread> threads;
+    auto start = bench::clock::now();
+    for (size_t t = 0; t < client_threads; t++) {
+        threads.emplace_back([&, t] {
+            std::mt19937 rng(t);
+            std::vector<int> sockets;
+            for (size_t i = 0; i < clients_per_thread; i++) {
+                auto socket = connect_loopback(port);
+                if (socket < 0) {
+                    failures++;
+                    continue;
+                }
+                sockets.push_back(socket);
+            }
+
+            for (size_t round = 0; round < rounds; round++) {
+
+                // the last round closes the connection with its last request
+                bool last = round + 1 == rounds;
+
+                // send a burst on every connection, cut into random pieces
+                std::vector<bench::clock::time_point> sent(sockets.size());
+                std::vector<std::string> expected(sockets.size());
+                for (size_t i = 0; i < sockets.size(); i++) {
+                    std::string burst;
+                    for (size_t n = 0; n < depth; n++) {
+                        auto &call = calls[rng() % std::size(calls)];
+                        if (last && n + 1 == depth) {
+                            burst += post("//services/get", false, "b", "HTTP/1.1", "close");
+                            expected[i] += RESPONSE_SERVICES.close;
+                        } else {
+                            burst += call.request;
+                            expected[i] += call.response->keep_alive;
+                        }
+                    }
+                    sent[i] = bench::clock::now();
+                    for (size_t pos = 0; pos < burst.size();) {
+                        auto length = std::min<size_t>(burst.size() - pos, 1 + rng() % 1500);
+                        if (::send(sockets[i], burst.data() + pos, length, MSG_NOSIGNAL) != (ssize_t) length) {
+                            failures++;
+                            break;
+                        }
+                        pos += length;
+                    }
+                }
+
+                // collect the responses
+                for (size_t i = 0; i < sockets.size(); i++) {
+                    std::string received;
+                    if (!read_bytes(sockets[i], expected[i].size(), received) || received != expected[i]) {
+                        failures++;
+                    }
+                    latencies[t].push_back(bench::seconds_since(sent[i]));
+                    if (last && !wait_closed(sockets[i])) {
+                        failures++;
+                    }
+                }
+            }
+
+            for (auto socket : sockets) {
+                close(socket);
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    auto elapsed = bench::seconds_since(start);
+    CHECK(failures == 0);
+
+    // report
+    if (bench) {
+        std::vector<double> all;
+        for (auto &thread_latencies : latencies) {
+            all.insert(all.end(), thread_latencies.begin(), thread_latencies.end());
+        }
+        auto requests = client_threads * clients_per_thread * rounds * depth;
+        printf("%zu clients, %zu requests in %.2f s, %.0f requests/s\n",
+                client_threads * clients_per_thread, requests, elapsed, requests / elapsed);
+        bench::report_latency("burst of 8 round trip", all);
+    }
+
+    // all connections got closed by the server
+    for (int i = 0; i < 500 && server.get_connection_count() > 0; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    CHECK(server.get_connection_count() == 0);
+
+    // a bad request after good ones still gets the good responses before the close
+    auto socket = connect_loopback(port);
+    auto request = post("//services/get") + GET + "PUT / HTTP/1.1\r\n\r\n" + post("//services/get");
+    CHECK(::send(socket, request.data(), request.size(), MSG_NOSIGNAL) == (ssize_t) request.size());
+    std::string received;
+    auto expected = RESPONSE_SERVICES.keep_alive + RESPONSE_HTTP_DEFAULT.keep_alive;
+    CHECK(read_bytes(socket, expected.size(), received) && received == expected);
+    CHECK(wait_closed(socket));
+    close(socket);
+
+    server.stop();
+    easrv_free_clients();
+}
+
+/*
+ * Parser and routing cost without the sockets, for a burst of pipelined requests.
+ */
+static void bench_parser() {
+    std::string burst;
+    size_t count = 0;
+    for (size_t i = 0; i < 16; i++) {
+        burst += post("/?model=KFC:J:A:A:2020&module=services&method=get", true, std::string(300, 'b'));
+        burst += post("//pcbtracker/alive", true, std::string(100, 'b'));
+        count += 2;
+    }
+    TestClient client;
+    auto seconds = bench::measure([&] {
+        client.output.clear();
+        client.receive(burst);
+        bench::keep(client.output);
+    });
+    bench::report("parse and route 32 pipelined requests", seconds, burst.size());
+    printf("%-40s %12.0f requests/s\n", "", count / seconds);
+}
+
+/*
+ * Response building as easrv did it for every request before the responses were prebuilt:
+ * the URL is checked against each route in turn with formatted strings, and the hit gets
+ * unescaped and framed into the send buffer.
+ */
+namespace legacy {
+
+    const std::string EA_HEADER =
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Type: application/octet-stream\r\n"
+            "Server: SpiceTools\r\n"
+            "X-Eamuse-Info: 1-53d121c7-a8b3\r\n"
+            "X-Compress: none\r\n";
+    const std::string EA_HEADER_PLAIN =
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Type: application/octet-stream\r\n"
+            "Server: SpiceTools\r\n"
+            "X-Compress: none\r\n";
+
+    // canned messages are either escaped strings or raw arrays
+    struct Route {
+        const char *module;
+        const char *method;
+        std::string message;
+        const unsigned char *data;
+        size_t size;
+        bool crypt;
+    };
+
+    static inline bool check_url(const std::string &url, const char *module, const char *method) {
+        std::ostringstream check1;
+        check1 << "module=" << module << "&method=" << method;
+        if (url.find(check1.str()) != std::string::npos) {
+            return true;
+        }
+        std::ostringstream check2;
+        check2 << '/' << module << '/' << method;
+        return url.find(check2.str()) != std::string::npos;
+    }
+
+    static inline void add_header(std::vector<char> &send, bool keep_alive, bool crypt, size_t size) {
+        auto &header = crypt ? EA_HEADER : EA_HEADER_PLAIN;
+        send.insert(send.end(), header.begin(), header.end());
+        auto fields = fmt::format("Connection: {}\r\nContent-Length: {}\r\n\r\n",
+                keep_alive ? "keep-alive" : "close", size);
+        send.insert(send.end(), fields.begin(), fields.end());
+    }
+
+    static inline void add_data(std::vector<char> &send, bool keep_alive, const std::string &data, bool crypt) {
+        bool escape = false;
+        size_t size = 0;
+        for (char c : data) {
+            if (escape) {
+                escape = false;
+                size++;
+            } else if (c == 1) {
+                escape = true;
+            } else {
+                size++;
+            }
+        }
+        add_header(send, keep_alive, crypt, size);
+        escape = false;
+        for (char c : data) {
+            if (escape) {
+                if (c == 2) {
+                    c = 0;
+                }
+                escape = false;
+                send.push_back(c);
+            } else if (c == 1) {
+                escape = true;
+            } else {
+                send.push_back(c);
+            }
+        }
+    }
+
+    static void respond(const std::vector<Route> &routes, const char *url, size_t url_length, bool keep_alive,
+            std::vector<char> &send) {
+        send.clear();
+        std::string url_string(url, url_length);
+        for (auto &route : routes) {
+            if (check_url(url_string, route.module, route.method)) {
+                if (route.data) {
+                    add_header(send, keep_alive, route.crypt, route.size);
+                    send.insert(send.end(), route.data, route.data + route.size);
+                } else {
+                    add_data(send, keep_alive, route.message, route.crypt);
+                }
+                return;
+            }
+        }
+    }
+}
+
+// escapes like the canned messages in easrv.cpp
+static std::string escape_message(size_t size, std::mt19937 &rng) {
+    std::string message;
+    for (size_t i = 0; i < size; i++) {
+        auto c = (char) (rng() % 4 == 0 ? rng() % 3 : rng());
+        if (c == 0) {
+            message += "\x01\x02";
+        } else if (c == 1) {
+            message += "\x01\x01";
+        } else {
+            message.push_back(c);
+        }
+    }
+    return message;
+}
+
+/*
+ * The real route list in the order of the old if/else chain, with the binary responses
+ * and escaped messages of similar size in place of the string ones.
+ */
+struct CannedRoutes {
+    std::vector<legacy::Route> legacy;
+    std::vector<EASrvResponse> responses;
+    EASrvRoutes routes {};
+
+    CannedRoutes() {
+        std::mt19937 rng(22);
+        auto message = [&rng] (const char *module, const char *method, size_t size, bool crypt = true) {
+            return legacy::Route { module, method, escape_message(size, rng), nullptr, 0, crypt };
+        };
+        auto raw = [] (const char *module, const char *method, const unsigned char *data, size_t size,
+                bool crypt = true) {
+            return legacy::Route { module, method, {}, data, size, crypt };
+        };
+        legacy = {
+            message("services", "get", 1400),
+            raw("pcbtracker", "alive", PCBTRACKER_ALIVE_BIN, PCBTRACKER_ALIVE_BIN_LEN),
+            message("message", "get", 120),
+            message("facility", "get", 700),
+            message("pcbevent", "put", 60),
+            message("package", "list", 90, false),
+            message("tax", "get_phase", 80),
+            message("eventlog", "write", 110),
+            message("machine", "get_control", 180),
+            raw("info2", "common", BS_INFO2_COMMON_BIN, BS_INFO2_COMMON_BIN_LEN, false),
+            raw("pcb2", "boot", BS_PCB2_BOOT_BIN, BS_PCB2_BOOT_BIN_LEN, false),
+            raw("pcb2", "error", BS_PCB2_ERROR_BIN, BS_PCB2_ERROR_BIN_LEN, false),
+            message("system", "getmaster", 2000),
+            message("hdkoperation", "get", 400),
+            raw("op2_common", "get_music_info", OP2_COMMON_GET_MUSIC_INFO_BIN, OP2_COMMON_GET_MUSIC_INFO_BIN_LEN),
+        };
+
+        // prebuilt like easrv_init_responses
+        responses.resize(legacy.size());
+        for (size_t i = 0; i < legacy.size(); i++) {
+            auto &route = legacy[i];
+            auto &header = route.crypt ? legacy::EA_HEADER : legacy::EA_HEADER_PLAIN;
+            if (route.data) {
+                easrv_build_response(responses[i], header, (const char *) route.data, route.size);
+            } else {
+                auto decoded = easrv_decode(route.message);
+                easrv_build_response(responses[i], header, decoded.data(), decoded.size());
+            }
+            easrv_add_route(routes, route.module, route.method, &responses[i]);
+        }
+    }
+};
+
+static void set_url(EASrvClient &client, const std::string &url) {
+    memcpy(client.url, url.c_str(), url.size() + 1);
+    client.url_length = url.size();
+    client.parser.method = HTTP_POST;
+}
+
+/*
+ * The prebuilt responses are byte for byte what the old code built per request.
+ */
+static void test_prebuilt(const CannedRoutes &canned) {
+    EASrvClient client;
+    client.routes = &canned.routes;
+    std::vector<char> send;
+    for (auto &route : canned.legacy) {
+        for (auto &url : {
+            fmt::format("//{}/{}", route.module, route.method),
+            fmt::format("/?model=KFC:J:A:A:2020&module={}&method={}&f=x", route.module, route.method),
+        }) {
+            set_url(client, url);
+            auto response = easrv_select_response(client);
+            if (!CHECK(response != nullptr)) {
+                continue;
+            }
+            for (auto keep_alive : { true, false }) {
+                legacy::respond(canned.legacy, client.url, client.url_length, keep_alive, send);
+                auto &message = keep_alive ? response->keep_alive : response->close;
+                if (!CHECK(std::string_view(send.data(), send.size()) == message)) {
+                    fprintf(stderr, "  url %s\n", url.c_str());
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Time to pick the response of a request, before and after prebuilding.
+ */
+static void bench_routes(const CannedRoutes &canned) {
+    EASrvClient client;
+    client.routes = &canned.routes;
+    std::vector<char> send;
+    struct {
+        const char *name;
+        std::vector<std::string> urls;
+    } cases[] {
+        { "services.get (first)", { "/?model=KFC:J:A:A:2020&module=services&method=get&f=services.get" } },
+        { "eventlog.write (8th)", { "/?model=KFC:J:A:A:2020&module=eventlog&method=write&f=eventlog.write" } },
+        { "op2_common.get_music_info (last)", { "//op2_common/get_music_info" } },
+        { "boot sequence", {
+            "/?model=KFC:J:A:A:2020&module=services&method=get",
+            "/?model=KFC:J:A:A:2020&module=pcbtracker&method=alive",
+            "/?model=KFC:J:A:A:2020&module=message&method=get",
+            "/?model=KFC:J:A:A:2020&module=facility&method=get",
+            "/?model=KFC:J:A:A:2020&module=pcbevent&method=put",
+            "/?model=KFC:J:A:A:2020&module=package&method=list",
+            "/?model=KFC:J:A:A:2020&module=tax&method=get_phase",
+            "/?model=KFC:J:A:A:2020&module=eventlog&method=write",
+        } },
+    };
+    for (auto &c : cases) {
+        auto before = bench::measure([&] {
+            for (auto &url : c.urls) {
+                legacy::respond(canned.legacy, url.data(), url.size(), true, send);
+                bench::keep(send);
+            }
+        }) / c.urls.size();
+        auto after = bench::measure([&] {
+            for (auto &url : c.urls) {
+                set_url(client, url);
+                auto response = easrv_select_response(client);
+                bench::keep(response);
+            }
+        }) / c.urls.size();
+        printf("%-40s before %10.3f us, after %8.3f us\n", c.name, before * 1e6, after * 1e6);
+    }
+}
+
+int main(int argc, char **argv) {
+    init_routes();
+    test_parse_url();
+    test_routes();
+    test_split();
+    test_pipelined();
+    test_close();
+    test_rejected();
+    CannedRoutes canned;
+    test_prebuilt(canned);
+    auto bench = bench::enabled(argc, argv);
+    test_load(20000 + getpid() % 20000, bench);
+    if (bench) {
+        bench_parser();
+        bench_routes(canned);
+    }
+    return test::result();
+}
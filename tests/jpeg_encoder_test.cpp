@@ -0,0 +1,233 @@
+#include <cmath>
+#include <csetjmp>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include <jpeglib.h>
+
+#include "util/jpeg_encoder.h"
+
+#include "bench.h"
+#include "test.h"
+
+/*
+ * Encodes synthetic images and decodes them again with libjpeg.
+ */
+
+struct Decoded {
+    size_t width = 0;
+    size_t height = 0;
+    int warnings = 0;
+    std::vector<uint8_t> rgb;
+};
+
+struct ErrorManager {
+    jpeg_error_mgr base;
+    jmp_buf jump;
+};
+
+static bool decode(const std::vector<uint8_t> &jpeg, Decoded &decoded) {
+    jpeg_decompress_struct info {};
+    ErrorManager error {};
+    info.err = jpeg_std_error(&error.base);
+    error.base.error_exit = [] (j_common_ptr info) {
+        longjmp(reinterpret_cast<ErrorManager *>(info->err)->jump, 1);
+    };
+    error.base.output_message = [] (j_common_ptr) {};
+    if (setjmp(error.jump)) {
+        jpeg_destroy_decompress(&info);
+        return false;
+    }
+
+    jpeg_create_decompress(&info);
+    jpeg_mem_src(&info, jpeg.data(), (unsigned long) jpeg.size());
+    jpeg_read_header(&info, TRUE);
+    info.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&info);
+    decoded.width = info.output_width;
+    decoded.height = info.output_height;
+    decoded.rgb.resize(decoded.width * decoded.height * 3);
+    while (info.output_scanline < info.output_height) {
+        auto row = &decoded.rgb[info.output_scanline * decoded.width * 3];
+        jpeg_read_scanlines(&info, &row, 1);
+    }
+    jpeg_finish_decompress(&info);
+
+    // corrupt entropy data or missing restart markers only produce warnings
+    decoded.warnings = (int) error.base.num_warnings;
+    jpeg_destroy_decompress(&info);
+    return true;
+}
+
+static double psnr(const std::vector<uint8_t> &a, const std::vector<uint8_t> &b) {
+    double error = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        double difference = (double) a[i] - b[i];
+        error += difference * difference;
+    }
+    if (error == 0) {
+        return 100;
+    }
+    return 10 * std::log10(255.0 * 255.0 * a.size() / error);
+}
+
+// gradients with a bit of noise and some hard edged blocks, like a game screen with its UI
+static std::vector<uint8_t> synthetic_image(size_t width, size_t height, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> rgb(width * height * 3);
+    for (size_t y = 0; y < height; y++) {
+        for (size_t x = 0; x < width; x++) {
+            auto pixel = &rgb[(y * width + x) * 3];
+            bool block = ((x / 24) + (y / 16)) % 7 == 0;
+            pixel[0] = block ? 240 : (uint8_t) (x * 255 / width);
+            pixel[1] = block ? 30 : (uint8_t) (y * 255 / height);
+            pixel[2] = (uint8_t) (128 + (int) (rng() % 17) - 8);
+        }
+    }
+    return rgb;
+}
+
+// positions of the restart markers in the scan, which has to be the last segment
+static std::vector<int> restart_markers(const std::vector<uint8_t> &jpeg) {
+    std::vector<int> markers;
+    size_t scan = 0;
+    for (size_t i = 0; i + 1 < jpeg.size(); i++) {
+        if (jpeg[i] == 0xFF && jpeg[i + 1] == 0xDA) {
+            scan = i;
+        }
+    }
+    for (size_t i = scan + 14; i + 1 < jpeg.size(); i++) {
+        if (jpeg[i] == 0xFF && jpeg[i + 1] >= 0xD0 && jpeg[i + 1] <= 0xD7) {
+            markers.push_back(jpeg[i + 1] - 0xD0);
+        }
+    }
+    return markers;
+}
+
+// libjpeg with the same quality and subsampling as the reference for the image quality
+static std::vector<uint8_t> libjpeg_encode(const std::vector<uint8_t> &rgb, size_t width, size_t height,
+        int quality, bool subsample = true) {
+    jpeg_compress_struct info {};
+    jpeg_error_mgr error {};
+    info.err = jpeg_std_error(&error);
+    jpeg_create_compress(&info);
+    unsigned char *buffer = nullptr;
+    unsigned long size = 0;
+    jpeg_mem_dest(&info, &buffer, &size);
+    info.image_width = (JDIMENSION) width;
+    info.image_height = (JDIMENSION) height;
+    info.input_components = 3;
+    info.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&info);
+    jpeg_set_quality(&info, quality, TRUE);
+    info.comp_info[0].h_samp_factor = subsample ? 2 : 1;
+    info.comp_info[0].v_samp_factor = subsample ? 2 : 1;
+    jpeg_start_compress(&info, TRUE);
+    while (info.next_scanline < info.image_height) {
+        auto row = const_cast<uint8_t *>(&rgb[info.next_scanline * width * 3]);
+        jpeg_write_scanlines(&info, &row, 1);
+    }
+    jpeg_finish_compress(&info);
+    std::vector<uint8_t> result(buffer, buffer + size);
+    jpeg_destroy_compress(&info);
+    free(buffer);
+    return result;
+}
+
+/*
+ * Sizes around the MCU and strip boundaries, every strip has to decode without warnings and
+ * carry its restart markers in sequence. The PSNR is compared to libjpeg since saturated edges
+ * limit what 4:2:0 can reach no matter the quality.
+ */
+static void test_decode() {
+    std::pair<size_t, size_t> sizes[] {
+        { 1, 1 }, { 7, 5 }, { 8, 8 }, { 16, 16 }, { 17, 33 }, { 31, 200 }, { 640, 480 }, { 641, 479 }, { 1920, 1080 },
+    };
+    util::JPEGEncoder encoder;
+    unsigned seed = 0;
+    for (auto [width, height] : sizes) {
+        for (bool subsample : { true, false }) {
+            for (int quality : { 30, 70, 95 }) {
+                auto rgb = synthetic_image(width, height, seed++);
+                std::vector<uint8_t> jpeg;
+                if (!CHECK(encoder.encode(jpeg, rgb.data(), width, height, quality, subsample))) {
+                    continue;
+                }
+
+                Decoded decoded;
+                if (!CHECK(decode(jpeg, decoded))) {
+                    continue;
+                }
+                CHECK(decoded.width == width && decoded.height == height);
+                CHECK(decoded.warnings == 0);
+
+                // one interval per MCU row
+                size_t mcu_rows = (height + (subsample ? 15 : 7)) / (subsample ? 16 : 8);
+                auto markers = restart_markers(jpeg);
+                CHECK(markers.size() == mcu_rows - 1);
+                for (size_t i = 0; i < markers.size(); i++) {
+                    CHECK(markers[i] == (int) (i % 8));
+                }
+
+                // image quality on par with libjpeg at the same settings, images smaller than
+                // an MCU only need to be recognizable since rounding differences dominate there
+                Decoded reference;
+                CHECK(decode(libjpeg_encode(rgb, width, height, quality, subsample), reference));
+                auto quality_psnr = psnr(rgb, decoded.rgb);
+                auto reference_psnr = psnr(rgb, reference.rgb);
+                auto expected = width < 16 && height < 16 ? 30 : reference_psnr - 0.5;
+                if (!CHECK(quality_psnr >= expected)) {
+                    fprintf(stderr, "  %zux%zu q%d%s: %.1f dB, libjpeg %.1f dB\n", width, height, quality,
+                            subsample ? " 4:2:0" : "", quality_psnr, reference_psnr);
+                }
+            }
+        }
+    }
+
+    // the encoder keeps its buffers, so encoding smaller images after large ones must not leave leftovers
+    auto rgb = synthetic_image(64, 48, 1);
+    std::vector<uint8_t> first, second;
+    encoder.encode(first, rgb.data(), 64, 48);
+    auto large = synthetic_image(1920, 1080, 2);
+    encoder.encode(second, large.data(), 1920, 1080);
+    encoder.encode(second, rgb.data(), 64, 48);
+    CHECK(first == second);
+
+    // invalid input
+    std::vector<uint8_t> out;
+    CHECK(!encoder.encode(out, nullptr, 1, 1));
+    CHECK(!encoder.encode(out, rgb.data(), 0, 1));
+    CHECK(!encoder.encode(out, rgb.data(), 70000, 1));
+}
+
+static void benchmark() {
+    const size_t width = 1920, height = 1080;
+    const int quality = 70;
+    auto rgb = synthetic_image(width, height, 7);
+    util::JPEGEncoder encoder;
+    std::vector<uint8_t> jpeg;
+    encoder.encode(jpeg, rgb.data(), width, height, quality);
+    auto reference = libjpeg_encode(rgb, width, height, quality);
+    Decoded decoded;
+    decode(jpeg, decoded);
+    printf("1920x1080 q%d: %zu bytes, %.1f dB, libjpeg %zu bytes\n",
+            quality, jpeg.size(), psnr(rgb, decoded.rgb), reference.size());
+
+    bench::report("encode", bench::measure([&] {
+        encoder.encode(jpeg, rgb.data(), width, height, quality);
+        bench::keep(jpeg);
+    }), rgb.size());
+    bench::report("libjpeg encode", bench::measure([&] {
+        reference = libjpeg_encode(rgb, width, height, quality);
+        bench::keep(reference);
+    }), rgb.size());
+}
+
+int main(int argc, char **argv) {
+    test_decode();
+    if (bench::enabled(argc, argv)) {
+        benchmark();
+    }
+    return test::result();
+}
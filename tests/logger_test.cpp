@@ -0,0 +1,379 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "launcher/launcher.h"
+#include "launcher/logger.h"
+#include "avs/ea3.h"
+#include "external/fmt/include/fmt/format.h"
+
+#include "bench.h"
+#include "test.h"
+
+/*
+ * Logs from many threads through the per-thread record rings and checks what reaches the log file
+ * and the sinks, including lines logged while the logger stops and sinks with full queues.
+ */
+
+HANDLE LOG_FILE = nullptr;
+
+namespace avs::ea3 {
+    std::string EA3_BOOT_PCBID = "0101020304050607080A";
+}
+
+// deferred record with raw arguments, like log_info
+static void log_record(size_t thread, size_t n) {
+    logger::push_deferred([] (std::string &out, std::time_t, std::string_view module, size_t thread, size_t n) {
+        out = fmt::format("{} {} {}\n", module, thread, n);
+    }, logger::Style::DEFAULT, "test", thread, n);
+}
+
+// line formatted by the caller, like log_fatal and the console hooks
+static void log_string(size_t thread, size_t n) {
+    logger::push(fmt::format("test {} {}\n", thread, n), logger::Style::GREY);
+}
+
+static void log_file_open() {
+    if (LOG_FILE) {
+        fclose((FILE *) LOG_FILE);
+    }
+    LOG_FILE = tmpfile();
+}
+
+static std::vector<std::string> log_file_lines() {
+    fflush((FILE *) LOG_FILE);
+    rewind((FILE *) LOG_FILE);
+    std::vector<std::string> lines;
+    char line[256];
+    while (fgets(line, sizeof(line), (FILE *) LOG_FILE)) {
+        lines.emplace_back(line);
+    }
+    return lines;
+}
+
+struct Collector {
+    std::mutex mutex;
+    std::vector<std::string> lines;
+
+    static void sink(void *user, const std::string &data, logger::Style) {
+        auto collector = reinterpret_cast<Collector *>(user);
+        std::lock_guard<std::mutex> lock(collector->mutex);
+        collector->lines.push_back(data);
+    }
+};
+
+// sink which takes its time every few lines, optionally logging from its callback
+struct SlowSink {
+    std::mutex mutex;
+    std::vector<std::string> lines;
+    std::chrono::microseconds delay {0};
+    size_t every = 1;
+    bool echo = false;
+    size_t burst = 0;
+    std::atomic<size_t> echoes = 0;
+
+    static void sink(void *user, const std::string &data, logger::Style) {
+        auto slow = reinterpret_cast<SlowSink *>(user);
+        size_t count;
+        {
+            std::lock_guard<std::mutex> lock(slow->mutex);
+            slow->lines.push_back(data);
+            count = slow->lines.size();
+        }
+        if (count % slow->every == 0) {
+            std::this_thread::sleep_for(slow->delay);
+            if (slow->echo) {
+                slow->echoes++;
+                logger::push("echo\n", logger::Style::DEFAULT);
+            }
+        }
+
+        // more than the ring holds, while the logging thread likely waits for this queue
+        if (count == 1000) {
+            for (size_t n = 0; n < slow->burst; n++) {
+                slow->echoes++;
+                logger::push("echo\n", logger::Style::DEFAULT);
+            }
+        }
+    }
+};
+
+/*
+ * Checks that every thread's lines arrived exactly once and in the order they were logged,
+ * counts holds the number of lines each thread logged.
+ */
+static bool check_lines(const std::vector<std::string> &lines, size_t threads, const std::vector<size_t> &counts) {
+    std::vector<size_t> next(threads, 0);
+    size_t unexpected = 0;
+    for (auto &line : lines) {
+        size_t thread, n;
+        if (sscanf(line.c_str(), "test %zu %zu", &thread, &n) != 2) {
+            continue;
+        }
+        if (thread >= threads || n != next[thread]) {
+            unexpected++;
+            continue;
+        }
+        next[thread]++;
+    }
+    auto result = CHECK(unexpected == 0) & CHECK(next == counts);
+    if (!result) {
+        for (size_t t = 0; t < threads; t++) {
+            fprintf(stderr, "  thread %zu: %zu of %zu lines\n", t, next[t], counts[t]);
+        }
+    }
+    return result;
+}
+
+/*
+ * Lines of concurrent producers reach file and sink once each, in per-thread order, with the PCBID hidden.
+ */
+static void test_producers() {
+    const size_t threads = 4;
+    const size_t lines = 20000;
+    log_file_open();
+    logger::start();
+    Collector collector;
+    logger::sink_add(Collector::sink, &collector, 1024, logger::SinkPolicy::Block);
+    std::vector<std::thread> producers;
+    for (size_t t = 0; t < threads; t++) {
+        producers.emplace_back([t] {
+            for (size_t n = 0; n < lines; n++) {
+                if (n % 3 == 0) {
+                    log_string(t, n);
+                } else {
+                    log_record(t, n);
+                }
+            }
+        });
+    }
+    for (auto &producer : producers) {
+        producer.join();
+    }
+
+    // hooks see the deferred lines too
+    {
+        logger::PCBIDFilter filter;
+        logger::push("pcbid " + avs::ea3::EA3_BOOT_PCBID + "\n", logger::Style::DEFAULT);
+    }
+
+    // flush waits for everything logged before
+    logger::push("flushed\n", logger::Style::DEFAULT);
+    logger::flush();
+    auto file = log_file_lines();
+    CHECK(!file.empty() && file.back() == "flushed\n");
+
+    logger::stop();
+    std::vector<size_t> counts(threads, lines);
+    check_lines(file, threads, counts);
+    check_lines(collector.lines, threads, counts);
+    CHECK(std::count(file.begin(), file.end(), "pcbid [hidden]\n") == 1);
+    CHECK(std::count(collector.lines.begin(), collector.lines.end(), "pcbid [hidden]\n") == 1);
+}
+
+// lines of a dropping sink may have gaps, but each thread's lines still come in order
+static bool check_order(const std::vector<std::string> &lines, size_t threads) {
+    std::vector<size_t> next(threads, 0);
+    size_t unordered = 0;
+    for (auto &line : lines) {
+        size_t thread, n;
+        if (sscanf(line.c_str(), "test %zu %zu", &thread, &n) != 2) {
+            continue;
+        }
+        if (thread >= threads || n < next[thread]) {
+            unordered++;
+            continue;
+        }
+        next[thread] = n + 1;
+    }
+    return CHECK(unordered == 0);
+}
+
+/*
+ * Producers keep logging while the logger stops. Lines after the stop are written by the producers
+ * themselves once the queued ones are out, none may get lost or overtake the queued ones.
+ */
+static void test_stop_race() {
+    const size_t threads = 3;
+    const size_t rounds = 300;
+    std::mt19937 rng(24);
+    size_t failed = 0;
+    for (size_t round = 0; round < rounds && failed == 0; round++) {
+        log_file_open();
+        logger::start();
+        std::atomic<bool> done = false;
+        std::atomic<size_t> running = 0;
+        std::vector<size_t> counts(threads, 0);
+        std::vector<std::thread> producers;
+        for (size_t t = 0; t < threads; t++) {
+            producers.emplace_back([t, &done, &running, &counts] {
+                running++;
+                size_t n = 0;
+                for (; !done; n++) {
+                    if (n % 3 == 0) {
+                        log_string(t, n);
+                    } else {
+                        log_record(t, n);
+                    }
+                }
+                counts[t] = n;
+            });
+        }
+        while (running < threads) {
+            std::this_thread::yield();
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(rng() % 2000));
+        logger::stop();
+
+        // some lines after the stop
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        done = true;
+        for (auto &producer : producers) {
+            producer.join();
+        }
+        if (!check_lines(log_file_lines(), threads, counts)) {
+            fprintf(stderr, "  round %zu\n", round);
+            failed++;
+        }
+    }
+}
+
+/*
+ * Full sink queues under load. A slow dropping sink accounts for every line as delivered or dropped,
+ * blocking sinks get every line, also one logging from its callback, and sinks come and go meanwhile.
+ * Only echoes logged from the callback may be dropped from blocking queues, since sink threads never wait.
+ */
+static void test_sinks() {
+    const size_t threads = 4;
+    const size_t lines = 20000;
+    log_file_open();
+    logger::start();
+
+    SlowSink dropping;
+    dropping.delay = std::chrono::microseconds(20);
+    auto dropped = logger::sink_add(SlowSink::sink, &dropping, 64, logger::SinkPolicy::Drop);
+    SlowSink blocking;
+    blocking.delay = std::chrono::microseconds(200);
+    blocking.every = 256;
+    auto blocked = logger::sink_add(SlowSink::sink, &blocking, 16, logger::SinkPolicy::Block);
+    SlowSink echoing;
+    echoing.echo = true;
+    echoing.every = 100;
+    echoing.burst = 4096;
+    auto echo_dropped = logger::sink_add(SlowSink::sink, &echoing, 16, logger::SinkPolicy::Block);
+
+    // sinks added and removed while the logging thread delivers
+    std::atomic<bool> done = false;
+    std::thread churn([&done] {
+        while (!done) {
+            Collector collector;
+            logger::sink_add(Collector::sink, &collector, 8, logger::SinkPolicy::Drop);
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            logger::sink_remove(Collector::sink, &collector);
+        }
+    });
+
+    std::vector<std::thread> producers;
+    for (size_t t = 0; t < threads; t++) {
+        producers.emplace_back([t] {
+            for (size_t n = 0; n < lines; n++) {
+                log_record(t, n);
+            }
+        });
+    }
+    for (auto &producer : producers) {
+        producer.join();
+    }
+    logger::flush();
+    done = true;
+    churn.join();
+
+    // echoes of the remaining lines reach the other sinks before they are counted
+    logger::sink_remove(SlowSink::sink, &echoing);
+    logger::flush();
+    logger::sink_remove(SlowSink::sink, &dropping);
+    logger::sink_remove(SlowSink::sink, &blocking);
+
+    std::vector<size_t> counts(threads, lines);
+    check_lines(log_file_lines(), threads, counts);
+    CHECK(*dropped > 0);
+    CHECK(dropping.lines.size() + *dropped == threads * lines + echoing.echoes);
+    check_order(dropping.lines, threads);
+    CHECK(*blocked <= echoing.echoes);
+    check_lines(blocking.lines, threads, counts);
+    CHECK(*echo_dropped <= echoing.echoes);
+    check_lines(echoing.lines, threads, counts);
+
+    // removing a sink the logging thread waits on frees it
+    SlowSink stuck;
+    stuck.delay = std::chrono::milliseconds(50);
+    logger::sink_add(SlowSink::sink, &stuck, 1, logger::SinkPolicy::Block);
+    for (size_t n = 0; n < 100; n++) {
+        log_record(0, n);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    auto start = bench::clock::now();
+    logger::sink_remove(SlowSink::sink, &stuck);
+    CHECK(bench::seconds_since(start) < 1);
+    CHECK(stuck.lines.size() < 100);
+    logger::push("unblocked\n", logger::Style::DEFAULT);
+    logger::flush();
+    auto file = log_file_lines();
+    CHECK(!file.empty() && file.back() == "unblocked\n");
+
+    logger::stop();
+}
+
+/*
+ * Time a producer spends per call, with all threads logging at once.
+ */
+static void bench_producers() {
+    LOG_FILE = fopen("/dev/null", "wb");
+    const size_t lines = 200000;
+    for (auto mode : { "deferred record", "formatted by caller" }) {
+        for (size_t threads : { 1, 2, 4, 8 }) {
+            logger::start();
+            std::vector<double> seconds(threads);
+            std::vector<std::thread> producers;
+            for (size_t t = 0; t < threads; t++) {
+                producers.emplace_back([t, mode, &seconds] {
+                    auto deferred = mode[0] == 'd';
+                    auto start = bench::clock::now();
+                    for (size_t n = 0; n < lines; n++) {
+                        if (deferred) {
+                            log_record(t, n);
+                        } else {
+                            log_string(t, n);
+                        }
+                    }
+                    seconds[t] = bench::seconds_since(start);
+                });
+            }
+            for (auto &producer : producers) {
+                producer.join();
+            }
+            logger::stop();
+            double total = 0;
+            for (auto s : seconds) {
+                total += s;
+            }
+            printf("%-24s %zu threads %10.1f ns per call\n", mode, threads, total / (threads * lines) * 1e9);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    test_producers();
+    test_stop_race();
+    test_sinks();
+    if (bench::enabled(argc, argv)) {
+        bench_producers();
+    }
+    return test::result();
+}
@@ -0,0 +1,174 @@
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "util/lz77.h"
+
+#include "test.h"
+
+using namespace util;
+
+/*
+ * The decoder this format was originally read with, the output has to stay readable by it.
+ */
+static std::vector<uint8_t> reference_decompress(const uint8_t *input, size_t input_length) {
+    std::vector<uint8_t> output;
+    std::vector<uint8_t> window(lz77::WINDOW_SIZE);
+    size_t window_pos = 0;
+    size_t input_pos = 0;
+    while (input_pos < input_length) {
+        uint8_t flag = input[input_pos++];
+        for (size_t bit_pos = 0; bit_pos < 8; bit_pos++) {
+            if ((flag >> bit_pos) & 1) {
+                if (input_pos >= input_length) {
+                    return output;
+                }
+                output.push_back(input[input_pos]);
+                window[window_pos++] = input[input_pos++];
+                window_pos &= lz77::WINDOW_SIZE - 1;
+            } else if (input_pos + 1 < input_length) {
+                size_t word = (input[input_pos] << 8) | input[input_pos + 1];
+                if (word == 0) {
+                    return output;
+                }
+                input_pos += 2;
+                size_t position = (window_pos - (word >> 4)) & (lz77::WINDOW_SIZE - 1);
+                size_t length = (word & 0x0F) + lz77::MIN_LENGTH;
+                for (size_t i = 0; i < length; i++) {
+                    uint8_t data = window[position++ & (lz77::WINDOW_SIZE - 1)];
+                    output.push_back(data);
+                    window[window_pos++] = data;
+                    window_pos &= lz77::WINDOW_SIZE - 1;
+                }
+            }
+        }
+    }
+    return output;
+}
+
+static std::mt19937_64 RNG(1);
+
+static std::vector<uint8_t> generate(int kind, size_t size) {
+    std::vector<uint8_t> data(size);
+    switch (kind) {
+        case 0:
+
+            // incompressible
+            for (auto &value : data) {
+                value = static_cast<uint8_t>(RNG());
+            }
+            break;
+        case 1:
+
+            // short matches everywhere
+            for (auto &value : data) {
+                value = static_cast<uint8_t>(RNG() % 3);
+            }
+            break;
+        case 2:
+
+            // long runs
+            for (size_t i = 0; i < size; i++) {
+                data[i] = static_cast<uint8_t>(i / 17);
+            }
+            break;
+        case 3:
+
+            // texture like RGBA gradient with noise
+            for (size_t i = 0; i < size; i++) {
+                data[i] = (i % 4 == 3) ? 0xFF : static_cast<uint8_t>((i / 4) % 64 + (RNG() % 4 == 0 ? RNG() % 3 : 0));
+            }
+            break;
+        case 4:
+
+            // zeros, matches overlapping their own output
+            break;
+        default:
+
+            // repeats close to the maximum distance
+            for (size_t i = 0; i < size; i++) {
+                data[i] = i < 5000 ? static_cast<uint8_t>(RNG()) : data[i - 4000 - (RNG() % 2 ? 95 : 0)];
+            }
+            break;
+    }
+    return data;
+}
+
+static void test_round_trip(const std::vector<uint8_t> &input) {
+    auto compressed = lz77::compress(input.data(), input.size());
+
+    // both decoders
+    CHECK(reference_decompress(compressed.data(), compressed.size()) == input);
+    CHECK(lz77::decompress(compressed.data(), compressed.size()) == input);
+
+    // known output size, and stopping early at a full buffer
+    std::vector<uint8_t> buffer(input.size() + 16, 0xAA);
+    CHECK(lz77::decompress(compressed.data(), compressed.size(), buffer.data(), buffer.size()) == input.size());
+    if (!input.empty()) {
+        CHECK(memcmp(buffer.data(), input.data(), input.size()) == 0);
+        size_t cut = RNG() % input.size();
+        std::vector<uint8_t> small(cut + 1, 0xAA);
+        CHECK(lz77::decompress(compressed.data(), compressed.size(), small.data(), cut) == cut);
+        CHECK(memcmp(small.data(), input.data(), cut) == 0 && small[cut] == 0xAA);
+    }
+
+    // streaming compressor gives the same output for any chunking, also when reused
+    lz77::Compressor compressor;
+    for (int pass = 0; pass < 2; pass++) {
+        std::vector<uint8_t> streamed;
+        for (size_t position = 0; position < input.size();) {
+            size_t length = std::min<size_t>(input.size() - position, RNG() % 9000);
+            compressor.write(input.data() + position, length, streamed);
+            position += length;
+        }
+        compressor.finish(streamed);
+        CHECK(streamed == compressed);
+    }
+
+    // streaming decompressor with random chunks, ignoring data after the end marker
+    auto trailing = compressed;
+    trailing.insert(trailing.end(), { 1, 2, 3 });
+    lz77::Decompressor decompressor;
+    std::vector<uint8_t> output;
+    size_t used = 0;
+    for (size_t position = 0; position < trailing.size() && !decompressor.is_finished();) {
+        size_t length = std::min<size_t>(trailing.size() - position, 1 + RNG() % 700);
+        used += decompressor.write(trailing.data() + position, length, output);
+        position += length;
+    }
+    CHECK(decompressor.is_finished());
+    CHECK(used == compressed.size());
+    CHECK(output == input);
+}
+
+static void test_stored() {
+
+    // stored blocks of the stub compressor
+    for (size_t size : { 0, 1, 7, 8, 9, 1000 }) {
+        auto input = generate(0, size);
+        size_t compressed_length = 0;
+        auto compressed = lz77::compress_stub(input.data(), input.size(), &compressed_length);
+        CHECK(lz77::decompress(compressed, compressed_length) == input);
+        CHECK(reference_decompress(compressed, compressed_length) == input);
+        free(compressed);
+    }
+}
+
+static void test_ratio() {
+
+    // zeros compress to close to the 18 bytes per word the format allows
+    auto input = generate(4, 1 << 16);
+    auto compressed = lz77::compress(input.data(), input.size());
+    CHECK(compressed.size() * 6 < input.size());
+}
+
+int main() {
+    for (int iteration = 0; iteration < 1500; iteration++) {
+        size_t size = iteration < 100 ? iteration : RNG() % (iteration < 1450 ? 3000 : 300000);
+        test_round_trip(generate(iteration % 6, size));
+    }
+    test_stored();
+    test_ratio();
+    return test::result();
+}
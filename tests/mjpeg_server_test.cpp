@@ -0,0 +1,293 @@
+#include <atomic>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "util/jpeg_encoder.h"
+#include "util/mjpeg_server.h"
+
+#include "test.h"
+
+/*
+ * Encodes synthetic frames and fans them out to stream clients over loopback,
+ * the same way the stream controller does with screen captures.
+ */
+
+static const char *PASSWORD = "pass word";
+
+static int connect_loopback(uint16_t port) {
+    int socket = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(socket, (sockaddr *) &address, sizeof(address)) != 0) {
+        close(socket);
+        return -1;
+    }
+    return socket;
+}
+
+static bool send_request(int socket, const std::string &request) {
+    return ::send(socket, request.data(), request.size(), MSG_NOSIGNAL) == (ssize_t) request.size();
+}
+
+/*
+ * Buffered reader for the client side of the stream.
+ */
+class StreamReader {
+public:
+    int socket;
+    std::string buffer;
+
+    explicit StreamReader(int socket) : socket(socket) {
+    }
+
+    bool fill() {
+        pollfd fd { socket, POLLIN, 0 };
+        if (poll(&fd, 1, 5000) <= 0) {
+            return false;
+        }
+        char data[16 * 1024];
+        auto received = recv(socket, data, sizeof(data), 0);
+        if (received <= 0) {
+            return false;
+        }
+        buffer.append(data, received);
+        return true;
+    }
+
+    bool read_header(std::string &header) {
+        size_t end;
+        while ((end = buffer.find("\r\n\r\n")) == std::string::npos) {
+            if (!fill()) {
+                return false;
+            }
+        }
+        header = buffer.substr(0, end + 4);
+        buffer.erase(0, end + 4);
+        return true;
+    }
+
+    bool read_bytes(size_t size, std::string &data) {
+        while (buffer.size() < size) {
+            if (!fill()) {
+                return false;
+            }
+        }
+        data = buffer.substr(0, size);
+        buffer.erase(0, size);
+        return true;
+    }
+
+    // reads everything until the server closes the connection
+    bool read_all(std::string &data) {
+        while (fill()) {
+        }
+        data.swap(buffer);
+        buffer.clear();
+        pollfd fd { socket, POLLIN, 0 };
+        char byte;
+        return poll(&fd, 1, 0) == 1 && recv(socket, &byte, 1, 0) == 0;
+    }
+
+    // reads the next part of the multipart stream
+    bool read_frame(std::string &frame) {
+        std::string header;
+        if (!read_header(header) || header.rfind("--frame\r\n", 0) != 0) {
+            return false;
+        }
+        auto length = header.find("Content-Length: ");
+        if (length == std::string::npos) {
+            return false;
+        }
+        std::string trailer;
+        return read_bytes(std::stoul(header.substr(length + 16)), frame)
+                && read_bytes(2, trailer) && trailer == "\r\n";
+    }
+};
+
+/*
+ * Requests which don't subscribe get their status line before the connection closes.
+ */
+static void test_status(uint16_t port) {
+    util::MJPEGServer server(2, PASSWORD);
+    if (!CHECK(server.listen(port, 16))) {
+        return;
+    }
+
+    std::pair<std::string, std::string> requests[] {
+        { "GET /2?password=pass%20word HTTP/1.1\r\n\r\n", "HTTP/1.0 404 Not Found\r\n" },
+        { "GET /x1?password=pass%20word HTTP/1.1\r\n\r\n", "HTTP/1.0 404 Not Found\r\n" },
+        { "GET /1?password=pass HTTP/1.1\r\n\r\n", "HTTP/1.0 403 Forbidden\r\n" },
+        { "GET /1 HTTP/1.1\r\n\r\n", "HTTP/1.0 403 Forbidden\r\n" },
+        { "POST /0?password=pass+word HTTP/1.1\r\n\r\n", "HTTP/1.0 405 Method Not Allowed\r\n" },
+
+        // input following a rejected request doesn't produce another response
+        { "GET /3 HTTP/1.1\r\n\r\nGET /0 HTTP/1.1\r\n\r\n", "HTTP/1.0 404 Not Found\r\n" },
+    };
+    for (auto &[request, status] : requests) {
+        auto socket = connect_loopback(port);
+        CHECK(send_request(socket, request));
+        StreamReader reader(socket);
+        std::string response;
+        CHECK(reader.read_all(response));
+        CHECK(response == status + "Content-Length: 0\r\nConnection: close\r\n\r\n");
+        close(socket);
+    }
+
+    // the same response if the request arrives in pieces
+    auto socket = connect_loopback(port);
+    for (auto c : std::string("GET /9 HTTP/1.1\r\n\r\n")) {
+        CHECK(::send(socket, &c, 1, MSG_NOSIGNAL) == 1);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    StreamReader reader(socket);
+    std::string response;
+    CHECK(reader.read_all(response));
+    CHECK(response.rfind("HTTP/1.0 404 Not Found\r\n", 0) == 0);
+    close(socket);
+    CHECK(server.get_subscriber_count(0) == 0);
+}
+
+static std::vector<uint8_t> encode_frame(util::JPEGEncoder &encoder, size_t index) {
+    const size_t width = 320;
+    const size_t height = 240;
+    std::mt19937 rng(index);
+    std::vector<uint8_t> rgb(width * height * 3);
+    for (size_t y = 0; y < height; y++) {
+        for (size_t x = 0; x < width; x++) {
+            auto pixel = &rgb[(y * width + x) * 3];
+            pixel[0] = (uint8_t) (x + index * 4);
+            pixel[1] = (uint8_t) (y + index * 2);
+            pixel[2] = (uint8_t) (rng() % 64);
+        }
+    }
+    std::vector<uint8_t> jpeg;
+    encoder.encode(jpeg, rgb.data(), width, height, 90);
+    return jpeg;
+}
+
+/*
+ * Fast clients get the newest frames in order, a client not reading at all just skips frames
+ * and doesn't hold up the others. Subscribers of another channel get nothing.
+ */
+static void test_fanout(uint16_t port) {
+    const size_t frame_count = 60;
+    const size_t client_count = 8;
+
+    util::MJPEGServer server(2, PASSWORD);
+    if (!CHECK(server.listen(port, 16))) {
+        return;
+    }
+
+    // frames are encoded up front so the clients can compare them
+    util::JPEGEncoder encoder;
+    std::vector<std::string> frames;
+    for (size_t i = 0; i < frame_count; i++) {
+        auto jpeg = encode_frame(encoder, i);
+        frames.emplace_back(jpeg.begin(), jpeg.end());
+    }
+    CHECK(frames[0].rfind("\xFF\xD8", 0) == 0);
+
+    // subscribe
+    auto subscribe = [port] (int channel) {
+        auto socket = connect_loopback(port);
+        send_request(socket, "GET /" + std::to_string(channel) + "?password=pass+word HTTP/1.1\r\n\r\n");
+        return socket;
+    };
+    std::vector<int> fast;
+    for (size_t i = 0; i < client_count; i++) {
+        fast.push_back(subscribe(0));
+    }
+    auto slow = subscribe(0);
+    auto other = subscribe(1);
+    for (int i = 0; i < 500 && server.get_subscriber_count(0) < client_count + 1; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    CHECK(server.get_subscriber_count(0) == client_count + 1);
+    CHECK(server.get_subscriber_count(1) == 1);
+
+    // read every frame until the last one arrives, checking they're in publishing order
+    auto receive = [&frames] (int socket, size_t &received) {
+        StreamReader reader(socket);
+        std::string header;
+        if (!reader.read_header(header) || header.rfind("HTTP/1.0 200 OK\r\n", 0) != 0) {
+            return false;
+        }
+        size_t next = 0;
+        while (next < frames.size()) {
+            std::string frame;
+            if (!reader.read_frame(frame)) {
+                return false;
+            }
+            while (next < frames.size() && frames[next] != frame) {
+                next++;
+            }
+            if (next == frames.size()) {
+                return false;
+            }
+            received++;
+            next++;
+        }
+        return true;
+    };
+    std::atomic<size_t> failures = 0;
+    std::vector<size_t> received(client_count);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < client_count; i++) {
+        threads.emplace_back([&, i] {
+            if (!receive(fast[i], received[i])) {
+                failures++;
+            }
+        });
+    }
+
+    // publish at a steady rate
+    for (auto &frame : frames) {
+        server.publish(0, std::make_shared<std::vector<uint8_t>>(frame.begin(), frame.end()));
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    CHECK(failures == 0);
+
+    // the slow client catches up to the latest frame once it starts reading
+    size_t slow_received = 0;
+    CHECK(receive(slow, slow_received));
+    CHECK(slow_received >= 1);
+
+    // nothing for the other channel beyond the stream header
+    StreamReader reader(other);
+    std::string header;
+    CHECK(reader.read_header(header));
+    pollfd fd { other, POLLIN, 0 };
+    CHECK(poll(&fd, 1, 50) == 0);
+
+    // disconnects unsubscribe
+    for (auto socket : fast) {
+        close(socket);
+    }
+    close(slow);
+    close(other);
+    for (int i = 0; i < 500 && server.get_subscriber_count(0) + server.get_subscriber_count(1) > 0; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    CHECK(server.get_subscriber_count(0) == 0);
+    CHECK(server.get_subscriber_count(1) == 0);
+}
+
+int main() {
+    uint16_t port = 20000 + getpid() % 20000;
+    test_status(port);
+    test_fanout(port + 1);
+    return test::result();
+}
@@ -0,0 +1,265 @@
+#include <random>
+#include <string>
+#include <vector>
+
+#include "api/msgpack.h"
+#include "external/rapidjson/stringbuffer.h"
+#include "external/rapidjson/writer.h"
+
+#include "bench.h"
+#include "test.h"
+
+using namespace rapidjson;
+
+static std::mt19937_64 RNG(3);
+
+static std::vector<char> encode(const Value &value) {
+    std::vector<char> out;
+    api::msgpack::write(value, out);
+    return out;
+}
+
+static bool decode(const std::vector<char> &data, Document &document) {
+    return api::msgpack::parse((const uint8_t *) data.data(), data.size(), document);
+}
+
+static bool decode(const std::string &data) {
+    Document document;
+    return api::msgpack::parse((const uint8_t *) data.data(), data.size(), document);
+}
+
+static std::string hex(const std::vector<char> &data) {
+    std::string result;
+    char digits[3];
+    for (auto c : data) {
+        snprintf(digits, sizeof(digits), "%02X", (uint8_t) c);
+        result += digits;
+    }
+    return result;
+}
+
+// values around every encoding boundary
+static const int64_t INTS[] {
+    0, 1, 31, 32, 127, 128, 255, 256, 65535, 65536, 4294967295LL, 4294967296LL, INT64_MAX,
+    -1, -32, -33, -128, -129, -32768, -32769, INT32_MIN, (int64_t) INT32_MIN - 1, INT64_MIN,
+};
+static const size_t STRING_LENGTHS[] { 0, 1, 31, 32, 255, 256, 65535, 65536 };
+
+static void random_value(Value &value, Document::AllocatorType &allocator, int depth) {
+    switch (RNG() % (depth > 4 ? 6 : 8)) {
+        case 0:
+            value.SetNull();
+            break;
+        case 1:
+            value.SetBool(RNG() % 2);
+            break;
+        case 2:
+            value.SetInt64(INTS[RNG() % std::size(INTS)]);
+            break;
+        case 3:
+            if (RNG() % 2) {
+                value.SetUint64(UINT64_MAX - RNG() % 2);
+            } else {
+                value.SetDouble(RNG() % 2 ? 0.5 : (double) RNG() / 3.0);
+            }
+            break;
+        case 4:
+        case 5: {
+            auto length = RNG() % 16 ? RNG() % 40 : STRING_LENGTHS[RNG() % std::size(STRING_LENGTHS)];
+            std::string string(length, 0);
+            for (auto &c : string) {
+                c = (char) RNG();
+            }
+            value.SetString(string.data(), (SizeType) string.size(), allocator);
+            break;
+        }
+        case 6: {
+            value.SetArray();
+            auto length = RNG() % 32 ? RNG() % 20 : 70000;
+            for (size_t i = 0; i < length; i++) {
+                Value element;
+                if (length > 20) {
+                    element.SetInt64(INTS[RNG() % std::size(INTS)]);
+                } else {
+                    random_value(element, allocator, depth + 1);
+                }
+                value.PushBack(element, allocator);
+            }
+            break;
+        }
+        case 7: {
+            value.SetObject();
+            auto length = RNG() % 20;
+            for (size_t i = 0; i < length; i++) {
+                Value key, element;
+                auto name = "key" + std::to_string(i);
+                key.SetString(name.data(), (SizeType) name.size(), allocator);
+                random_value(element, allocator, depth + 1);
+                value.AddMember(key, element, allocator);
+            }
+            break;
+        }
+    }
+}
+
+static void test_encoding() {
+    Document document;
+    document.Parse(R"({"a":[1,-1,null,true,false,"xy",0.5,1.1]})");
+    CHECK(hex(encode(document)) == "81A16198"
+            "01FFC0C3C2A27879CA3F000000CB3FF199999999999A");
+
+    // every size class
+    auto encode_int = [] (int64_t i) {
+        return hex(encode(Value(i)));
+    };
+    CHECK(encode_int(127) == "7F");
+    CHECK(encode_int(128) == "CC80");
+    CHECK(encode_int(256) == "CD0100");
+    CHECK(encode_int(65536) == "CE00010000");
+    CHECK(encode_int(4294967296LL) == "CF0000000100000000");
+    CHECK(encode_int(-32) == "E0");
+    CHECK(encode_int(-33) == "D0DF");
+    CHECK(encode_int(-129) == "D1FF7F");
+    CHECK(encode_int(-32769) == "D2FFFF7FFF");
+    CHECK(encode_int(INT64_MIN) == "D38000000000000000");
+    auto header = [&document] (size_t length) {
+        std::string string(length, 'x');
+        Value value(string.data(), (SizeType) string.size(), document.GetAllocator());
+        return hex(encode(value)).substr(0, 10);
+    };
+    CHECK(header(31).substr(0, 2) == "BF");
+    CHECK(header(32).substr(0, 4) == "D920");
+    CHECK(header(256).substr(0, 6) == "DA0100");
+    CHECK(header(65536) == "DB00010000");
+    Value array(kArrayType);
+    for (int i = 0; i < 16; i++) {
+        array.PushBack(Value(i), document.GetAllocator());
+    }
+    CHECK(hex(encode(array)).substr(0, 6) == "DC0010");
+
+    // types only other encoders produce
+    CHECK(decode(std::string("\xC4\x02hi", 4)));
+    CHECK(!decode("\xC1"));
+    CHECK(!decode("\x81\x01\x01"));
+}
+
+static void test_round_trip() {
+    for (int iteration = 0; iteration < 500; iteration++) {
+        Document source;
+        random_value(source, source.GetAllocator(), 0);
+        auto encoded = encode(source);
+        Document decoded;
+        if (!CHECK(decode(encoded, decoded))) {
+            continue;
+        }
+        CHECK(decoded == source);
+        CHECK(encode(decoded) == encoded);
+    }
+}
+
+static void test_depth_limit() {
+    auto nested = [] (size_t depth) {
+        return std::string(depth, '\x91') + "\xC0";
+    };
+
+    // the root and 64 levels below it
+    CHECK(decode(nested(64)));
+    CHECK(!decode(nested(65)));
+    auto nested_maps = [] (size_t depth) {
+        std::string result;
+        for (size_t i = 0; i < depth; i++) {
+            result += "\x81\xA1k";
+        }
+        return result + "\xC0";
+    };
+    CHECK(decode(nested_maps(64)));
+    CHECK(!decode(nested_maps(65)));
+
+    // deep input is refused before it gets anywhere near the stack limit
+    CHECK(!decode(nested(1000000)));
+    CHECK(!decode(std::string(1000000, '\x81')));
+}
+
+static void test_truncated() {
+    for (int iteration = 0; iteration < 200; iteration++) {
+        Document source;
+        random_value(source, source.GetAllocator(), 2);
+        auto encoded = encode(source);
+
+        // every prefix and anything trailing is rejected
+        for (size_t size = 0; size < encoded.size(); size += 1 + size / 64) {
+            Document document;
+            CHECK(!api::msgpack::parse((const uint8_t *) encoded.data(), size, document));
+        }
+        encoded.push_back(0);
+        Document document;
+        CHECK(!decode(encoded, document));
+    }
+
+    // lengths larger than the input fail without allocating for them
+    CHECK(!decode(std::string("\xDB\xFF\xFF\xFF\xFF", 5)));
+    CHECK(!decode(std::string("\xDD\xFF\xFF\xFF\xFF\xC0", 6)));
+    CHECK(!decode(std::string("\xDF\xFF\xFF\xFF\xFF\xA1k\xC0", 8)));
+    CHECK(!decode(std::string("\xCB\x00\x00", 3)));
+}
+
+/*
+ * Throughput against JSON for a typical analogs/lights reply.
+ */
+static void benchmark() {
+    Document document;
+    auto &allocator = document.GetAllocator();
+    document.SetObject();
+    document.AddMember("id", 123456, allocator);
+    document.AddMember("errors", Value(kArrayType), allocator);
+    Value data(kArrayType);
+    for (int i = 0; i < 64; i++) {
+        Value entry(kArrayType);
+        auto name = "Light " + std::to_string(i);
+        entry.PushBack(Value(name.data(), (SizeType) name.size(), allocator), allocator);
+        entry.PushBack(i / 64.0, allocator);
+        entry.PushBack(i % 3 == 0, allocator);
+        data.PushBack(entry, allocator);
+    }
+    document.AddMember("data", data, allocator);
+
+    std::vector<char> msgpack;
+    StringBuffer json;
+    api::msgpack::write(document, msgpack);
+    Writer<StringBuffer> json_writer(json);
+    document.Accept(json_writer);
+    printf("message: %zu bytes msgpack, %zu bytes json\n", msgpack.size(), json.GetSize());
+
+    bench::report("msgpack write", bench::measure([&] {
+        msgpack.clear();
+        api::msgpack::write(document, msgpack);
+        bench::keep(msgpack);
+    }), msgpack.size());
+    bench::report("json write", bench::measure([&] {
+        json.Clear();
+        Writer<StringBuffer> writer(json);
+        document.Accept(writer);
+        bench::keep(json);
+    }), json.GetSize());
+    bench::report("msgpack parse", bench::measure([&] {
+        Document parsed;
+        api::msgpack::parse((const uint8_t *) msgpack.data(), msgpack.size(), parsed);
+        bench::keep(parsed);
+    }), msgpack.size());
+    bench::report("json parse", bench::measure([&] {
+        Document parsed;
+        parsed.Parse(json.GetString(), json.GetSize());
+        bench::keep(parsed);
+    }), json.GetSize());
+}
+
+int main(int argc, char **argv) {
+    test_encoding();
+    test_round_trip();
+    test_depth_limit();
+    test_truncated();
+    if (bench::enabled(argc, argv)) {
+        benchmark();
+    }
+    return test::result();
+}
@@ -0,0 +1,352 @@
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "overlay/windows/patch_cache.h"
+
+#include "bench.h"
+#include "test.h"
+
+using overlay::windows::PatchCache;
+using overlay::windows::PatchCacheEntry;
+using overlay::windows::PatchCacheFile;
+
+static const PatchCacheFile FILE_A {
+    .size = 123456,
+    .time = 133000000000000000,
+    .pe_time_stamp = 0x5F5E1000,
+    .pe_checksum = 0x0001E240,
+    .hash = "a1b2c3",
+};
+
+static PatchCacheEntry entry(uint64_t location, bool found = true) {
+    return PatchCacheEntry {
+        .found = found,
+        .location = location,
+        .data_offset = location + 0x400,
+        .count = found ? 1u : 0u,
+    };
+}
+
+static bool same(const PatchCacheEntry *a, const PatchCacheEntry &b) {
+    return a && a->found == b.found && a->location == b.location
+        && a->data_offset == b.data_offset && a->count == b.count;
+}
+
+// a cache with two DLLs, saved the way the patch manager leaves it after a scan
+static std::string saved_cache() {
+    PatchCache cache;
+    cache.validate("game.dll", FILE_A, false);
+    cache.store("game.dll", "k1", entry(0x1000));
+    cache.store("game.dll", "k2", entry(0, false));
+    auto file_b = FILE_A;
+    file_b.size = 99;
+    cache.validate("other.dll", file_b, true);
+    cache.store("other.dll", "k1", entry(0x2000));
+    return cache.save();
+}
+
+/*
+ * Entries come back after saving and loading as long as the file identity matches.
+ */
+static void test_round_trip() {
+    auto json = saved_cache();
+    PatchCache cache;
+    CHECK(cache.load(json));
+    CHECK(!cache.is_dirty());
+
+    // nothing is found before the DLL was validated
+    CHECK(cache.find("game.dll", "k1") == nullptr);
+    CHECK(cache.validate("game.dll", FILE_A, false));
+    CHECK(same(cache.find("game.dll", "k1"), entry(0x1000)));
+    CHECK(same(cache.find("game.dll", "k2"), entry(0, false)));
+    CHECK(cache.find("game.dll", "k3") == nullptr);
+    CHECK(!cache.is_dirty());
+
+    // validating again keeps the entries, whatever the file
+    auto changed = FILE_A;
+    changed.size++;
+    CHECK(cache.validate("game.dll", changed, false));
+    CHECK(cache.find("game.dll", "k1") != nullptr);
+}
+
+/*
+ * Every part of the identity and the scan mode invalidate the entries of that DLL only.
+ */
+static void test_invalidation() {
+    auto json = saved_cache();
+    std::vector<PatchCacheFile> changes(5, FILE_A);
+    changes[0].size++;
+    changes[1].time--;
+    changes[2].pe_time_stamp++;
+    changes[3].pe_checksum ^= 1;
+    changes[4].hash = "a1b2c4";
+    for (auto &file : changes) {
+        PatchCache cache;
+        CHECK(cache.load(json));
+        CHECK(!cache.validate("game.dll", file, false));
+        CHECK(cache.find("game.dll", "k1") == nullptr);
+        CHECK(cache.is_dirty());
+
+        // the new identity is kept along with new results
+        cache.store("game.dll", "k1", entry(0x3000));
+        auto saved = cache.save();
+        PatchCache reloaded;
+        CHECK(reloaded.load(saved));
+        CHECK(reloaded.validate("game.dll", file, false));
+        CHECK(same(reloaded.find("game.dll", "k1"), entry(0x3000)));
+        CHECK(reloaded.find("game.dll", "k2") == nullptr);
+
+        // the other DLL wasn't looked at and is kept as it was
+        auto file_b = FILE_A;
+        file_b.size = 99;
+        CHECK(reloaded.validate("other.dll", file_b, true));
+        CHECK(same(reloaded.find("other.dll", "k1"), entry(0x2000)));
+    }
+
+    // standalone scans store file offsets instead of RVAs
+    PatchCache cache;
+    CHECK(cache.load(json));
+    CHECK(!cache.validate("game.dll", FILE_A, true));
+    CHECK(cache.find("game.dll", "k1") == nullptr);
+
+    // DLLs not in the cache yet
+    CHECK(!cache.validate("new.dll", FILE_A, false));
+}
+
+/*
+ * Unused entries of looked at DLLs are pruned on save.
+ */
+static void test_pruning() {
+    PatchCache cache;
+    CHECK(cache.load(saved_cache()));
+    CHECK(cache.validate("game.dll", FILE_A, false));
+    CHECK(cache.find("game.dll", "k2") != nullptr);
+    CHECK(cache.is_dirty());
+    PatchCache reloaded;
+    CHECK(reloaded.load(cache.save()));
+    CHECK(!cache.is_dirty());
+    CHECK(reloaded.validate("game.dll", FILE_A, false));
+    CHECK(reloaded.find("game.dll", "k1") == nullptr);
+    CHECK(reloaded.find("game.dll", "k2") != nullptr);
+}
+
+/*
+ * Documents of another version or with broken fields. Broken DLLs and entries are skipped
+ * without losing the rest.
+ */
+static void test_format() {
+    PatchCache cache;
+    auto json = saved_cache();
+    CHECK(json.rfind("{\"version\":2,", 0) == 0);
+
+    // whole documents
+    auto version = [&json] (const std::string &value) {
+        auto result = json;
+        result.replace(result.find("\"version\":2"), 11, "\"version\":" + value);
+        return result;
+    };
+    CHECK(!cache.load(version("1")));
+    CHECK(cache.find("game.dll", "k1") == nullptr);
+    CHECK(!cache.load(version("3")));
+    CHECK(!cache.load(version("\"2\"")));
+    CHECK(!cache.load(json.substr(0, json.size() - 1)));
+    CHECK(!cache.load(""));
+    CHECK(!cache.load("[]"));
+    CHECK(!cache.load("{\"version\":2}"));
+    CHECK(!cache.load("{\"version\":2,\"dlls\":[]}"));
+    CHECK(cache.load("{\"version\":2,\"dlls\":{}}"));
+
+    // a field of the DLL identity with the wrong type or missing drops that DLL
+    auto replace = [&json] (const std::string &from, const std::string &to) {
+        auto result = json;
+        auto position = result.find(from);
+        if (position != std::string::npos) {
+            result.replace(position, from.size(), to);
+        }
+        return result;
+    };
+    const std::pair<std::string, std::string> dll_fields[] {
+        { "\"size\":123456", "\"size\":-1" },
+        { "\"size\":123456", "\"size\":\"123456\"" },
+        { "\"time\":133000000000000000", "\"time\":1.5" },
+        { "\"pe_time_stamp\":1600000000", "\"pe_time_stamp\":4294967296" },
+        { "\"pe_checksum\":123456", "\"pe_checksum\":null" },
+        { "\"hash\":\"a1b2c3\"", "\"hash\":1" },
+        { "\"standalone\":false", "\"standalone\":0" },
+        { "\"size\":123456,", "" },
+    };
+    for (auto &[from, to] : dll_fields) {
+        auto broken = replace(from, to);
+        if (!CHECK(broken != json)) {
+            fprintf(stderr, "  %s not in %s\n", from.c_str(), json.c_str());
+            continue;
+        }
+        CHECK(cache.load(broken));
+        CHECK(!cache.validate("game.dll", FILE_A, false));
+        auto file_b = FILE_A;
+        file_b.size = 99;
+        CHECK(cache.validate("other.dll", file_b, true));
+    }
+
+    // an entry with a broken field is dropped, the others of the DLL are kept
+    const std::pair<std::string, std::string> entry_fields[] {
+        { "\"found\":true", "\"found\":1" },
+        { "\"location\":4096", "\"location\":-4096" },
+        { "\"data_offset\":5120", "\"data_offset\":\"5120\"" },
+        { "\"count\":1", "\"count\":[]" },
+        { "\"found\":true,", "" },
+    };
+    for (auto &[from, to] : entry_fields) {
+        auto broken = replace(from, to);
+        if (!CHECK(broken != json)) {
+            fprintf(stderr, "  %s not in %s\n", from.c_str(), json.c_str());
+            continue;
+        }
+        CHECK(cache.load(broken));
+        CHECK(cache.validate("game.dll", FILE_A, false));
+        CHECK(cache.find("game.dll", "k1") == nullptr);
+        CHECK(cache.find("game.dll", "k2") != nullptr);
+    }
+    CHECK(cache.load(replace("\"k2\":{", "\"k2\":[],\"k3\":{")));
+    CHECK(cache.validate("game.dll", FILE_A, false));
+    CHECK(cache.find("game.dll", "k2") == nullptr);
+    CHECK(cache.find("game.dll", "k3") != nullptr);
+}
+
+/*
+ * Keys change with every part of the signature, including where one field ends and the next starts.
+ */
+static void test_signature_key() {
+    auto key = PatchCache::signature_key("AABB??CC", "DDEE", 4, 0);
+    CHECK(key.size() == 64);
+    CHECK(key == PatchCache::signature_key("AABB??CC", "DDEE", 4, 0));
+    CHECK(key != PatchCache::signature_key("AABB??CD", "DDEE", 4, 0));
+    CHECK(key != PatchCache::signature_key("AABB??CC", "DDEF", 4, 0));
+    CHECK(key != PatchCache::signature_key("AABB??CC", "DDEE", 5, 0));
+    CHECK(key != PatchCache::signature_key("AABB??CC", "DDEE", 4, 1));
+    CHECK(PatchCache::signature_key("AB", "C", 0, 0) != PatchCache::signature_key("A", "BC", 0, 0));
+}
+
+static void write_file(const std::filesystem::path &path, const std::vector<uint8_t> &data) {
+    std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+    stream.write((const char *) data.data(), (std::streamsize) data.size());
+}
+
+/*
+ * Identity of files on disk, with the PE fields read from the headers.
+ */
+static void test_identify() {
+    auto directory = std::filesystem::temp_directory_path() / ("patch_cache_test_" + std::to_string(getpid()));
+    std::filesystem::create_directories(directory);
+    auto path = directory / "test.dll";
+
+    // DOS stub pointing to the NT headers, followed by the file header and the optional header
+    std::vector<uint8_t> data(0x2000);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = (uint8_t) (i * 7);
+    }
+    auto put32 = [&data] (size_t offset, uint32_t value) {
+        memcpy(&data[offset], &value, sizeof(value));
+    };
+    data[0] = 'M';
+    data[1] = 'Z';
+    put32(0x3C, 0x80);
+    memcpy(&data[0x80], "PE\0\0", 4);
+    put32(0x80 + 8, 0x5F5E1000);
+    put32(0x80 + 88, 0x0001E240);
+    write_file(path, data);
+    auto file = PatchCache::identify(path);
+    if (CHECK(file.has_value())) {
+        CHECK(file->size == data.size());
+        CHECK(file->pe_time_stamp == 0x5F5E1000);
+        CHECK(file->pe_checksum == 0x0001E240);
+        CHECK(file->hash.size() == 64);
+        CHECK(*file == *PatchCache::identify(path));
+    }
+
+    // the first page is hashed, the rest only shows in the size
+    data[100]++;
+    write_file(path, data);
+    auto changed = PatchCache::identify(path);
+    CHECK(changed && changed->hash != file->hash);
+    data[100]--;
+    data[0x1800]++;
+    write_file(path, data);
+    changed = PatchCache::identify(path);
+    CHECK(changed && changed->hash == file->hash);
+    data.push_back(0);
+    write_file(path, data);
+    changed = PatchCache::identify(path);
+    CHECK(changed && changed->size == file->size + 1 && !(*changed == *file));
+
+    // headers which don't fit or aren't PE
+    put32(0x3C, 4096 - 88);
+    write_file(path, data);
+    changed = PatchCache::identify(path);
+    CHECK(changed && changed->pe_time_stamp == 0 && changed->pe_checksum == 0);
+    put32(0x3C, 0x80);
+    data[0x81] = 'X';
+    write_file(path, data);
+    changed = PatchCache::identify(path);
+    CHECK(changed && changed->pe_time_stamp == 0 && changed->pe_checksum == 0);
+    write_file(path, { 'M', 'Z' });
+    changed = PatchCache::identify(path);
+    CHECK(changed && changed->size == 2 && changed->pe_checksum == 0);
+
+    // missing files
+    CHECK(!PatchCache::identify(directory / "missing.dll").has_value());
+    std::filesystem::remove_all(directory);
+}
+
+/*
+ * Loading, looking up and saving the cache of a game with a large patch set.
+ */
+static void benchmark() {
+    PatchCache cache;
+    for (int dll = 0; dll < 4; dll++) {
+        auto name = "game" + std::to_string(dll) + ".dll";
+        cache.validate(name, FILE_A, false);
+        for (int i = 0; i < 500; i++) {
+            cache.store(name, PatchCache::signature_key(std::to_string(i), "", 0, 0), entry(i * 16));
+        }
+    }
+    auto json = cache.save();
+    printf("2000 entries, %zu bytes\n", json.size());
+    bench::report("load", bench::measure([&] {
+        PatchCache loaded;
+        loaded.load(json);
+        bench::keep(loaded);
+    }), json.size());
+    bench::report("load, look up all and save", bench::measure([&] {
+        PatchCache loaded;
+        loaded.load(json);
+        for (int dll = 0; dll < 4; dll++) {
+            auto name = "game" + std::to_string(dll) + ".dll";
+            loaded.validate(name, FILE_A, false);
+            for (int i = 0; i < 500; i++) {
+                auto found = loaded.find(name, PatchCache::signature_key(std::to_string(i), "", 0, 0));
+                bench::keep(found);
+            }
+        }
+        auto saved = loaded.save();
+        bench::keep(saved);
+    }), json.size());
+}
+
+int main(int argc, char **argv) {
+    test_round_trip();
+    test_invalidation();
+    test_pruning();
+    test_format();
+    test_signature_key();
+    test_identify();
+    if (bench::enabled(argc, argv)) {
+        benchmark();
+    }
+    return test::result();
+}
@@ -0,0 +1,273 @@
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "util/peimage.h"
+
+#include "test.h"
+
+using util::PEImage;
+
+/*
+ * Builds a small DLL with overlapping sections, exports including an alias, a forwarder and an unused ordinal,
+ * and imports by name and by ordinal.
+ */
+class TestFile {
+public:
+
+    std::vector<uint8_t> data = std::vector<uint8_t>(0x1400);
+    bool pe32_plus;
+
+    struct SectionInfo {
+        const char *name;
+        uint32_t virtual_address;
+        uint32_t virtual_size;
+        uint32_t raw_address;
+        uint32_t raw_size;
+    };
+    std::vector<SectionInfo> sections = {
+        { ".text", 0x1000, 0x900, 0x400, 0x800 },
+        { ".rdata", 0x2000, 0x800, 0xC00, 0x800 },
+        { ".bss", 0x3000, 0x1000, 0, 0 },
+        { ".ovl", 0x1800, 0x1000, 0x400, 0x400 },
+    };
+
+    explicit TestFile(bool pe32_plus) : pe32_plus(pe32_plus) {
+
+        // DOS and file header
+        put16(0, 0x5A4D);
+        put32(0x3C, 0x80);
+        put32(0x80, 0x00004550);
+        put16(0x84, pe32_plus ? 0x8664 : 0x14C);
+        put16(0x86, static_cast<uint16_t>(sections.size()));
+        put32(0x88, 0x5F5E1000);
+        put16(0x94, pe32_plus ? 240 : 224);
+
+        // optional header
+        size_t optional = 0x98;
+        size_t directories;
+        if (pe32_plus) {
+            put16(optional, 0x20B);
+            put64(optional + 24, 0x180000000);
+            directories = optional + 108;
+        } else {
+            put16(optional, 0x10B);
+            put32(optional + 28, 0x10000000);
+            directories = optional + 92;
+        }
+        put32(optional + 56, 0x4000);
+        put32(optional + 60, 0x400);
+        put32(directories, 16);
+        put32(directories + 4, 0x2000);
+        put32(directories + 8, 0x200);
+        put32(directories + 12, 0x2200);
+        put32(directories + 16, 0x100);
+
+        // section table
+        size_t table = optional + (pe32_plus ? 240 : 224);
+        for (auto &section : sections) {
+            memcpy(&data[table], section.name, strlen(section.name));
+            put32(table + 8, section.virtual_size);
+            put32(table + 12, section.virtual_address);
+            put32(table + 16, section.raw_size);
+            put32(table + 20, section.raw_address);
+            table += 40;
+        }
+
+        // export directory, ordinal 6 is unused and 8 is forwarded
+        put32(raw(0x2000) + 12, 0x2100);
+        put32(raw(0x2000) + 16, 5);
+        put32(raw(0x2000) + 20, 4);
+        put32(raw(0x2000) + 24, 4);
+        put32(raw(0x2000) + 28, 0x2040);
+        put32(raw(0x2000) + 32, 0x2060);
+        put32(raw(0x2000) + 36, 0x2080);
+        const uint32_t functions[] = { 0x1010, 0, 0x1030, 0x2180 };
+        for (size_t i = 0; i < 4; i++) {
+            put32(raw(0x2040) + i * 4, functions[i]);
+        }
+        const std::pair<const char *, uint16_t> names[] = {
+            { "alpha", 0 }, { "beta", 2 }, { "beta_alias", 2 }, { "forwarded", 3 },
+        };
+        for (size_t i = 0; i < 4; i++) {
+            auto name_rva = static_cast<uint32_t>(0x2120 + i * 0x10);
+            put32(raw(0x2060) + i * 4, name_rva);
+            put16(raw(0x2080) + i * 2, names[i].second);
+            put_string(raw(name_rva), names[i].first);
+        }
+        put_string(raw(0x2100), "test.dll");
+        put_string(raw(0x2180), "NTDLL.RtlAllocateHeap");
+
+        // import descriptor with a lookup table, followed by an empty one
+        put32(raw(0x2200), 0x2240);
+        put32(raw(0x2200) + 12, 0x2300);
+        put32(raw(0x2200) + 16, 0x2260);
+        put_string(raw(0x2300), "KERNEL32.dll");
+        put_string(raw(0x2320) + 2, "Sleep");
+        for (uint32_t table_rva : { 0x2240, 0x2260 }) {
+            if (pe32_plus) {
+                put64(raw(table_rva), 0x2320);
+                put64(raw(table_rva) + 8, (1ull << 63) | 7);
+            } else {
+                put32(raw(table_rva), 0x2320);
+                put32(raw(table_rva) + 4, (1u << 31) | 7);
+            }
+        }
+    }
+
+    size_t thunk_size() const {
+        return pe32_plus ? 8 : 4;
+    }
+
+    // conversions by looking through the sections in header order
+    intptr_t reference_rva2offset(intptr_t rva) const {
+        for (auto &section : sections) {
+            if (rva >= section.virtual_address && rva < section.virtual_address + section.virtual_size) {
+                return rva - section.virtual_address + section.raw_address;
+            }
+        }
+        return -1;
+    }
+
+    intptr_t reference_offset2rva(intptr_t offset) const {
+        for (auto &section : sections) {
+            if (offset >= section.raw_address && offset < section.raw_address + section.raw_size) {
+                return offset - section.raw_address + section.virtual_address;
+            }
+        }
+        return -1;
+    }
+
+private:
+
+    size_t raw(uint32_t rva) const {
+        return rva - 0x2000 + 0xC00;
+    }
+
+    void put16(size_t offset, uint16_t value) {
+        memcpy(&data[offset], &value, sizeof(value));
+    }
+
+    void put32(size_t offset, uint32_t value) {
+        memcpy(&data[offset], &value, sizeof(value));
+    }
+
+    void put64(size_t offset, uint64_t value) {
+        memcpy(&data[offset], &value, sizeof(value));
+    }
+
+    void put_string(size_t offset, const char *value) {
+        memcpy(&data[offset], value, strlen(value) + 1);
+    }
+};
+
+static void test_headers(const TestFile &file, const PEImage &image) {
+    CHECK(image.is_64bit() == file.pe32_plus);
+    CHECK(image.get_image_base() == (file.pe32_plus ? 0x180000000 : 0x10000000));
+    CHECK(image.get_image_size() == 0x4000);
+    CHECK(image.get_timestamp() == 0x5F5E1000);
+
+    auto &sections = image.get_sections();
+    CHECK(sections.size() == file.sections.size());
+    for (size_t i = 0; i < sections.size() && i < file.sections.size(); i++) {
+        CHECK(sections[i].name == file.sections[i].name);
+        CHECK(sections[i].virtual_address == file.sections[i].virtual_address);
+        CHECK(sections[i].raw_size == file.sections[i].raw_size);
+    }
+}
+
+static void test_conversions(const TestFile &file, const PEImage &image) {
+
+    // every address around the sections, overlaps go to the first section like a linear search
+    for (intptr_t address = 0; address < 0x4100; address++) {
+        CHECK(image.rva2offset(address) == file.reference_rva2offset(address));
+        CHECK(image.offset2rva(address) == file.reference_offset2rva(address));
+    }
+    auto section = image.find_section(0x1880);
+    CHECK(section && section->name == ".text");
+    section = image.find_section(0x1A00);
+    CHECK(section && section->name == ".ovl");
+    CHECK(image.find_section(0x5000) == nullptr);
+}
+
+static void test_exports(const PEImage &image) {
+
+    // sorted by ordinal, the unused ordinal is left out
+    auto &exports = image.get_exports();
+    CHECK(exports.size() == 4);
+    if (exports.size() == 4) {
+        CHECK(exports[0].name == "alpha" && exports[0].ordinal == 5 && exports[0].rva == 0x1010);
+        CHECK(exports[1].name == "beta" && exports[1].ordinal == 7 && exports[1].rva == 0x1030);
+        CHECK(exports[2].name == "beta_alias" && exports[2].ordinal == 7 && exports[2].rva == 0x1030);
+        CHECK(exports[3].name == "forwarded" && exports[3].forwarder == "NTDLL.RtlAllocateHeap");
+    }
+
+    // lookups
+    auto entry = image.find_export("beta_alias");
+    CHECK(entry && entry->ordinal == 7);
+    CHECK(image.find_export("gamma") == nullptr);
+    CHECK(image.find_export("") == nullptr);
+    entry = image.find_export_ordinal(8);
+    CHECK(entry && entry->name == "forwarded");
+    CHECK(image.find_export_ordinal(6) == nullptr);
+    CHECK(image.find_export_ordinal(9) == nullptr);
+}
+
+static void test_imports(const TestFile &file, const PEImage &image) {
+    auto &imports = image.get_imports();
+    CHECK(imports.size() == 2);
+    if (imports.size() == 2) {
+        CHECK(imports[0].dll_name == "KERNEL32.dll" && imports[0].name == "Sleep");
+        CHECK(imports[0].thunk_rva == 0x2260);
+        CHECK(imports[1].name.empty() && imports[1].ordinal == 7);
+        CHECK(imports[1].thunk_rva == 0x2260 + file.thunk_size());
+    }
+}
+
+static void test_malformed(const TestFile &file) {
+
+    // truncated headers
+    for (size_t size = 0; size < 0x98; size++) {
+        CHECK(!PEImage::parse(file.data.data(), size));
+    }
+
+    // wrong magic
+    auto data = file.data;
+    data[0] = 'X';
+    CHECK(!PEImage::parse(data.data(), data.size()));
+
+    // broken export table still gives the sections
+    data = file.data;
+    uint32_t functions_rva = 0x7FFFFFF0;
+    memcpy(&data[0xC00 + 28], &functions_rva, sizeof(functions_rva));
+    auto image = PEImage::parse(data.data(), data.size());
+    CHECK(image && image->get_exports().empty() && image->get_sections().size() == 4);
+
+    // random corruption must not read out of bounds
+    std::mt19937 rng(42);
+    for (int iteration = 0; iteration < 2000; iteration++) {
+        data = file.data;
+        for (int i = 0; i < 8; i++) {
+            data[rng() % data.size()] = static_cast<uint8_t>(rng());
+        }
+        auto size = (iteration & 1) ? data.size() : rng() % data.size();
+        PEImage::parse(data.data(), size);
+    }
+}
+
+int main() {
+    for (bool pe32_plus : { false, true }) {
+        TestFile file(pe32_plus);
+        auto image = PEImage::parse(file.data.data(), file.data.size());
+        if (!CHECK(image)) {
+            continue;
+        }
+        test_headers(file, *image);
+        test_conversions(file, *image);
+        test_exports(*image);
+        test_imports(file, *image);
+        test_malformed(file);
+    }
+    return test::result();
+}
@@ -0,0 +1,244 @@
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "util/cpufeatures.h"
+#include "util/pixelutils.h"
+#include "util/pixelutils_kernels.h"
+
+#include "bench.h"
+#include "test.h"
+
+using pixelutils::Format;
+
+static std::mt19937 RNG(9);
+
+static const Format FORMATS[] {
+    Format::RGB24, Format::R8G8B8, Format::X8R8G8B8, Format::X8B8G8R8,
+    Format::R5G6B5, Format::X1R5G5B5, Format::A2R10G10B10, Format::A2B10G10R10,
+};
+
+struct KernelSet {
+    const char *name;
+    size_t (*convert_row)(Format, const uint8_t *, uint8_t *, size_t);
+    size_t (*accumulate_row)(const uint8_t *, uint32_t *, size_t);
+};
+
+static std::vector<KernelSet> supported_kernels() {
+    std::vector<KernelSet> sets { { "scalar", pixelutils::scalar::convert_row, pixelutils::scalar::accumulate_row } };
+    if (cpufeatures::has_sse2()) {
+        sets.push_back({ "SSE2", pixelutils::sse2::convert_row, pixelutils::sse2::accumulate_row });
+    }
+    if (cpufeatures::has_avx2()) {
+        sets.push_back({ "AVX2", pixelutils::avx2::convert_row, pixelutils::avx2::accumulate_row });
+    } else {
+        printf("AVX2 not supported, its kernels were not tested\n");
+    }
+    return sets;
+}
+
+/*
+ * Golden reference, written from the format definitions one pixel at a time.
+ */
+static uint8_t expand(uint32_t value, int bits) {
+    return (uint8_t) ((value << (8 - bits)) | (value >> (2 * bits - 8)));
+}
+
+static void reference_pixel(Format format, const uint8_t *src, uint8_t *rgb) {
+    uint32_t v = 0;
+    memcpy(&v, src, pixelutils::format_size(format));
+    switch (format) {
+        case Format::RGB24:
+            rgb[0] = src[0], rgb[1] = src[1], rgb[2] = src[2];
+            break;
+        case Format::R8G8B8:
+            rgb[0] = src[2], rgb[1] = src[1], rgb[2] = src[0];
+            break;
+        case Format::X8R8G8B8:
+            rgb[0] = (uint8_t) (v >> 16), rgb[1] = (uint8_t) (v >> 8), rgb[2] = (uint8_t) v;
+            break;
+        case Format::X8B8G8R8:
+            rgb[0] = (uint8_t) v, rgb[1] = (uint8_t) (v >> 8), rgb[2] = (uint8_t) (v >> 16);
+            break;
+        case Format::R5G6B5:
+            rgb[0] = expand((v >> 11) & 31, 5), rgb[1] = expand((v >> 5) & 63, 6), rgb[2] = expand(v & 31, 5);
+            break;
+        case Format::X1R5G5B5:
+            rgb[0] = expand((v >> 10) & 31, 5), rgb[1] = expand((v >> 5) & 31, 5), rgb[2] = expand(v & 31, 5);
+            break;
+        case Format::A2R10G10B10:
+            rgb[0] = (uint8_t) (v >> 22), rgb[1] = (uint8_t) (v >> 12), rgb[2] = (uint8_t) (v >> 2);
+            break;
+        case Format::A2B10G10R10:
+            rgb[0] = (uint8_t) (v >> 2), rgb[1] = (uint8_t) (v >> 12), rgb[2] = (uint8_t) (v >> 22);
+            break;
+        default:
+            break;
+    }
+}
+
+static std::vector<uint8_t> reference_convert(const pixelutils::Image &image, size_t width, size_t height) {
+    auto pixel_size = pixelutils::format_size(image.format);
+    std::vector<uint8_t> rgb(image.width * image.height * 3);
+    for (size_t y = 0; y < image.height; y++) {
+        for (size_t x = 0; x < image.width; x++) {
+            reference_pixel(image.format, image.data + y * image.pitch + x * pixel_size, &rgb[(y * image.width + x) * 3]);
+        }
+    }
+
+    // box filter over the source pixels each target pixel covers, at least one when upscaling
+    std::vector<uint8_t> result(width * height * 3);
+    for (size_t y = 0; y < height; y++) {
+        size_t y0 = y * image.height / height;
+        size_t y1 = std::max((y + 1) * image.height / height, y0 + 1);
+        for (size_t x = 0; x < width; x++) {
+            size_t x0 = x * image.width / width;
+            size_t x1 = std::max((x + 1) * image.width / width, x0 + 1);
+            for (size_t c = 0; c < 3; c++) {
+                uint32_t sum = 0;
+                for (size_t sy = y0; sy < y1; sy++) {
+                    for (size_t sx = x0; sx < x1; sx++) {
+                        sum += rgb[(sy * image.width + sx) * 3 + c];
+                    }
+                }
+                auto count = (uint32_t) ((y1 - y0) * (x1 - x0));
+                result[(y * width + x) * 3 + c] = (uint8_t) ((sum + count / 2) / count);
+            }
+        }
+    }
+    return result;
+}
+
+static std::vector<uint8_t> random_bytes(size_t size) {
+    std::vector<uint8_t> data(size);
+    for (auto &value : data) {
+        value = (uint8_t) RNG();
+    }
+    return data;
+}
+
+/*
+ * Every kernel set converts rows like the reference, up to the exact end of the source and
+ * without writing past the row.
+ */
+static void test_kernels() {
+    for (auto &kernels : supported_kernels()) {
+        for (auto format : FORMATS) {
+            auto pixel_size = pixelutils::format_size(format);
+            for (size_t width = 1; width < 80; width++) {
+
+                // the source ends right after the row so over-reads show up in sanitized builds
+                auto src = random_bytes(width * pixel_size);
+                std::vector<uint8_t> dst(width * 3 + 16, 0xCD);
+                auto x = kernels.convert_row(format, src.data(), dst.data(), width);
+                CHECK(x <= width);
+                pixelutils::scalar::convert_row(format, src.data() + x * pixel_size, dst.data() + x * 3, width - x);
+
+                std::vector<uint8_t> expected(width * 3 + 16, 0xCD);
+                for (size_t i = 0; i < width; i++) {
+                    reference_pixel(format, &src[i * pixel_size], &expected[i * 3]);
+                }
+                if (!CHECK(dst == expected)) {
+                    fprintf(stderr, "  %s, format %d, width %zu\n", kernels.name, (int) format, width);
+                }
+            }
+        }
+
+        // accumulation
+        for (size_t count = 0; count < 100; count++) {
+            auto src = random_bytes(count);
+            std::vector<uint32_t> sums(count + 8), expected(count + 8);
+            for (size_t i = 0; i < sums.size(); i++) {
+                sums[i] = expected[i] = RNG() % 100000;
+            }
+            auto i = kernels.accumulate_row(src.data(), sums.data(), count);
+            CHECK(i <= count);
+            pixelutils::scalar::accumulate_row(src.data() + i, sums.data() + i, count - i);
+            for (size_t j = 0; j < count; j++) {
+                expected[j] += src[j];
+            }
+            CHECK(sums == expected);
+        }
+    }
+}
+
+/*
+ * Whole images through the dispatched path, cropped and scaled to sizes around the common cases.
+ */
+static void test_convert() {
+    printf("dispatched instruction set: %s\n", pixelutils::get_instruction_set());
+    for (auto format : FORMATS) {
+        auto pixel_size = pixelutils::format_size(format);
+        size_t width = 67, height = 45, padding = 5;
+        auto data = random_bytes((width * pixel_size + padding) * height);
+        pixelutils::Image image { data.data(), width, height, width * pixel_size + padding, format };
+
+        std::pair<size_t, size_t> sizes[] { { 67, 45 }, { 33, 22 }, { 34, 23 }, { 16, 9 }, { 1, 1 }, { 100, 50 }, { 67, 1 } };
+        for (auto [target_width, target_height] : sizes) {
+            std::vector<uint8_t> dst(target_width * target_height * 3);
+            CHECK(pixelutils::convert_rgb(image, dst.data(), target_width, target_height));
+            if (!CHECK(dst == reference_convert(image, target_width, target_height))) {
+                fprintf(stderr, "  format %d, %zux%zu\n", (int) format, target_width, target_height);
+            }
+        }
+
+        // a crop of an even width exercises the halving loop
+        auto region = pixelutils::crop(image, 3, 7, 40, 30);
+        CHECK(region.width == 40 && region.height == 30);
+        std::vector<uint8_t> half(20 * 15 * 3);
+        CHECK(pixelutils::convert_rgb(region, half.data(), 20, 15));
+        CHECK(half == reference_convert(region, 20, 15));
+
+        // crops are clamped to the image
+        CHECK(pixelutils::crop(image, 60, 40, 100, 100).width == 7);
+        CHECK(pixelutils::crop(image, 67, 0, 1, 1).data == nullptr);
+    }
+
+    // invalid input
+    uint8_t pixel[4] {};
+    std::vector<uint8_t> dst(16);
+    CHECK(!pixelutils::convert_rgb(pixelutils::Image { pixel, 1, 1, 1, Format::X8R8G8B8 }, dst.data()));
+    CHECK(!pixelutils::convert_rgb(pixelutils::Image { pixel, 1, 1, 4, Format::Unknown }, dst.data()));
+    CHECK(!pixelutils::convert_rgb(pixelutils::Image { pixel, 1, 1, 4, Format::X8R8G8B8 }, dst.data(), 0, 1));
+}
+
+static void benchmark() {
+    const size_t width = 1920, height = 1080;
+    auto data = random_bytes(width * height * 4);
+    std::vector<uint8_t> dst(width * height * 3);
+    for (auto format : { Format::X8R8G8B8, Format::R5G6B5 }) {
+        auto pixel_size = pixelutils::format_size(format);
+        printf("1920x1080, %zu bytes per pixel\n", pixel_size);
+        for (auto &kernels : supported_kernels()) {
+            auto name = std::string("  convert ") + kernels.name;
+            bench::report(name.c_str(), bench::measure([&] {
+                for (size_t y = 0; y < height; y++) {
+                    auto src = data.data() + y * width * pixel_size;
+                    auto row = dst.data() + y * width * 3;
+                    auto x = kernels.convert_row(format, src, row, width);
+                    pixelutils::scalar::convert_row(format, src + x * pixel_size, row + x * 3, width - x);
+                }
+                bench::keep(dst);
+            }), width * height * pixel_size);
+        }
+        pixelutils::Image image { data.data(), width, height, width * pixel_size, format };
+        bench::report("  scale to 960x540, dispatched", bench::measure([&] {
+            pixelutils::convert_rgb(image, dst.data(), 960, 540);
+            bench::keep(dst);
+        }), width * height * pixel_size);
+        bench::report("  scale to 1280x720, dispatched", bench::measure([&] {
+            pixelutils::convert_rgb(image, dst.data(), 1280, 720);
+            bench::keep(dst);
+        }), width * height * pixel_size);
+    }
+}
+
+int main(int argc, char **argv) {
+    test_kernels();
+    test_convert();
+    if (bench::enabled(argc, argv)) {
+        benchmark();
+    }
+    return test::result();
+}
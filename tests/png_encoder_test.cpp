@@ -0,0 +1,233 @@
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <png.h>
+#include <zlib.h>
+
+#include "util/png_encoder.h"
+
+#include "bench.h"
+#include "test.h"
+
+/*
+ * Encodes images and decodes them again with libpng, which has to give back the exact pixels.
+ */
+
+static bool decode(const std::vector<uint8_t> &png, size_t width, size_t height, std::vector<uint8_t> &rgb) {
+    png_image image {};
+    image.version = PNG_IMAGE_VERSION;
+    if (!png_image_begin_read_from_memory(&image, png.data(), png.size())) {
+        fprintf(stderr, "  libpng: %s\n", image.message);
+        return false;
+    }
+    if (image.width != width || image.height != height) {
+        png_image_free(&image);
+        return false;
+    }
+    image.format = PNG_FORMAT_RGB;
+    rgb.resize(PNG_IMAGE_SIZE(image));
+    if (!png_image_finish_read(&image, nullptr, rgb.data(), 0, nullptr)) {
+        fprintf(stderr, "  libpng: %s\n", image.message);
+        return false;
+    }
+    return true;
+}
+
+struct Chunk {
+    std::string type;
+    std::vector<uint8_t> data;
+};
+
+// splits the file into its chunks, checking signature, lengths and CRCs on the way
+static bool read_chunks(const std::vector<uint8_t> &png, std::vector<Chunk> &chunks) {
+    static const uint8_t SIGNATURE[] { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    if (png.size() < 8 || memcmp(png.data(), SIGNATURE, 8) != 0) {
+        return false;
+    }
+    auto read_u32 = [] (const uint8_t *p) {
+        return (uint32_t) p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+    };
+    for (size_t pos = 8; pos < png.size();) {
+        if (png.size() - pos < 12) {
+            return false;
+        }
+        auto length = read_u32(&png[pos]);
+        if (png.size() - pos - 12 < length) {
+            return false;
+        }
+        auto crc = crc32(0, &png[pos + 4], length + 4);
+        if (crc != read_u32(&png[pos + 8 + length])) {
+            return false;
+        }
+        chunks.push_back({ std::string((const char *) &png[pos + 4], 4),
+                std::vector<uint8_t>(&png[pos + 8], &png[pos + 8 + length]) });
+        pos += 12 + length;
+    }
+    return !chunks.empty() && chunks.back().type == "IEND";
+}
+
+enum class Content { Noise, Flat, Gradient, Screen };
+
+static std::vector<uint8_t> make_image(size_t width, size_t height, Content content, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> rgb(width * height * 3);
+    for (size_t y = 0; y < height; y++) {
+        for (size_t x = 0; x < width; x++) {
+            auto pixel = &rgb[(y * width + x) * 3];
+            switch (content) {
+                case Content::Noise:
+                    pixel[0] = (uint8_t) rng(), pixel[1] = (uint8_t) rng(), pixel[2] = (uint8_t) rng();
+                    break;
+                case Content::Flat:
+                    pixel[0] = 12, pixel[1] = 34, pixel[2] = 56;
+                    break;
+                case Content::Gradient:
+                    pixel[0] = (uint8_t) x, pixel[1] = (uint8_t) y, pixel[2] = (uint8_t) (x + y);
+                    break;
+                case Content::Screen: {
+                    bool block = ((x / 24) + (y / 16)) % 5 == 0;
+                    pixel[0] = block ? 255 : (uint8_t) (x * 255 / width);
+                    pixel[1] = block ? 255 : (uint8_t) (y * 255 / height);
+                    pixel[2] = block ? 255 : (uint8_t) (rng() % 4);
+                    break;
+                }
+            }
+        }
+    }
+    return rgb;
+}
+
+/*
+ * Odd sizes, single and multi strip images, incompressible and highly compressible content.
+ */
+static void test_decode() {
+    std::pair<size_t, size_t> sizes[] {
+        { 1, 1 }, { 3, 1 }, { 1, 3 }, { 7, 5 }, { 31, 31 }, { 33, 63 }, { 100, 64 }, { 641, 479 }, { 1920, 1080 },
+    };
+    util::PNGEncoder encoder;
+    unsigned seed = 0;
+    for (auto [width, height] : sizes) {
+        for (auto content : { Content::Noise, Content::Flat, Content::Gradient, Content::Screen }) {
+            auto rgb = make_image(width, height, content, seed++);
+            std::vector<uint8_t> png;
+            if (!CHECK(encoder.encode(png, rgb.data(), width, height))) {
+                continue;
+            }
+
+            // exact pixels
+            std::vector<uint8_t> decoded;
+            if (!CHECK(decode(png, width, height, decoded)) || !CHECK(decoded == rgb)) {
+                fprintf(stderr, "  %zux%zu, content %d\n", width, height, (int) content);
+                continue;
+            }
+
+            // images below two strips get a single IDAT, larger ones one per strip
+            std::vector<Chunk> chunks;
+            if (!CHECK(read_chunks(png, chunks))) {
+                continue;
+            }
+            CHECK(chunks.front().type == "IHDR");
+            std::vector<uint8_t> stream;
+            size_t idat_count = 0;
+            for (auto &chunk : chunks) {
+                if (chunk.type == "IDAT") {
+                    idat_count++;
+                    stream.insert(stream.end(), chunk.data.begin(), chunk.data.end());
+                }
+            }
+            if (height < 64) {
+                CHECK(idat_count == 1);
+            } else {
+                CHECK(idat_count > 1);
+            }
+
+            // the IDATs form one valid zlib stream, checksum included
+            std::vector<uint8_t> filtered(height * (width * 3 + 1) + 1);
+            auto filtered_size = (uLongf) filtered.size();
+            CHECK(uncompress(filtered.data(), &filtered_size, stream.data(), (uLong) stream.size()) == Z_OK);
+            CHECK(filtered_size == height * (width * 3 + 1));
+
+            // noise can't compress, but flat images have to, apart from the fixed size of the chunks
+            if (content == Content::Flat && width * height > 1000) {
+                if (!CHECK(png.size() < rgb.size() / 50 + 100)) {
+                    fprintf(stderr, "  flat %zux%zu: %zu bytes\n", width, height, png.size());
+                }
+            }
+            if (content == Content::Noise) {
+                CHECK(png.size() < rgb.size() + rgb.size() / 50 + 200);
+            }
+        }
+    }
+}
+
+/*
+ * The streaming writer receives the same bytes, and aborting from it stops the encoding.
+ */
+static void test_writer() {
+    util::PNGEncoder encoder;
+    auto rgb = make_image(300, 300, Content::Screen, 1);
+    std::vector<uint8_t> expected, streamed;
+    CHECK(encoder.encode(expected, rgb.data(), 300, 300));
+    size_t calls = 0;
+    CHECK(encoder.encode([&streamed, &calls] (const uint8_t *data, size_t size) {
+        streamed.insert(streamed.end(), data, data + size);
+        calls++;
+        return true;
+    }, rgb.data(), 300, 300));
+    CHECK(streamed == expected);
+    CHECK(calls > 3);
+
+    size_t aborted_calls = 0;
+    CHECK(!encoder.encode([&aborted_calls] (const uint8_t *, size_t) {
+        return ++aborted_calls < 3;
+    }, rgb.data(), 300, 300));
+    CHECK(aborted_calls == 3);
+
+    // still usable afterwards
+    std::vector<uint8_t> again;
+    CHECK(encoder.encode(again, rgb.data(), 300, 300));
+    CHECK(again == expected);
+
+    // invalid input
+    CHECK(!encoder.encode(again, nullptr, 1, 1));
+    CHECK(!encoder.encode(again, rgb.data(), 0, 1));
+}
+
+static void benchmark() {
+    const size_t width = 1920, height = 1080;
+    auto rgb = make_image(width, height, Content::Screen, 7);
+    util::PNGEncoder encoder;
+    std::vector<uint8_t> png;
+    encoder.encode(png, rgb.data(), width, height);
+
+    png_image image {};
+    image.version = PNG_IMAGE_VERSION;
+    image.width = (png_uint_32) width;
+    image.height = (png_uint_32) height;
+    image.format = PNG_FORMAT_RGB;
+    std::vector<uint8_t> reference(rgb.size() * 2);
+    png_alloc_size_t reference_size = reference.size();
+    png_image_write_to_memory(&image, reference.data(), &reference_size, 0, rgb.data(), 0, nullptr);
+    printf("1920x1080: %zu bytes, libpng %zu bytes\n", png.size(), (size_t) reference_size);
+
+    bench::report("encode", bench::measure([&] {
+        encoder.encode(png, rgb.data(), width, height);
+        bench::keep(png);
+    }), rgb.size());
+    bench::report("libpng encode", bench::measure([&] {
+        reference_size = reference.size();
+        png_image_write_to_memory(&image, reference.data(), &reference_size, 0, rgb.data(), 0, nullptr);
+        bench::keep(reference);
+    }), rgb.size());
+}
+
+int main(int argc, char **argv) {
+    test_decode();
+    test_writer();
+    if (bench::enabled(argc, argv)) {
+        benchmark();
+    }
+    return test::result();
+}
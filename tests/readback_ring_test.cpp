@@ -0,0 +1,304 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "hooks/graphics/readback_ring.h"
+
+#include "test.h"
+
+/*
+ * Stands in for the GPU, copies finish once the fake frame counter passed their latency.
+ */
+static uint64_t GPU_FRAME = 0;
+static int SURFACES_ALIVE = 0;
+
+class FakeSurface;
+static std::vector<FakeSurface *> SURFACES_CREATED;
+
+class FakeSurface : public ReadbackSurface {
+public:
+    ReadbackFormat format;
+    uint64_t latency;
+    uint64_t ready_frame = 0;
+    int source = -1;
+    bool fail_copy = false;
+
+    FakeSurface(const ReadbackFormat &format, uint64_t latency) : format(format), latency(latency) {
+        SURFACES_ALIVE++;
+    }
+
+    ~FakeSurface() override {
+        SURFACES_ALIVE--;
+    }
+
+    bool copy(void *source) override {
+        if (fail_copy) {
+            return false;
+        }
+        this->source = *reinterpret_cast<int *>(source);
+        this->ready_frame = GPU_FRAME + latency;
+        return true;
+    }
+
+    bool poll() override {
+        return GPU_FRAME >= ready_frame;
+    }
+};
+
+static ReadbackRing<int>::Factory fake_factory(uint64_t latency) {
+    SURFACES_CREATED.clear();
+    return [latency] (const ReadbackFormat &format) {
+        auto surface = new FakeSurface(format, latency);
+        SURFACES_CREATED.push_back(surface);
+        return surface;
+    };
+}
+
+static const ReadbackFormat FORMAT_A { 640, 480, 21 };
+static const ReadbackFormat FORMAT_B { 320, 240, 23 };
+
+/*
+ * One submit and poll per present, like the D3D9 backend does.
+ */
+static void test_pipeline() {
+    ReadbackRing<int> ring(3, fake_factory(2));
+    std::vector<int> delivered;
+    for (int frame = 0; frame < 100; frame++) {
+        GPU_FRAME = frame;
+        ring.poll([&ring, &delivered] (ReadbackSurface *surface, const ReadbackFormat &format, int &request) {
+            auto fake = static_cast<FakeSurface *>(surface);
+            CHECK(format == FORMAT_A);
+            CHECK(fake->source == request);
+            delivered.push_back(request);
+            ring.release(surface);
+        });
+        CHECK(ring.submit(&frame, FORMAT_A, frame));
+    }
+    GPU_FRAME = 1000;
+    ring.poll([&ring, &delivered] (ReadbackSurface *surface, const ReadbackFormat &, int &request) {
+        delivered.push_back(request);
+        ring.release(surface);
+    });
+
+    // everything arrives in order, the surfaces only get created once per slot in use
+    CHECK(delivered.size() == 100);
+    for (size_t i = 0; i < delivered.size(); i++) {
+        CHECK(delivered[i] == (int) i);
+    }
+    auto stats = ring.get_stats();
+    CHECK(stats.cache_misses == 2);
+    CHECK(stats.cache_hits == 98);
+    CHECK(stats.stalls == 0);
+    CHECK(stats.completed == 100);
+    CHECK(SURFACES_ALIVE == 2);
+}
+
+/*
+ * A full ring refuses submits, copies are handed out oldest first even if newer ones finished earlier.
+ */
+static void test_stall_and_order() {
+    ReadbackRing<int> ring(2, fake_factory(0));
+    GPU_FRAME = 0;
+    int source = 0;
+    CHECK(ring.submit(&source, FORMAT_A, 1));
+    CHECK(ring.submit(&source, FORMAT_A, 2));
+    CHECK(!ring.submit(&source, FORMAT_A, 3));
+    CHECK(ring.get_stats().stalls == 1);
+
+    // hold back the oldest copy
+    std::vector<ReadbackSurface *> surfaces;
+    std::vector<int> delivered;
+    auto collect = [&surfaces, &delivered] (ReadbackSurface *surface, const ReadbackFormat &, int &request) {
+        surfaces.push_back(surface);
+        delivered.push_back(request);
+    };
+    CHECK(SURFACES_CREATED.size() == 2);
+    SURFACES_CREATED[0]->ready_frame = 10;
+    GPU_FRAME = 5;
+    ring.poll(collect);
+    CHECK(delivered.empty());
+
+    // not processing the old ones yet keeps the ring full
+    GPU_FRAME = 10;
+    ring.poll(collect);
+    CHECK(delivered == std::vector<int>({ 1, 2 }));
+    CHECK(!ring.submit(&source, FORMAT_A, 3));
+
+    // releasing makes room again, only once per processed surface
+    if (!CHECK(surfaces.size() == 2)) {
+        return;
+    }
+    ring.release(surfaces[0]);
+    ring.release(surfaces[0]);
+    CHECK(ring.submit(&source, FORMAT_A, 3));
+    CHECK(!ring.submit(&source, FORMAT_A, 4));
+    ring.release(surfaces[1]);
+    CHECK(ring.submit(&source, FORMAT_A, 4));
+}
+
+/*
+ * Slots with surfaces of the requested format are preferred, others get recreated.
+ */
+static void test_formats() {
+    ReadbackRing<int> ring(2, fake_factory(0));
+    GPU_FRAME = 0;
+    int source = 0;
+    auto drain = [&ring] {
+        ring.poll([&ring] (ReadbackSurface *surface, const ReadbackFormat &, int &) {
+            ring.release(surface);
+        });
+    };
+
+    CHECK(ring.submit(&source, FORMAT_A, 0));
+    drain();
+    CHECK(ring.submit(&source, FORMAT_B, 0));
+    drain();
+    CHECK(ring.get_stats().cache_misses == 2);
+    CHECK(SURFACES_ALIVE == 2);
+
+    // both formats stay cached
+    for (int i = 0; i < 10; i++) {
+        CHECK(ring.submit(&source, i % 2 ? FORMAT_A : FORMAT_B, 0));
+        drain();
+    }
+    CHECK(ring.get_stats().cache_misses == 2);
+    CHECK(ring.get_stats().cache_hits == 10);
+
+    // a third format replaces one of them
+    ReadbackFormat format_c { 1, 1, 21 };
+    CHECK(ring.submit(&source, format_c, 0));
+    drain();
+    CHECK(ring.get_stats().cache_misses == 3);
+    CHECK(SURFACES_ALIVE == 2);
+}
+
+/*
+ * Failing surface creation or copies don't count as stalls and leave the slot usable.
+ */
+static void test_failures() {
+    bool fail_create = true;
+    bool fail_copy = false;
+    ReadbackRing<int> ring(1, [&fail_create, &fail_copy] (const ReadbackFormat &format) -> ReadbackSurface * {
+        if (fail_create) {
+            return nullptr;
+        }
+        auto surface = new FakeSurface(format, 0);
+        surface->fail_copy = fail_copy;
+        return surface;
+    });
+    GPU_FRAME = 0;
+    int source = 0;
+    CHECK(!ring.submit(&source, FORMAT_A, 0));
+    fail_create = false;
+    fail_copy = true;
+    CHECK(!ring.submit(&source, FORMAT_B, 0));
+    CHECK(ring.get_stats().stalls == 0);
+
+    // nothing to hand out
+    bool called = false;
+    ring.poll([&called] (ReadbackSurface *, const ReadbackFormat &, int &) {
+        called = true;
+    });
+    CHECK(!called);
+
+    // the next format gets a working surface
+    fail_copy = false;
+    CHECK(ring.submit(&source, FORMAT_A, 7));
+    ring.poll([&ring] (ReadbackSurface *surface, const ReadbackFormat &, int &request) {
+        CHECK(request == 7);
+        ring.release(surface);
+    });
+    CHECK(ring.get_stats().completed == 1);
+}
+
+/*
+ * Clearing waits for surfaces being processed on other threads and reports copies in flight.
+ */
+static void test_clear() {
+    ReadbackRing<int> ring(3, fake_factory(1));
+    GPU_FRAME = 0;
+    int source = 0;
+    CHECK(ring.submit(&source, FORMAT_A, 1));
+    GPU_FRAME = 1;
+    CHECK(ring.submit(&source, FORMAT_A, 2));
+    CHECK(ring.submit(&source, FORMAT_A, 3));
+
+    // the first one is processed in the background
+    std::atomic<bool> released = false;
+    std::thread worker;
+    ring.poll([&] (ReadbackSurface *surface, const ReadbackFormat &, int &request) {
+        CHECK(request == 1);
+        worker = std::thread([&ring, &released, surface] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            released = true;
+            ring.release(surface);
+        });
+    });
+
+    std::vector<int> dropped;
+    ring.clear([&dropped] (int &request) {
+        dropped.push_back(request);
+    });
+    CHECK(released);
+    CHECK(dropped == std::vector<int>({ 2, 3 }));
+    CHECK(SURFACES_ALIVE == 0);
+    worker.join();
+
+    // usable again afterwards
+    CHECK(ring.submit(&source, FORMAT_A, 4));
+    CHECK(ring.get_stats().cache_misses == 4);
+}
+
+/*
+ * Frames produced and processed concurrently, with slots released from a pool of threads.
+ */
+static void test_threads() {
+    ReadbackRing<int> ring(3, fake_factory(1));
+    std::vector<std::thread> workers;
+    std::atomic<int> processed = 0;
+    int submitted = 0;
+    int source = 0;
+    for (int frame = 0; frame < 2000; frame++) {
+        GPU_FRAME = frame;
+        ring.poll([&] (ReadbackSurface *surface, const ReadbackFormat &, int &) {
+            workers.emplace_back([&ring, &processed, surface] {
+                processed++;
+                ring.release(surface);
+            });
+        });
+        if (ring.submit(&source, FORMAT_A, frame)) {
+            submitted++;
+        }
+        if (workers.size() > 16) {
+            for (auto &worker : workers) {
+                worker.join();
+            }
+            workers.clear();
+        }
+    }
+    GPU_FRAME = 5000;
+    ring.poll([&ring, &processed] (ReadbackSurface *surface, const ReadbackFormat &, int &) {
+        processed++;
+        ring.release(surface);
+    });
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    auto stats = ring.get_stats();
+    CHECK(processed == submitted);
+    CHECK(stats.completed == (uint64_t) submitted);
+    CHECK(stats.stalls + submitted == 2000);
+}
+
+int main() {
+    test_pipeline();
+    CHECK(SURFACES_ALIVE == 0);
+    test_stall_and_order();
+    test_formats();
+    test_failures();
+    test_clear();
+    test_threads();
+    CHECK(SURFACES_ALIVE == 0);
+    return test::result();
+}
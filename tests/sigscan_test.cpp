@@ -0,0 +1,371 @@
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "util/sigscan.h"
+
+#include "bench.h"
+#include "test.h"
+
+// straightforward search the compiled patterns have to agree with, returns all match positions
+static std::vector<size_t> reference_matches(const std::vector<uint8_t> &data, const std::vector<uint8_t> &pattern,
+        const std::string &mask)
+{
+    std::vector<size_t> matches;
+    for (size_t pos = 0; pos + pattern.size() <= data.size(); pos++) {
+        bool match = true;
+        for (size_t i = 0; i < pattern.size() && match; i++) {
+            match = mask[i] != 'X' || data[pos + i] == pattern[i];
+        }
+        if (match) {
+            matches.push_back(pos);
+        }
+    }
+    return matches;
+}
+
+static intptr_t reference_find(const std::vector<size_t> &matches, intptr_t base, intptr_t offset, intptr_t usage) {
+    if (static_cast<size_t>(usage) >= matches.size()) {
+        return 0;
+    }
+    return static_cast<intptr_t>(matches[usage]) + base + offset;
+}
+
+static void test_parse() {
+    auto pattern = SignaturePattern::parse("8B45 08 ??\t89");
+    CHECK(pattern && pattern->size() == 5);
+
+    // wildcards don't take part in the compare
+    uint8_t data[] = { 0x8B, 0x45, 0x08, 0x12, 0x89 };
+    CHECK(pattern && pattern->matches(data));
+    data[3] = 0xEE;
+    CHECK(pattern && pattern->matches(data));
+    data[4] = 0x88;
+    CHECK(pattern && !pattern->matches(data));
+
+    // invalid strings
+    CHECK(!SignaturePattern::parse("8B4"));
+    CHECK(!SignaturePattern::parse("8G"));
+    CHECK(!SignaturePattern::parse("?A"));
+
+    // apply only writes the fixed bytes
+    auto replacement = SignaturePattern::parse("??90??");
+    uint8_t target[] = { 1, 2, 3 };
+    replacement->apply(target);
+    CHECK(target[0] == 1 && target[1] == 0x90 && target[2] == 3);
+}
+
+static void test_flat() {
+    std::mt19937 rng(1234);
+
+    // small alphabets produce lots of overlapping matches
+    for (int iteration = 0; iteration < 3000; iteration++) {
+        std::vector<uint8_t> data(rng() % 300);
+        for (auto &value : data) {
+            value = rng() % 4;
+        }
+        std::vector<uint8_t> pattern(1 + rng() % 40);
+        std::string mask;
+        for (auto &value : pattern) {
+            value = rng() % 4;
+            mask += (rng() % 3) ? 'X' : '?';
+        }
+        mask[rng() % mask.size()] = 'X';
+
+        SignaturePattern compiled(pattern.data(), mask.c_str());
+        auto matches = reference_matches(data, pattern, mask);
+        for (intptr_t usage = 0; usage < 20; usage++) {
+            auto expected = reference_find(matches, 0x1000, 3, usage);
+            CHECK(find_pattern(data.data(), data.size(), 0x1000, compiled, 3, usage) == expected);
+            CHECK(find_pattern(data, 0x1000, pattern.data(), mask.c_str(), 3, usage) == expected);
+        }
+    }
+}
+
+// checks every pattern of the batch against the reference, usages included
+static void check_batch(const std::vector<uint8_t> &data, const std::vector<std::vector<uint8_t>> &patterns,
+        const std::vector<std::string> &masks, int max_usage)
+{
+    SignatureBatch batch;
+    for (size_t i = 0; i < patterns.size(); i++) {
+        SignaturePattern pattern(patterns[i].data(), masks[i].c_str());
+        for (intptr_t usage = 0; usage <= max_usage; usage++) {
+            batch.add(pattern, usage);
+        }
+    }
+    auto &results = batch.scan(data.data(), data.size(), 0x400000);
+    if (!CHECK(results.size() == patterns.size() * (max_usage + 1))) {
+        return;
+    }
+    for (size_t i = 0; i < patterns.size(); i++) {
+        auto matches = reference_matches(data, patterns[i], masks[i]);
+        for (intptr_t usage = 0; usage <= max_usage; usage++) {
+            auto &result = results[i * (max_usage + 1) + usage];
+            auto expected = reference_find(matches, 0x400000, 0, usage);
+            if (!CHECK(result.address == expected) || !CHECK(result.count == matches.size())) {
+                fprintf(stderr, "  pattern %zu, mask %s, usage %d, %zu matches\n",
+                        i, masks[i].c_str(), (int) usage, matches.size());
+            }
+        }
+    }
+}
+
+static void test_batch() {
+    std::mt19937 rng(99);
+    std::vector<uint8_t> data(1 << 16);
+    for (auto &value : data) {
+        value = rng() % 6;
+    }
+
+    // patterns of all lengths, a few of them made of wildcards only
+    std::vector<std::vector<uint8_t>> patterns;
+    std::vector<std::string> masks;
+    for (int i = 0; i < 64; i++) {
+        auto &pattern = patterns.emplace_back(1 + rng() % 12);
+        auto &mask = masks.emplace_back();
+        for (auto &value : pattern) {
+            value = rng() % 6;
+            mask += (i % 16 == 15 || rng() % 4 == 0) ? '?' : 'X';
+        }
+    }
+    check_batch(data, patterns, masks, 3);
+
+    // runs of one byte and of repeated pairs, with patterns overlapping themselves and each other,
+    // so several anchors share a bucket and matches overlap
+    std::vector<uint8_t> runs(4096);
+    for (size_t i = 0; i < runs.size(); i++) {
+        runs[i] = (i / 300) % 2 ? 0xAB : static_cast<uint8_t>(i % 2 ? 0x12 : 0x34);
+    }
+    runs[1000] = 0x55;
+    patterns = {
+        { 0xAB }, { 0xAB, 0xAB }, { 0xAB, 0xAB, 0xAB, 0xAB, 0xAB, 0xAB, 0xAB, 0xAB, 0xAB },
+        { 0x34, 0x12, 0x34 }, { 0x12, 0x34, 0x12 }, { 0x34, 0x12, 0x34, 0x12, 0x34, 0x12, 0x34, 0x12 },
+        { 0x34, 0x00, 0x34 }, { 0x00, 0x00, 0x12, 0x34 }, { 0xAB, 0x00, 0x34 }, { 0x12, 0x34, 0xAB, 0xAB },
+        { 0x55, 0x12 }, { 0x12, 0x55, 0x12 }, { 0x00, 0x00, 0x00 },
+    };
+    masks = { "X", "XX", "XXXXXXXXX", "XXX", "XXX", "XXXXXXXX", "X?X", "??XX", "X?X", "XXXX", "XX", "X?X", "???" };
+    check_batch(runs, patterns, masks, 600);
+
+    // matches right at the start and the end of the data, and data shorter than the patterns
+    std::vector<uint8_t> edges { 0x0F, 0x1F, 0x44, 0x00, 0x90, 0x0F, 0x1F, 0x44 };
+    patterns = { { 0x0F, 0x1F, 0x44 }, { 0x90, 0x0F, 0x1F, 0x44 }, { 0x0F, 0x1F, 0x44, 0x00, 0x90, 0x0F, 0x1F, 0x44, 0x00 },
+        { 0x44 }, { 0, 0, 0, 0, 0, 0, 0, 0 }, { 0, 0, 0, 0, 0, 0, 0, 0, 0 } };
+    masks = { "XXX", "XXXX", "XXXXXXXXX", "X", "????????", "?????????" };
+    check_batch(edges, patterns, masks, 3);
+    check_batch(std::vector<uint8_t>(), patterns, masks, 1);
+}
+
+/*
+ * Image with the code section between two data sections, so scanning code first changes the order.
+ */
+struct TestImage {
+    std::vector<uint8_t> data;
+    size_t code_begin;
+    size_t code_end;
+
+    explicit TestImage(size_t size) : data(size) {
+        std::mt19937 rng(5678);
+        for (auto &value : data) {
+            value = static_cast<uint8_t>(rng() % 8);
+        }
+        memset(data.data(), 0, 0x1000);
+        code_begin = size / 3;
+        code_end = 2 * size / 3;
+
+        // headers
+        auto dos_header = reinterpret_cast<IMAGE_DOS_HEADER *>(data.data());
+        dos_header->e_magic = IMAGE_DOS_SIGNATURE;
+        dos_header->e_lfanew = 0x80;
+        auto nt_headers = reinterpret_cast<IMAGE_NT_HEADERS *>(data.data() + 0x80);
+        nt_headers->Signature = IMAGE_NT_SIGNATURE;
+        nt_headers->FileHeader.NumberOfSections = 3;
+        nt_headers->FileHeader.SizeOfOptionalHeader = sizeof(IMAGE_OPTIONAL_HEADER);
+        nt_headers->OptionalHeader.SizeOfImage = static_cast<DWORD>(size);
+
+        // sections
+        auto section = IMAGE_FIRST_SECTION(nt_headers);
+        section[0].VirtualAddress = 0x1000;
+        section[0].Misc.VirtualSize = static_cast<DWORD>(code_begin - 0x1000);
+        section[1].VirtualAddress = static_cast<DWORD>(code_begin);
+        section[1].Misc.VirtualSize = static_cast<DWORD>(code_end - code_begin);
+        section[1].Characteristics = IMAGE_SCN_MEM_EXECUTE;
+        section[2].VirtualAddress = static_cast<DWORD>(code_end);
+        section[2].Misc.VirtualSize = static_cast<DWORD>(size - code_end);
+    }
+
+    HMODULE module() {
+        return reinterpret_cast<HMODULE>(data.data());
+    }
+
+    intptr_t base() const {
+        return reinterpret_cast<intptr_t>(data.data());
+    }
+};
+
+static void test_module() {
+    TestImage image(1 << 20);
+    const uint8_t signature[] = { 0x8B, 0x45, 0x08, 0xE8, 0, 0, 0, 0, 0x85, 0xC0, 0x74, 0x1A };
+    const char *mask = "XXXX????XXXX";
+
+    // matches in front of, across the start of, inside and behind the code section
+    std::vector<size_t> planted = {
+        0x2000,
+        image.code_begin - 4,
+        image.code_begin + 1000,
+        image.code_end + 77,
+        image.data.size() - sizeof(signature),
+    };
+    for (auto position : planted) {
+        memcpy(&image.data[position], signature, sizeof(signature));
+        image.data[position + 5] = static_cast<uint8_t>(position);
+    }
+
+    // usages count in address order, the code sections only get looked at first
+    for (size_t usage = 0; usage <= planted.size(); usage++) {
+        auto expected = usage < planted.size() ? image.base() + static_cast<intptr_t>(planted[usage]) + 2 : 0;
+        CHECK(find_pattern(image.module(), signature, mask, 2, usage) == expected);
+    }
+
+    // first usage inside the code section when there is nothing in front of it
+    memset(&image.data[planted[0]], 0xFF, sizeof(signature));
+    memset(&image.data[planted[1]], 0xFF, sizeof(signature));
+    CHECK(find_pattern(image.module(), signature, mask, 0, 0)
+            == image.base() + static_cast<intptr_t>(planted[2]));
+
+    // batch scans of the module agree with single scans
+    SignatureBatch batch;
+    SignaturePattern pattern(signature, mask);
+    for (intptr_t usage = 0; usage < 4; usage++) {
+        batch.add(pattern, usage);
+    }
+    auto &results = batch.scan(image.module());
+    for (intptr_t usage = 0; usage < 4 && usage < static_cast<intptr_t>(results.size()); usage++) {
+        CHECK(results[usage].address == find_pattern(image.module(), pattern, 0, usage));
+        CHECK(results[usage].count == 3);
+    }
+
+    // replace the first match
+    auto result = replace_pattern(image.module(), "8B4508E8????????85C0741A", "????????????????????9090", 0, 0);
+    auto position = planted[2];
+    CHECK(result == image.base() + static_cast<intptr_t>(position));
+    CHECK(image.data[position + 10] == 0x90 && image.data[position + 11] == 0x90);
+    CHECK(image.data[position + 9] == 0xC0);
+}
+
+/*
+ * Batch scans of a module with matches straddling the section boundaries and ending at the end of the image,
+ * for every usage, against single scans and a reference search over the whole image.
+ */
+static void test_module_batch() {
+    std::mt19937 rng(4321);
+    std::vector<std::vector<uint8_t>> patterns;
+    std::vector<std::string> masks;
+    for (int i = 0; i < 8; i++) {
+        auto &pattern = patterns.emplace_back(2 + rng() % 30);
+        auto &mask = masks.emplace_back();
+        for (auto &value : pattern) {
+            value = static_cast<uint8_t>(rng() % 8);
+            mask += rng() % 5 ? 'X' : '?';
+        }
+        mask[rng() % mask.size()] = 'X';
+    }
+
+    // one pattern at a time crosses every boundary, at a different offset into the pattern each time
+    const intptr_t max_usage = 5;
+    for (size_t planted = 0; planted < patterns.size(); planted++) {
+        TestImage image(1 << 16);
+        auto &pattern = patterns[planted];
+        for (auto boundary : { image.code_begin, image.code_end }) {
+            auto position = boundary - 1 - rng() % (pattern.size() - 1);
+            memcpy(&image.data[position], pattern.data(), pattern.size());
+        }
+        memcpy(&image.data[image.data.size() - pattern.size()], pattern.data(), pattern.size());
+        memcpy(&image.data[0x1000 + rng() % 0x1000], pattern.data(), pattern.size());
+
+        SignatureBatch batch;
+        for (size_t i = 0; i < patterns.size(); i++) {
+            for (intptr_t usage = 0; usage <= max_usage; usage++) {
+                batch.add(SignaturePattern(patterns[i].data(), masks[i].c_str()), usage);
+            }
+        }
+        auto &results = batch.scan(image.module());
+        if (!CHECK(results.size() == patterns.size() * (max_usage + 1))) {
+            return;
+        }
+        for (size_t i = 0; i < patterns.size(); i++) {
+            SignaturePattern compiled(patterns[i].data(), masks[i].c_str());
+            auto matches = reference_matches(image.data, patterns[i], masks[i]);
+            if (i == planted) {
+                CHECK(matches.size() >= 4);
+            }
+            for (intptr_t usage = 0; usage <= max_usage; usage++) {
+                auto &result = results[i * (max_usage + 1) + usage];
+                CHECK(result.address == reference_find(matches, image.base(), 0, usage));
+                CHECK(result.address == find_pattern(image.module(), compiled, 0, usage));
+                CHECK(result.count == matches.size());
+            }
+        }
+    }
+}
+
+/*
+ * A batch of typical signatures against scanning for them one by one.
+ */
+static void benchmark() {
+    std::mt19937 rng(77);
+    std::vector<uint8_t> data(16 << 20);
+    for (auto &value : data) {
+        auto common = rng() % 3;
+        value = common ? static_cast<uint8_t>(rng() % 16 * 17) : static_cast<uint8_t>(rng());
+    }
+    std::vector<SignaturePattern> patterns;
+    for (int i = 0; i < 64; i++) {
+        std::vector<uint8_t> pattern(8 + rng() % 24);
+        std::string mask;
+        for (auto &value : pattern) {
+            value = static_cast<uint8_t>(rng());
+            mask += rng() % 4 ? 'X' : '?';
+        }
+        auto position = rng() % (data.size() - pattern.size());
+        memcpy(&data[position], pattern.data(), pattern.size());
+        patterns.emplace_back(pattern.data(), mask.c_str());
+    }
+    printf("64 patterns, 16 MiB\n");
+    bench::report("single scans, first match", bench::measure([&] {
+        intptr_t sum = 0;
+        for (auto &pattern : patterns) {
+            sum += find_pattern(data.data(), data.size(), 0, pattern, 0, 0);
+        }
+        bench::keep(sum);
+    }), data.size());
+
+    // the batch counts every match to flag ambiguous signatures, which takes a full pass per pattern otherwise
+    bench::report("single scans, all matches", bench::measure([&] {
+        intptr_t sum = 0;
+        for (auto &pattern : patterns) {
+            sum += find_pattern(data.data(), data.size(), 0, pattern, 0, INTPTR_MAX);
+        }
+        bench::keep(sum);
+    }), data.size());
+    SignatureBatch batch;
+    for (auto &pattern : patterns) {
+        batch.add(pattern);
+    }
+    bench::report("batch scan", bench::measure([&] {
+        auto &results = batch.scan(data.data(), data.size(), 0);
+        bench::keep(results);
+    }), data.size());
+}
+
+int main(int argc, char **argv) {
+    test_parse();
+    test_flat();
+    test_batch();
+    test_module();
+    test_module_batch();
+    if (bench::enabled(argc, argv)) {
+        benchmark();
+    }
+    return test::result();
+}
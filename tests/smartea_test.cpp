@@ -0,0 +1,185 @@
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "easrv/smartea.h"
+#include "util/fileutils.h"
+
+#include "bench.h"
+#include "test.h"
+
+/*
+ * Probes local listeners, a listener which never completes the handshake and an unroutable address.
+ * Every check uses a URL of its own, since the probe result is kept per URL.
+ */
+
+static std::string CACHE;
+
+// listening socket on loopback, with the port picked by the system
+struct Listener {
+    int socket = -1;
+    uint16_t port = 0;
+    std::vector<int> clients;
+
+    explicit Listener(int backlog = SOMAXCONN) {
+        socket = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(address);
+        if (bind(socket, (sockaddr *) &address, length) != 0 || listen(socket, backlog) != 0
+        || getsockname(socket, (sockaddr *) &address, &length) != 0) {
+            close(socket);
+            socket = -1;
+            return;
+        }
+        port = ntohs(address.sin_port);
+    }
+
+    ~Listener() {
+        for (auto client : clients) {
+            close(client);
+        }
+        if (socket >= 0) {
+            close(socket);
+        }
+    }
+
+    /*
+     * Fills the accept queue without ever accepting, the kernel then drops further handshakes
+     * so connecting hangs like it does for an unreachable server.
+     */
+    void fill_backlog() {
+        for (int i = 0; i < 4; i++) {
+            auto client = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+            sockaddr_in address {};
+            address.sin_family = AF_INET;
+            address.sin_port = htons(port);
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            connect(client, (sockaddr *) &address, sizeof(address));
+            clients.push_back(client);
+        }
+    }
+};
+
+static std::string url(uint16_t port, const std::string &path = "/core") {
+    return "http://127.0.0.1:" + std::to_string(port) + path;
+}
+
+// checks the URL and returns the milliseconds it took
+static double check(const std::string &url, bool expected) {
+    auto start = bench::clock::now();
+    auto result = smartea::check_url(url);
+    auto elapsed = bench::seconds_since(start) * 1000;
+    if (!CHECK(result == expected)) {
+        fprintf(stderr, "  %s\n", url.c_str());
+    }
+    return elapsed;
+}
+
+static bool cache_has(const std::string &line) {
+    return fileutils::text_read(CACHE).find(line + "\n") != std::string::npos;
+}
+
+static void test_reachable() {
+    Listener listener;
+    if (!CHECK(listener.socket >= 0)) {
+        return;
+    }
+    CHECK(check(url(listener.port), true) < 1000);
+    auto port = std::to_string(listener.port);
+    CHECK(cache_has("127.0.0.1 " + port + " 127.0.0.1 " + port));
+
+    // the result stays until another URL is probed
+    close(listener.socket);
+    listener.socket = -1;
+    CHECK(check(url(listener.port), true) < 100);
+
+    // refused right away
+    CHECK(check(url(listener.port, "/refused"), false) < 1000);
+
+    // hosts are resolved
+    Listener named;
+    CHECK(check("localhost:" + std::to_string(named.port), true) < 1000);
+    CHECK(cache_has("localhost " + std::to_string(named.port) + " 127.0.0.1 " + std::to_string(named.port)));
+
+    // lines of other servers are kept
+    CHECK(cache_has("127.0.0.1 " + port + " 127.0.0.1 " + port));
+}
+
+static void test_unreachable() {
+    smartea::CONNECT_TIMEOUT_MS = 300;
+
+    // gives up at the connect deadline
+    Listener hanging(0);
+    hanging.fill_backlog();
+    auto elapsed = check(url(hanging.port), false);
+    CHECK(elapsed >= 290 && elapsed < 1000);
+    CHECK(!cache_has("127.0.0.1 " + std::to_string(hanging.port) + " "));
+
+    // documentation address which isn't routed anywhere, fails fast without a network
+    CHECK(check("http://192.0.2.1:80/core", false) < 1000);
+
+    // names that don't resolve, and garbage
+    smartea::RESOLVE_TIMEOUT_MS = 500;
+    CHECK(check("http://smartea.invalid:80/core", false) < 1000);
+    CHECK(check("", false) < 100);
+    CHECK(check("http://", false) < 100);
+    smartea::RESOLVE_TIMEOUT_MS = 2000;
+    smartea::CONNECT_TIMEOUT_MS = 2000;
+}
+
+/*
+ * A cached address which hangs doesn't hold up the resolved one, it gets its turn after the attempt delay.
+ */
+static void test_happy_eyeballs() {
+    Listener hanging(0);
+    hanging.fill_backlog();
+    Listener listener;
+    auto port = std::to_string(listener.port);
+    fileutils::text_write(CACHE, "127.0.0.1 " + port + " 127.0.0.1 " + std::to_string(hanging.port) + "\n");
+
+    auto elapsed = check(url(listener.port), true);
+    CHECK(elapsed >= 240 && elapsed < 1000);
+    CHECK(cache_has("127.0.0.1 " + port + " 127.0.0.1 " + port));
+
+    // the working address is tried first next time
+    CHECK(check(url(listener.port, "/again"), true) < 100);
+}
+
+/*
+ * Probe time against a local server, with and without a hanging cached address.
+ */
+static void bench_probe() {
+    Listener listener;
+    Listener hanging(0);
+    hanging.fill_backlog();
+    auto port = std::to_string(listener.port);
+    std::vector<double> direct, fallback;
+    for (int i = 0; i < 20; i++) {
+        direct.push_back(check(url(listener.port, "/direct" + std::to_string(i)), true) / 1000);
+    }
+    for (int i = 0; i < 5; i++) {
+        fileutils::text_write(CACHE, "127.0.0.1 " + port + " 127.0.0.1 " + std::to_string(hanging.port) + "\n");
+        fallback.push_back(check(url(listener.port, "/fallback" + std::to_string(i)), true) / 1000);
+    }
+    bench::report_latency("probe local server", direct);
+    bench::report_latency("probe with hanging cached address", fallback);
+}
+
+int main(int argc, char **argv) {
+    CACHE = (std::filesystem::temp_directory_path() / ("smartea_test_" + std::to_string(getpid()))).string();
+    smartea::CACHE_PATH = CACHE;
+    test_reachable();
+    test_unreachable();
+    test_happy_eyeballs();
+    if (bench::enabled(argc, argv)) {
+        bench_probe();
+    }
+    std::filesystem::remove(CACHE);
+    return test::result();
+}
@@ -0,0 +1,342 @@
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "util/socket_server.h"
+#include "util/threadpool.h"
+
+#include "bench.h"
+#include "test.h"
+
+/*
+ * Loopback load test of the socket server the API controller is built on.
+ * The server speaks the null terminated message protocol of the API and, like the controller,
+ * runs "slow" requests on a worker pool while holding back the following input of that client.
+ */
+
+static const size_t IO_THREADS = 2;
+static const size_t POOL_THREADS = 2;
+
+struct Session {
+    std::string message;
+    std::string held_input;
+
+    // result of the call running on the pool
+    std::shared_ptr<util::SocketServer::Wakeup> wakeup;
+    std::shared_ptr<std::atomic<bool>> done;
+    std::shared_ptr<std::string> result;
+};
+
+class EchoServer {
+public:
+    std::atomic<size_t> connects = 0;
+    std::atomic<size_t> disconnects = 0;
+
+    // the pool gets drained before the server stops, so its calls can still wake connections
+    util::SocketServer server { IO_THREADS, 64 * 1024, 16 * 1024 * 1024 };
+    ThreadPool pool { POOL_THREADS };
+
+    EchoServer() {
+        server.on_connect = [this] (util::SocketServer::Connection &connection) {
+            connection.user = new Session();
+            connects++;
+            return true;
+        };
+        server.on_receive = [this] (util::SocketServer::Connection &connection, char *data, size_t size) {
+            this->receive(connection, data, size);
+        };
+        server.on_tick = [this] (util::SocketServer::Connection &connection) {
+            auto session = reinterpret_cast<Session *>(connection.user);
+            if (session->done && *session->done) {
+                this->reply(connection, *session->result);
+                session->done.reset();
+                std::string held;
+                held.swap(session->held_input);
+                this->receive(connection, held.data(), held.size());
+            }
+            return -1;
+        };
+        server.on_disconnect = [this] (util::SocketServer::Connection &connection) {
+            delete reinterpret_cast<Session *>(connection.user);
+            disconnects++;
+        };
+    }
+
+private:
+
+    void reply(util::SocketServer::Connection &connection, const std::string &message) {
+        auto response = "re:" + message;
+        server.send(connection, response.c_str(), response.size() + 1);
+    }
+
+    void receive(util::SocketServer::Connection &connection, const char *data, size_t size) {
+        auto session = reinterpret_cast<Session *>(connection.user);
+        while (size > 0) {
+
+            // hold back input while a call runs
+            if (session->done) {
+                session->held_input.append(data, size);
+                return;
+            }
+
+            auto end = (const char *) memchr(data, 0, size);
+            if (end == nullptr) {
+                session->message.append(data, size);
+                return;
+            }
+            session->message.append(data, end);
+            size -= end - data + 1;
+            data = end + 1;
+
+            // slow calls complete on the pool and wake the connection
+            if (session->message.rfind("slow", 0) == 0) {
+                session->wakeup = server.get_wakeup(connection);
+                session->done = std::make_shared<std::atomic<bool>>(false);
+                session->result = std::make_shared<std::string>(session->message);
+                pool.add([this, wakeup = session->wakeup, done = session->done] {
+                    std::this_thread::sleep_for(std::chrono::microseconds(200));
+                    *done = true;
+                    server.wake(*wakeup);
+                });
+            } else {
+                this->reply(connection, session->message);
+            }
+            session->message.clear();
+        }
+    }
+};
+
+static int connect_loopback(uint16_t port) {
+    int socket = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(socket, (sockaddr *) &address, sizeof(address)) != 0) {
+        close(socket);
+        return -1;
+    }
+    int opt_enable = 1;
+    setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &opt_enable, sizeof(opt_enable));
+    return socket;
+}
+
+// reads until the given number of null terminated messages arrived
+static bool read_messages(int socket, size_t count, std::vector<std::string> &messages) {
+    std::string current;
+    char buffer[4096];
+    while (messages.size() < count) {
+        pollfd fd { socket, POLLIN, 0 };
+        if (poll(&fd, 1, 5000) <= 0) {
+            return false;
+        }
+        auto received = recv(socket, buffer, sizeof(buffer), 0);
+        if (received <= 0) {
+            return false;
+        }
+        for (ssize_t i = 0; i < received; i++) {
+            if (buffer[i] == 0) {
+                messages.push_back(std::move(current));
+                current.clear();
+            } else {
+                current.push_back(buffer[i]);
+            }
+        }
+    }
+    return current.empty();
+}
+
+static size_t thread_count() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("Threads:", 0) == 0) {
+            return std::stoul(line.substr(8));
+        }
+    }
+    return 0;
+}
+
+/*
+ * Many clients sending pipelined requests split at random points, a few of them slow.
+ * Every client has to get its responses in order, and the thread count must not grow.
+ */
+static void test_load(uint16_t port) {
+    const size_t client_threads = 4;
+    const size_t clients_per_thread = 500;
+    const size_t rounds = 5;
+    const size_t depth = 8;
+
+    EchoServer echo;
+    if (!CHECK(echo.server.listen(port, 128))) {
+        fprintf(stderr, "%s\n", echo.server.get_error().c_str());
+        return;
+    }
+    auto threads_idle = thread_count();
+
+    std::atomic<size_t> failures = 0;
+    std::atomic<size_t> ready = 0;
+    std::atomic<size_t> peak_threads = 0;
+    std::vector<std::vector<double>> latencies(client_threads);
+    std::vector<std::thread> threads;
+    auto start = bench::clock::now();
+    for (size_t t = 0; t < client_threads; t++) {
+        threads.emplace_back([&, t] {
+            std::mt19937 rng(t);
+            std::vector<int> sockets;
+            for (size_t i = 0; i < clients_per_thread; i++) {
+                auto socket = connect_loopback(port);
+                if (socket < 0) {
+                    failures++;
+                    continue;
+                }
+                sockets.push_back(socket);
+            }
+
+            // keep all clients connected until the thread count was sampled
+            ready++;
+            while (ready < client_threads) {
+                std::this_thread::yield();
+            }
+            while (peak_threads == 0) {
+                std::this_thread::yield();
+            }
+
+            for (size_t round = 0; round < rounds; round++) {
+
+                // send a burst on every connection, cut into random pieces
+                std::vector<bench::clock::time_point> sent(sockets.size());
+                std::vector<std::vector<std::string>> expected(sockets.size());
+                for (size_t i = 0; i < sockets.size(); i++) {
+                    std::string burst;
+                    for (size_t n = 0; n < depth; n++) {
+                        auto message = (rng() % 50 == 0 ? "slow " : "msg ")
+                                + std::to_string(t) + "." + std::to_string(i) + "." + std::to_string(n)
+                                + std::string(rng() % 200, 'x');
+                        burst.append(message);
+                        burst.push_back(0);
+                        expected[i].push_back("re:" + message);
+                    }
+                    sent[i] = bench::clock::now();
+                    for (size_t pos = 0; pos < burst.size();) {
+                        auto length = std::min<size_t>(burst.size() - pos, 1 + rng() % 300);
+                        if (::send(sockets[i], burst.data() + pos, length, MSG_NOSIGNAL) != (ssize_t) length) {
+                            failures++;
+                            break;
+                        }
+                        pos += length;
+                    }
+                }
+
+                // collect the responses
+                for (size_t i = 0; i < sockets.size(); i++) {
+                    std::vector<std::string> messages;
+                    if (!read_messages(sockets[i], depth, messages) || messages != expected[i]) {
+                        failures++;
+                    }
+                    latencies[t].push_back(bench::seconds_since(sent[i]));
+                }
+            }
+
+            for (auto socket : sockets) {
+                close(socket);
+            }
+        });
+    }
+
+    // all clients are served by the same threads
+    while (ready < client_threads) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    for (int i = 0; i < 500 && echo.server.get_connection_count() < client_threads * clients_per_thread; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    CHECK(echo.server.get_connection_count() == client_threads * clients_per_thread);
+    peak_threads = thread_count();
+    CHECK(peak_threads == threads_idle + client_threads);
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    auto elapsed = bench::seconds_since(start);
+    CHECK(failures == 0);
+
+    // report
+    std::vector<double> all;
+    for (auto &thread_latencies : latencies) {
+        all.insert(all.end(), thread_latencies.begin(), thread_latencies.end());
+    }
+    auto requests = client_threads * clients_per_thread * rounds * depth;
+    printf("%zu clients, %zu requests in %.2f s, %.0f requests/s\n",
+            client_threads * clients_per_thread, requests, elapsed, requests / elapsed);
+    bench::report_latency("burst of 8 round trip", all);
+
+    // disconnects are noticed
+    for (int i = 0; i < 500 && echo.disconnects < echo.connects; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    CHECK(echo.disconnects == echo.connects);
+}
+
+/*
+ * Output queued right before close_on_flush still arrives, and stop() closes open connections.
+ */
+static void test_close(uint16_t port) {
+    util::SocketServer server(1, 4096, 1024 * 1024);
+    std::atomic<size_t> disconnects = 0;
+    server.on_receive = [&server] (util::SocketServer::Connection &connection, char *, size_t) {
+        std::string response(512 * 1024, 'r');
+        server.send(connection, response.data(), response.size());
+        connection.close_on_flush = true;
+    };
+    server.on_disconnect = [&disconnects] (util::SocketServer::Connection &) {
+        disconnects++;
+    };
+    if (!CHECK(server.listen(port, 16))) {
+        return;
+    }
+
+    // large response read slowly
+    auto socket = connect_loopback(port);
+    CHECK(::send(socket, "x", 1, MSG_NOSIGNAL) == 1);
+    size_t total = 0;
+    char buffer[4096];
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    while (true) {
+        auto received = recv(socket, buffer, sizeof(buffer), 0);
+        if (received <= 0) {
+            break;
+        }
+        total += received;
+    }
+    CHECK(total == 512 * 1024);
+    close(socket);
+
+    // stop with a connected client
+    auto idle = connect_loopback(port);
+    for (int i = 0; i < 100 && server.get_connection_count() == 0; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    server.stop();
+    CHECK(recv(idle, buffer, sizeof(buffer), 0) == 0);
+    CHECK(disconnects == 2);
+    close(idle);
+}
+
+int main() {
+    uint16_t port = 20000 + getpid() % 20000;
+    test_load(port);
+    test_close(port + 1);
+    return test::result();
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdio>
+
+/*
+ * Minimal checks for the host tests.
+ * Failed checks are printed and counted, main returns test::result() so ctest sees the failure.
+ */
+namespace test {
+
+    inline int FAILURES = 0;
+
+    inline bool check(bool condition, const char *expression, const char *file, int line) {
+        if (!condition) {
+            fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expression);
+            FAILURES++;
+        }
+        return condition;
+    }
+
+    inline int result() {
+        if (FAILURES > 0) {
+            fprintf(stderr, "%d checks failed\n", FAILURES);
+            return 1;
+        }
+        return 0;
+    }
+}
+
+#define CHECK(condition) test::check(static_cast<bool>(condition), #condition, __FILE__, __LINE__)
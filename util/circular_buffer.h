@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdio>
 #include <memory>
 #include <vector>
@@ -23,13 +24,33 @@ public:
     }
 
     void put_all(const T *items, int size) {
-        for (int i = 0; i < size; i++)
-            this->put(items[i]);
+        if (size <= 0) {
+            return;
+        }
+
+        // only the newest items survive an overflow, just like with put()
+        size_t count = size;
+        if (count >= size_ - 1) {
+            items += count - (size_ - 1);
+            count = size_ - 1;
+            head_ = tail_ = 0;
+        }
+        size_t free = size_ - 1 - this->size();
+
+        // copy in up to two slices
+        size_t first = std::min(count, size_ - head_);
+        std::copy(items, items + first, &buf_[head_]);
+        std::copy(items + first, items + count, &buf_[0]);
+        head_ = (head_ + count) % size_;
+
+        // drop the oldest items on overflow
+        if (count > free) {
+            tail_ = (tail_ + count - free) % size_;
+        }
     }
 
-    void put_all(std::vector<T> items) {
-        for (auto i : items)
-            this->put(i);
+    void put_all(const std::vector<T> &items) {
+        this->put_all(items.data(), (int) items.size());
     }
 
     T get() {
@@ -44,6 +65,18 @@ public:
         return val;
     }
 
+    size_t get_all(T *items, size_t count) {
+
+        // copy in up to two slices
+        count = std::min(count, size());
+        size_t first = std::min(count, size_ - tail_);
+        std::copy(&buf_[tail_], &buf_[tail_] + first, items);
+        std::copy(&buf_[0], &buf_[0] + (count - first), items + first);
+        tail_ = (tail_ + count) % size_;
+
+        return count;
+    }
+
     std::vector<T> get_all() {
         std::vector<T> contents;
         contents.reserve(size());
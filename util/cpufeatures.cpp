@@ -0,0 +1,70 @@
+#include "cpufeatures.h"
+
+#include <cstdint>
+
+#if defined(__GNUC__) || defined(__clang__)
+#include <cpuid.h>
+#else
+#include <intrin.h>
+#endif
+
+namespace cpufeatures {
+
+    static void cpuid(unsigned int leaf, unsigned int info[4]) {
+#if defined(__GNUC__) || defined(__clang__)
+        __cpuid_count(leaf, 0, info[0], info[1], info[2], info[3]);
+#else
+        __cpuidex(reinterpret_cast<int *>(info), leaf, 0);
+#endif
+    }
+
+    static bool detect_sse2() {
+#if defined(__x86_64__) || defined(_M_X64)
+        return true;
+#else
+        unsigned int info[4] {};
+        cpuid(1, info);
+        return (info[3] & (1u << 26)) != 0;
+#endif
+    }
+
+    static bool detect_avx2() {
+        unsigned int info[4] {};
+
+        // get maximum leaf
+        cpuid(0, info);
+        if (info[0] < 7) {
+            return false;
+        }
+
+        // the OS has to support AVX and save the YMM registers
+        cpuid(1, info);
+        if (!(info[2] & (1u << 27)) || !(info[2] & (1u << 28))) {
+            return false;
+        }
+#if defined(__GNUC__) || defined(__clang__)
+        unsigned int xcr0_lo, xcr0_hi;
+        __asm__ volatile("xgetbv" : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0));
+        uint64_t xcr0 = ((uint64_t) xcr0_hi << 32) | xcr0_lo;
+#else
+        uint64_t xcr0 = _xgetbv(0);
+#endif
+        if ((xcr0 & 6) != 6) {
+            return false;
+        }
+
+        // check for AVX2
+        cpuid(7, info);
+        return (info[1] & (1u << 5)) != 0;
+    }
+
+    bool has_sse2() {
+        static const bool SSE2 = detect_sse2();
+        return SSE2;
+    }
+
+    bool has_avx2() {
+        static const bool AVX2 = detect_avx2();
+        return AVX2;
+    }
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+/*
+ * Runtime checks for instruction set extensions, so sources compiled for them can be dispatched to.
+ */
+namespace cpufeatures {
+
+    // SSE2 support, always available on x64
+    bool has_sse2();
+
+    // AVX2 support of both the CPU and the OS, checked once
+    bool has_avx2();
+}
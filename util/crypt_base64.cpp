@@ -0,0 +1,59 @@
+#include "crypt.h"
+
+#include <array>
+#include <cstring>
+
+#include "cpufeatures.h"
+
+namespace crypt {
+
+    // compiled with AVX2 enabled, encodes whole blocks and returns the number of bytes consumed
+    namespace avx2 {
+        size_t base64_encode(const uint8_t *src, size_t length, char *dst);
+    }
+
+    static const char *BASE64_TABLE = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    // every 12-bit value mapped to its two output characters
+    static const auto BASE64_PAIRS = [] {
+        std::array<uint16_t, 4096> pairs {};
+        for (size_t i = 0; i < pairs.size(); i++) {
+            char chars[2] { BASE64_TABLE[i >> 6], BASE64_TABLE[i & 0x3F] };
+            memcpy(&pairs[i], chars, sizeof(chars));
+        }
+        return pairs;
+    }();
+
+    std::string base64_encode(const uint8_t *ptr, size_t length) {
+        std::string result(4 * ((length + 2) / 3), '=');
+        if (!ptr || !length) {
+            return result;
+        }
+        auto out = result.data();
+
+        // 24 bytes per step if the CPU supports it
+        size_t i = 0;
+        if (cpufeatures::has_avx2()) {
+            i = avx2::base64_encode(ptr, length, out);
+            out += i / 3 * 4;
+        }
+
+        // full triplets, two characters per lookup
+        for (; i + 3 <= length; i += 3, out += 4) {
+            uint32_t triplet = ptr[i] << 16 | ptr[i + 1] << 8 | ptr[i + 2];
+            memcpy(out, &BASE64_PAIRS[triplet >> 12], 2);
+            memcpy(out + 2, &BASE64_PAIRS[triplet & 0xFFF], 2);
+        }
+
+        // remaining bytes, padding is already in place
+        if (i < length) {
+            uint32_t triplet = ptr[i] << 16 | (i + 1 < length ? ptr[i + 1] << 8 : 0);
+            out[0] = BASE64_TABLE[triplet >> 18];
+            out[1] = BASE64_TABLE[(triplet >> 12) & 0x3F];
+            if (i + 1 < length) {
+                out[2] = BASE64_TABLE[(triplet >> 6) & 0x3F];
+            }
+        }
+        return result;
+    }
+}
@@ -0,0 +1,61 @@
+// compiled with AVX2 enabled, see CMakeLists.txt
+#include <cstddef>
+#include <cstdint>
+
+#include <immintrin.h>
+
+namespace crypt::avx2 {
+
+    /*
+     * Spreads 12 input bytes per lane into 16 bytes holding one 6-bit value each.
+     * The input is expected 4 bytes into the lower lane and at the start of the upper lane.
+     */
+    static inline __m256i reshuffle(__m256i input) {
+
+        // duplicate the middle byte of every triplet, [b, a, c, b] per 32 bits
+        auto in = _mm256_shuffle_epi8(input, _mm256_set_epi8(
+                10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+                14, 15, 13, 14, 11, 12, 10, 11, 8, 9, 7, 8, 5, 6, 4, 5));
+
+        // move the first and third value down, the second and fourth up into their bytes
+        auto high = _mm256_mulhi_epu16(
+                _mm256_and_si256(in, _mm256_set1_epi32(0x0FC0FC00)),
+                _mm256_set1_epi32(0x04000040));
+        auto low = _mm256_mullo_epi16(
+                _mm256_and_si256(in, _mm256_set1_epi32(0x003F03F0)),
+                _mm256_set1_epi32(0x01000010));
+        return _mm256_or_si256(high, low);
+    }
+
+    // maps 6-bit values to the base64 alphabet by adding the offset of their range
+    static inline __m256i translate(__m256i values) {
+        auto offsets = _mm256_setr_epi8(
+                65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0,
+                65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+
+        // 0 for A-Z, 1 for a-z, 2-11 for digits, 12 for + and 13 for /
+        auto indices = _mm256_subs_epu8(values, _mm256_set1_epi8(51));
+        indices = _mm256_sub_epi8(indices, _mm256_cmpgt_epi8(values, _mm256_set1_epi8(25)));
+        return _mm256_add_epi8(values, _mm256_shuffle_epi8(offsets, indices));
+    }
+
+    size_t base64_encode(const uint8_t *src, size_t length, char *dst) {
+        if (length < 32) {
+            return 0;
+        }
+
+        // the first block can't be loaded from before the input, move it into place instead
+        auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src));
+        block = _mm256_permutevar8x32_epi32(block, _mm256_setr_epi32(0, 0, 1, 2, 3, 4, 5, 6));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), translate(reshuffle(block)));
+        size_t i = 24;
+        dst += 32;
+
+        // following blocks are loaded 4 bytes early, which puts the lanes in place right away
+        for (; i + 28 <= length; i += 24, dst += 32) {
+            block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i - 4));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), translate(reshuffle(block)));
+        }
+        return i;
+    }
+}
@@ -0,0 +1,17 @@
+#include "encoder_pool.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace util {
+
+    size_t encoder_worker_count() {
+        static const size_t WORKER_COUNT = std::clamp(std::thread::hardware_concurrency(), 1u, 8u) - 1;
+        return WORKER_COUNT;
+    }
+
+    ThreadPool &encoder_worker_pool() {
+        static ThreadPool POOL(encoder_worker_count());
+        return POOL;
+    }
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+
+#include "util/threadpool.h"
+
+namespace util {
+
+    /*
+     * Worker threads shared by the image encoders.
+     * There is one worker less than the threads used for encoding since the caller helps out.
+     */
+    size_t encoder_worker_count();
+    ThreadPool &encoder_worker_pool();
+}
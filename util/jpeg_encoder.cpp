@@ -0,0 +1,608 @@
+#include "jpeg_encoder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <future>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define JPEG_ENCODER_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "util/encoder_pool.h"
+
+namespace util {
+
+    // quantization tables from the JPEG standard, Annex K
+    static const uint8_t QUANT_LUMINANCE[64] {
+        16, 11, 10, 16, 24, 40, 51, 61,
+        12, 12, 14, 19, 26, 58, 60, 55,
+        14, 13, 16, 24, 40, 57, 69, 56,
+        14, 17, 22, 29, 51, 87, 80, 62,
+        18, 22, 37, 56, 68, 109, 103, 77,
+        24, 35, 55, 64, 81, 104, 113, 92,
+        49, 64, 78, 87, 103, 121, 120, 101,
+        72, 92, 95, 98, 112, 100, 103, 99,
+    };
+    static const uint8_t QUANT_CHROMINANCE[64] {
+        17, 18, 24, 47, 99, 99, 99, 99,
+        18, 21, 26, 66, 99, 99, 99, 99,
+        24, 26, 56, 99, 99, 99, 99, 99,
+        47, 66, 99, 99, 99, 99, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99,
+    };
+
+    // index in the 8x8 block of each coefficient in zig-zag order
+    static const uint8_t ZIGZAG[64] {
+        0, 1, 8, 16, 9, 2, 3, 10,
+        17, 24, 32, 25, 18, 11, 4, 5,
+        12, 19, 26, 33, 40, 48, 41, 34,
+        27, 20, 13, 6, 7, 14, 21, 28,
+        35, 42, 49, 56, 57, 50, 43, 36,
+        29, 22, 15, 23, 30, 37, 44, 51,
+        58, 59, 52, 45, 38, 31, 39, 46,
+        53, 60, 61, 54, 47, 55, 62, 63,
+    };
+
+    // huffman tables from the JPEG standard, Annex K, as code counts per length followed by the symbols
+    static const uint8_t HUFFMAN_DC_LUMINANCE[16 + 12] {
+        0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0,
+        0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11,
+    };
+    static const uint8_t HUFFMAN_DC_CHROMINANCE[16 + 12] {
+        0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0,
+        0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11,
+    };
+    static const uint8_t HUFFMAN_AC_LUMINANCE[16 + 162] {
+        0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 125,
+        0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+        0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xA1, 0x08, 0x23, 0x42, 0xB1, 0xC1, 0x15, 0x52, 0xD1, 0xF0,
+        0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0A, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x25, 0x26, 0x27, 0x28,
+        0x29, 0x2A, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+        0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+        0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+        0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7,
+        0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3, 0xC4, 0xC5,
+        0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA, 0xE1, 0xE2,
+        0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
+        0xF9, 0xFA,
+    };
+    static const uint8_t HUFFMAN_AC_CHROMINANCE[16 + 162] {
+        0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 119,
+        0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+        0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xA1, 0xB1, 0xC1, 0x09, 0x23, 0x33, 0x52, 0xF0,
+        0x15, 0x62, 0x72, 0xD1, 0x0A, 0x16, 0x24, 0x34, 0xE1, 0x25, 0xF1, 0x17, 0x18, 0x19, 0x1A, 0x26,
+        0x27, 0x28, 0x29, 0x2A, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+        0x49, 0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+        0x69, 0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+        0x88, 0x89, 0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5,
+        0xA6, 0xA7, 0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3,
+        0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA,
+        0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
+        0xF9, 0xFA,
+    };
+
+    namespace {
+
+        /*
+         * Four floats, backed by SSE2 if the build targets it.
+         */
+#ifdef JPEG_ENCODER_SSE2
+        struct F4 {
+            __m128 v;
+
+            static inline F4 load(const float *src) {
+                return { _mm_loadu_ps(src) };
+            }
+
+            static inline F4 set(float value) {
+                return { _mm_set1_ps(value) };
+            }
+
+            inline void store(float *dst) const {
+                _mm_storeu_ps(dst, this->v);
+            }
+
+            inline void store_rounded(int32_t *dst) const {
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm_cvtps_epi32(this->v));
+            }
+
+            // sums of neighboring pairs, first of a and then of b
+            static inline F4 pair_sums(F4 a, F4 b) {
+                return { _mm_add_ps(
+                        _mm_shuffle_ps(a.v, b.v, _MM_SHUFFLE(2, 0, 2, 0)),
+                        _mm_shuffle_ps(a.v, b.v, _MM_SHUFFLE(3, 1, 3, 1))) };
+            }
+
+            static inline void transpose(F4 &a, F4 &b, F4 &c, F4 &d) {
+                _MM_TRANSPOSE4_PS(a.v, b.v, c.v, d.v);
+            }
+        };
+
+        inline F4 operator+(F4 a, F4 b) { return { _mm_add_ps(a.v, b.v) }; }
+        inline F4 operator-(F4 a, F4 b) { return { _mm_sub_ps(a.v, b.v) }; }
+        inline F4 operator*(F4 a, F4 b) { return { _mm_mul_ps(a.v, b.v) }; }
+#else
+        struct F4 {
+            float v[4];
+
+            static inline F4 load(const float *src) {
+                return { { src[0], src[1], src[2], src[3] } };
+            }
+
+            static inline F4 set(float value) {
+                return { { value, value, value, value } };
+            }
+
+            inline void store(float *dst) const {
+                for (int i = 0; i < 4; i++) {
+                    dst[i] = this->v[i];
+                }
+            }
+
+            inline void store_rounded(int32_t *dst) const {
+                for (int i = 0; i < 4; i++) {
+                    dst[i] = (int32_t) std::lrint(this->v[i]);
+                }
+            }
+
+            static inline F4 pair_sums(F4 a, F4 b) {
+                return { { a.v[0] + a.v[1], a.v[2] + a.v[3], b.v[0] + b.v[1], b.v[2] + b.v[3] } };
+            }
+
+            static inline void transpose(F4 &a, F4 &b, F4 &c, F4 &d) {
+                F4 rows[4] { a, b, c, d };
+                for (int i = 0; i < 4; i++) {
+                    a.v[i] = rows[i].v[0];
+                    b.v[i] = rows[i].v[1];
+                    c.v[i] = rows[i].v[2];
+                    d.v[i] = rows[i].v[3];
+                }
+            }
+        };
+
+        inline F4 operator+(F4 a, F4 b) { return { { a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3] } }; }
+        inline F4 operator-(F4 a, F4 b) { return { { a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3] } }; }
+        inline F4 operator*(F4 a, F4 b) { return { { a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3] } }; }
+#endif
+
+        /*
+         * One row of an 8x8 block.
+         */
+        struct Row {
+            F4 lo, hi;
+
+            static inline Row load(const float *src) {
+                return { F4::load(src), F4::load(src + 4) };
+            }
+
+            static inline Row set(float value) {
+                return { F4::set(value), F4::set(value) };
+            }
+        };
+
+        inline Row operator+(Row a, Row b) { return { a.lo + b.lo, a.hi + b.hi }; }
+        inline Row operator-(Row a, Row b) { return { a.lo - b.lo, a.hi - b.hi }; }
+        inline Row operator*(Row a, Row b) { return { a.lo * b.lo, a.hi * b.hi }; }
+
+        struct HuffmanTable {
+            uint16_t codes[256];
+            uint8_t lengths[256];
+
+            explicit HuffmanTable(const uint8_t *definition) : codes(), lengths() {
+
+                // canonical codes, assigned in order of length
+                uint16_t code = 0;
+                auto symbols = definition + 16;
+                for (int length = 1; length <= 16; length++) {
+                    for (int i = 0; i < definition[length - 1]; i++) {
+                        auto symbol = *symbols++;
+                        this->codes[symbol] = code++;
+                        this->lengths[symbol] = (uint8_t) length;
+                    }
+                    code <<= 1;
+                }
+            }
+        };
+
+        class BitWriter {
+        public:
+            explicit BitWriter(std::vector<uint8_t> &out) : out(out) {
+            }
+
+            inline void put(uint32_t bits, int length) {
+                this->buffer = (this->buffer << length) | bits;
+                this->count += length;
+                if (this->count >= 32) {
+                    this->count -= 32;
+                    auto word = (uint32_t) (this->buffer >> this->count);
+
+                    // whole word at once unless it contains a 0xFF byte
+                    auto inverted = ~word;
+                    if (((inverted - 0x01010101) & ~inverted & 0x80808080) == 0) {
+                        uint8_t bytes[4] { (uint8_t) (word >> 24), (uint8_t) (word >> 16),
+                                           (uint8_t) (word >> 8), (uint8_t) word };
+                        this->out.insert(this->out.end(), bytes, bytes + 4);
+                    } else {
+                        for (int shift = 24; shift >= 0; shift -= 8) {
+                            this->put_byte((uint8_t) (word >> shift));
+                        }
+                    }
+                }
+            }
+
+            // pads the last byte with ones
+            inline void flush() {
+                if (this->count % 8 > 0) {
+                    int padding = 8 - this->count % 8;
+                    this->buffer = (this->buffer << padding) | ((1u << padding) - 1);
+                    this->count += padding;
+                }
+                while (this->count > 0) {
+                    this->count -= 8;
+                    this->put_byte((uint8_t) (this->buffer >> this->count));
+                }
+                this->buffer = 0;
+            }
+
+        private:
+            std::vector<uint8_t> &out;
+            uint64_t buffer = 0;
+            int count = 0;
+
+            inline void put_byte(uint8_t byte) {
+                this->out.push_back(byte);
+
+                // stuff a zero so the byte isn't mistaken for a marker
+                if (byte == 0xFF) {
+                    this->out.push_back(0);
+                }
+            }
+        };
+    }
+
+    static const HuffmanTable DC_LUMINANCE(HUFFMAN_DC_LUMINANCE);
+    static const HuffmanTable DC_CHROMINANCE(HUFFMAN_DC_CHROMINANCE);
+    static const HuffmanTable AC_LUMINANCE(HUFFMAN_AC_LUMINANCE);
+    static const HuffmanTable AC_CHROMINANCE(HUFFMAN_AC_CHROMINANCE);
+
+    struct JPEGEncoder::Tables {
+        bool subsample;
+        size_t mcu_size;
+        size_t mcu_count_x;
+
+        // quantization tables in zig-zag order
+        uint8_t quant_luminance[64];
+        uint8_t quant_chrominance[64];
+
+        // reciprocals of the quantization steps including the DCT scale, in transposed order
+        float scale_luminance[64];
+        float scale_chrominance[64];
+
+        Tables(int quality, bool subsample, size_t width) {
+            this->subsample = subsample;
+            this->mcu_size = subsample ? 16 : 8;
+            this->mcu_count_x = (width + this->mcu_size - 1) / this->mcu_size;
+
+            // scale the default tables like libjpeg does
+            quality = std::clamp(quality, 1, 100);
+            int factor = quality < 50 ? 5000 / quality : 200 - quality * 2;
+            for (int i = 0; i < 64; i++) {
+                this->quant_luminance[i] = (uint8_t) std::clamp(
+                        (QUANT_LUMINANCE[ZIGZAG[i]] * factor + 50) / 100, 1, 255);
+                this->quant_chrominance[i] = (uint8_t) std::clamp(
+                        (QUANT_CHROMINANCE[ZIGZAG[i]] * factor + 50) / 100, 1, 255);
+            }
+
+            // the AAN DCT leaves each coefficient scaled by 8 * s(u) * s(v)
+            static const double PI = 3.14159265358979323846;
+            double aan[8];
+            aan[0] = 1.0;
+            for (int i = 1; i < 8; i++) {
+                aan[i] = std::cos(i * PI / 16) * std::sqrt(2.0);
+            }
+            for (int i = 0; i < 64; i++) {
+                int u = ZIGZAG[i] / 8;
+                int v = ZIGZAG[i] % 8;
+                double dct_scale = 8.0 * aan[u] * aan[v];
+                this->scale_luminance[v * 8 + u] = (float) (1.0 / (this->quant_luminance[i] * dct_scale));
+                this->scale_chrominance[v * 8 + u] = (float) (1.0 / (this->quant_chrominance[i] * dct_scale));
+            }
+        }
+    };
+
+    static inline void write_u16(std::vector<uint8_t> &out, size_t value) {
+        out.push_back((uint8_t) (value >> 8));
+        out.push_back((uint8_t) value);
+    }
+
+    // AAN forward DCT over the rows, which transforms all 8 columns at once
+    static inline void dct(Row *block) {
+        auto tmp0 = block[0] + block[7];
+        auto tmp7 = block[0] - block[7];
+        auto tmp1 = block[1] + block[6];
+        auto tmp6 = block[1] - block[6];
+        auto tmp2 = block[2] + block[5];
+        auto tmp5 = block[2] - block[5];
+        auto tmp3 = block[3] + block[4];
+        auto tmp4 = block[3] - block[4];
+
+        // even part
+        auto tmp10 = tmp0 + tmp3;
+        auto tmp13 = tmp0 - tmp3;
+        auto tmp11 = tmp1 + tmp2;
+        auto tmp12 = tmp1 - tmp2;
+        block[0] = tmp10 + tmp11;
+        block[4] = tmp10 - tmp11;
+        auto z1 = (tmp12 + tmp13) * Row::set(0.707106781f);
+        block[2] = tmp13 + z1;
+        block[6] = tmp13 - z1;
+
+        // odd part
+        tmp10 = tmp4 + tmp5;
+        tmp11 = tmp5 + tmp6;
+        tmp12 = tmp6 + tmp7;
+        auto z5 = (tmp10 - tmp12) * Row::set(0.382683433f);
+        auto z2 = tmp10 * Row::set(0.541196100f) + z5;
+        auto z4 = tmp12 * Row::set(1.306562965f) + z5;
+        auto z3 = tmp11 * Row::set(0.707106781f);
+        auto z11 = tmp7 + z3;
+        auto z13 = tmp7 - z3;
+        block[5] = z13 + z2;
+        block[3] = z13 - z2;
+        block[1] = z11 + z4;
+        block[7] = z11 - z4;
+    }
+
+    static inline void transpose(Row *block) {
+        F4::transpose(block[0].lo, block[1].lo, block[2].lo, block[3].lo);
+        F4::transpose(block[0].hi, block[1].hi, block[2].hi, block[3].hi);
+        F4::transpose(block[4].lo, block[5].lo, block[6].lo, block[7].lo);
+        F4::transpose(block[4].hi, block[5].hi, block[6].hi, block[7].hi);
+        for (int i = 0; i < 4; i++) {
+            std::swap(block[i].hi, block[i + 4].lo);
+        }
+    }
+
+    static inline void encode_block(BitWriter &writer, const float *src, size_t stride, const float *scale,
+            int32_t &dc, const HuffmanTable &dc_table, const HuffmanTable &ac_table) {
+
+        // transform columns, then rows, which leaves the coefficients transposed
+        Row block[8];
+        for (int i = 0; i < 8; i++) {
+            block[i] = Row::load(src + i * stride);
+        }
+        dct(block);
+        transpose(block);
+        dct(block);
+
+        // quantize
+        int32_t coefficients[64];
+        for (int i = 0; i < 8; i++) {
+            (block[i].lo * F4::load(scale + i * 8)).store_rounded(coefficients + i * 8);
+            (block[i].hi * F4::load(scale + i * 8 + 4)).store_rounded(coefficients + i * 8 + 4);
+        }
+
+        // reorder into zig-zag order
+        int32_t values[64];
+        for (int i = 0; i < 64; i++) {
+            values[i] = coefficients[(ZIGZAG[i] % 8) * 8 + ZIGZAG[i] / 8];
+        }
+
+        // DC is coded as difference to the previous block
+        auto encode_value = [&writer] (const HuffmanTable &table, int symbol_base, int32_t value) {
+            auto magnitude = (uint32_t) (value < 0 ? -value : value);
+            int size = (int) std::bit_width(magnitude);
+            writer.put(table.codes[symbol_base | size], table.lengths[symbol_base | size]);
+            if (size > 0) {
+                writer.put((uint32_t) (value < 0 ? value - 1 : value) & ((1u << size) - 1), size);
+            }
+        };
+        encode_value(dc_table, 0, values[0] - dc);
+        dc = values[0];
+
+        // AC as run length of zeros followed by the value
+        int last = 63;
+        while (last > 0 && values[last] == 0) {
+            last--;
+        }
+        int run = 0;
+        for (int i = 1; i <= last; i++) {
+            if (values[i] == 0) {
+                run++;
+                continue;
+            }
+            while (run >= 16) {
+                writer.put(ac_table.codes[0xF0], ac_table.lengths[0xF0]);
+                run -= 16;
+            }
+            encode_value(ac_table, run << 4, values[i]);
+            run = 0;
+        }
+
+        // end of block
+        if (last < 63) {
+            writer.put(ac_table.codes[0x00], ac_table.lengths[0x00]);
+        }
+    }
+
+    bool JPEGEncoder::encode(std::vector<uint8_t> &out, const uint8_t *rgb, size_t width, size_t height,
+            int quality, bool subsample) {
+        if (rgb == nullptr || width == 0 || height == 0 || width > 0xFFFF || height > 0xFFFF) {
+            return false;
+        }
+        Tables tables(quality, subsample, width);
+        size_t mcu_rows = (height + tables.mcu_size - 1) / tables.mcu_size;
+
+        // split the rows into strips, a few more than workers for balancing
+        size_t thread_count = encoder_worker_count() + 1;
+        size_t strip_count = std::clamp(mcu_rows / strip_min_rows, (size_t) 1, thread_count * 4);
+        this->strips.resize(strip_count);
+
+        // encode strips, the calling thread helps out
+        std::atomic<size_t> next_strip = 0;
+        auto worker = [&] {
+            size_t strip;
+            while ((strip = next_strip++) < strip_count) {
+                this->encode_strip(tables, rgb, width, height,
+                        mcu_rows * strip / strip_count,
+                        mcu_rows * (strip + 1) / strip_count,
+                        this->strips[strip]);
+            }
+        };
+        std::vector<std::future<void>> futures;
+        for (size_t i = 0; i < std::min(strip_count, thread_count) - 1; i++) {
+            futures.emplace_back(encoder_worker_pool().add(worker));
+        }
+        worker();
+        for (auto &future : futures) {
+            future.wait();
+        }
+
+        // headers
+        out.clear();
+        size_t size = 1024;
+        for (auto &strip : this->strips) {
+            size += strip.size();
+        }
+        out.reserve(size);
+        out.insert(out.end(), {
+            0xFF, 0xD8,
+            0xFF, 0xE0, 0x00, 0x10, 'J', 'F', 'I', 'F', 0x00, 0x01, 0x01, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00,
+        });
+
+        // quantization tables
+        out.insert(out.end(), { 0xFF, 0xDB, 0x00, 0x84, 0x00 });
+        out.insert(out.end(), tables.quant_luminance, tables.quant_luminance + 64);
+        out.push_back(0x01);
+        out.insert(out.end(), tables.quant_chrominance, tables.quant_chrominance + 64);
+
+        // frame with Y, Cb and Cr
+        out.insert(out.end(), { 0xFF, 0xC0, 0x00, 0x11, 0x08 });
+        write_u16(out, height);
+        write_u16(out, width);
+        out.insert(out.end(), {
+            0x03,
+            0x01, (uint8_t) (subsample ? 0x22 : 0x11), 0x00,
+            0x02, 0x11, 0x01,
+            0x03, 0x11, 0x01,
+        });
+
+        // huffman tables
+        out.insert(out.end(), { 0xFF, 0xC4, 0x01, 0xA2, 0x00 });
+        out.insert(out.end(), HUFFMAN_DC_LUMINANCE, HUFFMAN_DC_LUMINANCE + sizeof(HUFFMAN_DC_LUMINANCE));
+        out.push_back(0x10);
+        out.insert(out.end(), HUFFMAN_AC_LUMINANCE, HUFFMAN_AC_LUMINANCE + sizeof(HUFFMAN_AC_LUMINANCE));
+        out.push_back(0x01);
+        out.insert(out.end(), HUFFMAN_DC_CHROMINANCE, HUFFMAN_DC_CHROMINANCE + sizeof(HUFFMAN_DC_CHROMINANCE));
+        out.push_back(0x11);
+        out.insert(out.end(), HUFFMAN_AC_CHROMINANCE, HUFFMAN_AC_CHROMINANCE + sizeof(HUFFMAN_AC_CHROMINANCE));
+
+        // restart interval of one MCU row
+        out.insert(out.end(), { 0xFF, 0xDD, 0x00, 0x04 });
+        write_u16(out, tables.mcu_count_x);
+
+        // scan
+        out.insert(out.end(), {
+            0xFF, 0xDA, 0x00, 0x0C, 0x03,
+            0x01, 0x00,
+            0x02, 0x11,
+            0x03, 0x11,
+            0x00, 0x3F, 0x00,
+        });
+        for (auto &strip : this->strips) {
+            out.insert(out.end(), strip.begin(), strip.end());
+        }
+        out.insert(out.end(), { 0xFF, 0xD9 });
+        return true;
+    }
+
+    void JPEGEncoder::encode_strip(const Tables &tables, const uint8_t *rgb, size_t width, size_t height,
+            size_t row_start, size_t row_end, std::vector<uint8_t> &out) {
+
+        // planes of one MCU row, padded to whole MCUs
+        size_t mcu_size = tables.mcu_size;
+        size_t plane_width = tables.mcu_count_x * mcu_size;
+        size_t chroma_width = tables.subsample ? plane_width / 2 : plane_width;
+        static thread_local std::vector<float> R, G, B, Y, CB, CR;
+        R.resize(plane_width);
+        G.resize(plane_width);
+        B.resize(plane_width);
+        Y.resize(plane_width * mcu_size);
+        CB.resize(plane_width * mcu_size);
+        CR.resize(plane_width * mcu_size);
+
+        out.clear();
+        BitWriter writer(out);
+        size_t mcu_rows = (height + mcu_size - 1) / mcu_size;
+        for (size_t mcu_row = row_start; mcu_row < row_end; mcu_row++) {
+
+            // convert to YCbCr, repeating the edge pixels to fill the last MCUs
+            for (size_t y = 0; y < mcu_size; y++) {
+                auto src = rgb + std::min(mcu_row * mcu_size + y, height - 1) * width * 3;
+                for (size_t x = 0; x < width; x++) {
+                    R[x] = src[x * 3 + 0];
+                    G[x] = src[x * 3 + 1];
+                    B[x] = src[x * 3 + 2];
+                }
+                std::fill(R.begin() + width, R.end(), R[width - 1]);
+                std::fill(G.begin() + width, G.end(), G[width - 1]);
+                std::fill(B.begin() + width, B.end(), B[width - 1]);
+                for (size_t x = 0; x < plane_width; x += 4) {
+                    auto r = F4::load(&R[x]);
+                    auto g = F4::load(&G[x]);
+                    auto b = F4::load(&B[x]);
+                    auto offset = y * plane_width + x;
+                    (r * F4::set(0.299f) + g * F4::set(0.587f) + b * F4::set(0.114f) - F4::set(128.f))
+                            .store(&Y[offset]);
+                    (b * F4::set(0.5f) - r * F4::set(0.168736f) - g * F4::set(0.331264f)).store(&CB[offset]);
+                    (r * F4::set(0.5f) - g * F4::set(0.418688f) - b * F4::set(0.081312f)).store(&CR[offset]);
+                }
+            }
+
+            // average 2x2 chroma pixels in place
+            if (tables.subsample) {
+                for (size_t y = 0; y < 8; y++) {
+                    for (auto plane : { CB.data(), CR.data() }) {
+                        auto top = plane + y * 2 * plane_width;
+                        auto bottom = top + plane_width;
+                        auto dst = plane + y * chroma_width;
+                        for (size_t x = 0; x < plane_width; x += 8) {
+                            auto left = F4::load(top + x) + F4::load(bottom + x);
+                            auto right = F4::load(top + x + 4) + F4::load(bottom + x + 4);
+                            (F4::pair_sums(left, right) * F4::set(0.25f)).store(dst + x / 2);
+                        }
+                    }
+                }
+            }
+
+            // encode MCUs
+            int32_t dc_y = 0, dc_cb = 0, dc_cr = 0;
+            for (size_t mcu = 0; mcu < tables.mcu_count_x; mcu++) {
+                auto y = &Y[mcu * mcu_size];
+                for (size_t block_y = 0; block_y < mcu_size; block_y += 8) {
+                    for (size_t block_x = 0; block_x < mcu_size; block_x += 8) {
+                        encode_block(writer, y + block_y * plane_width + block_x, plane_width,
+                                tables.scale_luminance, dc_y, DC_LUMINANCE, AC_LUMINANCE);
+                    }
+                }
+                encode_block(writer, &CB[mcu * 8], chroma_width,
+                        tables.scale_chrominance, dc_cb, DC_CHROMINANCE, AC_CHROMINANCE);
+                encode_block(writer, &CR[mcu * 8], chroma_width,
+                        tables.scale_chrominance, dc_cr, DC_CHROMINANCE, AC_CHROMINANCE);
+            }
+
+            // end of restart interval
+            writer.flush();
+            if (mcu_row + 1 < mcu_rows) {
+                out.push_back(0xFF);
+                out.push_back((uint8_t) (0xD0 + (mcu_row & 7)));
+            }
+        }
+    }
+}
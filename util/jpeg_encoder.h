@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace util {
+
+    /*
+     * Baseline JPEG encoder for RGB24 images.
+     *
+     * Every row of MCUs is its own restart interval, so strips of rows get encoded independently
+     * on the shared worker threads and are joined with restart markers afterwards.
+     * The result is a standard baseline JFIF which any decoder can read.
+     *
+     * An instance keeps its buffers between calls and must not be used by multiple threads at once.
+     */
+    class JPEGEncoder {
+    public:
+
+        /*
+         * Encodes the image into the output buffer, replacing its contents.
+         * Quality is in range [1, 100], subsampling uses YCbCr 4:2:0 instead of 4:4:4.
+         */
+        bool encode(std::vector<uint8_t> &out, const uint8_t *rgb, size_t width, size_t height,
+                int quality = 80, bool subsample = true);
+
+    private:
+
+        // configuration
+        const static size_t strip_min_rows = 2;
+
+        struct Tables;
+
+        std::vector<std::vector<uint8_t>> strips;
+
+        void encode_strip(const Tables &tables, const uint8_t *rgb, size_t width, size_t height,
+                size_t row_start, size_t row_end, std::vector<uint8_t> &out);
+    };
+}
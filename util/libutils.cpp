@@ -4,10 +4,22 @@
 #include <psapi.h>
 #include <shlwapi.h>
 
+#include <mutex>
+#include <unordered_map>
+
 #include "logging.h"
 #include "utils.h"
 #include "peb.h"
 
+// parsed PE files by path
+struct PEImageCacheEntry {
+    uint64_t size = 0;
+    uint64_t time = 0;
+    std::shared_ptr<const util::PEImage> image;
+};
+static std::mutex PE_IMAGE_CACHE_MUTEX;
+static std::unordered_map<std::wstring, PEImageCacheEntry> PE_IMAGE_CACHE;
+
 std::filesystem::path libutils::module_file_name(HMODULE module) {
     std::wstring buf;
     buf.resize(MAX_PATH + 1);
@@ -205,50 +217,11 @@ intptr_t libutils::rva2offset(IMAGE_NT_HEADERS *nt_headers, intptr_t rva) {
 
 
 intptr_t libutils::rva2offset(const std::filesystem::path &path, intptr_t rva) {
-
-    // open file
-    HANDLE dll_file = CreateFileW(
-            path.c_str(),
-            GENERIC_READ,
-            FILE_SHARE_READ,
-            NULL,
-            OPEN_EXISTING,
-            FILE_ATTRIBUTE_NORMAL,
-            0);
-    if (!dll_file) {
-        return ~0;
-    }
-
-    // create file mapping
-    HANDLE dll_mapping = CreateFileMappingW(dll_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
-    if (!dll_mapping) {
-        CloseHandle(dll_file);
-        log_warning("libutils", "could not create file mapping for {}", path.string());
+    auto image = libutils::pe_image(path);
+    if (!image) {
         return -1;
     }
-
-    // map view of file
-    LPVOID dll_file_base = MapViewOfFile(dll_mapping, FILE_MAP_READ, 0, 0, 0);
-    if (!dll_file_base) {
-        CloseHandle(dll_file);
-        CloseHandle(dll_mapping);
-        log_warning("libutils", "could not map view of file for {}", path.string());
-        return -1;
-    }
-
-    // get offset
-    intptr_t offset = -1;
-    auto dll_dos = reinterpret_cast<PIMAGE_DOS_HEADER>(dll_file_base);
-    if (dll_dos->e_magic == IMAGE_DOS_SIGNATURE) {
-        auto dll_nt = reinterpret_cast<PIMAGE_NT_HEADERS>(reinterpret_cast<uint8_t *>(dll_dos) + dll_dos->e_lfanew);
-        offset = libutils::rva2offset(dll_nt, rva);
-    }
-
-    // clean up and return
-    UnmapViewOfFile(dll_file_base);
-    CloseHandle(dll_file);
-    CloseHandle(dll_mapping);
-    return offset;
+    return image->rva2offset(rva);
 }
 
 intptr_t libutils::offset2rva(IMAGE_NT_HEADERS *nt_headers, intptr_t offset) {
@@ -276,6 +249,30 @@ intptr_t libutils::offset2rva(IMAGE_NT_HEADERS *nt_headers, intptr_t offset) {
 }
 
 intptr_t libutils::offset2rva(const std::filesystem::path &path, intptr_t offset) {
+    auto image = libutils::pe_image(path);
+    if (!image) {
+        return -1;
+    }
+    return image->offset2rva(offset);
+}
+
+std::shared_ptr<const util::PEImage> libutils::pe_image(const std::filesystem::path &path) {
+
+    // get file identity
+    WIN32_FILE_ATTRIBUTE_DATA attributes {};
+    if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &attributes)) {
+        return nullptr;
+    }
+    auto size = (static_cast<uint64_t>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+    auto time = (static_cast<uint64_t>(attributes.ftLastWriteTime.dwHighDateTime) << 32)
+            | attributes.ftLastWriteTime.dwLowDateTime;
+
+    // check cache
+    std::lock_guard<std::mutex> lock(PE_IMAGE_CACHE_MUTEX);
+    auto &entry = PE_IMAGE_CACHE[path.wstring()];
+    if (entry.image && entry.size == size && entry.time == time) {
+        return entry.image;
+    }
 
     // open file
     HANDLE dll_file = CreateFileW(
@@ -286,8 +283,8 @@ intptr_t libutils::offset2rva(const std::filesystem::path &path, intptr_t offset
             OPEN_EXISTING,
             FILE_ATTRIBUTE_NORMAL,
             0);
-    if (!dll_file) {
-        return -1;
+    if (dll_file == INVALID_HANDLE_VALUE) {
+        return nullptr;
     }
 
     // create file mapping
@@ -295,7 +292,7 @@ intptr_t libutils::offset2rva(const std::filesystem::path &path, intptr_t offset
     if (!dll_mapping) {
         log_warning("libutils", "could not create file mapping for {}: {}", path.string(), get_last_error_string());
         CloseHandle(dll_file);
-        return -1;
+        return nullptr;
     }
 
     // map view of file
@@ -304,21 +301,25 @@ intptr_t libutils::offset2rva(const std::filesystem::path &path, intptr_t offset
         log_warning("libutils", "could not map view of file for {}: {}", path.string(), get_last_error_string());
         CloseHandle(dll_file);
         CloseHandle(dll_mapping);
-        return -1;
+        return nullptr;
     }
 
-    // get RVA
-    intptr_t rva = -1;
-    auto dll_dos = reinterpret_cast<PIMAGE_DOS_HEADER>(dll_file_base);
-    if (dll_dos->e_magic == IMAGE_DOS_SIGNATURE) {
-        auto dll_nt = reinterpret_cast<PIMAGE_NT_HEADERS>(reinterpret_cast<uint8_t *>(dll_dos) + dll_dos->e_lfanew);
-        rva = libutils::offset2rva(dll_nt, offset);
-    }
+    // parse headers, only touching the pages they are on
+    auto image = util::PEImage::parse(reinterpret_cast<const uint8_t *>(dll_file_base), static_cast<size_t>(size));
 
     // clean up
     UnmapViewOfFile(dll_file_base);
     CloseHandle(dll_file);
     CloseHandle(dll_mapping);
 
-    return rva;
+    // remember image
+    if (!image) {
+        log_warning("libutils", "could not parse PE headers of {}", path.string());
+        PE_IMAGE_CACHE.erase(path.wstring());
+        return nullptr;
+    }
+    entry.size = size;
+    entry.time = time;
+    entry.image = std::make_shared<const util::PEImage>(std::move(*image));
+    return entry.image;
 }
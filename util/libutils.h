@@ -2,10 +2,13 @@
 
 #include <filesystem>
 #include <initializer_list>
+#include <memory>
 #include <string>
 
 #include <windows.h>
 
+#include "util/peimage.h"
+
 namespace libutils {
 
     // loaded module handle helpers
@@ -74,4 +77,7 @@ namespace libutils {
     intptr_t rva2offset(const std::filesystem::path &path, intptr_t rva);
     intptr_t offset2rva(IMAGE_NT_HEADERS *nt_headers, intptr_t offset);
     intptr_t offset2rva(const std::filesystem::path &path, intptr_t offset);
+
+    // parsed PE file, cached until the file changes
+    std::shared_ptr<const util::PEImage> pe_image(const std::filesystem::path &path);
 }
@@ -6,6 +6,13 @@ std::string_view log_get_datetime() {
 
 std::string_view log_get_datetime(std::time_t now) {
     static thread_local char buf[64];
+    static thread_local std::time_t buf_time = -1;
+
+    // the logging thread formats many lines per second
+    if (now == buf_time) {
+        return buf;
+    }
+    buf_time = now;
 
     // `localtime` on Windows is thread-safe
     strftime(buf, sizeof(buf), "[%Y/%m/%d %X]", localtime(&now));
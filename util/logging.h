@@ -71,15 +71,23 @@ struct fmt::formatter<fmt_hresult> {
     }
 };
 
+// hresults are copied into log records as is
+template<>
+struct logger::record_raw<fmt_hresult> : std::true_type {};
+
 // misc log
 #define LOG_FORMAT(level, module, fmt_str, ...) fmt::format(FMT_COMPILE("{}" fmt_str "\n"), \
     fmt_log { std::time(nullptr), level, module }, ## __VA_ARGS__)
-#define log_misc(module, format_str, ...) logger::push( \
-    LOG_FORMAT("M", module, format_str, ## __VA_ARGS__), logger::Style::GREY)
-#define log_info(module, format_str, ...) logger::push( \
-    LOG_FORMAT("I", module, format_str, ## __VA_ARGS__), logger::Style::DEFAULT)
-#define log_warning(module, format_str, ...) logger::push( \
-    LOG_FORMAT("W", module, format_str, ## __VA_ARGS__), logger::Style::YELLOW)
+#define LOG_DEFERRED(level, style, module, fmt_str, ...) logger::push_deferred( \
+    [] (std::string &out, std::time_t ts, std::string_view log_module, const auto &... log_args) { \
+        out = fmt::format(FMT_COMPILE("{}" fmt_str "\n"), fmt_log { ts, level, log_module }, log_args...); \
+    }, style, module, ## __VA_ARGS__)
+#define log_misc(module, format_str, ...) \
+    LOG_DEFERRED("M", logger::Style::GREY, module, format_str, ## __VA_ARGS__)
+#define log_info(module, format_str, ...) \
+    LOG_DEFERRED("I", logger::Style::DEFAULT, module, format_str, ## __VA_ARGS__)
+#define log_warning(module, format_str, ...) \
+    LOG_DEFERRED("W", logger::Style::YELLOW, module, format_str, ## __VA_ARGS__)
 #define log_fatal(module, format_str, ...) { \
     logger::push(LOG_FORMAT("F", module, format_str, ## __VA_ARGS__), logger::Style::RED); \
     \
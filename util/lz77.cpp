@@ -1,19 +1,10 @@
 #include "lz77.h"
+
+#include <algorithm>
 #include <cstdlib>
 
 namespace util::lz77 {
 
-    /*
-     * Configuration Values
-     */
-    static const size_t LZ_WINDOW_SIZE = 0x1000;
-    static const size_t LZ_WINDOW_MASK = LZ_WINDOW_SIZE - 1;
-    static const size_t LZ_THRESHOLD = 3;
-    static const size_t LZ_THRESHOLD_INPLACE = 0xA;
-    static const size_t LZ_LOOK_RANGE = 0x200;
-    static const size_t LZ_MAX_LEN = 0xF + LZ_THRESHOLD;
-    static const size_t LZ_MAX_BUFFER = 0x10 + 1;
-
     /*
      * Dummy Compression
      * Results in even bigger output size but is fast af.
@@ -54,207 +45,301 @@ namespace util::lz77 {
     }
 
     /*
-     * Compression Helpers
+     * Compressor
      */
 
-    static size_t match_current(uint8_t *window, size_t pos, size_t length_max,
-            uint8_t *data, uint8_t data_length, size_t data_pos) {
-
-        // compare data
-        size_t length = 0;
-        while ((data_pos + length < data_length) &&
-               (length < length_max) &&
-               (window[(pos + length) & LZ_WINDOW_MASK] == data[data_pos + length] &&
-                length < LZ_MAX_LEN)) {
-            length++;
-        }
-
-        // return detected length
-        return length;
+    static inline size_t hash_bytes(const uint8_t *data, size_t bits) {
+        uint32_t value = data[0] | (data[1] << 8) | (data[2] << 16);
+        return (value * 2654435761u) >> (32 - bits);
     }
 
-    static bool match_window(uint8_t *window, size_t pos, uint8_t *data, size_t data_length, size_t data_pos,
-            size_t *match_pos, size_t *match_length) {
+    Compressor::Compressor() : head(1 << hash_bits, 0), chain(WINDOW_SIZE, 0) {
+    }
 
-        // search window for best match
-        size_t pos_max = 0, length_max = 0;
-        for (size_t i = LZ_THRESHOLD; i < LZ_LOOK_RANGE; i++) {
+    Compressor::Match Compressor::find(size_t pos, size_t end) const {
+        Match best;
+        if (end - pos < MIN_LENGTH) {
+            return best;
+        }
 
-            // check for match
-            size_t length = match_current(window, (pos - i) & LZ_WINDOW_MASK, i, data, data_length, data_pos);
+        // walk the chain of previous positions with the same hash
+        const uint8_t *current = &this->data[pos - this->data_base];
+        size_t length_max = std::min(MAX_LENGTH, end - pos);
+        size_t candidate = this->head[hash_bytes(current, hash_bits)];
+        for (size_t steps = 0; candidate != 0 && steps < chain_max; steps++) {
+            size_t candidate_pos = candidate - 1;
+            size_t distance = pos - candidate_pos;
+            if (distance > MAX_DISTANCE) {
+                break;
+            }
 
-            // check if threshold is reached
-            if (length >= LZ_THRESHOLD_INPLACE) {
-                *match_pos = i;
-                *match_length = length;
-                return true;
+            // compare, overlapping the current position is fine for the decoder
+            const uint8_t *previous = current - distance;
+            if (previous[best.length] == current[best.length]) {
+                size_t length = 0;
+                while (length < length_max && previous[length] == current[length]) {
+                    length++;
+                }
+                if (length > best.length) {
+                    best.length = length;
+                    best.distance = distance;
+                    if (length == length_max) {
+                        break;
+                    }
+                }
             }
 
-            // update max values
-            if (length >= LZ_THRESHOLD) {
-                pos_max = i;
-                length_max = length;
+            // slots get reused after a full window, stale entries point forward
+            size_t next = this->chain[candidate_pos & (WINDOW_SIZE - 1)];
+            if (next >= candidate) {
+                break;
             }
+            candidate = next;
         }
 
-        // check if threshold is reached
-        if (length_max >= LZ_THRESHOLD) {
-            *match_pos = pos_max;
-            *match_length = length_max;
-            return true;
-        } else {
-            return false;
+        // short matches don't pay off
+        if (best.length < MIN_LENGTH) {
+            return Match();
         }
+        return best;
     }
 
-    /*
-     * This one actually compresses the data.
-     */
-    std::vector<uint8_t> compress(uint8_t *input, size_t input_length) {
-
-        // output buffer
-        std::vector<uint8_t> output;
-        output.reserve(input_length);
-
-        // window buffer
-        uint8_t *window = new uint8_t[LZ_WINDOW_SIZE];
-        size_t window_pos = 0;
-
-        // working buffer
-        uint8_t *buffer = new uint8_t[LZ_MAX_BUFFER];
-        size_t buffer_pos = 0;
-
-        // state
-        uint8_t flag;
-        size_t pad = 3;
+    void Compressor::insert(size_t pos, size_t end) {
+        if (end - pos >= MIN_LENGTH) {
+            size_t &slot = this->head[hash_bytes(&this->data[pos - this->data_base], hash_bits)];
+            this->chain[pos & (WINDOW_SIZE - 1)] = slot;
+            slot = pos + 1;
+        }
+    }
 
-        // iterate input bytes
-        size_t input_pos = 0;
-        while (input_pos < input_length) {
+    void Compressor::emit_literal(uint8_t value, std::vector<uint8_t> &output) {
+        this->group[0] |= 1 << this->group_items;
+        this->group[this->group_length++] = value;
+        if (++this->group_items == 8) {
+            output.insert(output.end(), this->group, this->group + this->group_length);
+            this->group[0] = 0;
+            this->group_length = 1;
+            this->group_items = 0;
+        }
+    }
 
-            // reset state
-            flag = 0;
-            buffer_pos = 0;
+    void Compressor::emit_word(size_t word, std::vector<uint8_t> &output) {
+        this->group[this->group_length++] = (uint8_t) (word >> 8);
+        this->group[this->group_length++] = (uint8_t) word;
+        if (++this->group_items == 8) {
+            output.insert(output.end(), this->group, this->group + this->group_length);
+            this->group[0] = 0;
+            this->group_length = 1;
+            this->group_items = 0;
+        }
+    }
 
-            // iterate flag bytes
-            for (size_t bit_pos = 0; bit_pos < 8; bit_pos++) {
+    void Compressor::encode(size_t limit, size_t end, std::vector<uint8_t> &output) {
+        while (this->position < limit) {
+            size_t pos = this->position;
+
+            // match at the current position, possibly known from the last step
+            Match match = this->lazy_valid ? this->lazy : this->find(pos, end);
+            this->lazy_valid = false;
+            this->insert(pos, end);
+            if (match.length == 0) {
+                this->emit_literal(this->data[pos - this->data_base], output);
+                this->position++;
+                continue;
+            }
 
-                // don't match if data is bigger than input
-                if (input_pos >= input_length) {
-                    pad = 0;
-                    flag = flag >> (8 - bit_pos);
-                    buffer[buffer_pos++] = 0;
-                    buffer[buffer_pos++] = 0;
+            // lazy matching: prefer a literal if the next position has a longer match
+            if (match.length < MAX_LENGTH && pos + 1 < end) {
+                Match next = this->find(pos + 1, end);
+                if (next.length > match.length) {
+                    this->emit_literal(this->data[pos - this->data_base], output);
+                    this->lazy = next;
+                    this->lazy_valid = true;
+                    this->position++;
+                    continue;
                 }
+            }
 
-                // match window
-                uint8_t bit_value;
-                size_t match_pos, match_length;
-                if (match_window(window, window_pos, input, input_length, input_pos, &match_pos, &match_length)) {
-
-                    // apply match
-                    buffer[buffer_pos++] = match_pos >> 4;
-                    buffer[buffer_pos++] = ((match_pos & 0xF) << 4) | ((match_length - LZ_THRESHOLD) & 0xF);
-                    bit_value = 0;
-                    for (size_t n = 0; n < match_length; n++) {
-                        window[window_pos++ & LZ_WINDOW_MASK] = input[input_pos++];
-                    }
+            // emit match
+            this->emit_word((match.distance << 4) | (match.length - MIN_LENGTH), output);
+            for (size_t i = 1; i < match.length; i++) {
+                this->insert(pos + i, end);
+            }
+            this->position += match.length;
+        }
+    }
 
-                } else {
+    void Compressor::write(const uint8_t *input, size_t input_length, std::vector<uint8_t> &output) {
+        this->data.insert(this->data.end(), input, input + input_length);
+        output.reserve(output.size() + input_length + input_length / 8 + 1);
 
-                    // no match found
-                    buffer[buffer_pos++] = input[input_pos];
-                    window[window_pos++] = input[input_pos++];
-                    bit_value = 1;
-                }
+        // keep enough lookahead for the longest match of the next position
+        size_t end = this->data_base + this->data.size();
+        if (end > this->position + MAX_LENGTH + 1) {
+            this->encode(end - MAX_LENGTH - 1, end, output);
+        }
 
-                // add bit to flags
-                flag = (flag >> 1) & 0x7F;
-                flag |= bit_value == 0 ? 0 : 0x80;
+        // drop history which can't be referenced anymore
+        if (this->position - this->data_base > slide_threshold + WINDOW_SIZE) {
+            size_t drop = this->position - this->data_base - WINDOW_SIZE;
+            this->data.erase(this->data.begin(), this->data.begin() + drop);
+            this->data_base += drop;
+        }
+    }
 
-                // update window
-                window_pos &= LZ_WINDOW_MASK;
-            }
+    void Compressor::finish(std::vector<uint8_t> &output) {
+        size_t end = this->data_base + this->data.size();
+        this->encode(end, end, output);
 
-            // write to output
-            output.push_back(flag);
-            for (size_t i = 0; i < buffer_pos; i++) {
-                output.push_back(buffer[i]);
+        // end marker, an empty group with it when aligned
+        if (this->group_items == 0) {
+            output.insert(output.end(), { 0x00, 0x00, 0x00 });
+        } else {
+            this->emit_word(0, output);
+            if (this->group_items > 0) {
+                output.insert(output.end(), this->group, this->group + this->group_length);
             }
         }
 
-        // padding
-        for (size_t i = 0; i < pad; i++) {
-            output.push_back(0x00);
-        }
-
-        // clean up and return result
-        delete[] window;
-        delete[] buffer;
-        return output;
+        // reset
+        *this = Compressor();
     }
 
-    std::vector<uint8_t> decompress(uint8_t *input, size_t input_length) {
-
-        // output buffer
+    std::vector<uint8_t> compress(const uint8_t *input, size_t input_length) {
         std::vector<uint8_t> output;
-        output.reserve(input_length);
+        Compressor compressor;
+        compressor.write(input, input_length, output);
+        compressor.finish(output);
+        return output;
+    }
 
-        // create window
-        uint8_t *window = new uint8_t[LZ_WINDOW_SIZE];
-        size_t window_pos = 0;
+    /*
+     * Decompressor
+     */
 
-        // iterate input data
+    size_t decompress(const uint8_t *input, size_t input_length, uint8_t *output, size_t output_length) {
         size_t input_pos = 0;
+        size_t output_pos = 0;
         while (input_pos < input_length) {
-
-            // read flag
             uint8_t flag = input[input_pos++];
-
-            // iterate flag bits
             for (size_t bit_pos = 0; bit_pos < 8; bit_pos++) {
-
-                // check flag bit
                 if ((flag >> bit_pos) & 1) {
 
-                    // copy data from input
-                    output.push_back(input[input_pos]);
-                    window[window_pos++] = input[input_pos++];
-                    window_pos &= LZ_WINDOW_MASK;
+                    // literal
+                    if (input_pos >= input_length || output_pos >= output_length) {
+                        return output_pos;
+                    }
+                    output[output_pos++] = input[input_pos++];
 
-                } else if (input_pos + 1 < input_length) {
+                } else {
 
-                    // check word
+                    // match word
+                    if (input_pos + 1 >= input_length) {
+                        return output_pos;
+                    }
                     size_t word = (input[input_pos] << 8) | input[input_pos + 1];
+                    input_pos += 2;
                     if (word == 0) {
+                        return output_pos;
+                    }
+
+                    // copy from the output, data before the start reads as zero
+                    size_t distance = word >> 4;
+                    size_t length = std::min((word & 0x0F) + MIN_LENGTH, output_length - output_pos);
+                    size_t i = 0;
+                    for (; i < length && distance > output_pos + i; i++) {
+                        output[output_pos + i] = 0;
+                    }
+                    for (; i < length; i++) {
+                        output[output_pos + i] = output[output_pos + i - distance];
+                    }
+                    output_pos += length;
+                    if (output_pos >= output_length) {
+                        return output_pos;
+                    }
+                }
+            }
+        }
+        return output_pos;
+    }
 
-                        // detected end
-                        delete[] window;
-                        return output;
+    void Decompressor::flush(std::vector<uint8_t> &output) {
+        size_t start = (this->window_pos - this->window_pending) & (WINDOW_SIZE - 1);
+        if (start + this->window_pending > WINDOW_SIZE) {
+            output.insert(output.end(), this->window + start, this->window + WINDOW_SIZE);
+            output.insert(output.end(), this->window, this->window + this->window_pos);
+        } else {
+            output.insert(output.end(), this->window + start, this->window + start + this->window_pending);
+        }
+        this->window_pending = 0;
+    }
 
-                    } else {
+    inline void Decompressor::put(uint8_t value, std::vector<uint8_t> &output) {
+        this->window[this->window_pos] = value;
+        this->window_pos = (this->window_pos + 1) & (WINDOW_SIZE - 1);
 
-                        // skip word
-                        input_pos += 2;
+        // flush before the window wraps around unflushed data
+        if (++this->window_pending == WINDOW_SIZE) {
+            this->flush(output);
+        }
+    }
 
-                        // get window
-                        size_t position = (window_pos - (word >> 4)) & LZ_WINDOW_MASK;
-                        size_t length = (word & 0x0F) + LZ_THRESHOLD;
+    size_t Decompressor::write(const uint8_t *input, size_t input_length, std::vector<uint8_t> &output) {
+        size_t input_pos = 0;
+        while (input_pos < input_length && !this->finished) {
+            uint8_t value = input[input_pos++];
+
+            // new group
+            if (this->flag_bits == 0) {
+                this->flag = value;
+                this->flag_bits = 8;
+                continue;
+            }
 
-                        // copy data from window
-                        for (size_t i = 0; i < length; i++) {
-                            uint8_t data = window[position++ & LZ_WINDOW_MASK];
-                            output.push_back(data);
-                            window[window_pos++] = data;
-                            window_pos &= LZ_WINDOW_MASK;
-                        }
-                    }
+            if (this->flag & 1) {
+
+                // literal
+                this->put(value, output);
+
+            } else if (!this->word_pending) {
+
+                // first half of a match word
+                this->word_high = value;
+                this->word_pending = true;
+                continue;
+
+            } else {
+
+                // match word
+                size_t word = (this->word_high << 8) | value;
+                this->word_pending = false;
+                if (word == 0) {
+                    this->finished = true;
+                    break;
+                }
+
+                // copy from the window
+                size_t length = (word & 0x0F) + MIN_LENGTH;
+                size_t position = this->window_pos - (word >> 4);
+                for (size_t i = 0; i < length; i++) {
+                    this->put(this->window[position++ & (WINDOW_SIZE - 1)], output);
                 }
             }
+
+            // next item
+            this->flag >>= 1;
+            this->flag_bits--;
         }
 
-        // clean up and return result
-        delete[] window;
+        this->flush(output);
+        return input_pos;
+    }
+
+    std::vector<uint8_t> decompress(const uint8_t *input, size_t input_length) {
+        std::vector<uint8_t> output;
+        output.reserve(input_length * 2);
+        Decompressor decompressor;
+        decompressor.write(input, input_length, output);
         return output;
     }
 }
@@ -1,11 +1,119 @@
 #pragma once
 
 #include <vector>
+#include <cstddef>
 #include <cstdint>
 
 namespace util::lz77 {
 
+    /*
+     * Stream format
+     * Groups of a flag byte followed by 8 items, bit n of the flag set means item n is a literal byte.
+     * Other items are big endian words with a 12 bit distance and the length minus 3 in the low nibble.
+     * A zero word marks the end.
+     */
+    const static size_t WINDOW_SIZE = 0x1000;
+    const static size_t MIN_LENGTH = 3;
+    const static size_t MAX_LENGTH = 0xF + MIN_LENGTH;
+    const static size_t MAX_DISTANCE = WINDOW_SIZE - 1;
+
     uint8_t *compress_stub(uint8_t *input, size_t input_length, size_t *compressed_length);
-    std::vector<uint8_t> compress(uint8_t *input, size_t input_length);
-    std::vector<uint8_t> decompress(uint8_t *input, size_t input_length);
+    std::vector<uint8_t> compress(const uint8_t *input, size_t input_length);
+    std::vector<uint8_t> decompress(const uint8_t *input, size_t input_length);
+
+    /*
+     * Decompresses into a buffer of known size and returns the amount of bytes written.
+     * Stops early when the buffer is full.
+     */
+    size_t decompress(const uint8_t *input, size_t input_length, uint8_t *output, size_t output_length);
+
+    /*
+     * Incremental compressor using hash chains and lazy matching.
+     * Matches can reference data of previous writes, so the output equals a single compress call.
+     */
+    class Compressor {
+    public:
+
+        Compressor();
+
+        /*
+         * Appends the compressed data for as much of the input as can be decided yet.
+         */
+        void write(const uint8_t *input, size_t input_length, std::vector<uint8_t> &output);
+
+        /*
+         * Appends the remaining data and the end marker.
+         */
+        void finish(std::vector<uint8_t> &output);
+
+    private:
+
+        // configuration
+        const static size_t hash_bits = 13;
+        const static size_t chain_max = 48;
+        const static size_t slide_threshold = 0x10000;
+
+        struct Match {
+            size_t length = 0;
+            size_t distance = 0;
+        };
+
+        // window history followed by pending input
+        std::vector<uint8_t> data;
+        size_t data_base = 0;
+        size_t position = 0;
+
+        // most recent position + 1 per hash, and the previous one per window slot
+        std::vector<size_t> head;
+        std::vector<size_t> chain;
+
+        // match of the next position found by the lazy evaluation
+        Match lazy;
+        bool lazy_valid = false;
+
+        // current group
+        uint8_t group[1 + 8 * 2] {};
+        size_t group_length = 1;
+        size_t group_items = 0;
+
+        Match find(size_t pos, size_t end) const;
+        void insert(size_t pos, size_t end);
+        void emit_literal(uint8_t value, std::vector<uint8_t> &output);
+        void emit_word(size_t word, std::vector<uint8_t> &output);
+        void encode(size_t limit, size_t end, std::vector<uint8_t> &output);
+    };
+
+    /*
+     * Incremental decompressor for data arriving in chunks.
+     */
+    class Decompressor {
+    public:
+
+        /*
+         * Appends the decompressed data of the chunk.
+         * Returns the amount of input bytes used, which is less than the length only after the end marker.
+         */
+        size_t write(const uint8_t *input, size_t input_length, std::vector<uint8_t> &output);
+
+        inline bool is_finished() const {
+            return this->finished;
+        }
+
+    private:
+
+        // output history, also staging the output until flushed
+        uint8_t window[WINDOW_SIZE] {};
+        size_t window_pos = 0;
+        size_t window_pending = 0;
+
+        // parser state
+        uint8_t flag = 0;
+        size_t flag_bits = 0;
+        uint8_t word_high = 0;
+        bool word_pending = false;
+        bool finished = false;
+
+        void flush(std::vector<uint8_t> &output);
+        void put(uint8_t value, std::vector<uint8_t> &output);
+    };
 }
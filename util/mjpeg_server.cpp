@@ -0,0 +1,242 @@
+#include "mjpeg_server.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+
+namespace util {
+
+    static const char *STREAM_HEADER =
+            "HTTP/1.0 200 OK\r\n"
+            "Content-Type: multipart/x-mixed-replace; boundary=frame\r\n"
+            "Cache-Control: no-cache\r\n"
+            "Connection: close\r\n"
+            "\r\n";
+
+    static int hex_value(char c) {
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            return c - 'A' + 10;
+        }
+        return -1;
+    }
+
+    static std::string url_decode(std::string_view value) {
+        std::string result;
+        result.reserve(value.size());
+        for (size_t i = 0; i < value.size(); i++) {
+            if (value[i] == '%' && i + 2 < value.size()
+            && hex_value(value[i + 1]) >= 0 && hex_value(value[i + 2]) >= 0) {
+                result += (char) (hex_value(value[i + 1]) << 4 | hex_value(value[i + 2]));
+                i += 2;
+            } else if (value[i] == '+') {
+                result += ' ';
+            } else {
+                result += value[i];
+            }
+        }
+        return result;
+    }
+
+    MJPEGServer::MJPEGServer(size_t channel_count, std::string password)
+        : channel_count(channel_count),
+          channels(new Channel[channel_count]),
+          password(std::move(password)),
+          server(server_worker_count, server_receive_buffer_size, server_send_buffer_max_size)
+    {
+        this->server.on_connect = [this] (SocketServer::Connection &connection) {
+            return this->connection_open(connection);
+        };
+        this->server.on_receive = [this] (SocketServer::Connection &connection, char *data, size_t size) {
+            this->connection_receive(connection, data, size);
+        };
+        this->server.on_disconnect = [this] (SocketServer::Connection &connection) {
+            this->connection_close(connection);
+        };
+        this->server.on_tick = [this] (SocketServer::Connection &connection) {
+            return this->connection_tick(connection);
+        };
+    }
+
+    MJPEGServer::~MJPEGServer() {
+        this->stop();
+    }
+
+    bool MJPEGServer::listen(uint16_t port, int backlog, bool external) {
+        return this->server.listen(port, backlog, external);
+    }
+
+    void MJPEGServer::close_listener() {
+        this->server.close_listener();
+    }
+
+    void MJPEGServer::stop() {
+        this->server.stop();
+    }
+
+    void MJPEGServer::publish(size_t channel, Frame frame) {
+        if (channel >= this->channel_count) {
+            return;
+        }
+
+        if (!frame) {
+            return;
+        }
+
+        // build the part once for all subscribers
+        auto header = "--frame\r\nContent-Type: image/jpeg\r\nContent-Length: "
+                + std::to_string(frame->size()) + "\r\n\r\n";
+        auto part = std::make_shared<std::vector<char>>();
+        part->reserve(header.size() + frame->size() + 2);
+        part->insert(part->end(), header.begin(), header.end());
+        part->insert(part->end(), frame->begin(), frame->end());
+        part->push_back('\r');
+        part->push_back('\n');
+
+        // replace the current part and let the subscribers pick it up
+        auto &target = this->channels[channel];
+        std::lock_guard<std::mutex> lock(target.frame_m);
+        target.part = std::move(part);
+        target.sequence++;
+        for (auto &wakeup : target.wakeups) {
+            this->server.wake(*wakeup);
+        }
+    }
+
+    bool MJPEGServer::connection_open(SocketServer::Connection &connection) {
+        connection.user = new Client();
+        return true;
+    }
+
+    void MJPEGServer::connection_receive(SocketServer::Connection &connection, char *data, size_t size) {
+        auto client = reinterpret_cast<Client *>(connection.user);
+
+        // anything after the request is ignored
+        if (client->channel >= 0 || connection.close_on_flush) {
+            return;
+        }
+
+        // buffer until the header is complete
+        client->request.append(data, size);
+        if (client->request.find("\r\n\r\n") == std::string::npos) {
+            if (client->request.size() > request_max_size) {
+                connection.close = true;
+            }
+            return;
+        }
+
+        this->process_request(connection, *client);
+    }
+
+    void MJPEGServer::connection_close(SocketServer::Connection &connection) {
+        auto client = reinterpret_cast<Client *>(connection.user);
+
+        // unsubscribe
+        if (client->channel >= 0) {
+            auto &channel = this->channels[client->channel];
+            std::lock_guard<std::mutex> lock(channel.frame_m);
+            auto &wakeups = channel.wakeups;
+            wakeups.erase(std::find(wakeups.begin(), wakeups.end(), connection.wakeup));
+            channel.subscribers--;
+        }
+
+        delete client;
+        connection.user = nullptr;
+    }
+
+    int MJPEGServer::connection_tick(SocketServer::Connection &connection) {
+        auto client = reinterpret_cast<Client *>(connection.user);
+
+        // wait for the request
+        if (client->channel < 0) {
+            return -1;
+        }
+
+        // drop frames while the previous one is still being sent
+        if (connection.out_size > 0) {
+            return send_poll_ms;
+        }
+
+        // get the latest part
+        SocketServer::SharedBuffer part;
+        auto &channel = this->channels[client->channel];
+        {
+            std::lock_guard<std::mutex> lock(channel.frame_m);
+            if (channel.sequence == client->sequence || !channel.part) {
+                return -1;
+            }
+            part = channel.part;
+            client->sequence = channel.sequence;
+        }
+
+        // send, check back for a newer frame once it's out
+        this->server.send(connection, std::move(part));
+        return connection.out_size > 0 ? send_poll_ms : -1;
+    }
+
+    void MJPEGServer::process_request(SocketServer::Connection &connection, Client &client) {
+
+        // parse request line
+        std::string_view request(client.request);
+        request = request.substr(0, request.find("\r\n"));
+        if (request.substr(0, 4) != "GET ") {
+            return this->send_status(connection, "405 Method Not Allowed");
+        }
+        request.remove_prefix(4);
+        auto target = request.substr(0, request.find(' '));
+        auto query_start = target.find('?');
+        auto path = target.substr(0, query_start);
+        auto query = query_start == std::string_view::npos ? std::string_view() : target.substr(query_start + 1);
+
+        // get channel from path
+        size_t channel = 0;
+        if (path.empty() || path[0] != '/' || path.size() > 4) {
+            return this->send_status(connection, "404 Not Found");
+        }
+        for (auto c : path.substr(1)) {
+            if (c < '0' || c > '9') {
+                return this->send_status(connection, "404 Not Found");
+            }
+            channel = channel * 10 + (c - '0');
+        }
+        if (channel >= this->channel_count) {
+            return this->send_status(connection, "404 Not Found");
+        }
+
+        // check password
+        std::string password;
+        while (!query.empty()) {
+            auto param = query.substr(0, query.find('&'));
+            query.remove_prefix(std::min(query.size(), param.size() + 1));
+            if (param.substr(0, 9) == "password=") {
+                password = url_decode(param.substr(9));
+            }
+        }
+        if (password != this->password) {
+            return this->send_status(connection, "403 Forbidden");
+        }
+
+        // subscribe
+        client.request.clear();
+        client.request.shrink_to_fit();
+        client.channel = (int) channel;
+        {
+            std::lock_guard<std::mutex> lock(this->channels[channel].frame_m);
+            this->channels[channel].wakeups.push_back(this->server.get_wakeup(connection));
+            this->channels[channel].subscribers++;
+        }
+        this->server.send(connection, STREAM_HEADER, strlen(STREAM_HEADER));
+    }
+
+    void MJPEGServer::send_status(SocketServer::Connection &connection, const char *status) {
+        char response[256];
+        auto size = snprintf(response, sizeof(response),
+                "HTTP/1.0 %s\r\nContent-Length: 0\r\nConnection: close\r\n\r\n", status);
+        this->server.send(connection, response, size);
+        connection.close_on_flush = true;
+    }
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "socket_server.h"
+
+namespace util {
+
+    /*
+     * Serves JPEG frames as multipart MJPEG streams over HTTP.
+     *
+     * Frames are published once per channel and wrapped into a single multipart buffer,
+     * which all of its subscribers send from without copying it.
+     * A subscriber which is still busy sending an older frame skips the ones in between,
+     * so slow consumers only ever get the latest frame and never hold up the others.
+     * Publishing a frame wakes the subscribers of its channel.
+     */
+    class MJPEGServer {
+    public:
+        typedef std::shared_ptr<const std::vector<uint8_t>> Frame;
+
+        MJPEGServer(size_t channel_count, std::string password);
+        ~MJPEGServer();
+
+        bool listen(uint16_t port, int backlog, bool external = false);
+        void close_listener();
+        void stop();
+
+        void publish(size_t channel, Frame frame);
+
+        inline size_t get_channel_count() const {
+            return this->channel_count;
+        }
+
+        inline size_t get_subscriber_count(size_t channel) const {
+            return this->channels[channel].subscribers;
+        }
+
+        inline const std::string &get_error() const {
+            return this->server.get_error();
+        }
+
+    private:
+
+        // configuration
+        const static int server_worker_count = 1;
+        const static int server_receive_buffer_size = 4 * 1024;
+        const static int server_send_buffer_max_size = 16 * 1024 * 1024;
+        const static int request_max_size = 8 * 1024;
+        const static int send_poll_ms = 4;
+
+        struct Channel {
+            std::mutex frame_m;
+            SocketServer::SharedBuffer part;
+            uint64_t sequence = 0;
+            std::atomic<size_t> subscribers = 0;
+            std::vector<std::shared_ptr<SocketServer::Wakeup>> wakeups;
+        };
+
+        struct Client {
+            std::string request;
+            int channel = -1;
+            uint64_t sequence = 0;
+        };
+
+        size_t channel_count;
+        std::unique_ptr<Channel[]> channels;
+        std::string password;
+        SocketServer server;
+
+        bool connection_open(SocketServer::Connection &connection);
+        void connection_receive(SocketServer::Connection &connection, char *data, size_t size);
+        void connection_close(SocketServer::Connection &connection);
+        int connection_tick(SocketServer::Connection &connection);
+        void process_request(SocketServer::Connection &connection, Client &client);
+        void send_status(SocketServer::Connection &connection, const char *status);
+    };
+}
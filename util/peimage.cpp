@@ -0,0 +1,409 @@
+#include "peimage.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace util {
+
+    // limits against broken tables
+    static const size_t EXPORT_COUNT_MAX = 1 << 16;
+    static const size_t IMPORT_DLL_COUNT_MAX = 1 << 12;
+    static const size_t IMPORT_COUNT_MAX = 1 << 16;
+    static const size_t NAME_LENGTH_MAX = 1 << 10;
+
+    template<typename T>
+    static bool read(const uint8_t *data, size_t size, size_t offset, T &value) {
+        if (offset > size || size - offset < sizeof(T)) {
+            return false;
+        }
+        memcpy(&value, data + offset, sizeof(T));
+        return true;
+    }
+
+    static bool read_string(const uint8_t *data, size_t size, size_t offset, std::string &value) {
+        if (offset >= size) {
+            return false;
+        }
+        auto begin = reinterpret_cast<const char *>(data + offset);
+        auto length = strnlen(begin, std::min(size - offset, NAME_LENGTH_MAX));
+        if (offset + length >= size) {
+            return false;
+        }
+        value.assign(begin, length);
+        return true;
+    }
+
+    /*
+     * Finds the range containing the value, preferring the lowest index like a linear search would.
+     * The order is sorted by range start, reach holds the maximum range end up to each position.
+     */
+    template<typename Start, typename End>
+    static const uint32_t *find_range(const std::vector<uint32_t> &order, const std::vector<uint64_t> &reach,
+            uint64_t value, Start start, End end)
+    {
+        auto upper = std::upper_bound(order.begin(), order.end(), value, [&start] (uint64_t value, uint32_t index) {
+            return value < start(index);
+        });
+        const uint32_t *result = nullptr;
+        for (auto i = upper - order.begin(); i > 0 && reach[i - 1] > value; i--) {
+            auto &index = order[i - 1];
+            if (value < end(index) && (result == nullptr || index < *result)) {
+                result = &index;
+            }
+        }
+        return result;
+    }
+
+    template<typename Start, typename End>
+    static void build_ranges(size_t count, std::vector<uint32_t> &order, std::vector<uint64_t> &reach,
+            Start start, End end)
+    {
+        order.clear();
+        for (uint32_t i = 0; i < count; i++) {
+            if (start(i) < end(i)) {
+                order.push_back(i);
+            }
+        }
+        std::stable_sort(order.begin(), order.end(), [&start] (uint32_t a, uint32_t b) {
+            return start(a) < start(b);
+        });
+        reach.resize(order.size());
+        uint64_t max = 0;
+        for (size_t i = 0; i < order.size(); i++) {
+            max = std::max(max, end(order[i]));
+            reach[i] = max;
+        }
+    }
+
+    std::optional<PEImage> PEImage::parse(const uint8_t *data, size_t size) {
+        PEImage image;
+
+        // DOS header
+        uint16_t dos_magic = 0;
+        uint32_t nt_offset = 0;
+        if (!read(data, size, 0, dos_magic) || dos_magic != 0x5A4D || !read(data, size, 0x3C, nt_offset)) {
+            return std::nullopt;
+        }
+
+        // file header
+        uint32_t nt_signature = 0;
+        uint16_t section_count = 0;
+        uint16_t optional_size = 0;
+        size_t file_header = static_cast<size_t>(nt_offset) + 4;
+        if (!read(data, size, nt_offset, nt_signature) || nt_signature != 0x00004550
+        || !read(data, size, file_header + 2, section_count)
+        || !read(data, size, file_header + 4, image.timestamp)
+        || !read(data, size, file_header + 16, optional_size)) {
+            return std::nullopt;
+        }
+
+        // optional header
+        size_t optional_header = file_header + 20;
+        uint16_t optional_magic = 0;
+        if (!read(data, size, optional_header, optional_magic)) {
+            return std::nullopt;
+        }
+        size_t directories;
+        if (optional_magic == 0x10B) {
+            uint32_t image_base = 0;
+            if (!read(data, size, optional_header + 28, image_base)) {
+                return std::nullopt;
+            }
+            image.image_base = image_base;
+            directories = optional_header + 92;
+        } else if (optional_magic == 0x20B) {
+            image.pe32_plus = true;
+            if (!read(data, size, optional_header + 24, image.image_base)) {
+                return std::nullopt;
+            }
+            directories = optional_header + 108;
+        } else {
+            return std::nullopt;
+        }
+        uint32_t headers_size = 0;
+        uint32_t directory_count = 0;
+        if (!read(data, size, optional_header + 56, image.image_size)
+        || !read(data, size, optional_header + 60, headers_size)
+        || !read(data, size, directories, directory_count)) {
+            return std::nullopt;
+        }
+
+        // sections
+        size_t section_table = optional_header + optional_size;
+        for (size_t i = 0; i < section_count; i++) {
+            size_t header = section_table + i * 40;
+            Section section;
+            char name[8];
+            if (!read(data, size, header, name)
+            || !read(data, size, header + 8, section.virtual_size)
+            || !read(data, size, header + 12, section.virtual_address)
+            || !read(data, size, header + 16, section.raw_size)
+            || !read(data, size, header + 20, section.raw_address)
+            || !read(data, size, header + 36, section.characteristics)) {
+                return std::nullopt;
+            }
+            section.name.assign(name, strnlen(name, sizeof(name)));
+            image.sections.emplace_back(std::move(section));
+        }
+
+        // index sections
+        std::vector<uint64_t> reach;
+        auto &sections = image.sections;
+        build_ranges(sections.size(), image.sections_virtual, reach,
+                [&sections] (uint32_t i) -> uint64_t { return sections[i].virtual_address; },
+                [&sections] (uint32_t i) -> uint64_t {
+                    return static_cast<uint64_t>(sections[i].virtual_address) + sections[i].virtual_size;
+                });
+        image.sections_virtual_reach = std::move(reach);
+        build_ranges(sections.size(), image.sections_raw, reach,
+                [&sections] (uint32_t i) -> uint64_t { return sections[i].raw_address; },
+                [&sections] (uint32_t i) -> uint64_t {
+                    return static_cast<uint64_t>(sections[i].raw_address) + sections[i].raw_size;
+                });
+        image.sections_raw_reach = std::move(reach);
+        image.headers_size = headers_size;
+
+        // export and import tables
+        uint32_t export_rva = 0, export_size = 0, import_rva = 0;
+        if (directory_count > 0 && read(data, size, directories + 4, export_rva)
+        && read(data, size, directories + 8, export_size) && export_rva) {
+            image.parse_exports(data, size, export_rva, export_size);
+        }
+        if (directory_count > 1 && read(data, size, directories + 12, import_rva) && import_rva) {
+            image.parse_imports(data, size, import_rva);
+        }
+
+        return image;
+    }
+
+    size_t PEImage::data_offset(uint32_t rva) const {
+        auto offset = this->rva2offset(rva);
+        if (offset >= 0) {
+            return static_cast<size_t>(offset);
+        }
+
+        // headers are mapped as they are
+        if (rva < this->headers_size) {
+            return rva;
+        }
+        return SIZE_MAX;
+    }
+
+    void PEImage::parse_exports(const uint8_t *data, size_t size, uint32_t rva, uint32_t dir_size) {
+
+        // directory
+        auto directory = this->data_offset(rva);
+        if (directory == SIZE_MAX) {
+            return;
+        }
+        uint32_t base = 0, function_count = 0, name_count = 0;
+        uint32_t functions_rva = 0, names_rva = 0, ordinals_rva = 0;
+        if (!read(data, size, directory + 16, base)
+        || !read(data, size, directory + 20, function_count)
+        || !read(data, size, directory + 24, name_count)
+        || !read(data, size, directory + 28, functions_rva)
+        || !read(data, size, directory + 32, names_rva)
+        || !read(data, size, directory + 36, ordinals_rva)
+        || function_count > EXPORT_COUNT_MAX || name_count > EXPORT_COUNT_MAX) {
+            return;
+        }
+
+        // functions
+        auto functions = this->data_offset(functions_rva);
+        if (functions == SIZE_MAX) {
+            return;
+        }
+        std::vector<Export> functions_list(function_count);
+        for (uint32_t i = 0; i < function_count; i++) {
+            auto &entry = functions_list[i];
+            if (!read(data, size, functions + i * 4, entry.rva)) {
+                return;
+            }
+            entry.ordinal = base + i;
+
+            // forwarders point back into the export directory
+            if (entry.rva >= rva && entry.rva - rva < dir_size) {
+                read_string(data, size, this->data_offset(entry.rva), entry.forwarder);
+            }
+        }
+
+        // names
+        auto names = this->data_offset(names_rva);
+        auto ordinals = this->data_offset(ordinals_rva);
+        if (names == SIZE_MAX || ordinals == SIZE_MAX) {
+            name_count = 0;
+        }
+        for (uint32_t i = 0; i < name_count; i++) {
+            uint32_t name_rva = 0;
+            uint16_t index = 0;
+            std::string name;
+            if (!read(data, size, names + i * 4, name_rva)
+            || !read(data, size, ordinals + i * 2, index)
+            || index >= function_count
+            || !read_string(data, size, this->data_offset(name_rva), name)) {
+                continue;
+            }
+
+            // functions may have multiple names
+            auto &entry = functions_list[index];
+            if (entry.name.empty()) {
+                entry.name = std::move(name);
+            } else {
+                auto alias = entry;
+                alias.name = std::move(name);
+                functions_list.emplace_back(std::move(alias));
+            }
+        }
+
+        // keep used slots, ordered by ordinal
+        for (auto &entry : functions_list) {
+            if (entry.rva) {
+                this->exports.emplace_back(std::move(entry));
+            }
+        }
+        std::stable_sort(this->exports.begin(), this->exports.end(), [] (const Export &a, const Export &b) {
+            return a.ordinal < b.ordinal;
+        });
+
+        // index names
+        this->exports_name.clear();
+        for (uint32_t i = 0; i < this->exports.size(); i++) {
+            if (!this->exports[i].name.empty()) {
+                this->exports_name.push_back(i);
+            }
+        }
+        std::sort(this->exports_name.begin(), this->exports_name.end(), [this] (uint32_t a, uint32_t b) {
+            return this->exports[a].name < this->exports[b].name;
+        });
+    }
+
+    void PEImage::parse_imports(const uint8_t *data, size_t size, uint32_t rva) {
+        auto descriptors = this->data_offset(rva);
+        if (descriptors == SIZE_MAX) {
+            return;
+        }
+        size_t thunk_size = this->pe32_plus ? 8 : 4;
+        size_t import_count = 0;
+        for (size_t i = 0; i < IMPORT_DLL_COUNT_MAX; i++) {
+
+            // descriptor
+            auto descriptor = descriptors + i * 20;
+            uint32_t lookup_rva = 0, name_rva = 0, thunk_rva = 0;
+            if (!read(data, size, descriptor, lookup_rva)
+            || !read(data, size, descriptor + 12, name_rva)
+            || !read(data, size, descriptor + 16, thunk_rva)) {
+                return;
+            }
+            if (!name_rva && !thunk_rva) {
+                return;
+            }
+            std::string dll_name;
+            if (!read_string(data, size, this->data_offset(name_rva), dll_name)) {
+                continue;
+            }
+
+            // thunks, the lookup table stays untouched by binding
+            auto lookup = this->data_offset(lookup_rva ? lookup_rva : thunk_rva);
+            if (lookup == SIZE_MAX) {
+                continue;
+            }
+            for (size_t j = 0; import_count < IMPORT_COUNT_MAX; j++, import_count++) {
+                uint64_t thunk = 0;
+                bool ordinal;
+                if (this->pe32_plus) {
+                    if (!read(data, size, lookup + j * thunk_size, thunk)) {
+                        break;
+                    }
+                    ordinal = (thunk >> 63) != 0;
+                } else {
+                    uint32_t thunk32 = 0;
+                    if (!read(data, size, lookup + j * thunk_size, thunk32)) {
+                        break;
+                    }
+                    thunk = thunk32;
+                    ordinal = (thunk32 >> 31) != 0;
+                }
+                if (!thunk) {
+                    break;
+                }
+
+                Import entry;
+                entry.dll_name = dll_name;
+                entry.thunk_rva = static_cast<uint32_t>(thunk_rva + j * thunk_size);
+                if (ordinal) {
+                    entry.ordinal = static_cast<uint16_t>(thunk);
+                } else {
+                    auto by_name = this->data_offset(static_cast<uint32_t>(thunk));
+                    uint16_t hint = 0;
+                    if (by_name == SIZE_MAX || !read(data, size, by_name, hint) || !read_string(data, size, by_name + 2, entry.name)) {
+                        continue;
+                    }
+                }
+                this->imports.emplace_back(std::move(entry));
+            }
+        }
+    }
+
+    const PEImage::Section *PEImage::find_virtual(uint32_t rva) const {
+        auto &sections = this->sections;
+        auto index = find_range(this->sections_virtual, this->sections_virtual_reach, rva,
+                [&sections] (uint32_t i) -> uint64_t { return sections[i].virtual_address; },
+                [&sections] (uint32_t i) -> uint64_t {
+                    return static_cast<uint64_t>(sections[i].virtual_address) + sections[i].virtual_size;
+                });
+        return index ? &sections[*index] : nullptr;
+    }
+
+    const PEImage::Section *PEImage::find_raw(uint32_t offset) const {
+        auto &sections = this->sections;
+        auto index = find_range(this->sections_raw, this->sections_raw_reach, offset,
+                [&sections] (uint32_t i) -> uint64_t { return sections[i].raw_address; },
+                [&sections] (uint32_t i) -> uint64_t {
+                    return static_cast<uint64_t>(sections[i].raw_address) + sections[i].raw_size;
+                });
+        return index ? &sections[*index] : nullptr;
+    }
+
+    intptr_t PEImage::rva2offset(intptr_t rva) const {
+        auto section = this->find_virtual(static_cast<uint32_t>(rva));
+        if (section == nullptr) {
+            return -1;
+        }
+        return rva - section->virtual_address + section->raw_address;
+    }
+
+    intptr_t PEImage::offset2rva(intptr_t offset) const {
+        auto section = this->find_raw(static_cast<uint32_t>(offset));
+        if (section == nullptr) {
+            return -1;
+        }
+        return offset - section->raw_address + section->virtual_address;
+    }
+
+    const PEImage::Section *PEImage::find_section(uint32_t rva) const {
+        return this->find_virtual(rva);
+    }
+
+    const PEImage::Export *PEImage::find_export(const std::string &name) const {
+        auto it = std::lower_bound(this->exports_name.begin(), this->exports_name.end(), name,
+                [this] (uint32_t index, const std::string &name) {
+                    return this->exports[index].name < name;
+                });
+        if (it == this->exports_name.end() || this->exports[*it].name != name) {
+            return nullptr;
+        }
+        return &this->exports[*it];
+    }
+
+    const PEImage::Export *PEImage::find_export_ordinal(uint32_t ordinal) const {
+        auto it = std::lower_bound(this->exports.begin(), this->exports.end(), ordinal,
+                [] (const Export &entry, uint32_t ordinal) {
+                    return entry.ordinal < ordinal;
+                });
+        if (it == this->exports.end() || it->ordinal != ordinal) {
+            return nullptr;
+        }
+        return &*it;
+    }
+}
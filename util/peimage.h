@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace util {
+
+    /*
+     * Parsed headers, sections, exports and imports of a PE file.
+     *
+     * Parsing only works on the raw bytes of the file and doesn't depend on any Windows API. Sections and
+     * exports are indexed once, so address conversions and lookups are binary searches.
+     */
+    class PEImage {
+    public:
+
+        struct Section {
+            std::string name;
+            uint32_t virtual_address = 0;
+            uint32_t virtual_size = 0;
+            uint32_t raw_address = 0;
+            uint32_t raw_size = 0;
+            uint32_t characteristics = 0;
+        };
+
+        struct Export {
+
+            // empty for exports by ordinal only
+            std::string name;
+            uint32_t ordinal = 0;
+            uint32_t rva = 0;
+
+            // target like "NTDLL.RtlAllocateHeap" for forwarded exports
+            std::string forwarder;
+        };
+
+        struct Import {
+            std::string dll_name;
+
+            // empty for imports by ordinal
+            std::string name;
+            uint32_t ordinal = 0;
+
+            // RVA of the import address table slot
+            uint32_t thunk_rva = 0;
+        };
+
+        /*
+         * Parses the file contents, returns nothing for malformed headers.
+         * Broken export or import tables are skipped.
+         */
+        static std::optional<PEImage> parse(const uint8_t *data, size_t size);
+
+        inline bool is_64bit() const {
+            return this->pe32_plus;
+        }
+
+        inline uint64_t get_image_base() const {
+            return this->image_base;
+        }
+
+        inline uint32_t get_image_size() const {
+            return this->image_size;
+        }
+
+        inline uint32_t get_timestamp() const {
+            return this->timestamp;
+        }
+
+        // sections in header order
+        inline const std::vector<Section> &get_sections() const {
+            return this->sections;
+        }
+
+        inline const std::vector<Export> &get_exports() const {
+            return this->exports;
+        }
+
+        inline const std::vector<Import> &get_imports() const {
+            return this->imports;
+        }
+
+        /*
+         * Address conversions with the same results as libutils, -1 if outside of all sections.
+         */
+        intptr_t rva2offset(intptr_t rva) const;
+        intptr_t offset2rva(intptr_t offset) const;
+
+        const Section *find_section(uint32_t rva) const;
+        const Export *find_export(const std::string &name) const;
+        const Export *find_export_ordinal(uint32_t ordinal) const;
+
+    private:
+
+        bool pe32_plus = false;
+        uint64_t image_base = 0;
+        uint32_t image_size = 0;
+        uint32_t timestamp = 0;
+        std::vector<Section> sections;
+        std::vector<Export> exports;
+        std::vector<Import> imports;
+
+        uint32_t headers_size = 0;
+
+        // section indices sorted by virtual and raw address, with the maximum range end up to each position
+        std::vector<uint32_t> sections_virtual;
+        std::vector<uint64_t> sections_virtual_reach;
+        std::vector<uint32_t> sections_raw;
+        std::vector<uint64_t> sections_raw_reach;
+
+        // export indices sorted by name, the exports themselves are sorted by ordinal
+        std::vector<uint32_t> exports_name;
+
+        const Section *find_virtual(uint32_t rva) const;
+        const Section *find_raw(uint32_t offset) const;
+        size_t data_offset(uint32_t rva) const;
+        void parse_exports(const uint8_t *data, size_t size, uint32_t rva, uint32_t dir_size);
+        void parse_imports(const uint8_t *data, size_t size, uint32_t rva);
+    };
+}
@@ -0,0 +1,258 @@
+#include "pixelutils.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "cpufeatures.h"
+#include "pixelutils_kernels.h"
+
+namespace pixelutils {
+
+    namespace {
+        struct ScalarOps {
+            typedef uint32_t V;
+            static const size_t N = 1;
+
+            static inline V load16(const uint8_t *src) {
+                return src[0] | (src[1] << 8);
+            }
+
+            static inline V load24(const uint8_t *src) {
+                return src[0] | (src[1] << 8) | (src[2] << 16);
+            }
+
+            static inline V load32(const uint8_t *src) {
+                V v;
+                memcpy(&v, src, sizeof(v));
+                return v;
+            }
+
+            static inline void store(uint8_t *dst, V v) {
+                dst[0] = (uint8_t) v;
+                dst[1] = (uint8_t) (v >> 8);
+                dst[2] = (uint8_t) (v >> 16);
+            }
+
+            static inline V srl(V v, int count) {
+                return v >> count;
+            }
+
+            static inline V sll(V v, int count) {
+                return v << count;
+            }
+
+            static inline V band(V v, uint32_t mask) {
+                return v & mask;
+            }
+
+            static inline V bor(V a, V b) {
+                return a | b;
+            }
+        };
+
+
+        typedef size_t (*convert_row_t)(Format format, const uint8_t *src, uint8_t *dst, size_t width);
+        typedef size_t (*accumulate_row_t)(const uint8_t *src, uint32_t *sums, size_t count);
+
+        struct Kernels {
+            const char *name;
+            convert_row_t convert_row;
+            accumulate_row_t accumulate_row;
+        };
+    }
+
+    size_t scalar::convert_row(Format format, const uint8_t *src, uint8_t *dst, size_t width) {
+        return kernels::convert_row<ScalarOps>(format, src, dst, width, 0);
+    }
+
+    size_t scalar::accumulate_row(const uint8_t *src, uint32_t *sums, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            sums[i] += src[i];
+        }
+        return count;
+    }
+
+
+    static const Kernels &get_kernels() {
+        static const Kernels KERNELS = [] {
+            if (cpufeatures::has_avx2()) {
+                return Kernels { "AVX2", avx2::convert_row, avx2::accumulate_row };
+            }
+            if (cpufeatures::has_sse2()) {
+                return Kernels { "SSE2", sse2::convert_row, sse2::accumulate_row };
+            }
+            return Kernels { "scalar", scalar::convert_row, scalar::accumulate_row };
+        }();
+        return KERNELS;
+    }
+
+    static inline void convert_row(const Kernels &kernels, Format format, size_t pixel_size,
+            const uint8_t *src, uint8_t *dst, size_t width) {
+        auto x = kernels.convert_row(format, src, dst, width);
+        scalar::convert_row(format, src + x * pixel_size, dst + x * 3, width - x);
+    }
+
+    static inline void accumulate_row(const Kernels &kernels, const uint8_t *src, uint32_t *sums, size_t count) {
+        auto i = kernels.accumulate_row(src, sums, count);
+        scalar::accumulate_row(src + i, sums + i, count - i);
+    }
+
+    static bool is_valid(const Image &image) {
+        auto pixel_size = format_size(image.format);
+        return pixel_size > 0
+               && image.data != nullptr
+               && image.width > 0
+               && image.height > 0
+               && image.pitch >= image.width * pixel_size;
+    }
+
+    size_t format_size(Format format) {
+        switch (format) {
+            case Format::RGB24:
+            case Format::R8G8B8:
+                return 3;
+            case Format::X8R8G8B8:
+            case Format::X8B8G8R8:
+            case Format::A2R10G10B10:
+            case Format::A2B10G10R10:
+                return 4;
+            case Format::R5G6B5:
+            case Format::X1R5G5B5:
+                return 2;
+            default:
+                return 0;
+        }
+    }
+
+    Image crop(const Image &image, size_t x, size_t y, size_t width, size_t height) {
+        if (width == 0 || height == 0) {
+            return image;
+        }
+        if (x >= image.width || y >= image.height) {
+            return Image {};
+        }
+
+        Image region = image;
+        region.data = image.data + y * image.pitch + x * format_size(image.format);
+        region.width = std::min(width, image.width - x);
+        region.height = std::min(height, image.height - y);
+        return region;
+    }
+
+    bool convert_rgb(const Image &image, uint8_t *dst) {
+        if (!is_valid(image) || dst == nullptr) {
+            return false;
+        }
+
+        // convert row by row
+        auto &kernels = get_kernels();
+        auto pixel_size = format_size(image.format);
+        for (size_t y = 0; y < image.height; y++) {
+            convert_row(kernels, image.format, pixel_size,
+                    image.data + y * image.pitch,
+                    dst + y * image.width * 3,
+                    image.width);
+        }
+        return true;
+    }
+
+    bool convert_rgb(const Image &image, uint8_t *dst, size_t width, size_t height) {
+        if (!is_valid(image) || dst == nullptr || width == 0 || height == 0) {
+            return false;
+        }
+
+        // same size needs no filtering
+        if (width == image.width && height == image.height) {
+            return convert_rgb(image, dst);
+        }
+
+        // buffers for the converted source row and the column sums of the current target row
+        static thread_local std::vector<uint8_t> ROW;
+        static thread_local std::vector<uint32_t> SUMS;
+        static thread_local std::vector<size_t> COLUMNS;
+        static thread_local std::vector<uint64_t> RECIPROCALS;
+        ROW.resize(image.width * 3);
+        SUMS.resize(image.width * 3);
+        COLUMNS.resize(width + 1);
+        RECIPROCALS.resize(width);
+
+        // source columns covered by each target column
+        for (size_t x = 0; x <= width; x++) {
+            COLUMNS[x] = (size_t) ((uint64_t) x * image.width / width);
+        }
+
+        auto &kernels = get_kernels();
+        auto pixel_size = format_size(image.format);
+        size_t last_row_count = 0;
+        for (size_t y = 0; y < height; y++) {
+
+            // sum up all source rows covered by the target row, at least one when upscaling
+            size_t row_start = (size_t) ((uint64_t) y * image.height / height);
+            size_t row_end = std::max((size_t) ((uint64_t) (y + 1) * image.height / height), row_start + 1);
+            std::fill(SUMS.begin(), SUMS.end(), 0);
+            for (size_t row = row_start; row < row_end; row++) {
+                convert_row(kernels, image.format, pixel_size,
+                        image.data + row * image.pitch,
+                        ROW.data(), image.width);
+                accumulate_row(kernels, ROW.data(), SUMS.data(), ROW.size());
+            }
+
+            /*
+             * Divide by multiplying with the reciprocal, rounded up to 40 bits of precision.
+             * This is exact as long as the sums stay below 2^40 / count, which holds for areas below 65536 pixels.
+             */
+            size_t row_count = row_end - row_start;
+            if (row_count != last_row_count) {
+                last_row_count = row_count;
+                for (size_t x = 0; x < width; x++) {
+                    auto count = (uint64_t) std::max(COLUMNS[x + 1] - COLUMNS[x], (size_t) 1) * row_count;
+                    RECIPROCALS[x] = count < 65536 ? ((uint64_t) 1 << 40) / count + 1 : 0;
+                }
+            }
+
+            // average over the covered columns
+            auto target = dst + y * width * 3;
+            if (image.width == width * 2 && RECIPROCALS[0]) {
+
+                // halving is the common case, so it gets an unrolled loop
+                auto reciprocal = RECIPROCALS[0];
+                auto round = (uint32_t) row_count;
+                auto sums = SUMS.data();
+                for (size_t x = 0; x < width; x++, sums += 6, target += 3) {
+                    target[0] = (uint8_t) (((uint64_t) (sums[0] + sums[3] + round) * reciprocal) >> 40);
+                    target[1] = (uint8_t) (((uint64_t) (sums[1] + sums[4] + round) * reciprocal) >> 40);
+                    target[2] = (uint8_t) (((uint64_t) (sums[2] + sums[5] + round) * reciprocal) >> 40);
+                }
+                continue;
+            }
+            for (size_t x = 0; x < width; x++) {
+                size_t column_start = COLUMNS[x];
+                size_t columns = std::max(COLUMNS[x + 1] - column_start, (size_t) 1);
+                auto sums = &SUMS[column_start * 3];
+                uint32_t r = sums[0], g = sums[1], b = sums[2];
+                for (size_t column = 1; column < columns; column++) {
+                    r += sums[column * 3 + 0];
+                    g += sums[column * 3 + 1];
+                    b += sums[column * 3 + 2];
+                }
+                auto count = (uint32_t) (columns * row_count);
+                auto reciprocal = RECIPROCALS[x];
+                if (reciprocal) {
+                    target[x * 3 + 0] = (uint8_t) (((uint64_t) (r + count / 2) * reciprocal) >> 40);
+                    target[x * 3 + 1] = (uint8_t) (((uint64_t) (g + count / 2) * reciprocal) >> 40);
+                    target[x * 3 + 2] = (uint8_t) (((uint64_t) (b + count / 2) * reciprocal) >> 40);
+                } else {
+                    target[x * 3 + 0] = (uint8_t) ((r + count / 2) / count);
+                    target[x * 3 + 1] = (uint8_t) ((g + count / 2) / count);
+                    target[x * 3 + 2] = (uint8_t) ((b + count / 2) / count);
+                }
+            }
+        }
+        return true;
+    }
+
+    const char *get_instruction_set() {
+        return get_kernels().name;
+    }
+}
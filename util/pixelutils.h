@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace pixelutils {
+
+    /*
+     * Pixel layouts, named like their D3DFMT_ counterparts.
+     * The alpha/unused bits of a format are ignored.
+     */
+    enum class Format {
+        Unknown,
+        RGB24,          // bytes in R, G, B order, which is also the output format
+        R8G8B8,         // bytes in B, G, R order
+        X8R8G8B8,       // also A8R8G8B8
+        X8B8G8R8,       // also A8B8G8R8
+        R5G6B5,
+        X1R5G5B5,       // also A1R5G5B5
+        A2R10G10B10,
+        A2B10G10R10,
+    };
+
+    size_t format_size(Format format);
+
+    /*
+     * View of pixel data. Cropping works by offsetting the data pointer and keeping the pitch.
+     */
+    struct Image {
+        const uint8_t *data = nullptr;
+        size_t width = 0;
+        size_t height = 0;
+        size_t pitch = 0;
+        Format format = Format::Unknown;
+    };
+
+    /*
+     * Selects a region of the image, clamped to its bounds. An empty region selects the whole image.
+     * The result is empty if the region lies outside of the image.
+     */
+    Image crop(const Image &image, size_t x, size_t y, size_t width, size_t height);
+
+    /*
+     * Converts the image into packed RGB24 of the same size.
+     * The destination needs space for width * height * 3 bytes.
+     */
+    bool convert_rgb(const Image &image, uint8_t *dst);
+
+    /*
+     * Converts the image into packed RGB24 of the given size in a single pass.
+     * When downscaling, each target pixel is the average of the source pixels it covers.
+     */
+    bool convert_rgb(const Image &image, uint8_t *dst, size_t width, size_t height);
+
+    // name of the instruction set used for the conversion, for logging purposes
+    const char *get_instruction_set();
+}
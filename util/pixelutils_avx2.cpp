@@ -0,0 +1,76 @@
+// compiled with AVX2 enabled, see CMakeLists.txt
+#include <cstddef>
+#include <cstdint>
+
+#include <immintrin.h>
+
+#include "pixelutils_kernels.h"
+
+namespace pixelutils::avx2 {
+
+    namespace {
+        struct Ops {
+            typedef __m256i V;
+            static const size_t N = 8;
+
+            static inline V load16(const uint8_t *src) {
+                return _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src)));
+            }
+
+            static inline V load24(const uint8_t *src) {
+
+                // move bytes 12-27 into the upper lane, then spread 4 pixels over each lane
+                auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src));
+                v = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 1, 2, 3, 3, 4, 5, 6));
+                return _mm256_shuffle_epi8(v, _mm256_setr_epi8(
+                        0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                        0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1));
+            }
+
+            static inline V load32(const uint8_t *src) {
+                return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src));
+            }
+
+            static inline void store(uint8_t *dst, V v) {
+
+                // pack 12 bytes per lane, the second store overwrites the gap of the first one
+                v = _mm256_shuffle_epi8(v, _mm256_setr_epi8(
+                        0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                        0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm256_castsi256_si128(v));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 12), _mm256_extracti128_si256(v, 1));
+            }
+
+            static inline V srl(V v, int count) {
+                return _mm256_srli_epi32(v, count);
+            }
+
+            static inline V sll(V v, int count) {
+                return _mm256_slli_epi32(v, count);
+            }
+
+            static inline V band(V v, uint32_t mask) {
+                return _mm256_and_si256(v, _mm256_set1_epi32((int) mask));
+            }
+
+            static inline V bor(V a, V b) {
+                return _mm256_or_si256(a, b);
+            }
+        };
+    }
+
+    size_t convert_row(Format format, const uint8_t *src, uint8_t *dst, size_t width) {
+        return kernels::convert_row<Ops>(format, src, dst, width, kernels::VECTOR_MARGIN);
+    }
+
+    size_t accumulate_row(const uint8_t *src, uint32_t *sums, size_t count) {
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            auto bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i));
+            auto sum = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(sums + i));
+            sum = _mm256_add_epi32(sum, _mm256_cvtepu8_epi32(bytes));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(sums + i), sum);
+        }
+        return i;
+    }
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+/*
+ * Conversion kernels shared by the instruction set specific translation units.
+ *
+ * Every format is described once in terms of a small set of vector operations (Ops),
+ * which each instruction set implements for its own register width:
+ *
+ *  - V: register holding Ops::N pixels as 32-bit lanes
+ *  - load16/load24/load32: loads N pixels of the given size, zero extended to 32-bit lanes
+ *  - store: writes the N lanes in 0x00BBGGRR form as packed RGB24, may write up to 4 bytes more
+ *  - srl/sll/band/bor: lane wise shifts and bit operations
+ *
+ * Include only after <cstddef>/<cstdint> and the headers of the instruction set.
+ * Nothing from the standard library may be instantiated in here, since this header gets
+ * compiled with different target flags and the linker would be free to pick any of the copies.
+ */
+
+#include "pixelutils.h"
+
+namespace pixelutils::kernels {
+
+    // pixels past the vector loop are left to the scalar kernel so loads and stores stay in bounds
+    static const size_t VECTOR_MARGIN = 4;
+
+    template<Format F, class Ops>
+    inline typename Ops::V extract(const uint8_t *src) {
+        if constexpr (F == Format::RGB24) {
+            return Ops::load24(src);
+        } else if constexpr (F == Format::R8G8B8) {
+            auto v = Ops::load24(src);
+            return Ops::bor(Ops::bor(
+                    Ops::band(Ops::srl(v, 16), 0xFF),
+                    Ops::band(v, 0xFF00)),
+                    Ops::band(Ops::sll(v, 16), 0xFF0000));
+        } else if constexpr (F == Format::X8R8G8B8) {
+            auto v = Ops::load32(src);
+            return Ops::bor(Ops::bor(
+                    Ops::band(Ops::srl(v, 16), 0xFF),
+                    Ops::band(v, 0xFF00)),
+                    Ops::band(Ops::sll(v, 16), 0xFF0000));
+        } else if constexpr (F == Format::X8B8G8R8) {
+            return Ops::band(Ops::load32(src), 0xFFFFFF);
+        } else if constexpr (F == Format::R5G6B5) {
+
+            // expand to 8 bits by repeating the upper bits
+            auto v = Ops::load16(src);
+            return Ops::bor(Ops::bor(Ops::bor(
+                    Ops::band(Ops::srl(v, 8), 0xF8),
+                    Ops::band(Ops::srl(v, 13), 0x07)), Ops::bor(
+                    Ops::band(Ops::sll(v, 5), 0xFC00),
+                    Ops::band(Ops::srl(v, 1), 0x300))), Ops::bor(
+                    Ops::band(Ops::sll(v, 19), 0xF80000),
+                    Ops::band(Ops::sll(v, 14), 0x70000)));
+        } else if constexpr (F == Format::X1R5G5B5) {
+            auto v = Ops::load16(src);
+            return Ops::bor(Ops::bor(Ops::bor(
+                    Ops::band(Ops::srl(v, 7), 0xF8),
+                    Ops::band(Ops::srl(v, 12), 0x07)), Ops::bor(
+                    Ops::band(Ops::sll(v, 6), 0xF800),
+                    Ops::band(Ops::sll(v, 1), 0x700))), Ops::bor(
+                    Ops::band(Ops::sll(v, 19), 0xF80000),
+                    Ops::band(Ops::sll(v, 14), 0x70000)));
+        } else if constexpr (F == Format::A2R10G10B10) {
+
+            // drop the lower 2 bits of each channel
+            auto v = Ops::load32(src);
+            return Ops::bor(Ops::bor(
+                    Ops::band(Ops::srl(v, 22), 0xFF),
+                    Ops::band(Ops::srl(v, 4), 0xFF00)),
+                    Ops::band(Ops::sll(v, 14), 0xFF0000));
+        } else {
+            static_assert(F == Format::A2B10G10R10);
+            auto v = Ops::load32(src);
+            return Ops::bor(Ops::bor(
+                    Ops::band(Ops::srl(v, 2), 0xFF),
+                    Ops::band(Ops::srl(v, 4), 0xFF00)),
+                    Ops::band(Ops::srl(v, 6), 0xFF0000));
+        }
+    }
+
+    template<Format F, size_t PixelSize, class Ops>
+    inline size_t convert_row(const uint8_t *src, uint8_t *dst, size_t width, size_t margin) {
+        size_t x = 0;
+        for (; x + Ops::N + margin <= width; x += Ops::N) {
+            Ops::store(dst + x * 3, extract<F, Ops>(src + x * PixelSize));
+        }
+        return x;
+    }
+
+    /*
+     * Converts pixels of a row as long as the vector width allows it.
+     * Returns the number of pixels processed.
+     */
+    template<class Ops>
+    inline size_t convert_row(Format format, const uint8_t *src, uint8_t *dst, size_t width, size_t margin) {
+        switch (format) {
+            case Format::RGB24:
+                return convert_row<Format::RGB24, 3, Ops>(src, dst, width, margin);
+            case Format::R8G8B8:
+                return convert_row<Format::R8G8B8, 3, Ops>(src, dst, width, margin);
+            case Format::X8R8G8B8:
+                return convert_row<Format::X8R8G8B8, 4, Ops>(src, dst, width, margin);
+            case Format::X8B8G8R8:
+                return convert_row<Format::X8B8G8R8, 4, Ops>(src, dst, width, margin);
+            case Format::R5G6B5:
+                return convert_row<Format::R5G6B5, 2, Ops>(src, dst, width, margin);
+            case Format::X1R5G5B5:
+                return convert_row<Format::X1R5G5B5, 2, Ops>(src, dst, width, margin);
+            case Format::A2R10G10B10:
+                return convert_row<Format::A2R10G10B10, 4, Ops>(src, dst, width, margin);
+            case Format::A2B10G10R10:
+                return convert_row<Format::A2B10G10R10, 4, Ops>(src, dst, width, margin);
+            default:
+                return 0;
+        }
+    }
+}
+
+namespace pixelutils::scalar {
+
+    // implemented in pixelutils.cpp, converts whole rows
+    size_t convert_row(Format format, const uint8_t *src, uint8_t *dst, size_t width);
+    size_t accumulate_row(const uint8_t *src, uint32_t *sums, size_t count);
+}
+
+namespace pixelutils::sse2 {
+
+    // implemented in pixelutils_sse2.cpp, only to be called if the CPU supports SSE2
+    size_t convert_row(Format format, const uint8_t *src, uint8_t *dst, size_t width);
+    size_t accumulate_row(const uint8_t *src, uint32_t *sums, size_t count);
+}
+
+namespace pixelutils::avx2 {
+
+    // implemented in pixelutils_avx2.cpp, only to be called if the CPU supports AVX2
+    size_t convert_row(Format format, const uint8_t *src, uint8_t *dst, size_t width);
+    size_t accumulate_row(const uint8_t *src, uint32_t *sums, size_t count);
+}
@@ -0,0 +1,81 @@
+// compiled with SSE2 enabled, see CMakeLists.txt
+#include <cstddef>
+#include <cstdint>
+
+#include <emmintrin.h>
+
+#include "pixelutils_kernels.h"
+
+namespace pixelutils::sse2 {
+
+    namespace {
+        struct Ops {
+            typedef __m128i V;
+            static const size_t N = 4;
+
+            static inline V load16(const uint8_t *src) {
+                auto v = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(src));
+                return _mm_unpacklo_epi16(v, _mm_setzero_si128());
+            }
+
+            static inline V load24(const uint8_t *src) {
+
+                // shift pixel i by i bytes so it starts at its lane
+                auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+                return _mm_or_si128(_mm_or_si128(
+                        _mm_and_si128(v, _mm_setr_epi32(0xFFFFFF, 0, 0, 0)),
+                        _mm_and_si128(_mm_slli_si128(v, 1), _mm_setr_epi32(0, 0xFFFFFF, 0, 0))), _mm_or_si128(
+                        _mm_and_si128(_mm_slli_si128(v, 2), _mm_setr_epi32(0, 0, 0xFFFFFF, 0)),
+                        _mm_and_si128(_mm_slli_si128(v, 3), _mm_setr_epi32(0, 0, 0, 0xFFFFFF))));
+            }
+
+            static inline V load32(const uint8_t *src) {
+                return _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+            }
+
+            static inline void store(uint8_t *dst, V v) {
+
+                // reverse of load24, the upper 4 bytes are left zero
+                v = _mm_or_si128(_mm_or_si128(
+                        _mm_and_si128(v, _mm_setr_epi32(0xFFFFFF, 0, 0, 0)),
+                        _mm_and_si128(_mm_srli_si128(v, 1), _mm_setr_epi32((int) 0xFF000000, 0xFFFF, 0, 0))), _mm_or_si128(
+                        _mm_and_si128(_mm_srli_si128(v, 2), _mm_setr_epi32(0, (int) 0xFFFF0000, 0xFF, 0)),
+                        _mm_and_si128(_mm_srli_si128(v, 3), _mm_setr_epi32(0, 0, (int) 0xFFFFFF00, 0))));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), v);
+            }
+
+            static inline V srl(V v, int count) {
+                return _mm_srli_epi32(v, count);
+            }
+
+            static inline V sll(V v, int count) {
+                return _mm_slli_epi32(v, count);
+            }
+
+            static inline V band(V v, uint32_t mask) {
+                return _mm_and_si128(v, _mm_set1_epi32((int) mask));
+            }
+
+            static inline V bor(V a, V b) {
+                return _mm_or_si128(a, b);
+            }
+        };
+    }
+
+    size_t convert_row(Format format, const uint8_t *src, uint8_t *dst, size_t width) {
+        return kernels::convert_row<Ops>(format, src, dst, width, kernels::VECTOR_MARGIN);
+    }
+
+    size_t accumulate_row(const uint8_t *src, uint32_t *sums, size_t count) {
+        size_t i = 0;
+        auto zero = _mm_setzero_si128();
+        for (; i + 8 <= count; i += 8) {
+            auto bytes = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i)), zero);
+            auto sum_lo = reinterpret_cast<__m128i *>(sums + i);
+            auto sum_hi = reinterpret_cast<__m128i *>(sums + i + 4);
+            _mm_storeu_si128(sum_lo, _mm_add_epi32(_mm_loadu_si128(sum_lo), _mm_unpacklo_epi16(bytes, zero)));
+            _mm_storeu_si128(sum_hi, _mm_add_epi32(_mm_loadu_si128(sum_hi), _mm_unpackhi_epi16(bytes, zero)));
+        }
+        return i;
+    }
+}
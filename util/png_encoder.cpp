@@ -0,0 +1,743 @@
+#include "png_encoder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <mutex>
+#include <queue>
+
+#include "util/encoder_pool.h"
+
+namespace util {
+
+    static const uint8_t PNG_SIGNATURE[8] { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+    // deflate length and distance codes, RFC 1951 section 3.2.5
+    static const uint16_t LENGTH_BASE[29] {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+    };
+    static const uint8_t LENGTH_EXTRA[29] {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+    };
+    static const uint16_t DIST_BASE[30] {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577,
+    };
+    static const uint8_t DIST_EXTRA[30] {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+        7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+    };
+
+    // order in which the code length code lengths are stored
+    static const uint8_t CODE_LENGTH_ORDER[19] {
+        16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15,
+    };
+
+    namespace {
+
+        struct Tables {
+            uint32_t crc[256];
+            uint8_t length_code[259];
+            uint8_t dist_code[32769];
+
+            // fixed huffman code lengths
+            uint8_t fixed_litlen[288];
+            uint8_t fixed_dist[30];
+
+            Tables() {
+                for (uint32_t i = 0; i < 256; i++) {
+                    uint32_t c = i;
+                    for (int bit = 0; bit < 8; bit++) {
+                        c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+                    }
+                    this->crc[i] = c;
+                }
+                for (uint8_t code = 0; code < 29; code++) {
+                    for (size_t i = 0; i < (1u << LENGTH_EXTRA[code]); i++) {
+                        this->length_code[LENGTH_BASE[code] + i] = code;
+                    }
+                }
+                this->length_code[258] = 28;
+                for (uint8_t code = 0; code < 30; code++) {
+                    for (size_t i = 0; i < (1u << DIST_EXTRA[code]); i++) {
+                        this->dist_code[DIST_BASE[code] + i] = code;
+                    }
+                }
+                for (size_t i = 0; i < 288; i++) {
+                    this->fixed_litlen[i] = i < 144 ? 8 : (i < 256 ? 9 : (i < 280 ? 7 : 8));
+                }
+                std::fill_n(this->fixed_dist, 30, 5);
+            }
+        };
+
+        const Tables TABLES;
+
+        uint32_t crc32(uint32_t crc, const uint8_t *data, size_t size) {
+            crc = ~crc;
+            for (size_t i = 0; i < size; i++) {
+                crc = TABLES.crc[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+            }
+            return ~crc;
+        }
+
+        uint32_t adler32(uint32_t adler, const uint8_t *data, size_t size) {
+            uint32_t a = adler & 0xFFFF;
+            uint32_t b = adler >> 16;
+            while (size > 0) {
+
+                // largest block before the sums can overflow
+                size_t block = std::min(size, (size_t) 5552);
+                size -= block;
+                while (block--) {
+                    a += *data++;
+                    b += a;
+                }
+                a %= 65521;
+                b %= 65521;
+            }
+            return (b << 16) | a;
+        }
+
+        // checksum of two concatenated inputs from their separate checksums, like zlib's adler32_combine
+        uint32_t adler32_combine(uint32_t adler1, uint32_t adler2, size_t length2) {
+            const uint32_t BASE = 65521;
+            uint32_t rem = (uint32_t) (length2 % BASE);
+            uint32_t sum1 = adler1 & 0xFFFF;
+            uint32_t sum2 = (uint32_t) (((uint64_t) rem * sum1) % BASE);
+            sum1 += (adler2 & 0xFFFF) + BASE - 1;
+            sum2 += (adler1 >> 16) + (adler2 >> 16) + BASE - rem;
+            if (sum1 >= BASE) sum1 -= BASE;
+            if (sum1 >= BASE) sum1 -= BASE;
+            if (sum2 >= BASE * 2) sum2 -= BASE * 2;
+            if (sum2 >= BASE) sum2 -= BASE;
+            return (sum2 << 16) | sum1;
+        }
+
+        /*
+         * Computes huffman code lengths limited to the given maximum.
+         * Frequencies get halved until the tree is shallow enough, which barely costs any compression.
+         */
+        void huffman_lengths(const uint32_t *freqs, size_t count, int limit, uint8_t *lengths) {
+            uint32_t weights[288];
+            std::copy_n(freqs, count, weights);
+
+            // decoders reject codes with a single symbol, so always have at least two
+            size_t used = std::count_if(weights, weights + count, [] (uint32_t w) { return w > 0; });
+            for (size_t i = 0; used < 2; i++) {
+                if (weights[i] == 0) {
+                    weights[i] = 1;
+                    used++;
+                }
+            }
+
+            while (true) {
+
+                // build the tree bottom up
+                typedef std::pair<uint64_t, size_t> Node;
+                std::priority_queue<Node, std::vector<Node>, std::greater<>> queue;
+                size_t parents[288 * 2];
+                for (size_t i = 0; i < count; i++) {
+                    if (weights[i] > 0) {
+                        queue.emplace(weights[i], i);
+                    }
+                }
+                size_t next = count;
+                while (queue.size() > 1) {
+                    auto a = queue.top();
+                    queue.pop();
+                    auto b = queue.top();
+                    queue.pop();
+                    parents[a.second] = next;
+                    parents[b.second] = next;
+                    queue.emplace(a.first + b.first, next++);
+                }
+                auto root = next - 1;
+
+                // depth of each leaf
+                int max_length = 0;
+                for (size_t i = 0; i < count; i++) {
+                    int length = 0;
+                    if (weights[i] > 0) {
+                        for (auto node = i; node != root; node = parents[node]) {
+                            length++;
+                        }
+                    }
+                    lengths[i] = (uint8_t) length;
+                    max_length = std::max(max_length, length);
+                }
+                if (max_length <= limit) {
+                    return;
+                }
+
+                // flatten the distribution and try again
+                for (size_t i = 0; i < count; i++) {
+                    if (weights[i] > 0) {
+                        weights[i] = (weights[i] + 1) / 2;
+                    }
+                }
+            }
+        }
+
+        // canonical codes, bit reversed since deflate stores them starting with the most significant bit
+        void huffman_codes(const uint8_t *lengths, size_t count, uint16_t *codes) {
+            uint16_t length_count[16] {};
+            for (size_t i = 0; i < count; i++) {
+                length_count[lengths[i]]++;
+            }
+            length_count[0] = 0;
+            uint16_t next_code[16] {};
+            uint16_t code = 0;
+            for (int bits = 1; bits < 16; bits++) {
+                code = (code + length_count[bits - 1]) << 1;
+                next_code[bits] = code;
+            }
+            for (size_t i = 0; i < count; i++) {
+                auto length = lengths[i];
+                if (length > 0) {
+                    uint16_t value = next_code[length]++;
+                    uint16_t reversed = 0;
+                    for (int bit = 0; bit < length; bit++) {
+                        reversed = (reversed << 1) | ((value >> bit) & 1);
+                    }
+                    codes[i] = reversed;
+                }
+            }
+        }
+
+        // filters a row with the predictor of the left, upper and upper left bytes and returns its cost
+        template<typename Predictor>
+        inline uint32_t filter_row(const uint8_t *cur, const uint8_t *up, uint8_t *dst, size_t size,
+                Predictor predict) {
+            uint32_t cost = 0;
+            for (size_t x = 0; x < size; x++) {
+                auto value = (uint8_t) (cur[x] - predict(cur[x - 3], up[x], up[x - 3]));
+                dst[x] = value;
+                cost += std::abs((int8_t) value);
+            }
+            return cost;
+        }
+
+        class BitWriter {
+        public:
+            std::vector<uint8_t> *out = nullptr;
+
+            inline void put(uint32_t bits, int length) {
+                this->buffer |= (uint64_t) bits << this->count;
+                this->count += length;
+                if (this->count >= 32) {
+                    uint8_t bytes[4] { (uint8_t) this->buffer, (uint8_t) (this->buffer >> 8),
+                                       (uint8_t) (this->buffer >> 16), (uint8_t) (this->buffer >> 24) };
+                    this->out->insert(this->out->end(), bytes, bytes + 4);
+                    this->buffer >>= 32;
+                    this->count -= 32;
+                }
+            }
+
+            // pads the last byte with zeros
+            inline void align() {
+                while (this->count > 0) {
+                    this->out->push_back((uint8_t) this->buffer);
+                    this->buffer >>= 8;
+                    this->count = std::max(this->count - 8, 0);
+                }
+                this->buffer = 0;
+            }
+
+        private:
+            uint64_t buffer = 0;
+            int count = 0;
+        };
+
+        /*
+         * Greedy hash chain LZ77 followed by dynamic, fixed or stored blocks, whichever is smallest.
+         */
+        class Deflater {
+        public:
+
+            Deflater() : head(HASH_SIZE), prev(WINDOW_SIZE) {
+                this->symbols.reserve(BLOCK_SYMBOLS);
+            }
+
+            void compress(std::vector<uint8_t> &out, const uint8_t *data, size_t size, bool last) {
+                this->writer.out = &out;
+                std::fill(this->head.begin(), this->head.end(), -1);
+                this->reset_block();
+
+                size_t block_start = 0;
+                size_t pos = 0;
+                while (pos < size) {
+
+                    // find the longest match in the window
+                    size_t best_length = 0;
+                    size_t best_dist = 0;
+                    if (pos + MIN_MATCH <= size) {
+                        auto max_length = std::min(size - pos, MAX_MATCH);
+                        auto candidate = this->insert(data, pos);
+                        for (size_t chain = 0; chain < MAX_CHAIN && candidate >= 0; chain++) {
+                            if (pos - candidate >= WINDOW_SIZE) {
+                                break;
+                            }
+                            if (data[candidate + best_length] == data[pos + best_length]) {
+                                auto length = match_length(data + candidate, data + pos, max_length);
+                                if (length > best_length) {
+                                    best_length = length;
+                                    best_dist = pos - candidate;
+                                    if (length >= NICE_MATCH || length == max_length) {
+                                        break;
+                                    }
+                                }
+                            }
+                            candidate = this->prev[candidate & (WINDOW_SIZE - 1)];
+                        }
+                    }
+
+                    if (best_length >= MIN_MATCH) {
+                        this->symbols.push_back({ (uint16_t) best_length, (uint16_t) best_dist });
+                        this->litlen_freqs[257 + TABLES.length_code[best_length]]++;
+                        this->dist_freqs[TABLES.dist_code[best_dist]]++;
+
+                        // keep the chains complete for the skipped positions
+                        auto end = pos + best_length;
+                        for (pos++; pos < end; pos++) {
+                            if (pos + MIN_MATCH <= size) {
+                                this->insert(data, pos);
+                            }
+                        }
+                    } else {
+                        this->symbols.push_back({ data[pos], 0 });
+                        this->litlen_freqs[data[pos]]++;
+                        pos++;
+                    }
+
+                    if (this->symbols.size() >= BLOCK_SYMBOLS) {
+                        this->write_block(data + block_start, pos - block_start, false);
+                        block_start = pos;
+                    }
+                }
+                this->write_block(data + block_start, pos - block_start, last);
+
+                // empty stored block to end on a byte boundary, so the next strip can be appended
+                if (!last) {
+                    this->writer.put(0, 3);
+                    this->writer.align();
+                    out.insert(out.end(), { 0x00, 0x00, 0xFF, 0xFF });
+                } else {
+                    this->writer.align();
+                }
+            }
+
+        private:
+
+            // configuration
+            constexpr static size_t WINDOW_SIZE = 32768;
+            constexpr static size_t HASH_BITS = 15;
+            constexpr static size_t HASH_SIZE = 1 << HASH_BITS;
+            constexpr static size_t MIN_MATCH = 3;
+            constexpr static size_t MAX_MATCH = 258;
+            constexpr static size_t NICE_MATCH = 128;
+            constexpr static size_t MAX_CHAIN = 16;
+            constexpr static size_t BLOCK_SYMBOLS = 32768;
+
+            struct Symbol {
+                uint16_t value;     // literal or match length
+                uint16_t dist;      // zero for literals
+            };
+
+            BitWriter writer;
+            std::vector<int32_t> head;
+            std::vector<int32_t> prev;
+            std::vector<Symbol> symbols;
+            uint32_t litlen_freqs[286] {};
+            uint32_t dist_freqs[30] {};
+
+            // adds the position to its hash chain and returns the previous chain head
+            inline int32_t insert(const uint8_t *data, size_t pos) {
+                uint32_t value = data[pos] | (data[pos + 1] << 8) | (data[pos + 2] << 16);
+                auto hash = (value * 2654435761u) >> (32 - HASH_BITS);
+                auto candidate = this->head[hash];
+                this->head[hash] = (int32_t) pos;
+                this->prev[pos & (WINDOW_SIZE - 1)] = candidate;
+                return candidate;
+            }
+
+            static inline size_t match_length(const uint8_t *a, const uint8_t *b, size_t max_length) {
+                size_t length = 0;
+                while (length + 8 <= max_length) {
+                    uint64_t x, y;
+                    memcpy(&x, a + length, 8);
+                    memcpy(&y, b + length, 8);
+                    if (x != y) {
+                        return length + (std::countr_zero(x ^ y) >> 3);
+                    }
+                    length += 8;
+                }
+                while (length < max_length && a[length] == b[length]) {
+                    length++;
+                }
+                return length;
+            }
+
+            void reset_block() {
+                this->symbols.clear();
+                std::fill_n(this->litlen_freqs, 286, 0);
+                std::fill_n(this->dist_freqs, 30, 0);
+            }
+
+            // size of the block data in bits, excluding the extra bits which are the same for any table
+            size_t data_cost(const uint8_t *litlen_lengths, const uint8_t *dist_lengths) {
+                size_t cost = 0;
+                for (size_t i = 0; i < 286; i++) {
+                    cost += (size_t) this->litlen_freqs[i] * litlen_lengths[i];
+                }
+                for (size_t i = 0; i < 30; i++) {
+                    cost += (size_t) this->dist_freqs[i] * dist_lengths[i];
+                }
+                return cost;
+            }
+
+            void write_block(const uint8_t *data, size_t size, bool final) {
+                this->litlen_freqs[256]++;
+
+                // dynamic tables
+                uint8_t litlen_lengths[286];
+                uint8_t dist_lengths[30];
+                huffman_lengths(this->litlen_freqs, 286, 15, litlen_lengths);
+                huffman_lengths(this->dist_freqs, 30, 15, dist_lengths);
+                size_t litlen_count = 286;
+                while (litlen_count > 257 && litlen_lengths[litlen_count - 1] == 0) {
+                    litlen_count--;
+                }
+                size_t dist_count = 30;
+                while (dist_count > 1 && dist_lengths[dist_count - 1] == 0) {
+                    dist_count--;
+                }
+
+                // run length encode the code lengths of both tables as one sequence
+                uint8_t sequence[286 + 30];
+                std::copy_n(litlen_lengths, litlen_count, sequence);
+                std::copy_n(dist_lengths, dist_count, sequence + litlen_count);
+                size_t sequence_size = litlen_count + dist_count;
+                std::pair<uint8_t, uint8_t> runs[286 + 30];
+                size_t run_count = 0;
+                uint32_t code_length_freqs[19] {};
+                for (size_t i = 0; i < sequence_size;) {
+                    auto value = sequence[i];
+                    size_t run = 1;
+                    while (i + run < sequence_size && sequence[i + run] == value) {
+                        run++;
+                    }
+                    i += run;
+                    if (value == 0) {
+                        while (run >= 3) {
+                            auto length = std::min(run, (size_t) 138);
+                            if (length >= 11) {
+                                runs[run_count++] = { 18, (uint8_t) (length - 11) };
+                            } else {
+                                runs[run_count++] = { 17, (uint8_t) (length - 3) };
+                            }
+                            run -= length;
+                        }
+                    } else {
+                        runs[run_count++] = { value, 0 };
+                        run--;
+                        while (run >= 3) {
+                            auto length = std::min(run, (size_t) 6);
+                            runs[run_count++] = { 16, (uint8_t) (length - 3) };
+                            run -= length;
+                        }
+                    }
+                    while (run > 0) {
+                        runs[run_count++] = { value, 0 };
+                        run--;
+                    }
+                }
+                for (size_t i = 0; i < run_count; i++) {
+                    code_length_freqs[runs[i].first]++;
+                }
+                uint8_t code_length_lengths[19];
+                huffman_lengths(code_length_freqs, 19, 7, code_length_lengths);
+                size_t code_length_count = 19;
+                while (code_length_count > 4
+                        && code_length_lengths[CODE_LENGTH_ORDER[code_length_count - 1]] == 0) {
+                    code_length_count--;
+                }
+
+                // compare the block sizes
+                size_t extra_cost = 0;
+                for (size_t i = 0; i < 29; i++) {
+                    extra_cost += (size_t) this->litlen_freqs[257 + i] * LENGTH_EXTRA[i];
+                }
+                for (size_t i = 0; i < 30; i++) {
+                    extra_cost += (size_t) this->dist_freqs[i] * DIST_EXTRA[i];
+                }
+                size_t dynamic_cost = 3 + 14 + code_length_count * 3 + extra_cost
+                        + this->data_cost(litlen_lengths, dist_lengths);
+                for (size_t i = 0; i < 19; i++) {
+                    static const uint8_t RUN_EXTRA[3] { 2, 3, 7 };
+                    dynamic_cost += (size_t) code_length_freqs[i] * (code_length_lengths[i]
+                            + (i >= 16 ? RUN_EXTRA[i - 16] : 0));
+                }
+                size_t fixed_cost = 3 + extra_cost + this->data_cost(TABLES.fixed_litlen, TABLES.fixed_dist);
+                size_t stored_cost = (size + 5 * (size / 65535 + 1)) * 8 + 7;
+
+                if (stored_cost <= dynamic_cost && stored_cost <= fixed_cost) {
+                    size_t offset = 0;
+                    do {
+                        auto length = std::min(size - offset, (size_t) 65535);
+                        this->writer.put((final && offset + length == size) ? 1 : 0, 3);
+                        this->writer.align();
+                        auto &out = *this->writer.out;
+                        out.insert(out.end(), {
+                            (uint8_t) length, (uint8_t) (length >> 8),
+                            (uint8_t) ~length, (uint8_t) (~length >> 8),
+                        });
+                        out.insert(out.end(), data + offset, data + offset + length);
+                        offset += length;
+                    } while (offset < size);
+                } else if (fixed_cost <= dynamic_cost) {
+                    uint16_t litlen_codes[288];
+                    uint16_t dist_codes[30];
+                    huffman_codes(TABLES.fixed_litlen, 288, litlen_codes);
+                    huffman_codes(TABLES.fixed_dist, 30, dist_codes);
+                    this->writer.put((final ? 1 : 0) | (1 << 1), 3);
+                    this->write_symbols(TABLES.fixed_litlen, litlen_codes, TABLES.fixed_dist, dist_codes);
+                } else {
+                    uint16_t litlen_codes[286];
+                    uint16_t dist_codes[30];
+                    uint16_t code_length_codes[19];
+                    huffman_codes(litlen_lengths, 286, litlen_codes);
+                    huffman_codes(dist_lengths, 30, dist_codes);
+                    huffman_codes(code_length_lengths, 19, code_length_codes);
+                    this->writer.put((final ? 1 : 0) | (2 << 1), 3);
+                    this->writer.put((uint32_t) (litlen_count - 257), 5);
+                    this->writer.put((uint32_t) (dist_count - 1), 5);
+                    this->writer.put((uint32_t) (code_length_count - 4), 4);
+                    for (size_t i = 0; i < code_length_count; i++) {
+                        this->writer.put(code_length_lengths[CODE_LENGTH_ORDER[i]], 3);
+                    }
+                    for (size_t i = 0; i < run_count; i++) {
+                        auto symbol = runs[i].first;
+                        this->writer.put(code_length_codes[symbol], code_length_lengths[symbol]);
+                        if (symbol == 16) {
+                            this->writer.put(runs[i].second, 2);
+                        } else if (symbol == 17) {
+                            this->writer.put(runs[i].second, 3);
+                        } else if (symbol == 18) {
+                            this->writer.put(runs[i].second, 7);
+                        }
+                    }
+                    this->write_symbols(litlen_lengths, litlen_codes, dist_lengths, dist_codes);
+                }
+
+                this->reset_block();
+            }
+
+            void write_symbols(const uint8_t *litlen_lengths, const uint16_t *litlen_codes,
+                    const uint8_t *dist_lengths, const uint16_t *dist_codes) {
+                for (auto &symbol : this->symbols) {
+                    if (symbol.dist == 0) {
+                        this->writer.put(litlen_codes[symbol.value], litlen_lengths[symbol.value]);
+                        continue;
+                    }
+                    auto length_code = TABLES.length_code[symbol.value];
+                    this->writer.put(litlen_codes[257 + length_code], litlen_lengths[257 + length_code]);
+                    this->writer.put(symbol.value - LENGTH_BASE[length_code], LENGTH_EXTRA[length_code]);
+                    auto dist_code = TABLES.dist_code[symbol.dist];
+                    this->writer.put(dist_codes[dist_code], dist_lengths[dist_code]);
+                    this->writer.put(symbol.dist - DIST_BASE[dist_code], DIST_EXTRA[dist_code]);
+                }
+                this->writer.put(litlen_codes[256], litlen_lengths[256]);
+            }
+        };
+    }
+
+    static inline void write_u32(uint8_t *dst, uint32_t value) {
+        dst[0] = (uint8_t) (value >> 24);
+        dst[1] = (uint8_t) (value >> 16);
+        dst[2] = (uint8_t) (value >> 8);
+        dst[3] = (uint8_t) value;
+    }
+
+    static bool write_chunk(const PNGEncoder::Writer &writer, const char *type,
+            const uint8_t *data, size_t size, uint32_t crc) {
+        uint8_t header[8];
+        write_u32(header, (uint32_t) size);
+        memcpy(header + 4, type, 4);
+        uint8_t footer[4];
+        write_u32(footer, crc);
+        return writer(header, sizeof(header))
+            && (size == 0 || writer(data, size))
+            && writer(footer, sizeof(footer));
+    }
+
+    static bool write_chunk(const PNGEncoder::Writer &writer, const char *type, const uint8_t *data, size_t size) {
+        auto crc = crc32(crc32(0, reinterpret_cast<const uint8_t *>(type), 4), data, size);
+        return write_chunk(writer, type, data, size, crc);
+    }
+
+    bool PNGEncoder::encode(const Writer &writer, const uint8_t *rgb, size_t width, size_t height) {
+        if (rgb == nullptr || width == 0 || height == 0 || width > 0x1FFFFFFF || height > 0x7FFFFFFF) {
+            return false;
+        }
+
+        // deflate strips independently, more of them than threads so they finish close together
+        size_t thread_count = encoder_worker_count() + 1;
+        size_t strip_count = std::clamp(height / strip_min_rows, (size_t) 1, thread_count * 4);
+        this->strips.resize(strip_count);
+
+        // encode strips in the background
+        std::atomic<size_t> next_strip = 0;
+        std::vector<bool> finished(strip_count);
+        std::mutex finished_m;
+        std::condition_variable finished_cv;
+        auto encode_next = [&] {
+            size_t strip = next_strip++;
+            if (strip >= strip_count) {
+                return false;
+            }
+            encode_strip(rgb, width,
+                    height * strip / strip_count,
+                    height * (strip + 1) / strip_count,
+                    strip == 0, strip + 1 == strip_count,
+                    this->strips[strip]);
+            {
+                std::lock_guard<std::mutex> lock(finished_m);
+                finished[strip] = true;
+            }
+            finished_cv.notify_all();
+            return true;
+        };
+        std::vector<std::future<void>> futures;
+        for (size_t i = 0; i < std::min(strip_count, thread_count) - 1; i++) {
+            futures.emplace_back(encoder_worker_pool().add([&encode_next] {
+                while (encode_next());
+            }));
+        }
+
+        // headers
+        uint8_t header[13];
+        write_u32(header, (uint32_t) width);
+        write_u32(header + 4, (uint32_t) height);
+        header[8] = 8;      // bit depth
+        header[9] = 2;      // RGB
+        header[10] = 0;     // deflate
+        header[11] = 0;     // adaptive filtering
+        header[12] = 0;     // no interlacing
+        bool success = writer(PNG_SIGNATURE, sizeof(PNG_SIGNATURE))
+                && write_chunk(writer, "IHDR", header, sizeof(header));
+
+        // write out strips in order, the calling thread helps out while waiting
+        uint32_t adler = 1;
+        for (size_t i = 0; i < strip_count && success; i++) {
+            while (true) {
+                {
+                    std::unique_lock<std::mutex> lock(finished_m);
+                    if (finished[i]) {
+                        break;
+                    }
+                }
+                if (!encode_next()) {
+                    std::unique_lock<std::mutex> lock(finished_m);
+                    finished_cv.wait(lock, [&finished, i] { return finished[i]; });
+                    break;
+                }
+            }
+            auto &strip = this->strips[i];
+            adler = adler32_combine(adler, strip.adler, strip.length);
+
+            // the zlib checksum finishes the last strip
+            if (i + 1 == strip_count) {
+                uint8_t checksum[4];
+                write_u32(checksum, adler);
+                strip.data.insert(strip.data.end(), checksum, checksum + 4);
+                strip.crc = crc32(strip.crc, checksum, 4);
+            }
+            success = write_chunk(writer, "IDAT", strip.data.data(), strip.data.size(), strip.crc);
+        }
+
+        // stop remaining work on failure
+        next_strip = strip_count;
+        for (auto &future : futures) {
+            future.wait();
+        }
+
+        return success && write_chunk(writer, "IEND", nullptr, 0);
+    }
+
+    bool PNGEncoder::encode(std::vector<uint8_t> &out, const uint8_t *rgb, size_t width, size_t height) {
+        out.clear();
+        return this->encode([&out] (const uint8_t *data, size_t size) {
+            out.insert(out.end(), data, data + size);
+            return true;
+        }, rgb, width, height);
+    }
+
+    void PNGEncoder::encode_strip(const uint8_t *rgb, size_t width,
+            size_t row_start, size_t row_end, bool first, bool last, Strip &strip) {
+        size_t stride = width * 3;
+        size_t row_size = stride + 1;
+        static thread_local std::vector<uint8_t> FILTERED, CANDIDATE, ROWS[2];
+        static thread_local Deflater DEFLATER;
+        FILTERED.resize((row_end - row_start) * row_size);
+        CANDIDATE.resize(stride);
+
+        // rows with a black pixel in front, so the filters need no special case for the left edge
+        ROWS[0].assign(stride + 3, 0);
+        ROWS[1].assign(stride + 3, 0);
+        if (row_start > 0) {
+            memcpy(ROWS[(row_start + 1) & 1].data() + 3, rgb + (row_start - 1) * stride, stride);
+        }
+
+        // filter each row with the type that has the lowest sum of absolute differences
+        for (size_t y = row_start; y < row_end; y++) {
+            auto cur = ROWS[y & 1].data() + 3;
+            auto up = ROWS[(y + 1) & 1].data() + 3;
+            memcpy(cur, rgb + y * stride, stride);
+            auto dst = &FILTERED[(y - row_start) * row_size];
+
+            // none
+            uint8_t best_type = 0;
+            auto best_cost = filter_row(cur, up, dst + 1, stride, [] (int, int, int) { return 0; });
+
+            // the others, keeping the better candidate in the output
+            auto candidate = CANDIDATE.data();
+            auto try_filter = [&] (uint8_t type, auto predict) {
+                auto cost = filter_row(cur, up, candidate, stride, predict);
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_type = type;
+                    std::swap_ranges(candidate, candidate + stride, dst + 1);
+                }
+            };
+            try_filter(1, [] (int a, int, int) { return a; });
+            try_filter(2, [] (int, int b, int) { return b; });
+            try_filter(3, [] (int a, int b, int) { return (a + b) >> 1; });
+            try_filter(4, [] (int a, int b, int c) {
+                int pa = std::abs(b - c);
+                int pb = std::abs(a - c);
+                int pc = std::abs(a + b - 2 * c);
+                return pa <= pb && pa <= pc ? a : (pb <= pc ? b : c);
+            });
+            dst[0] = best_type;
+        }
+
+        // compress, with the zlib header in front of the first strip
+        strip.data.clear();
+        if (first) {
+            strip.data.insert(strip.data.end(), { 0x78, 0x01 });
+        }
+        DEFLATER.compress(strip.data, FILTERED.data(), FILTERED.size(), last);
+
+        // checksums
+        strip.length = FILTERED.size();
+        strip.adler = adler32(1, FILTERED.data(), FILTERED.size());
+        strip.crc = crc32(crc32(0, reinterpret_cast<const uint8_t *>("IDAT"), 4),
+                strip.data.data(), strip.data.size());
+    }
+}
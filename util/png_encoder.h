@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace util {
+
+    /*
+     * PNG encoder for RGB24 images.
+     *
+     * Strips of rows are filtered and deflated independently on the shared worker threads. Every strip but
+     * the last ends on a byte boundary with an empty stored block, so the strips concatenate into a single
+     * zlib stream like pigz does it, and each one is written as its own IDAT chunk as soon as it is ready.
+     *
+     * An instance keeps its buffers between calls and must not be used by multiple threads at once.
+     */
+    class PNGEncoder {
+    public:
+
+        // receives the output in order, returning false aborts the encoding
+        typedef std::function<bool(const uint8_t *data, size_t size)> Writer;
+
+        /*
+         * Encodes the image and streams it into the writer.
+         */
+        bool encode(const Writer &writer, const uint8_t *rgb, size_t width, size_t height);
+
+        /*
+         * Encodes the image into the output buffer, replacing its contents.
+         */
+        bool encode(std::vector<uint8_t> &out, const uint8_t *rgb, size_t width, size_t height);
+
+    private:
+
+        // configuration
+        const static size_t strip_min_rows = 32;
+
+        struct Strip {
+            std::vector<uint8_t> data;
+            uint32_t adler = 1;
+            uint32_t crc = 0;
+            size_t length = 0;
+        };
+
+        std::vector<Strip> strips;
+
+        static void encode_strip(const uint8_t *rgb, size_t width,
+                size_t row_start, size_t row_end, bool first, bool last, Strip &strip);
+    };
+}
@@ -1,4 +1,6 @@
 #include "rc4.h"
+#include <algorithm>
+#include <cstring>
 #include <iterator>
 #include "util/logging.h"
 
@@ -26,21 +28,59 @@ util::RC4::RC4(uint8_t *key, size_t key_size) {
     }
 }
 
-void util::RC4::crypt(uint8_t *data, size_t size) {
+void util::RC4::generate() {
 
-    // iterate all bytes
-    for (size_t pos = 0; pos < size; pos++) {
+    // work on locals so the indices stay in registers and wrap by themselves
+    uint8_t i = a;
+    uint8_t j = b;
+    auto s = s_box;
+    for (size_t pos = 0; pos < std::size(keystream); pos++) {
 
         // update
-        a = (a + 1) % std::size(s_box);
-        b = (b + s_box[a]) % std::size(s_box);
+        i++;
+        auto si = s[i];
+        j += si;
 
         // swap
-        auto tmp = s_box[a];
-        s_box[a] = s_box[b];
-        s_box[b] = tmp;
+        auto sj = s[j];
+        s[i] = sj;
+        s[j] = si;
+
+        // output
+        keystream[pos] = s[(uint8_t) (si + sj)];
+    }
+    a = i;
+    b = j;
+    keystream_pos = 0;
+}
+
+void util::RC4::crypt(uint8_t *data, size_t size) {
+    while (size > 0) {
+
+        // refill keystream
+        if (keystream_pos == std::size(keystream))
+            generate();
+
+        // apply as much of the buffered keystream as possible
+        auto count = std::min(size, std::size(keystream) - keystream_pos);
+        auto stream = &keystream[keystream_pos];
+        size_t pos = 0;
+
+        // eight bytes at once
+        for (; pos + 8 <= count; pos += 8) {
+            uint64_t value, key;
+            memcpy(&value, data + pos, sizeof(value));
+            memcpy(&key, stream + pos, sizeof(key));
+            value ^= key;
+            memcpy(data + pos, &value, sizeof(value));
+        }
+
+        // remaining bytes
+        for (; pos < count; pos++)
+            data[pos] ^= stream[pos];
 
-        // crypt
-        data[pos] ^= s_box[(s_box[a] + s_box[b]) % std::size(s_box)];
+        keystream_pos += count;
+        data += count;
+        size -= count;
     }
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
 namespace util {
@@ -7,7 +8,13 @@ namespace util {
     class RC4 {
     private:
         uint8_t s_box[256];
-        size_t a = 0, b = 0;
+        uint8_t a = 0, b = 0;
+
+        // keystream generated ahead in blocks
+        uint8_t keystream[256];
+        size_t keystream_pos = sizeof(keystream);
+
+        void generate();
 
     public:
 
@@ -1,90 +1,558 @@
 #include "sigscan.h"
 
-#include <sstream>
+#include <bit>
+#include <cctype>
+#include <cstring>
 #include <vector>
 
-#include "util/logging.h"
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIGSCAN_SSE2
+#include <emmintrin.h>
+#endif
+
 #include "util/memutils.h"
 #include "util/utils.h"
 
-intptr_t find_pattern(std::vector<uint8_t> &data, intptr_t base, const uint8_t *pattern,
-        const char *mask, intptr_t offset, intptr_t usage)
+// byte values which are very common in x86 code and data, most frequent first
+static const uint8_t COMMON_BYTES[] {
+    0x00, 0xFF, 0xCC, 0x8B, 0x48, 0x89, 0x24, 0x0F, 0x44, 0x4C, 0x01, 0xE8, 0x85, 0x83,
+    0x45, 0x8D, 0x74, 0x75, 0x10, 0x08, 0x04, 0xC0, 0x40, 0x41, 0x20, 0x90, 0xC3, 0x49,
+    0x50, 0x02, 0x03, 0x4D, 0xE9, 0x5D, 0x55, 0xC7, 0x80, 0x18, 0x0C, 0x84,
+};
+
+static size_t byte_rarity(uint8_t value) {
+    for (size_t i = 0; i < std::size(COMMON_BYTES); i++) {
+        if (COMMON_BYTES[i] == value) {
+            return i;
+        }
+    }
+    return std::size(COMMON_BYTES);
+}
+
+SignaturePattern::SignaturePattern(const uint8_t *pattern, const char *mask) {
+    auto length = strlen(mask);
+    this->bytes.resize(length);
+    this->mask.resize(length);
+    for (size_t i = 0; i < length; i++) {
+        this->mask[i] = mask[i] == 'X' ? 0xFF : 0x00;
+        this->bytes[i] = pattern[i] & this->mask[i];
+    }
+    this->compile();
+}
+
+std::optional<SignaturePattern> SignaturePattern::parse(const std::string &hex) {
+    SignaturePattern pattern;
+    for (size_t i = 0; i < hex.length(); i++) {
+
+        // skip whitespace
+        if (isspace(static_cast<unsigned char>(hex[i]))) {
+            continue;
+        }
+        if (i + 1 >= hex.length()) {
+            return std::nullopt;
+        }
+
+        // wildcard
+        if (hex[i] == '?' && hex[i + 1] == '?') {
+            pattern.bytes.push_back(0x00);
+            pattern.mask.push_back(0x00);
+            i++;
+            continue;
+        }
+
+        // hex byte
+        auto high = _hex2bin_helper(hex[i]);
+        auto low = _hex2bin_helper(hex[i + 1]);
+        if (high < 0 || low < 0) {
+            return std::nullopt;
+        }
+        pattern.bytes.push_back(static_cast<uint8_t>(high * 16 + low));
+        pattern.mask.push_back(0xFF);
+        i++;
+    }
+
+    pattern.compile();
+    return pattern;
+}
+
+void SignaturePattern::compile() {
+
+    // pick the rarest fixed byte
+    this->wildcard_only = true;
+    size_t best_rarity = 0;
+    for (size_t i = 0; i < this->bytes.size(); i++) {
+        if (this->mask[i]) {
+            auto rarity = byte_rarity(this->bytes[i]);
+            if (this->wildcard_only || rarity > best_rarity) {
+                this->anchor_first = i;
+                best_rarity = rarity;
+            }
+            this->wildcard_only = false;
+        }
+    }
+    if (this->wildcard_only) {
+        return;
+    }
+
+    // pick the rarest of the others, falling back to the same one for single byte patterns
+    this->anchor_second = this->anchor_first;
+    bool found = false;
+    for (size_t i = 0; i < this->bytes.size(); i++) {
+        if (this->mask[i] && i != this->anchor_first) {
+            auto rarity = byte_rarity(this->bytes[i]);
+            if (!found || rarity > best_rarity) {
+                this->anchor_second = i;
+                best_rarity = rarity;
+                found = true;
+            }
+        }
+    }
+}
+
+bool SignaturePattern::matches(const uint8_t *data) const {
+    auto size = this->bytes.size();
+    auto bytes = this->bytes.data();
+    auto mask = this->mask.data();
+
+    // compare 8 bytes at once
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t data_word, bytes_word, mask_word;
+        memcpy(&data_word, data + i, 8);
+        memcpy(&bytes_word, bytes + i, 8);
+        memcpy(&mask_word, mask + i, 8);
+        if ((data_word ^ bytes_word) & mask_word) {
+            return false;
+        }
+    }
+
+    // remainder
+    for (; i < size; i++) {
+        if ((data[i] ^ bytes[i]) & mask[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const uint8_t *SignaturePattern::find(const uint8_t *begin, const uint8_t *end, const uint8_t *limit) const {
+
+    // get the range of possible start positions
+    auto size = this->bytes.size();
+    if (limit < begin || static_cast<size_t>(limit - begin) < size) {
+        return nullptr;
+    }
+    auto last = std::min(end, limit - size + 1);
+    if (begin >= last) {
+        return nullptr;
+    }
+    if (this->wildcard_only) {
+        return begin;
+    }
+
+    auto first_offset = this->anchor_first;
+    auto second_offset = this->anchor_second;
+    auto first_value = this->bytes[first_offset];
+    auto second_value = this->bytes[second_offset];
+    auto cur = begin;
+
+#ifdef SIGSCAN_SSE2
+
+    // check both anchors for 32 positions per iteration, skipping ahead while the rarer one is missing
+    auto first_vector = _mm_set1_epi8(static_cast<char>(first_value));
+    auto second_vector = _mm_set1_epi8(static_cast<char>(second_value));
+    for (; last - cur >= 32; cur += 32) {
+        auto first_low = _mm_cmpeq_epi8(first_vector,
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(cur + first_offset)));
+        auto first_high = _mm_cmpeq_epi8(first_vector,
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(cur + first_offset + 16)));
+        if (!_mm_movemask_epi8(_mm_or_si128(first_low, first_high))) {
+            continue;
+        }
+        auto second_low = _mm_cmpeq_epi8(second_vector,
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(cur + second_offset)));
+        auto second_high = _mm_cmpeq_epi8(second_vector,
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(cur + second_offset + 16)));
+        auto hits = static_cast<uint32_t>(_mm_movemask_epi8(_mm_and_si128(first_low, second_low)))
+                | (static_cast<uint32_t>(_mm_movemask_epi8(_mm_and_si128(first_high, second_high))) << 16);
+        while (hits) {
+            auto candidate = cur + std::countr_zero(hits);
+            if (this->matches(candidate)) {
+                return candidate;
+            }
+            hits &= hits - 1;
+        }
+    }
+
+#endif
+
+    // look for the first anchor byte
+    while (cur < last) {
+        auto hit = static_cast<const uint8_t *>(memchr(cur + first_offset, first_value, last - cur));
+        if (!hit) {
+            break;
+        }
+        cur = hit - first_offset;
+        if (cur[second_offset] == second_value && this->matches(cur)) {
+            return cur;
+        }
+        cur++;
+    }
+
+    return nullptr;
+}
+
+void SignaturePattern::apply(uint8_t *target) const {
+    for (size_t i = 0; i < this->bytes.size(); i++) {
+        if (this->mask[i]) {
+            target[i] = this->bytes[i];
+        }
+    }
+}
+
+/*
+ * Part of the mapped image, ranges cover the image in address order.
+ */
+struct ModuleRange {
+    size_t begin;
+    size_t end;
+    bool code;
+};
+
+/*
+ * Gets the mapped image of the module and its scan ranges.
+ */
+static bool module_ranges(HMODULE module, const uint8_t **image, size_t *size,
+        std::vector<ModuleRange> &ranges)
 {
+    if (module == nullptr) {
+        return false;
+    }
 
-    // build pattern
-    std::vector<std::pair<uint8_t, bool>> pattern_vector;
-    size_t mask_size = strlen(mask);
-    for (size_t i = 0; i < mask_size; i++) {
-        pattern_vector.emplace_back(pattern[i], mask[i] == 'X');
+    // get the image bounds from the mapped headers
+    *image = reinterpret_cast<const uint8_t *>(module);
+    auto dos_header = reinterpret_cast<const IMAGE_DOS_HEADER *>(*image);
+    const IMAGE_NT_HEADERS *nt_headers = nullptr;
+    if (dos_header->e_magic == IMAGE_DOS_SIGNATURE) {
+        nt_headers = reinterpret_cast<const IMAGE_NT_HEADERS *>(*image + dos_header->e_lfanew);
+        if (nt_headers->Signature != IMAGE_NT_SIGNATURE) {
+            nt_headers = nullptr;
+        }
+    }
+
+    // fall back to treating the whole image as code
+    if (nt_headers == nullptr) {
+        MODULEINFO module_info {};
+        if (!GetModuleInformation(GetCurrentProcess(), module, &module_info, sizeof(module_info))) {
+            return false;
+        }
+        *image = reinterpret_cast<const uint8_t *>(module_info.lpBaseOfDll);
+        *size = static_cast<size_t>(module_info.SizeOfImage);
+        ranges.push_back(ModuleRange { 0, *size, true });
+        return true;
+    }
+    *size = static_cast<size_t>(nt_headers->OptionalHeader.SizeOfImage);
+
+    // collect executable sections
+    std::vector<std::pair<size_t, size_t>> code_ranges;
+    auto section = IMAGE_FIRST_SECTION(nt_headers);
+    for (WORD i = 0; i < nt_headers->FileHeader.NumberOfSections; i++, section++) {
+        if (!(section->Characteristics & IMAGE_SCN_MEM_EXECUTE)) {
+            continue;
+        }
+        size_t start = std::min<size_t>(section->VirtualAddress, *size);
+        size_t end = std::min<size_t>(
+                start + std::max(section->Misc.VirtualSize, section->SizeOfRawData), *size);
+        if (start < end) {
+            code_ranges.emplace_back(start, end);
+        }
+    }
+
+    // merge them so matches across adjacent sections are found once, and fill the gaps with the rest
+    // of the image so every start position is covered by exactly one range
+    std::sort(code_ranges.begin(), code_ranges.end());
+    size_t position = 0;
+    for (auto &range : code_ranges) {
+        if (!ranges.empty() && ranges.back().code && ranges.back().end >= range.first) {
+            ranges.back().end = std::max(ranges.back().end, range.second);
+            position = ranges.back().end;
+            continue;
+        }
+        if (position < range.first) {
+            ranges.push_back(ModuleRange { position, range.first, false });
+        }
+        ranges.push_back(ModuleRange { range.first, range.second, true });
+        position = range.second;
+    }
+    if (position < *size) {
+        ranges.push_back(ModuleRange { position, *size, false });
     }
 
-    // the scan loop
-    auto data_begin = data.begin();
-    auto cur_usage = 0;
-    while (true) {
+    return true;
+}
+
+size_t SignatureBatch::add(const SignaturePattern &pattern, intptr_t usage) {
+    this->patterns.push_back(pattern);
+    this->usages.push_back(usage);
+    return this->patterns.size() - 1;
+}
 
-        // search for the pattern
-        auto search_result = std::search(data_begin, data.end(), pattern_vector.begin(), pattern_vector.end(),
-                               [&](uint8_t c, std::pair<uint8_t, bool> pat) {
-                                   return (!pat.second) || c == pat.first;
-                               });
+void SignatureBatch::build() {
+    std::vector<std::pair<uint32_t, Anchor>> pairs;
+    std::vector<std::pair<uint32_t, Anchor>> singles;
+    this->wildcard_patterns.clear();
+    this->anchor_offset_max = 0;
 
-        // check for a match
-        if (search_result != data.end()) {
+    // pick an anchor for every pattern
+    for (uint32_t index = 0; index < this->patterns.size(); index++) {
+        auto &pattern = this->patterns[index];
+        if (pattern.wildcard_only) {
+            this->wildcard_patterns.push_back(index);
+            continue;
+        }
 
-            // return the result if we hit the usage count
-            if (cur_usage == usage) {
-                return (std::distance(data.begin(), search_result) + base) + offset;
+        // rarest pair of adjacent fixed bytes
+        bool pair_found = false;
+        size_t pair_offset = 0;
+        size_t pair_rarity = 0;
+        for (size_t i = 0; i + 1 < pattern.size(); i++) {
+            if (pattern.mask[i] && pattern.mask[i + 1]) {
+                auto rarity = byte_rarity(pattern.bytes[i]) + byte_rarity(pattern.bytes[i + 1]);
+                if (!pair_found || rarity > pair_rarity) {
+                    pair_found = true;
+                    pair_offset = i;
+                    pair_rarity = rarity;
+                }
             }
+        }
 
-            // increment the found count
-            ++cur_usage;
-            data_begin = ++search_result;
+        // fall back to the rarest byte
+        if (pair_found) {
+            uint32_t key = pattern.bytes[pair_offset] | (pattern.bytes[pair_offset + 1] << 8);
+            pairs.emplace_back(key, Anchor { index, static_cast<uint32_t>(pair_offset) });
+            this->anchor_offset_max = std::max(this->anchor_offset_max, pair_offset);
         } else {
-            break;
+            uint32_t key = pattern.bytes[pattern.anchor_first];
+            singles.emplace_back(key, Anchor { index, static_cast<uint32_t>(pattern.anchor_first) });
+            this->anchor_offset_max = std::max(this->anchor_offset_max, pattern.anchor_first);
+        }
+    }
+
+    // bucket the anchors by key
+    auto bucket = [] (std::vector<std::pair<uint32_t, Anchor>> &entries, size_t key_count,
+            std::vector<Anchor> &anchors, std::vector<uint32_t> &buckets) {
+        buckets.assign(key_count + 1, 0);
+        for (auto &entry : entries) {
+            buckets[entry.first + 1]++;
         }
+        for (size_t key = 0; key < key_count; key++) {
+            buckets[key + 1] += buckets[key];
+        }
+        anchors.resize(entries.size());
+        std::vector<uint32_t> fill(buckets.begin(), buckets.end() - 1);
+        for (auto &entry : entries) {
+            anchors[fill[entry.first]++] = entry.second;
+        }
+    };
+    bucket(pairs, 65536, this->pair_anchors, this->pair_buckets);
+    bucket(singles, 256, this->byte_anchors, this->byte_buckets);
+
+    // bit set of the used pairs, small enough to stay in the L1 cache
+    this->pair_filter.assign(65536 / 64, 0);
+    for (auto &entry : pairs) {
+        this->pair_filter[entry.first >> 6] |= 1ull << (entry.first & 63);
+    }
+}
+
+void SignatureBatch::scan_range(const uint8_t *begin, const uint8_t *end, const uint8_t *data_begin,
+        const uint8_t *limit, intptr_t base)
+{
+    // empty data may come without a buffer, which the pointer math below can't handle
+    if (begin >= end) {
+        return;
+    }
+
+    auto results = this->results.data();
+    auto patterns = this->patterns.data();
+    auto usages = this->usages.data();
+
+    // verifies a candidate and records the match
+    auto check = [&] (const uint8_t *position, const Anchor &anchor) {
+        if (static_cast<size_t>(position - begin) < anchor.offset) {
+            return;
+        }
+        auto start = position - anchor.offset;
+        auto &pattern = patterns[anchor.pattern];
+        if (start >= end || static_cast<size_t>(limit - start) < pattern.size() || !pattern.matches(start)) {
+            return;
+        }
+        auto &result = results[anchor.pattern];
+        if (static_cast<intptr_t>(result.count) == usages[anchor.pattern]) {
+            result.address = (start - data_begin) + base;
+        }
+        result.count++;
+    };
+
+    // anchors of patterns starting in the range may lie behind it
+    auto scan_end = static_cast<size_t>(limit - end) > this->anchor_offset_max
+            ? end + this->anchor_offset_max : limit;
+    auto pair_end = std::min(scan_end, limit - 1);
+    auto pair_filter = this->pair_filter.data();
+    auto pair_buckets = this->pair_buckets.data();
+    auto byte_buckets = this->byte_buckets.data();
+    bool has_bytes = !this->byte_anchors.empty();
+
+    for (auto position = begin; position < scan_end; position++) {
+
+        // byte pair anchors
+        if (position < pair_end) {
+            uint32_t key = position[0] | (position[1] << 8);
+            if (pair_filter[key >> 6] & (1ull << (key & 63))) {
+                for (auto i = pair_buckets[key]; i < pair_buckets[key + 1]; i++) {
+                    check(position, this->pair_anchors[i]);
+                }
+            }
+        }
+
+        // single byte anchors
+        if (has_bytes) {
+            auto key = position[0];
+            for (auto i = byte_buckets[key]; i < byte_buckets[key + 1]; i++) {
+                check(position, this->byte_anchors[i]);
+            }
+        }
+    }
+
+    // patterns without fixed bytes match at every position
+    for (auto index : this->wildcard_patterns) {
+        auto size = this->patterns[index].size();
+        if (static_cast<size_t>(limit - begin) < size) {
+            continue;
+        }
+        auto last = std::min(end, limit - size + 1);
+        if (begin >= last) {
+            continue;
+        }
+        auto &result = results[index];
+        auto count = static_cast<size_t>(last - begin);
+        auto usage = usages[index] - static_cast<intptr_t>(result.count);
+        if (usage >= 0 && static_cast<size_t>(usage) < count) {
+            result.address = (begin + usage - data_begin) + base;
+        }
+        result.count += count;
+    }
+}
+
+const std::vector<SignatureBatch::Result> &SignatureBatch::scan(const uint8_t *data, size_t size, intptr_t base) {
+    this->build();
+    this->results.assign(this->patterns.size(), Result {});
+    this->scan_range(data, data + size, data, data + size, base);
+    return this->results;
+}
+
+const std::vector<SignatureBatch::Result> &SignatureBatch::scan(HMODULE module) {
+    this->build();
+    this->results.assign(this->patterns.size(), Result {});
+
+    // get the image
+    const uint8_t *image = nullptr;
+    size_t size = 0;
+    std::vector<ModuleRange> ranges;
+    if (!module_ranges(module, &image, &size, ranges)) {
+        return this->results;
+    }
+
+    // every match is needed anyway, so scan in place in a single pass
+    this->scan_range(image, image + size, image, image + size, reinterpret_cast<intptr_t>(image));
+    return this->results;
+}
+
+intptr_t find_pattern(const uint8_t *data, size_t size, intptr_t base,
+        const SignaturePattern &pattern, intptr_t offset, intptr_t usage)
+{
+    auto end = data + size;
+    auto cur = data;
+    intptr_t cur_usage = 0;
+    while (auto match = pattern.find(cur, end, end)) {
+
+        // return the result if we hit the usage count
+        if (cur_usage == usage) {
+            return (match - data + base) + offset;
+        }
+
+        ++cur_usage;
+        cur = match + 1;
     }
 
     return 0;
 }
 
-intptr_t find_pattern(HMODULE module, const uint8_t *pattern, const char *mask,
-        intptr_t offset, intptr_t result_usage)
+intptr_t find_pattern(std::vector<uint8_t> &data, intptr_t base, const uint8_t *pattern,
+        const char *mask, intptr_t offset, intptr_t usage)
 {
-    // get module information
-    MODULEINFO module_info {};
-    if (!GetModuleInformation(GetCurrentProcess(), module, &module_info, sizeof(module_info))) {
+    return find_pattern(data.data(), data.size(), base, SignaturePattern(pattern, mask), offset, usage);
+}
+
+intptr_t find_pattern(HMODULE module, const SignaturePattern &pattern, intptr_t offset, intptr_t usage) {
+
+    // get scan ranges
+    const uint8_t *image = nullptr;
+    size_t size = 0;
+    std::vector<ModuleRange> ranges;
+    if (!module_ranges(module, &image, &size, ranges)) {
         return 0;
     }
+    auto limit = image + size;
 
-    auto size = static_cast<size_t>(module_info.SizeOfImage);
+    // the first match is usually code, so look there before scanning the data in front of it
+    if (usage == 0) {
+        const uint8_t *first = nullptr;
+        for (auto &range : ranges) {
+            if (range.code && (first = pattern.find(image + range.begin, image + range.end, limit))) {
+                break;
+            }
+        }
+        auto end = first ? first : limit;
+        for (auto &range : ranges) {
+            if (range.code || image + range.begin >= end) {
+                continue;
+            }
+            if (auto match = pattern.find(image + range.begin, std::min(image + range.end, end), limit)) {
+                return reinterpret_cast<intptr_t>(match) + offset;
+            }
+        }
+        return first ? reinterpret_cast<intptr_t>(first) + offset : 0;
+    }
 
-    try {
+    // count the matches in address order
+    auto cur = image;
+    intptr_t cur_usage = 0;
+    while (auto match = pattern.find(cur, limit, limit)) {
 
-        // copy data
-        std::vector<uint8_t> data(size);
-        memcpy(data.data(), module_info.lpBaseOfDll, size);
+        // return the result if we hit the usage count
+        if (cur_usage == usage) {
+            return reinterpret_cast<intptr_t>(match) + offset;
+        }
 
-        // find pattern
-        return find_pattern(
-                data,
-                reinterpret_cast<intptr_t>(module_info.lpBaseOfDll),
-                pattern,
-                mask,
-                offset,
-                result_usage);
-    } catch (const std::bad_alloc &e) {
-        log_warning("sigscan", "failed to allocate buffer of size {} for image data", size);
-        return false;
+        ++cur_usage;
+        cur = match + 1;
     }
+
+    return 0;
 }
 
-intptr_t replace_pattern(HMODULE module, const uint8_t *pattern, const char *mask, intptr_t offset,
-        intptr_t usage, const uint8_t *replace_data, const char *replace_mask)
+intptr_t find_pattern(HMODULE module, const uint8_t *pattern, const char *mask,
+        intptr_t offset, intptr_t result_usage)
+{
+    return find_pattern(module, SignaturePattern(pattern, mask), offset, result_usage);
+}
+
+intptr_t replace_pattern(HMODULE module, const SignaturePattern &signature,
+        const SignaturePattern &replacement, intptr_t offset, intptr_t usage)
 {
 
     // find result
-    auto result = find_pattern(module, pattern, mask, offset, usage);
+    auto result = find_pattern(module, signature, offset, usage);
 
     // check result
     if (!result) {
@@ -92,75 +560,36 @@ intptr_t replace_pattern(HMODULE module, const uint8_t *pattern, const char *mas
     }
 
     // unprotect memory
-    auto replace_mask_len = strlen(replace_mask);
-    memutils::VProtectGuard guard((void *) result, replace_mask_len);
+    memutils::VProtectGuard guard((void *) result, replacement.size());
 
     // replace data
-    for (size_t i = 0; i < replace_mask_len; i++) {
-        if (replace_mask[i] == 'X') {
-            *((unsigned char *) (result + i)) = replace_data[i];
-        }
-    }
+    replacement.apply(reinterpret_cast<uint8_t *>(result));
 
     // success
     return result;
 }
 
+intptr_t replace_pattern(HMODULE module, const uint8_t *pattern, const char *mask, intptr_t offset,
+        intptr_t usage, const uint8_t *replace_data, const char *replace_mask)
+{
+    return replace_pattern(
+            module,
+            SignaturePattern(pattern, mask),
+            SignaturePattern(replace_data, replace_mask),
+            offset,
+            usage);
+}
+
 intptr_t replace_pattern(HMODULE module, const std::string &signature,
         const std::string &replacement, intptr_t offset, intptr_t usage)
 {
-    // build pattern
-    std::string pattern_str(signature);
-    strreplace(pattern_str, "??", "00");
-    auto pattern_bin = std::make_unique<uint8_t[]>(signature.length() / 2);
-    if (!hex2bin(pattern_str.c_str(), pattern_bin.get())) {
-        return false;
-    }
-
-    // build signature mask
-    std::ostringstream signature_mask;
-    for (size_t i = 0; i < signature.length(); i += 2) {
-        if (signature[i] == '?') {
-            if (signature[i + 1] == '?') {
-                signature_mask << '?';
-            } else {
-                return false;
-            }
-        } else {
-            signature_mask << 'X';
-        }
-    }
-
-    // build replace data
-    std::string replace_data_str(replacement);
-    strreplace(replace_data_str, "??", "00");
-    auto replace_data_bin = std::make_unique<uint8_t[]>(replacement.length() / 2);
-    if (!hex2bin(replace_data_str.c_str(), replace_data_bin.get())) {
+    // parse patterns
+    auto signature_pattern = SignaturePattern::parse(signature);
+    auto replacement_pattern = SignaturePattern::parse(replacement);
+    if (!signature_pattern || !replacement_pattern) {
         return false;
     }
 
-    // build replace mask
-    std::ostringstream replace_mask;
-    for (size_t i = 0; i < replacement.length(); i += 2) {
-        if (replacement[i] == '?') {
-            if (replacement[i + 1] == '?') {
-                replace_mask << '?';
-            } else {
-                return false;
-            }
-        } else {
-            replace_mask << 'X';
-        }
-    }
-
     // do the replacement
-    return replace_pattern(
-            module,
-            pattern_bin.get(),
-            signature_mask.str().c_str(),
-            offset,
-            usage,
-            replace_data_bin.get(),
-            replace_mask.str().c_str()
-    );
+    return replace_pattern(module, *signature_pattern, *replacement_pattern, offset, usage);
 }
@@ -1,11 +1,145 @@
 #pragma once
 
 #include <algorithm>
+#include <optional>
 #include <string>
 #include <vector>
 #include "windows.h"
 #include "psapi.h"
 
+/*
+ * Byte pattern with wildcards, compiled once so it can be searched for repeatedly.
+ *
+ * The search compares two rare bytes of the pattern against 32 positions at a time and only verifies the
+ * remaining bytes of the candidates, using 8 byte masked compares.
+ */
+class SignaturePattern {
+public:
+
+    SignaturePattern() = default;
+
+    /*
+     * Builds the pattern from data and a mask of equal length, 'X' marks bytes which have to match.
+     * The length is taken from the null terminated mask, so pattern has to hold at least strlen(mask) bytes,
+     * even where the mask has wildcards.
+     */
+    SignaturePattern(const uint8_t *pattern, const char *mask);
+
+    /*
+     * Parses a hex string like "8B45??89", with "??" as wildcard bytes and whitespace being ignored.
+     */
+    static std::optional<SignaturePattern> parse(const std::string &hex);
+
+    inline size_t size() const {
+        return this->bytes.size();
+    }
+
+    inline bool empty() const {
+        return this->bytes.empty();
+    }
+
+    /*
+     * Checks if the pattern matches at the given position, which must have size() readable bytes.
+     */
+    bool matches(const uint8_t *data) const;
+
+    /*
+     * Returns the first match starting in [begin, end) or nullptr.
+     * Matches may extend past end but never past limit.
+     */
+    const uint8_t *find(const uint8_t *begin, const uint8_t *end, const uint8_t *limit) const;
+
+    /*
+     * Writes the non-wildcard bytes of the pattern to the target.
+     */
+    void apply(uint8_t *target) const;
+
+private:
+    friend class SignatureBatch;
+
+    // pattern bytes, and the mask with 0xFF for bytes that have to match
+    std::vector<uint8_t> bytes;
+    std::vector<uint8_t> mask;
+
+    // positions of the bytes the search looks for first
+    size_t anchor_first = 0;
+    size_t anchor_second = 0;
+    bool wildcard_only = true;
+
+    void compile();
+};
+
+/*
+ * Set of patterns which are all searched for in a single pass over the data.
+ *
+ * Patterns are bucketed by their rarest pair of adjacent fixed bytes, or by their rarest single byte if they
+ * have no such pair, so every position of the data only verifies the patterns anchored at the bytes found there.
+ * All matches are counted, which allows flagging ambiguous signatures.
+ */
+class SignatureBatch {
+public:
+
+    struct Result {
+
+        // address of the match selected by the usage index, or 0 if there are not enough matches
+        intptr_t address = 0;
+
+        // total amount of matches
+        size_t count = 0;
+    };
+
+    /*
+     * Adds a pattern and returns its index into the results.
+     */
+    size_t add(const SignaturePattern &pattern, intptr_t usage = 0);
+
+    inline size_t size() const {
+        return this->patterns.size();
+    }
+
+    /*
+     * Scans the data, with addresses relative to base like the flat find_pattern.
+     */
+    const std::vector<Result> &scan(const uint8_t *data, size_t size, intptr_t base);
+
+    /*
+     * Scans the mapped image in place, counting matches in address order like the module find_pattern.
+     */
+    const std::vector<Result> &scan(HMODULE module);
+
+private:
+
+    struct Anchor {
+        uint32_t pattern;
+        uint32_t offset;
+    };
+
+    std::vector<SignaturePattern> patterns;
+    std::vector<intptr_t> usages;
+    std::vector<Result> results;
+
+    // anchors of all patterns, indexed by byte pair or single byte
+    std::vector<Anchor> pair_anchors;
+    std::vector<uint32_t> pair_buckets;
+    std::vector<uint64_t> pair_filter;
+    std::vector<Anchor> byte_anchors;
+    std::vector<uint32_t> byte_buckets;
+    std::vector<uint32_t> wildcard_patterns;
+    size_t anchor_offset_max = 0;
+
+    void build();
+    void scan_range(const uint8_t *begin, const uint8_t *end, const uint8_t *data_begin,
+            const uint8_t *limit, intptr_t base);
+};
+
+intptr_t find_pattern(
+        const uint8_t *data,
+        size_t size,
+        intptr_t base,
+        const SignaturePattern &pattern,
+        intptr_t offset,
+        intptr_t usage);
+
 intptr_t find_pattern(
         std::vector<unsigned char> &data,
         intptr_t base,
@@ -14,6 +148,16 @@ intptr_t find_pattern(
         intptr_t offset,
         intptr_t usage);
 
+/*
+ * Scans the mapped image in place, the usage index counts the matches in address order.
+ * The first match is looked for in the executable sections before the rest of the image.
+ */
+intptr_t find_pattern(
+        HMODULE module,
+        const SignaturePattern &pattern,
+        intptr_t offset,
+        intptr_t usage);
+
 intptr_t find_pattern(
         HMODULE module,
         const unsigned char *pattern,
@@ -21,6 +165,13 @@ intptr_t find_pattern(
         intptr_t offset,
         intptr_t usage);
 
+intptr_t replace_pattern(
+        HMODULE module,
+        const SignaturePattern &signature,
+        const SignaturePattern &replacement,
+        intptr_t offset,
+        intptr_t usage);
+
 intptr_t replace_pattern(
         HMODULE module,
         const unsigned char *pattern,
@@ -0,0 +1,571 @@
+#include "socket_server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+
+#include "util/logging.h"
+
+#ifdef _WIN32
+typedef WSAPOLLFD pollfd_t;
+typedef int socklen_t;
+#define poll_sockets WSAPoll
+#define SEND_FLAGS 0
+#else
+typedef pollfd pollfd_t;
+#define poll_sockets poll
+#define INVALID_SOCKET (-1)
+#define SOCKET_ERROR (-1)
+#define closesocket close
+#define SEND_FLAGS MSG_NOSIGNAL
+#endif
+
+static inline int socket_error() {
+#ifdef _WIN32
+    return WSAGetLastError();
+#else
+    return errno;
+#endif
+}
+
+static inline bool socket_would_block(int error) {
+#ifdef _WIN32
+    return error == WSAEWOULDBLOCK;
+#else
+    return error == EWOULDBLOCK || error == EAGAIN || error == EINTR;
+#endif
+}
+
+static inline bool socket_set_nonblocking(util::socket_t socket) {
+#ifdef _WIN32
+    u_long mode = 1;
+    return ioctlsocket(socket, FIONBIO, &mode) == 0;
+#else
+    int flags = fcntl(socket, F_GETFL, 0);
+    return flags != -1 && fcntl(socket, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+namespace util {
+
+    SocketServer::SocketServer(size_t thread_count, size_t receive_buffer_size, size_t send_buffer_max_size)
+        : thread_count(thread_count),
+          receive_buffer_size(receive_buffer_size),
+          send_buffer_max_size(send_buffer_max_size),
+          listener(INVALID_SOCKET) {
+    }
+
+    SocketServer::~SocketServer() {
+        this->stop();
+    }
+
+    bool SocketServer::listen(uint16_t port, int backlog, bool external) {
+
+        // create socket
+        this->listener = socket(AF_INET, SOCK_STREAM, 0);
+        if (this->listener == INVALID_SOCKET) {
+            this->error = "could not create listener socket: " + std::to_string(socket_error());
+            return false;
+        }
+
+        // configure socket
+        int opt_enable = 1;
+        setsockopt(this->listener, SOL_SOCKET, SO_REUSEADDR,
+                reinterpret_cast<const char *>(&opt_enable), sizeof(int));
+        if (!socket_set_nonblocking(this->listener)) {
+            this->error = "could not set listener to non-blocking: " + std::to_string(socket_error());
+            closesocket(this->listener);
+            this->listener = INVALID_SOCKET;
+            return false;
+        }
+
+        // create address
+        sockaddr_in address {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(external ? INADDR_ANY : INADDR_LOOPBACK);
+
+        // bind and listen
+        if (bind(this->listener, (sockaddr *) &address, sizeof(address)) == SOCKET_ERROR) {
+            this->error = "could not bind socket on port " + std::to_string(port)
+                    + ": " + std::to_string(socket_error());
+            closesocket(this->listener);
+            this->listener = INVALID_SOCKET;
+            return false;
+        }
+        if (::listen(this->listener, backlog) == SOCKET_ERROR) {
+            this->error = "could not listen to socket on port " + std::to_string(port)
+                    + ": " + std::to_string(socket_error());
+            closesocket(this->listener);
+            this->listener = INVALID_SOCKET;
+            return false;
+        }
+
+        // create wake sockets, bound to loopback so nobody else can interrupt the I/O threads
+        for (size_t i = 0; i < std::max<size_t>(this->thread_count, 1); i++) {
+            auto worker = std::make_unique<Worker>();
+            worker->wake_address.sin_family = AF_INET;
+            worker->wake_address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            socklen_t wake_address_size = sizeof(worker->wake_address);
+            worker->wake_socket = socket(AF_INET, SOCK_DGRAM, 0);
+            if (worker->wake_socket == INVALID_SOCKET
+                    || bind(worker->wake_socket, (sockaddr *) &worker->wake_address,
+                            sizeof(worker->wake_address)) == SOCKET_ERROR
+                    || getsockname(worker->wake_socket, (sockaddr *) &worker->wake_address,
+                            &wake_address_size) == SOCKET_ERROR
+                    || !socket_set_nonblocking(worker->wake_socket)) {
+                this->error = "could not create wake socket: " + std::to_string(socket_error());
+                if (worker->wake_socket != INVALID_SOCKET) {
+                    closesocket(worker->wake_socket);
+                }
+                for (auto &created : this->workers) {
+                    closesocket(created->wake_socket);
+                }
+                this->workers.clear();
+                closesocket(this->listener);
+                this->listener = INVALID_SOCKET;
+                return false;
+            }
+            this->workers.emplace_back(std::move(worker));
+        }
+
+        // start I/O threads
+        this->running = true;
+        this->listening = true;
+        for (size_t i = 0; i < this->workers.size(); i++) {
+            this->workers[i]->thread = std::thread([this, i] {
+                this->worker(i);
+            });
+        }
+
+        return true;
+    }
+
+    void SocketServer::close_listener() {
+
+        // stop accepting, the listening thread closes the socket once it's out of its poll set
+        if (this->listening.exchange(false) && !this->workers.empty()) {
+            this->wake_worker(*this->workers[0]);
+        }
+    }
+
+    void SocketServer::stop() {
+
+        // the I/O threads close their connections on exit
+        this->running = false;
+        this->listening = false;
+        for (auto &worker : this->workers) {
+            this->wake_worker(*worker);
+        }
+        for (auto &worker : this->workers) {
+            if (worker->thread.joinable()) {
+                worker->thread.join();
+            }
+        }
+
+        // nobody polls the sockets anymore
+        for (auto &worker : this->workers) {
+            for (auto &incoming : worker->incoming) {
+                closesocket(incoming.first);
+            }
+            closesocket(worker->wake_socket);
+        }
+        this->workers.clear();
+        if (this->listener != INVALID_SOCKET) {
+            closesocket(this->listener);
+            this->listener = INVALID_SOCKET;
+        }
+    }
+
+    void SocketServer::send(Connection &connection, const char *data, size_t size) {
+        if (connection.close || size == 0) {
+            return;
+        }
+
+        // keep ordering if there's still output pending
+        if (connection.out_size > 0) {
+            if (connection.out_size + size > this->send_buffer_max_size) {
+                connection.close = true;
+                return;
+            }
+            if (!connection.out_tail) {
+                connection.out_tail = std::make_shared<std::vector<char>>();
+                connection.out.push_back(connection.out_tail);
+            }
+            connection.out_tail->insert(connection.out_tail->end(), data, data + size);
+            connection.out_size += size;
+            return;
+        }
+
+        // buffer remaining data until the socket is writable again
+        auto sent = this->send_direct(connection, data, size);
+        if (sent < size && !connection.close) {
+            if (size - sent > this->send_buffer_max_size) {
+                connection.close = true;
+                return;
+            }
+            connection.out_tail = std::make_shared<std::vector<char>>(data + sent, data + size);
+            connection.out.push_back(connection.out_tail);
+            connection.out_pos = 0;
+            connection.out_size = size - sent;
+        }
+    }
+
+    void SocketServer::send(Connection &connection, SharedBuffer buffer) {
+        if (connection.close || !buffer || buffer->empty()) {
+            return;
+        }
+        auto size = buffer->size();
+
+        // keep ordering if there's still output pending
+        if (connection.out_size > 0) {
+            if (connection.out_size + size > this->send_buffer_max_size) {
+                connection.close = true;
+                return;
+            }
+            connection.out.push_back(std::move(buffer));
+            connection.out_tail.reset();
+            connection.out_size += size;
+            return;
+        }
+
+        // keep a reference to the rest instead of copying it
+        auto sent = this->send_direct(connection, buffer->data(), size);
+        if (sent < size && !connection.close) {
+            if (size - sent > this->send_buffer_max_size) {
+                connection.close = true;
+                return;
+            }
+            connection.out.push_back(std::move(buffer));
+            connection.out_tail.reset();
+            connection.out_pos = sent;
+            connection.out_size = size - sent;
+        }
+    }
+
+    size_t SocketServer::send_direct(Connection &connection, const char *data, size_t size) {
+        size_t total = 0;
+        while (total < size) {
+            auto sent = ::send(connection.socket, data + total, (int) (size - total), SEND_FLAGS);
+            if (sent == SOCKET_ERROR) {
+                if (!socket_would_block(socket_error())) {
+                    connection.close = true;
+                }
+                break;
+            }
+            total += sent;
+        }
+        return total;
+    }
+
+    std::shared_ptr<SocketServer::Wakeup> SocketServer::get_wakeup(Connection &connection) {
+        if (!connection.wakeup) {
+            connection.wakeup = std::make_shared<Wakeup>();
+            connection.wakeup->worker = connection.worker;
+        }
+        return connection.wakeup;
+    }
+
+    void SocketServer::wake(Wakeup &wakeup) {
+        if (!wakeup.pending.exchange(true) && wakeup.worker < this->workers.size()) {
+            this->wake_worker(*this->workers[wakeup.worker]);
+        }
+    }
+
+    void SocketServer::wake_worker(Worker &worker) {
+
+        // one datagram is enough until the worker drained it
+        if (!worker.wake_pending.exchange(true)) {
+            char signal = 0;
+            sendto(worker.wake_socket, &signal, 1, 0,
+                    (const sockaddr *) &worker.wake_address, sizeof(worker.wake_address));
+        }
+    }
+
+    void SocketServer::worker(size_t index) {
+        auto &self = *this->workers[index];
+
+        // per thread state
+        std::vector<Connection *> connections;
+        std::vector<pollfd_t> fds;
+        std::vector<char> receive_buffer(this->receive_buffer_size);
+        int poll_error = 0;
+
+        // event loop
+        while (this->running) {
+
+            // only the first thread owns the listener, it closes it after close_listener()
+            bool listener_polled = false;
+            if (index == 0 && this->listener != INVALID_SOCKET) {
+                if (this->listening) {
+                    listener_polled = true;
+                } else {
+                    closesocket(this->listener);
+                    this->listener = INVALID_SOCKET;
+                }
+            }
+
+            // build poll set, wake socket and listener first
+            fds.clear();
+            pollfd_t wake_fd {};
+            wake_fd.fd = self.wake_socket;
+            wake_fd.events = POLLIN;
+            fds.push_back(wake_fd);
+            if (listener_polled) {
+                pollfd_t fd {};
+                fd.fd = this->listener;
+                fd.events = POLLIN;
+                fds.push_back(fd);
+            }
+            for (auto connection : connections) {
+                pollfd_t fd {};
+                fd.fd = connection->socket;
+                fd.events = POLLIN;
+                if (connection->out_size > 0) {
+                    fd.events |= POLLOUT;
+                }
+                fds.push_back(fd);
+            }
+
+            // wait no longer than the closest tick
+            auto now = std::chrono::steady_clock::now();
+            auto timeout = std::chrono::milliseconds(poll_timeout_ms);
+            for (auto connection : connections) {
+                if (connection->tick_deadline <= now) {
+                    timeout = std::chrono::milliseconds(0);
+                    break;
+                } else if (connection->tick_deadline - now < timeout) {
+                    timeout = std::chrono::ceil<std::chrono::milliseconds>(connection->tick_deadline - now);
+                }
+            }
+
+            // wait for readiness
+            int ready = poll_sockets(fds.data(), (unsigned long) fds.size(), (int) timeout.count());
+            if (ready < 0) {
+
+                // back off instead of spinning on a persistent error
+                auto error = socket_error();
+                if (socket_would_block(error)) {
+                    continue;
+                }
+                if (error != poll_error) {
+                    log_warning("socket", "poll failed on I/O thread {}: {}", index, error);
+                    poll_error = error;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(poll_timeout_ms));
+                continue;
+            }
+            poll_error = 0;
+
+            // drain wake signals before looking at the wakeups so none get lost
+            if (ready > 0 && (fds[0].revents & POLLIN)) {
+                self.wake_pending = false;
+                char signal[64];
+                while (recv(self.wake_socket, signal, sizeof(signal), 0) > 0) {}
+            }
+
+            // handle connections, in reverse so removals don't shift the remaining indices
+            now = std::chrono::steady_clock::now();
+            size_t fd_offset = listener_polled ? 2 : 1;
+            for (size_t i = connections.size(); i-- > 0;) {
+                auto connection = connections[i];
+                auto revents = ready > 0 ? fds[fd_offset + i].revents : 0;
+                bool woken = connection->wakeup && connection->wakeup->pending.exchange(false);
+                if (revents & (POLLIN | POLLHUP | POLLERR | POLLNVAL)) {
+                    if (!this->receive(*connection, receive_buffer.data())) {
+                        connection->close = true;
+                    } else {
+                        this->tick(*connection, now);
+                    }
+                } else if (woken || connection->tick_deadline <= now) {
+                    this->tick(*connection, now);
+                }
+                if (!connection->close && (revents & POLLOUT)) {
+                    if (!this->flush(*connection)) {
+                        connection->close = true;
+                    }
+                }
+                if (connection->close_on_flush && connection->out_size == 0) {
+                    connection->close = true;
+                }
+                if (connection->close) {
+                    this->close_connection(connection);
+                    self.connection_count--;
+                    connections.erase(connections.begin() + i);
+                }
+            }
+
+            // hand out new clients, then take over the ones meant for this thread
+            if (listener_polled && ready > 0 && (fds[1].revents & POLLIN)) {
+                this->accept_connections();
+            }
+            this->adopt_connections(index, connections);
+        }
+
+        // close remaining connections
+        for (auto connection : connections) {
+            this->close_connection(connection);
+            self.connection_count--;
+        }
+    }
+
+    void SocketServer::accept_connections() {
+
+        // drain the backlog at once, nobody else accepts
+        while (this->listening) {
+            sockaddr_in address {};
+            socklen_t address_size = sizeof(address);
+            auto socket = accept(this->listener, (sockaddr *) &address, &address_size);
+            if (socket == INVALID_SOCKET) {
+                return;
+            }
+
+            // configure socket
+            int opt_enable = 1;
+            setsockopt(socket, IPPROTO_TCP, TCP_NODELAY,
+                    reinterpret_cast<const char *>(&opt_enable), sizeof(int));
+            if (!socket_set_nonblocking(socket)) {
+                closesocket(socket);
+                continue;
+            }
+
+            // the least loaded thread takes the client
+            Worker *target = this->workers[0].get();
+            for (auto &worker : this->workers) {
+                if (worker->connection_count < target->connection_count) {
+                    target = worker.get();
+                }
+            }
+            target->connection_count++;
+            {
+                std::lock_guard<std::mutex> lock(target->incoming_m);
+                target->incoming.emplace_back(socket, address);
+            }
+            if (target != this->workers[0].get()) {
+                this->wake_worker(*target);
+            }
+        }
+    }
+
+    void SocketServer::adopt_connections(size_t index, std::vector<Connection *> &connections) {
+        auto &self = *this->workers[index];
+
+        // take the handed over sockets
+        std::vector<std::pair<socket_t, sockaddr_in>> incoming;
+        {
+            std::lock_guard<std::mutex> lock(self.incoming_m);
+            if (self.incoming.empty()) {
+                return;
+            }
+            incoming.swap(self.incoming);
+        }
+
+        for (auto &[socket, address] : incoming) {
+
+            // create connection
+            auto connection = new Connection();
+            connection->socket = socket;
+            connection->address = address;
+            connection->worker = index;
+
+            // let the owner decide
+            if (this->on_connect && !this->on_connect(*connection)) {
+                closesocket(socket);
+                delete connection;
+                self.connection_count--;
+                continue;
+            }
+
+            this->connection_count++;
+            connections.push_back(connection);
+        }
+    }
+
+    bool SocketServer::receive(Connection &connection, char *buffer) {
+
+        // drain the socket
+        while (!connection.close) {
+            auto received = recv(connection.socket, buffer, (int) this->receive_buffer_size, 0);
+            if (received == SOCKET_ERROR) {
+                return socket_would_block(socket_error());
+            } else if (received == 0) {
+
+                // connection was closed by peer
+                return false;
+            }
+
+            // pass data to owner
+            if (this->on_receive) {
+                this->on_receive(connection, buffer, (size_t) received);
+            }
+
+            // a short read means the socket is drained
+            if ((size_t) received < this->receive_buffer_size) {
+                break;
+            }
+        }
+
+        return true;
+    }
+
+    bool SocketServer::flush(Connection &connection) {
+
+        // send pending output
+        while (!connection.out.empty()) {
+            auto &buffer = *connection.out.front();
+            while (connection.out_pos < buffer.size()) {
+                auto sent = ::send(connection.socket,
+                        buffer.data() + connection.out_pos,
+                        (int) (buffer.size() - connection.out_pos),
+                        SEND_FLAGS);
+                if (sent == SOCKET_ERROR) {
+                    return socket_would_block(socket_error());
+                }
+                connection.out_pos += sent;
+                connection.out_size -= sent;
+            }
+
+            // release buffer
+            if (connection.out.front() == connection.out_tail) {
+                connection.out_tail.reset();
+            }
+            connection.out.pop_front();
+            connection.out_pos = 0;
+        }
+        return true;
+    }
+
+    void SocketServer::tick(Connection &connection, std::chrono::steady_clock::time_point now) {
+        if (!this->on_tick || connection.close) {
+            return;
+        }
+
+        // schedule next tick
+        auto delay = this->on_tick(connection);
+        if (delay < 0) {
+            connection.tick_deadline = std::chrono::steady_clock::time_point::max();
+        } else {
+            connection.tick_deadline = now + std::chrono::milliseconds(delay);
+        }
+    }
+
+    void SocketServer::close_connection(Connection *connection) {
+        if (this->on_disconnect) {
+            this->on_disconnect(*connection);
+        }
+        closesocket(connection->socket);
+        this->connection_count--;
+        delete connection;
+    }
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <netinet/in.h>
+#endif
+
+namespace util {
+
+#ifdef _WIN32
+    typedef SOCKET socket_t;
+#else
+    typedef int socket_t;
+#endif
+
+    /*
+     * Readiness based TCP server.
+     *
+     * A small fixed set of I/O threads poll the connections they own, so the thread count stays
+     * the same no matter how many clients are connected. Only the first I/O thread polls the
+     * listener, it accepts all pending clients and hands each one to the least loaded thread.
+     * All callbacks of a connection are invoked on the I/O thread owning it, which is also the
+     * only thread allowed to call send() for that connection. Other threads can request an early
+     * on_tick through the connection's wakeup.
+     */
+    class SocketServer {
+    public:
+
+        // output shared by multiple connections, queued by reference instead of being copied
+        typedef std::shared_ptr<const std::vector<char>> SharedBuffer;
+
+        // shared with other threads, stays valid after the connection closed
+        struct Wakeup {
+            std::atomic<bool> pending = false;
+            size_t worker = 0;
+        };
+
+        struct Connection {
+            socket_t socket;
+            sockaddr_in address {};
+            void *user = nullptr;
+            bool close = false;
+
+            // close once all pending output was sent
+            bool close_on_flush = false;
+
+            // output which could not be sent without blocking, out_pos is into the first buffer
+            std::deque<SharedBuffer> out;
+            size_t out_pos = 0;
+            size_t out_size = 0;
+
+            // last queued buffer if it's owned by the connection, further sends get appended to it
+            std::shared_ptr<std::vector<char>> out_tail;
+
+            // next time on_tick is due
+            std::chrono::steady_clock::time_point tick_deadline = std::chrono::steady_clock::time_point::max();
+
+            // created on first use by get_wakeup()
+            std::shared_ptr<Wakeup> wakeup;
+            size_t worker = 0;
+        };
+
+        // connection callbacks, on_connect may return false to refuse the client
+        std::function<bool(Connection &)> on_connect;
+        std::function<void(Connection &, char *, size_t)> on_receive;
+        std::function<void(Connection &)> on_disconnect;
+
+        // called after receiving data and when the deadline passed, returns ms until the next tick or -1
+        std::function<int(Connection &)> on_tick;
+
+        SocketServer(size_t thread_count, size_t receive_buffer_size, size_t send_buffer_max_size);
+        ~SocketServer();
+
+        // binds to loopback unless external clients are explicitly allowed
+        bool listen(uint16_t port, int backlog, bool external = false);
+        void close_listener();
+        void stop();
+
+        void send(Connection &connection, const char *data, size_t size);
+        void send(Connection &connection, SharedBuffer buffer);
+
+        // get_wakeup() is for the owning I/O thread, wake() may be called from any thread until stop()
+        std::shared_ptr<Wakeup> get_wakeup(Connection &connection);
+        void wake(Wakeup &wakeup);
+
+        inline bool is_running() const {
+            return this->running;
+        }
+
+        inline size_t get_connection_count() const {
+            return this->connection_count;
+        }
+
+        inline const std::string &get_error() const {
+            return this->error;
+        }
+
+    private:
+
+        // configuration
+        constexpr static int poll_timeout_ms = 100;
+
+        size_t thread_count;
+        size_t receive_buffer_size;
+        size_t send_buffer_max_size;
+
+        struct Worker {
+            std::thread thread;
+
+            // a datagram to ourselves interrupts the poll
+            socket_t wake_socket;
+            sockaddr_in wake_address {};
+            std::atomic<bool> wake_pending = false;
+
+            // accepted sockets handed over by the listening thread
+            std::mutex incoming_m;
+            std::vector<std::pair<socket_t, sockaddr_in>> incoming;
+            std::atomic<size_t> connection_count = 0;
+        };
+
+        // state
+        socket_t listener;
+        std::atomic<bool> running = false;
+        std::atomic<bool> listening = false;
+        std::atomic<size_t> connection_count = 0;
+        std::vector<std::unique_ptr<Worker>> workers;
+        std::string error;
+
+        void worker(size_t index);
+        void wake_worker(Worker &worker);
+        void accept_connections();
+        void adopt_connections(size_t index, std::vector<Connection *> &connections);
+        bool receive(Connection &connection, char *buffer);
+        size_t send_direct(Connection &connection, const char *data, size_t size);
+        bool flush(Connection &connection);
+        void tick(Connection &connection, std::chrono::steady_clock::time_point now);
+        void close_connection(Connection *connection);
+    };
+}